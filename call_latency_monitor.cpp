@@ -0,0 +1,91 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstring>
+#include "call_latency_monitor.h"
+
+static const char* const call_names[rppicomidi::Call_latency_monitor::NUM_CALLS] = {
+    "task", "initialize", "deinitialize", "connect", "disconnect", "start_scan", "autoconnect",
+    "save_settings", "load_settings", "get_rssi"
+};
+
+void rppicomidi::Call_latency_monitor::reset()
+{
+    memset(histogram, 0, sizeof(histogram));
+    memset(calls, 0, sizeof(calls));
+    memset(total_us, 0, sizeof(total_us));
+    memset(worst, 0, sizeof(worst));
+}
+
+unsigned rppicomidi::Call_latency_monitor::get_bucket(uint32_t duration_us)
+{
+    unsigned bucket = 0;
+    while (duration_us > 1 && bucket < NUM_BUCKETS - 1) {
+        duration_us >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+void rppicomidi::Call_latency_monitor::record(Call call, uint32_t duration_us, uint8_t from_state, uint8_t to_state, uint32_t when_us)
+{
+    if (call >= NUM_CALLS) {
+        return;
+    }
+    ++histogram[call][get_bucket(duration_us)];
+    ++calls[call];
+    total_us[call] += duration_us;
+    if (duration_us >= worst[call].duration_us) {
+        worst[call].duration_us = duration_us;
+        worst[call].when_us = when_us;
+        worst[call].from_state = from_state;
+        worst[call].to_state = to_state;
+    }
+}
+
+uint32_t rppicomidi::Call_latency_monitor::get_percentile_us(Call call, unsigned percent) const
+{
+    if (call >= NUM_CALLS || calls[call] == 0) {
+        return 0;
+    }
+    if (percent > 100) {
+        percent = 100;
+    }
+    // the number of calls at or below the percentile, rounded up
+    uint64_t target = (static_cast<uint64_t>(calls[call]) * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (unsigned bucket = 0; bucket < NUM_BUCKETS - 1; bucket++) {
+        seen += histogram[call][bucket];
+        if (seen >= target) {
+            uint32_t upper = (2u << bucket) - 1;
+            return upper < worst[call].duration_us ? upper : worst[call].duration_us;
+        }
+    }
+    return worst[call].duration_us;
+}
+
+const char* rppicomidi::Call_latency_monitor::get_name(Call call)
+{
+    return call < NUM_CALLS ? call_names[call] : "";
+}
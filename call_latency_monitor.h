@@ -0,0 +1,149 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace rppicomidi
+{
+/**
+ * @brief Measure how long the connection manager's public calls block
+ *
+ * For each instrumented call the monitor keeps a histogram of durations
+ * with power of 2 bucket boundaries, the number of calls, the total time,
+ * and the worst case with the state transition the call made.
+ * initialize() and deinitialize() are also timed when other calls make
+ * them, because a radio restart dominates every worst case.
+ *
+ * Like Wifi_power_governor, this class does not talk to the Wi-Fi
+ * driver, so it can run on any host.
+ */
+class Call_latency_monitor
+{
+public:
+    enum Call {
+        CALL_TASK,
+        CALL_INITIALIZE,
+        CALL_DEINITIALIZE,
+        CALL_CONNECT,
+        CALL_DISCONNECT,
+        CALL_START_SCAN,
+        CALL_AUTOCONNECT,
+        CALL_SAVE_SETTINGS,
+        CALL_LOAD_SETTINGS,
+        CALL_GET_RSSI,
+        NUM_CALLS
+    };
+    /**
+     * @brief Bucket 0 counts durations below 2 us; bucket b > 0 counts
+     * durations from 2^b us to just under 2^(b+1) us. The last bucket
+     * also counts everything longer.
+     */
+    static constexpr unsigned NUM_BUCKETS = 24;
+
+    struct Worst {
+        uint32_t duration_us;   //!< the longest duration; 0 if the call was never made
+        uint32_t when_us;       //!< the driver's timestamp_us() when that call returned
+        uint8_t from_state;     //!< the Wifi_state when that call started
+        uint8_t to_state;       //!< the Wifi_state when that call returned
+    };
+
+    Call_latency_monitor() { reset(); }
+
+    /**
+     * @brief Record one call
+     *
+     * @param call the call
+     * @param duration_us how long it took
+     * @param from_state the Wifi_state when it started
+     * @param to_state the Wifi_state when it returned
+     * @param when_us the time it returned
+     */
+    void record(Call call, uint32_t duration_us, uint8_t from_state, uint8_t to_state, uint32_t when_us);
+
+    /**
+     * @brief Forget all measurements
+     */
+    void reset();
+
+    /**
+     * @brief Get the histogram bucket for a duration
+     */
+    static unsigned get_bucket(uint32_t duration_us);
+
+    /**
+     * @brief Get the number of calls that took the durations of a histogram bucket
+     */
+    uint32_t get_bucket_count(Call call, unsigned bucket) const
+    {
+        return call < NUM_CALLS && bucket < NUM_BUCKETS ? histogram[call][bucket] : 0;
+    }
+
+    /**
+     * @brief Get the number of calls measured
+     */
+    uint32_t get_calls(Call call) const { return call < NUM_CALLS ? calls[call] : 0; }
+
+    /**
+     * @brief Get the total time spent in a call
+     */
+    uint64_t get_total_us(Call call) const { return call < NUM_CALLS ? total_us[call] : 0; }
+
+    /**
+     * @brief Get the worst case of a call
+     */
+    const Worst& get_worst(Call call) const { return worst[call < NUM_CALLS ? call : CALL_TASK]; }
+
+    /**
+     * @brief Get an upper bound on a percentile of a call's durations
+     *
+     * @param call the call
+     * @param percent the percentile, 1-100
+     * @return uint32_t the upper boundary of the bucket that holds the
+     * percentile, but no more than the worst case; 0 if the call was never made
+     */
+    uint32_t get_percentile_us(Call call, unsigned percent) const;
+
+    /**
+     * @brief Get the worst observed time to restart the radio
+     *
+     * @return uint32_t the worst deinitialize() plus the worst initialize()
+     */
+    uint32_t get_restart_estimate_us() const
+    {
+        return worst[CALL_DEINITIALIZE].duration_us + worst[CALL_INITIALIZE].duration_us;
+    }
+
+    /**
+     * @brief Get the name of a call, e.g. "connect"
+     */
+    static const char* get_name(Call call);
+private:
+    uint32_t histogram[NUM_CALLS][NUM_BUCKETS];
+    uint32_t calls[NUM_CALLS];
+    uint64_t total_us[NUM_CALLS];
+    Worst worst[NUM_CALLS];
+};
+}
@@ -0,0 +1,156 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <climits>
+#include "channel_survey.h"
+
+// Overlap of two 20 MHz channels d channels apart, with 8 fractional bits
+static const uint32_t overlap_x256[rppicomidi::Channel_survey::MAX_OVERLAP + 1] = {256, 205, 154, 102, 51};
+
+rppicomidi::Channel_survey::Channel_survey() :
+    config{true, 2, -80, 15}
+{
+    clear();
+}
+
+void rppicomidi::Channel_survey::clear()
+{
+    for (auto& row: table) {
+        row.occupancy_x256 = 0;
+        row.interference_x256 = 0;
+        row.strongest_rssi = INT16_MIN;
+        row.last_update_ms = 0;
+    }
+    num_scans = 0;
+    begin_scan();
+}
+
+uint32_t rppicomidi::Channel_survey::signal_weight(int16_t rssi)
+{
+    // dB above a -100 dBm noise floor, capped at the strength of a very close AP
+    int32_t weight = static_cast<int32_t>(rssi) + 100;
+    if (weight < 0) {
+        return 0;
+    }
+    return weight > 70 ? 70 : static_cast<uint32_t>(weight);
+}
+
+void rppicomidi::Channel_survey::begin_scan()
+{
+    for (uint8_t idx = 0; idx < NUM_CHANNELS; idx++) {
+        scan_count[idx] = 0;
+        scan_interference[idx] = 0;
+        scan_strongest[idx] = INT16_MIN;
+    }
+}
+
+void rppicomidi::Channel_survey::add_bssid(uint8_t channel, int16_t rssi)
+{
+    if (channel < 1 || channel > NUM_CHANNELS) {
+        return;
+    }
+    int idx = channel - 1;
+    ++scan_count[idx];
+    if (rssi > scan_strongest[idx]) {
+        scan_strongest[idx] = rssi;
+    }
+    uint32_t weight = signal_weight(rssi);
+    for (int other = idx - MAX_OVERLAP; other <= idx + MAX_OVERLAP; other++) {
+        if (other >= 0 && other < NUM_CHANNELS) {
+            scan_interference[other] += weight * overlap_x256[other < idx ? idx - other : other - idx];
+        }
+    }
+}
+
+void rppicomidi::Channel_survey::end_scan(uint32_t now_ms)
+{
+    for (uint8_t idx = 0; idx < NUM_CHANNELS; idx++) {
+        auto& row = table[idx];
+        uint32_t occupancy = static_cast<uint32_t>(scan_count[idx]) << 8;
+        if (num_scans == 0) {
+            row.occupancy_x256 = occupancy;
+            row.interference_x256 = scan_interference[idx];
+        }
+        else {
+            row.occupancy_x256 = static_cast<uint32_t>(static_cast<int32_t>(row.occupancy_x256) +
+                ((static_cast<int32_t>(occupancy) - static_cast<int32_t>(row.occupancy_x256)) >> config.alpha_shift));
+            row.interference_x256 = static_cast<uint32_t>(static_cast<int32_t>(row.interference_x256) +
+                ((static_cast<int32_t>(scan_interference[idx]) - static_cast<int32_t>(row.interference_x256)) >> config.alpha_shift));
+        }
+        row.strongest_rssi = scan_strongest[idx];
+        row.last_update_ms = now_ms;
+    }
+    ++num_scans;
+    begin_scan();
+}
+
+const rppicomidi::Channel_survey::Channel_stats* rppicomidi::Channel_survey::get_channel(uint8_t channel) const
+{
+    if (channel < 1 || channel > NUM_CHANNELS) {
+        return nullptr;
+    }
+    return &table[channel - 1];
+}
+
+uint32_t rppicomidi::Channel_survey::get_congestion_x256(uint8_t channel, int16_t rssi) const
+{
+    auto row = get_channel(channel);
+    if (row == nullptr) {
+        return UINT32_MAX;
+    }
+    uint32_t own = signal_weight(rssi) * overlap_x256[0];
+    return row->interference_x256 > own ? row->interference_x256 - own : 0;
+}
+
+int rppicomidi::Channel_survey::select(const Candidate* candidates, size_t num_candidates) const
+{
+    int strongest = -1;
+    for (size_t idx = 0; idx < num_candidates; idx++) {
+        if (strongest < 0 || candidates[idx].rssi > candidates[strongest].rssi) {
+            strongest = static_cast<int>(idx);
+        }
+    }
+    if (strongest < 0 || !config.steering_enabled || num_scans == 0) {
+        return strongest;
+    }
+    int16_t floor_rssi = candidates[strongest].rssi - config.rssi_margin_db;
+    if (floor_rssi < config.min_rssi_dbm) {
+        floor_rssi = config.min_rssi_dbm;
+    }
+    int best = strongest;
+    uint32_t best_congestion = get_congestion_x256(candidates[strongest].channel, candidates[strongest].rssi);
+    for (size_t idx = 0; idx < num_candidates; idx++) {
+        const auto& candidate = candidates[idx];
+        if (candidate.rssi < floor_rssi || static_cast<int>(idx) == best) {
+            continue;
+        }
+        uint32_t congestion = get_congestion_x256(candidate.channel, candidate.rssi);
+        if (congestion < best_congestion ||
+                (congestion == best_congestion && candidate.rssi > candidates[best].rssi)) {
+            best = static_cast<int>(idx);
+            best_congestion = congestion;
+        }
+    }
+    return best;
+}
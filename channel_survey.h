@@ -0,0 +1,154 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace rppicomidi
+{
+/**
+ * @brief Track how crowded each 2.4 GHz channel is and choose among
+ * access points that serve the same SSID
+ *
+ * Feed the survey every BSSID a scan finds. For each channel it keeps an
+ * exponentially weighted moving average of the number of BSSIDs on the
+ * channel (occupancy) and of an interference score. A BSSID contributes
+ * to the interference score of its own channel and, less and less, to
+ * the channels up to 4 away, because 20 MHz channels 5 MHz apart
+ * overlap. Stronger signals contribute more.
+ *
+ * Like Wifi_power_governor, this class does not talk to the Wi-Fi
+ * driver, so it can run on any host.
+ */
+class Channel_survey
+{
+public:
+    static constexpr uint8_t NUM_CHANNELS = 14;    //!< 2.4 GHz channels 1-14
+    static constexpr uint8_t MAX_OVERLAP = 4;      //!< channels farther apart than this do not overlap
+
+    struct Config {
+        bool steering_enabled;  //!< true to let select() prefer less congested channels
+        uint8_t alpha_shift;    //!< each scan moves the averages 1/2^alpha_shift of the way to the new sample
+        int16_t min_rssi_dbm;   //!< ignore less congested candidates weaker than this
+        int16_t rssi_margin_db; //!< ignore less congested candidates this much weaker than the strongest
+    };
+
+    /**
+     * @brief One row of the survey table
+     *
+     * Averages are fixed point with 8 fractional bits.
+     */
+    struct Channel_stats {
+        uint32_t occupancy_x256;    //!< average number of BSSIDs on the channel
+        uint32_t interference_x256; //!< average overlap- and signal-weighted interference
+        int16_t strongest_rssi;     //!< strongest BSSID on the channel in the last scan or INT16_MIN if none
+        uint32_t last_update_ms;    //!< time of the last scan that updated this row
+    };
+
+    /**
+     * @brief A BSSID that could be used to connect
+     */
+    struct Candidate {
+        uint8_t channel;
+        int16_t rssi;
+    };
+
+    Channel_survey();
+
+    void set_config(const Config& config_) { config = config_; }
+    const Config& get_config() const { return config; }
+
+    /**
+     * @brief Start collecting the results of a new scan
+     */
+    void begin_scan();
+
+    /**
+     * @brief Add one BSSID from the scan begun with begin_scan()
+     *
+     * @param channel the BSSID's channel; channels outside 1-14 are ignored
+     * @param rssi the received signal strength in dBm
+     */
+    void add_bssid(uint8_t channel, int16_t rssi);
+
+    /**
+     * @brief Fold the scan begun with begin_scan() into the averages
+     *
+     * @param now_ms the current time in milliseconds
+     */
+    void end_scan(uint32_t now_ms);
+
+    /**
+     * @brief Forget every scan
+     */
+    void clear();
+
+    /**
+     * @brief Get the number of scans folded into the averages
+     */
+    uint32_t get_num_scans() const { return num_scans; }
+
+    /**
+     * @brief Get one row of the survey table
+     *
+     * @param channel 1-14
+     * @return a pointer to the row or nullptr if channel is out of range
+     */
+    const Channel_stats* get_channel(uint8_t channel) const;
+
+    /**
+     * @brief Get the congestion a BSSID on channel would see
+     *
+     * This is the channel's interference score less the BSSID's own
+     * contribution, so an access point alone on a clear channel scores 0.
+     * @param channel 1-14
+     * @param rssi the BSSID's received signal strength in dBm
+     * @return the congestion score with 8 fractional bits
+     */
+    uint32_t get_congestion_x256(uint8_t channel, int16_t rssi) const;
+
+    /**
+     * @brief Choose the BSSID to connect to
+     *
+     * Candidates weaker than min_rssi_dbm or more than rssi_margin_db
+     * weaker than the strongest candidate are not considered unless no
+     * candidate qualifies. Among the rest, the one on the least congested
+     * channel wins, and signal strength breaks ties. If steering is
+     * disabled or the survey has no data, the strongest candidate wins.
+     * @param candidates the BSSIDs that serve the SSID
+     * @param num_candidates the number of entries in candidates
+     * @return the index of the chosen candidate or -1 if num_candidates is 0
+     */
+    int select(const Candidate* candidates, size_t num_candidates) const;
+private:
+    static uint32_t signal_weight(int16_t rssi);
+    Config config;
+    Channel_stats table[NUM_CHANNELS];
+    uint16_t scan_count[NUM_CHANNELS];
+    uint32_t scan_interference[NUM_CHANNELS];
+    int16_t scan_strongest[NUM_CHANNELS];
+    uint32_t num_scans;
+};
+}
@@ -0,0 +1,400 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstring>
+#include "cyw43_wifi_driver.h"
+#include "pico/cyw43_arch.h"
+#include "pico/time.h"
+#include "lwip/netif.h"
+#if LWIP_RAW
+#include "lwip/raw.h"
+#include "lwip/icmp.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/def.h"
+#endif
+#if LWIP_DNS
+#include "lwip/dns.h"
+#endif
+
+#define CYW43_WIFI_DRIVER_USES_DNS (LWIP_DNS && DNS_LOCAL_HOSTLIST && DNS_LOCAL_HOSTLIST_IS_DYNAMIC)
+
+static_assert(rppicomidi::Wifi_driver::LINK_DOWN == CYW43_LINK_DOWN && rppicomidi::Wifi_driver::LINK_JOIN == CYW43_LINK_JOIN &&
+    rppicomidi::Wifi_driver::LINK_NOIP == CYW43_LINK_NOIP && rppicomidi::Wifi_driver::LINK_UP == CYW43_LINK_UP &&
+    rppicomidi::Wifi_driver::LINK_FAIL == CYW43_LINK_FAIL && rppicomidi::Wifi_driver::LINK_NONET == CYW43_LINK_NONET &&
+    rppicomidi::Wifi_driver::LINK_BADAUTH == CYW43_LINK_BADAUTH, "link status values differ from the CYW43 driver's");
+static_assert(rppicomidi::Wifi_driver::AUTH_OPEN == CYW43_AUTH_OPEN &&
+    rppicomidi::Wifi_driver::AUTH_WPA_TKIP_PSK == CYW43_AUTH_WPA_TKIP_PSK &&
+    rppicomidi::Wifi_driver::AUTH_WPA2_AES_PSK == CYW43_AUTH_WPA2_AES_PSK &&
+    rppicomidi::Wifi_driver::AUTH_WPA2_MIXED_PSK == CYW43_AUTH_WPA2_MIXED_PSK, "auth values differ from the CYW43 driver's");
+static_assert(rppicomidi::Wifi_driver::PM_NONE == cyw43_pm_value(CYW43_NO_POWERSAVE_MODE, 10, 0, 0, 0) &&
+    rppicomidi::Wifi_driver::PM_PM1 == cyw43_pm_value(CYW43_PM1_POWERSAVE_MODE, 10, 0, 0, 0) &&
+    rppicomidi::Wifi_driver::PM_DEFAULT == CYW43_DEFAULT_PM, "power management values differ from the CYW43 driver's");
+
+class rppicomidi::Cyw43_wifi_driver::Callbacks
+{
+public:
+    static int scan_result(void* env, const cyw43_ev_scan_result_t* result)
+    {
+        auto me = reinterpret_cast<Cyw43_wifi_driver*>(env);
+        if (me->scan_cb == nullptr) {
+            return 0;
+        }
+        if (result == nullptr) {
+            return me->scan_cb(me->scan_env, nullptr);
+        }
+        Scan_result converted;
+        memset(&converted, 0, sizeof(converted));
+        memcpy(converted.bssid, result->bssid, sizeof(converted.bssid));
+        converted.channel = result->channel;
+        converted.auth_mode = result->auth_mode;
+        converted.rssi = result->rssi;
+        converted.ssid_len = result->ssid_len <= sizeof(converted.ssid) ? result->ssid_len : sizeof(converted.ssid);
+        memcpy(converted.ssid, result->ssid, converted.ssid_len);
+        return me->scan_cb(me->scan_env, &converted);
+    }
+#if LWIP_RAW
+    static uint8_t ping_recv(void* arg, struct raw_pcb*, struct pbuf* p, const ip_addr_t* addr)
+    {
+        auto me = reinterpret_cast<Cyw43_wifi_driver*>(arg);
+        if (addr != nullptr && ip4_addr_get_u32(ip_2_ip4(addr)) == me->ping_addr &&
+                p->tot_len >= (PBUF_IP_HLEN + sizeof(struct icmp_echo_hdr)) && pbuf_remove_header(p, PBUF_IP_HLEN) == 0) {
+            struct icmp_echo_hdr iecho;
+            pbuf_copy_partial(p, &iecho, sizeof(iecho), 0);
+            if (ICMPH_TYPE(&iecho) == ICMP_ER && iecho.id == ping_id) {
+                me->ping_reply = lwip_ntohs(iecho.seqno);
+                pbuf_free(p);
+                return 1; // packet consumed
+            }
+            pbuf_add_header(p, PBUF_IP_HLEN);
+        }
+        return 0; // let lwIP process the packet
+    }
+#endif
+#if CYW43_WIFI_DRIVER_USES_DNS
+    // lwIP cannot cancel a query, so the answer may arrive after the
+    // driver that asked is gone. The callback argument is the query
+    // number, never the driver, and only the current query's answer is
+    // delivered, to the driver that still owns it.
+    static Cyw43_wifi_driver* dns_owner;
+    static uintptr_t dns_query_id;
+
+    static void dns_found(const char* name, const ip_addr_t* ipaddr, void* arg)
+    {
+        auto me = dns_owner;
+        if (me == nullptr || reinterpret_cast<uintptr_t>(arg) != dns_query_id ||
+                name == nullptr || strcmp(name, me->dns_name) != 0) {
+            return;
+        }
+        if (ipaddr != nullptr && IP_IS_V4(ipaddr)) {
+            me->dns_addr = ip4_addr_get_u32(ip_2_ip4(ipaddr));
+            me->dns_result = 0;
+        }
+        else {
+            me->dns_result = -1;
+        }
+    }
+#endif
+};
+
+#if CYW43_WIFI_DRIVER_USES_DNS
+rppicomidi::Cyw43_wifi_driver* rppicomidi::Cyw43_wifi_driver::Callbacks::dns_owner = nullptr;
+uintptr_t rppicomidi::Cyw43_wifi_driver::Callbacks::dns_query_id = 0;
+#endif
+
+rppicomidi::Cyw43_wifi_driver::Cyw43_wifi_driver() :
+    scan_cb{nullptr}, scan_env{nullptr}, ping_pcb{nullptr}, ping_addr{0}, ping_reply{0}, dns_name{""},
+    dns_result{-1}, dns_addr{0}
+{
+}
+
+rppicomidi::Cyw43_wifi_driver::~Cyw43_wifi_driver()
+{
+    close_ping();
+    // a late answer must not reach this object
+    cancel_dns_query();
+}
+
+uint32_t rppicomidi::Cyw43_wifi_driver::now_ms()
+{
+    return to_ms_since_boot(get_absolute_time());
+}
+
+uint32_t rppicomidi::Cyw43_wifi_driver::timestamp_us()
+{
+    return time_us_32();
+}
+
+int rppicomidi::Cyw43_wifi_driver::init(uint32_t country_code)
+{
+    return cyw43_arch_init_with_country(country_code);
+}
+
+void rppicomidi::Cyw43_wifi_driver::deinit()
+{
+    cyw43_arch_deinit();
+}
+
+void rppicomidi::Cyw43_wifi_driver::enable_sta_mode()
+{
+    cyw43_arch_enable_sta_mode();
+}
+
+uint32_t rppicomidi::Cyw43_wifi_driver::get_country_code()
+{
+    return cyw43_arch_get_country_code();
+}
+
+int rppicomidi::Cyw43_wifi_driver::link_status()
+{
+    return cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA);
+}
+
+int rppicomidi::Cyw43_wifi_driver::scan(Scan_result_cb cb, void* env)
+{
+    scan_cb = cb;
+    scan_env = env;
+    cyw43_wifi_scan_options_t scan_options;
+    memset(&scan_options, 0, sizeof(scan_options));
+    return cyw43_wifi_scan(&cyw43_state, &scan_options, this, Callbacks::scan_result);
+}
+
+bool rppicomidi::Cyw43_wifi_driver::is_scan_active()
+{
+    return cyw43_wifi_scan_active(&cyw43_state);
+}
+
+int rppicomidi::Cyw43_wifi_driver::connect(const char* ssid, const char* pw, uint32_t auth, const uint8_t* bssid, uint32_t channel)
+{
+    if (bssid == nullptr) {
+        return cyw43_arch_wifi_connect_async(ssid, pw, auth);
+    }
+    return cyw43_wifi_join(&cyw43_state, strlen(ssid), reinterpret_cast<const uint8_t*>(ssid),
+        pw ? strlen(pw) : 0, reinterpret_cast<const uint8_t*>(pw), auth, bssid, channel);
+}
+
+int rppicomidi::Cyw43_wifi_driver::leave()
+{
+    return cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
+}
+
+int rppicomidi::Cyw43_wifi_driver::set_power_management(uint32_t pm)
+{
+    return cyw43_wifi_pm(&cyw43_state, pm);
+}
+
+int rppicomidi::Cyw43_wifi_driver::get_rssi(int32_t& rssi)
+{
+    // See https://forums.raspberrypi.com/viewtopic.php?t=341774
+    return cyw43_ioctl(&cyw43_state, 254, sizeof(rssi), reinterpret_cast<uint8_t*>(&rssi), CYW43_ITF_STA);
+}
+
+uint32_t rppicomidi::Cyw43_wifi_driver::get_ip_address()
+{
+    return cyw43_state.netif[CYW43_ITF_STA].ip_addr.addr;
+}
+
+uint32_t rppicomidi::Cyw43_wifi_driver::get_gateway()
+{
+    return cyw43_state.netif[CYW43_ITF_STA].gw.addr;
+}
+
+int rppicomidi::Cyw43_wifi_driver::get_byte_count(uint32_t& bytes)
+{
+#if MIB2_STATS
+    const struct netif* netif = &cyw43_state.netif[CYW43_ITF_STA];
+    bytes = netif->mib2_counters.ifinoctets + netif->mib2_counters.ifoutoctets;
+    return 0;
+#else
+    // lwIP only counts bytes if MIB2_STATS is 1
+    bytes = 0;
+    return -1;
+#endif
+}
+
+int rppicomidi::Cyw43_wifi_driver::open_ping(uint32_t addr)
+{
+    close_ping();
+#if LWIP_RAW
+    cyw43_arch_lwip_begin();
+    ping_pcb = raw_new(IP_PROTO_ICMP);
+    if (ping_pcb != nullptr) {
+        ping_addr = addr;
+        ping_reply = 0;
+        raw_recv(ping_pcb, Callbacks::ping_recv, this);
+        raw_bind(ping_pcb, IP_ADDR_ANY);
+    }
+    cyw43_arch_lwip_end();
+    return ping_pcb != nullptr ? 0 : -1;
+#else
+    (void)addr;
+    return -1;
+#endif
+}
+
+void rppicomidi::Cyw43_wifi_driver::close_ping()
+{
+#if LWIP_RAW
+    if (ping_pcb != nullptr) {
+        cyw43_arch_lwip_begin();
+        raw_remove(ping_pcb);
+        cyw43_arch_lwip_end();
+        ping_pcb = nullptr;
+    }
+#endif
+}
+
+int rppicomidi::Cyw43_wifi_driver::send_ping(uint16_t seq)
+{
+#if LWIP_RAW
+    if (ping_pcb == nullptr) {
+        return -1;
+    }
+    int result = -1;
+    cyw43_arch_lwip_begin();
+    struct pbuf* p = pbuf_alloc(PBUF_IP, sizeof(struct icmp_echo_hdr), PBUF_RAM);
+    if (p != nullptr) {
+        auto iecho = reinterpret_cast<struct icmp_echo_hdr*>(p->payload);
+        ICMPH_TYPE_SET(iecho, ICMP_ECHO);
+        ICMPH_CODE_SET(iecho, 0);
+        iecho->id = ping_id;
+        iecho->seqno = lwip_htons(seq);
+        iecho->chksum = 0;
+        iecho->chksum = inet_chksum(iecho, sizeof(struct icmp_echo_hdr));
+        ip_addr_t addr;
+        ip_addr_set_ip4_u32(&addr, ping_addr);
+        result = raw_sendto(ping_pcb, p, &addr) == ERR_OK ? 0 : -1;
+        pbuf_free(p);
+    }
+    cyw43_arch_lwip_end();
+    return result;
+#else
+    (void)seq;
+    return -1;
+#endif
+}
+
+uint16_t rppicomidi::Cyw43_wifi_driver::get_ping_reply()
+{
+    return ping_reply;
+}
+
+int rppicomidi::Cyw43_wifi_driver::add_local_host(const char* name, uint32_t addr)
+{
+#if CYW43_WIFI_DRIVER_USES_DNS
+    ip_addr_t ipaddr;
+    ip_addr_set_ip4_u32(&ipaddr, addr);
+    cyw43_arch_lwip_begin();
+    dns_local_removehost(name, nullptr);
+    err_t err = dns_local_addhost(name, &ipaddr);
+    cyw43_arch_lwip_end();
+    return err == ERR_OK ? 0 : -1;
+#else
+    (void)name;
+    (void)addr;
+    return -1;
+#endif
+}
+
+void rppicomidi::Cyw43_wifi_driver::remove_local_host(const char* name)
+{
+#if CYW43_WIFI_DRIVER_USES_DNS
+    cyw43_arch_lwip_begin();
+    dns_local_removehost(name, nullptr);
+    cyw43_arch_lwip_end();
+#else
+    (void)name;
+#endif
+}
+
+int rppicomidi::Cyw43_wifi_driver::start_dns_query(const char* name)
+{
+    cancel_dns_query();
+#if CYW43_WIFI_DRIVER_USES_DNS
+    if (name == nullptr || name[0] == '\0' || strlen(name) > MAX_DNS_NAME_LEN) {
+        return -1;
+    }
+    strcpy(dns_name, name);
+    dns_result = 1;
+    dns_addr = 0;
+    ip_addr_t ipaddr;
+    cyw43_arch_lwip_begin();
+    Callbacks::dns_owner = this;
+    void* query_id = reinterpret_cast<void*>(++Callbacks::dns_query_id);
+    // lwIP answers from the local host list before asking the server, so
+    // take the name out of the list just while the query is sent; nothing
+    // else can look it up in between because lwIP is locked
+    ip_addr_t local_addr;
+    bool is_local = dns_local_lookup(dns_name, &local_addr, LWIP_DNS_ADDRTYPE_IPV4) == ERR_OK;
+    if (is_local) {
+        dns_local_removehost(dns_name, nullptr);
+    }
+    err_t err = dns_gethostbyname(dns_name, &ipaddr, Callbacks::dns_found, query_id);
+    if (is_local) {
+        dns_local_addhost(dns_name, &local_addr);
+    }
+    cyw43_arch_lwip_end();
+    if (err == ERR_OK) {
+        // already in lwIP's own cache
+        Callbacks::dns_found(dns_name, &ipaddr, query_id);
+    }
+    else if (err != ERR_INPROGRESS) {
+        cancel_dns_query();
+        return -1;
+    }
+    return 0;
+#else
+    (void)name;
+    return -1;
+#endif
+}
+
+int rppicomidi::Cyw43_wifi_driver::poll_dns_query(uint32_t& addr)
+{
+    int result = dns_result;
+    addr = result == 0 ? dns_addr : 0;
+    return result;
+}
+
+void rppicomidi::Cyw43_wifi_driver::cancel_dns_query()
+{
+#if CYW43_WIFI_DRIVER_USES_DNS
+    cyw43_arch_lwip_begin();
+    if (Callbacks::dns_owner == this) {
+        Callbacks::dns_owner = nullptr;
+    }
+    cyw43_arch_lwip_end();
+#endif
+    dns_name[0] = '\0';
+    dns_result = -1;
+}
+
+void rppicomidi::Cyw43_wifi_driver::lock()
+{
+    cyw43_arch_lwip_begin();
+}
+
+void rppicomidi::Cyw43_wifi_driver::unlock()
+{
+    cyw43_arch_lwip_end();
+}
@@ -0,0 +1,91 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstddef>
+#include "wifi_driver.h"
+
+struct raw_pcb;
+namespace rppicomidi
+{
+/**
+ * @brief The Wi-Fi driver the connection manager uses unless told otherwise
+ *
+ * Every method calls the CYW43 driver or lwIP function it replaces. The
+ * ping methods need LWIP_RAW and the DNS methods need LWIP_DNS,
+ * DNS_LOCAL_HOSTLIST and DNS_LOCAL_HOSTLIST_IS_DYNAMIC in the
+ * application's lwipopts.h; without them they return -1. Only one
+ * driver object at a time can have a DNS query in progress; starting a
+ * query abandons any other driver's.
+ */
+class Cyw43_wifi_driver : public Wifi_driver
+{
+public:
+    static constexpr size_t MAX_DNS_NAME_LEN = 63;
+
+    Cyw43_wifi_driver();
+    ~Cyw43_wifi_driver();
+    Cyw43_wifi_driver(Cyw43_wifi_driver const&) = delete;
+    void operator=(Cyw43_wifi_driver const&) = delete;
+
+    uint32_t now_ms() final;
+    uint32_t timestamp_us() final;
+    int init(uint32_t country_code) final;
+    void deinit() final;
+    void enable_sta_mode() final;
+    uint32_t get_country_code() final;
+    int link_status() final;
+    int scan(Scan_result_cb cb, void* env) final;
+    bool is_scan_active() final;
+    int connect(const char* ssid, const char* pw, uint32_t auth, const uint8_t* bssid, uint32_t channel) final;
+    int leave() final;
+    int set_power_management(uint32_t pm) final;
+    int get_rssi(int32_t& rssi) final;
+    uint32_t get_ip_address() final;
+    uint32_t get_gateway() final;
+    int get_byte_count(uint32_t& bytes) final;
+    int open_ping(uint32_t addr) final;
+    void close_ping() final;
+    int send_ping(uint16_t seq) final;
+    uint16_t get_ping_reply() final;
+    int add_local_host(const char* name, uint32_t addr) final;
+    void remove_local_host(const char* name) final;
+    int start_dns_query(const char* name) final;
+    int poll_dns_query(uint32_t& addr) final;
+    void cancel_dns_query() final;
+    void lock() final;
+    void unlock() final;
+private:
+    class Callbacks;
+    Scan_result_cb scan_cb;
+    void* scan_env;
+    struct raw_pcb* ping_pcb;
+    uint32_t ping_addr;
+    volatile uint16_t ping_reply;
+    static const uint16_t ping_id = 0x5057; // "PW"
+    char dns_name[MAX_DNS_NAME_LEN + 1];    // the name being resolved or empty
+    volatile int dns_result;                // poll_dns_query() return value
+    volatile uint32_t dns_addr;
+};
+}
@@ -0,0 +1,283 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstring>
+#include "dns_cache.h"
+
+rppicomidi::Dns_cache::Dns_cache(Wifi_driver& driver_) :
+    driver{driver_}, config{true, 300000, 30000, 10000}, active{false}, pending{-1}, pending_start_ms{0},
+    refreshes{0}, refresh_failures{0}
+{
+}
+
+rppicomidi::Dns_cache::~Dns_cache()
+{
+    link_down();
+}
+
+bool rppicomidi::Dns_cache::add_host(const std::string& hostname)
+{
+    if (hostname.empty() || hostname.length() > MAX_HOSTNAME_LEN) {
+        return false;
+    }
+    for (auto& host: hosts) {
+        if (host == hostname) {
+            return true;
+        }
+    }
+    if (hosts.size() >= MAX_HOSTS) {
+        return false;
+    }
+    hosts.push_back(hostname);
+    for (auto& network: addresses) {
+        network.second.resize(hosts.size(), 0);
+    }
+    if (active) {
+        // due on the next poll()
+        next_refresh_ms.push_back(pending_start_ms);
+        seeded.push_back(false);
+        addresses[active_ssid].resize(hosts.size(), 0);
+    }
+    return true;
+}
+
+bool rppicomidi::Dns_cache::remove_host(const std::string& hostname)
+{
+    size_t idx = 0;
+    while (idx < hosts.size() && hosts[idx] != hostname) {
+        ++idx;
+    }
+    if (idx == hosts.size()) {
+        return false;
+    }
+    if (active) {
+        unseed(idx);
+        if (pending == static_cast<int>(idx)) {
+            driver.cancel_dns_query();
+            pending = -1;
+        }
+        else if (pending > static_cast<int>(idx)) {
+            --pending;
+        }
+        next_refresh_ms.erase(next_refresh_ms.begin() + idx);
+        seeded.erase(seeded.begin() + idx);
+    }
+    for (auto& network: addresses) {
+        if (idx < network.second.size()) {
+            network.second.erase(network.second.begin() + idx);
+        }
+    }
+    hosts.erase(hosts.begin() + idx);
+    return true;
+}
+
+uint32_t rppicomidi::Dns_cache::get_address(const std::string& ssid, const std::string& hostname) const
+{
+    auto network = addresses.find(ssid);
+    if (network == addresses.end()) {
+        return 0;
+    }
+    for (size_t idx = 0; idx < hosts.size() && idx < network->second.size(); idx++) {
+        if (hosts[idx] == hostname) {
+            return network->second[idx];
+        }
+    }
+    return 0;
+}
+
+void rppicomidi::Dns_cache::link_up(const std::string& ssid, uint32_t now_ms)
+{
+    link_down();
+    if (!config.enabled || hosts.empty()) {
+        return;
+    }
+    active_ssid = ssid;
+    active = true;
+    addresses[active_ssid].resize(hosts.size(), 0);
+    // Seeded addresses are used right away; all of them are refreshed
+    // because there is no way to tell how old an address loaded from
+    // flash is
+    next_refresh_ms.assign(hosts.size(), now_ms);
+    seeded.assign(hosts.size(), false);
+    pending_start_ms = now_ms;
+    for (size_t idx = 0; idx < hosts.size(); idx++) {
+        seed(idx);
+    }
+}
+
+void rppicomidi::Dns_cache::link_down()
+{
+    if (active) {
+        for (size_t idx = 0; idx < seeded.size(); idx++) {
+            unseed(idx);
+        }
+    }
+    if (pending >= 0) {
+        driver.cancel_dns_query();
+    }
+    active = false;
+    pending = -1;
+    next_refresh_ms.clear();
+    seeded.clear();
+}
+
+bool rppicomidi::Dns_cache::poll(uint32_t now_ms)
+{
+    if (!active || !config.enabled) {
+        return false;
+    }
+    bool changed = false;
+    if (pending >= 0) {
+        size_t idx = static_cast<size_t>(pending);
+        uint32_t addr = 0;
+        int result = driver.poll_dns_query(addr);
+        if (result <= 0 || now_ms - pending_start_ms >= config.query_timeout_ms) {
+            if (result != 0) {
+                addr = 0;
+                driver.cancel_dns_query();
+            }
+            if (addr != 0) {
+                ++refreshes;
+                auto& addrs = addresses[active_ssid];
+                if (addrs[idx] != addr) {
+                    addrs[idx] = addr;
+                    changed = true;
+                }
+                next_refresh_ms[idx] = now_ms + config.refresh_interval_ms;
+            }
+            else {
+                ++refresh_failures;
+                next_refresh_ms[idx] = now_ms + config.retry_interval_ms;
+            }
+            pending = -1;
+            // replace the seeded address only if it changed
+            if (changed || !seeded[idx]) {
+                seed(idx);
+            }
+        }
+    }
+    if (pending < 0) {
+        for (size_t idx = 0; idx < hosts.size(); idx++) {
+            if (static_cast<int32_t>(now_ms - next_refresh_ms[idx]) >= 0) {
+                if (!start_refresh(idx, now_ms)) {
+                    ++refresh_failures;
+                    next_refresh_ms[idx] = now_ms + config.retry_interval_ms;
+                }
+                break;
+            }
+        }
+    }
+    return changed;
+}
+
+void rppicomidi::Dns_cache::seed(size_t idx)
+{
+    uint32_t addr = addresses[active_ssid][idx];
+    if (addr != 0) {
+        seeded[idx] = driver.add_local_host(hosts[idx].c_str(), addr) == 0;
+    }
+}
+
+void rppicomidi::Dns_cache::unseed(size_t idx)
+{
+    if (seeded[idx]) {
+        driver.remove_local_host(hosts[idx].c_str());
+        seeded[idx] = false;
+    }
+}
+
+bool rppicomidi::Dns_cache::start_refresh(size_t idx, uint32_t now_ms)
+{
+    // the query skips the local host list, so the seeded address keeps
+    // answering the application while the query is in flight
+    if (driver.start_dns_query(hosts[idx].c_str()) != 0) {
+        return false;
+    }
+    pending = static_cast<int>(idx);
+    pending_start_ms = now_ms;
+    return true;
+}
+
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+void rppicomidi::Dns_cache::serialize(JSON_Object* dns_object) const
+{
+    JSON_Value* hosts_value = json_value_init_array();
+    JSON_Array* hosts_array = json_value_get_array(hosts_value);
+    for (auto& host: hosts) {
+        json_array_append_string(hosts_array, host.c_str());
+    }
+    json_object_set_value(dns_object, "hosts", hosts_value);
+    JSON_Value* nets_value = json_value_init_object();
+    JSON_Object* nets_object = json_value_get_object(nets_value);
+    for (auto& network: addresses) {
+        bool any = false;
+        for (auto addr: network.second) {
+            any = any || addr != 0;
+        }
+        if (!any) {
+            continue;
+        }
+        JSON_Value* addrs_value = json_value_init_array();
+        JSON_Array* addrs_array = json_value_get_array(addrs_value);
+        for (size_t idx = 0; idx < hosts.size(); idx++) {
+            json_array_append_number(addrs_array, idx < network.second.size() ? network.second[idx] : 0);
+        }
+        json_object_set_value(nets_object, network.first.c_str(), addrs_value);
+    }
+    json_object_set_value(dns_object, "nets", nets_value);
+}
+
+bool rppicomidi::Dns_cache::deserialize(JSON_Object* dns_object)
+{
+    JSON_Array* hosts_array = json_object_get_array(dns_object, "hosts");
+    JSON_Object* nets_object = json_object_get_object(dns_object, "nets");
+    if (hosts_array == nullptr || nets_object == nullptr) {
+        return false;
+    }
+    link_down();
+    hosts.clear();
+    addresses.clear();
+    size_t nhosts = json_array_get_count(hosts_array);
+    for (size_t idx = 0; idx < nhosts && hosts.size() < MAX_HOSTS; idx++) {
+        const char* host = json_array_get_string(hosts_array, idx);
+        if (host == nullptr || !add_host(host)) {
+            return false;
+        }
+    }
+    size_t nnets = json_object_get_count(nets_object);
+    for (size_t net = 0; net < nnets; net++) {
+        const char* ssid = json_object_get_name(nets_object, net);
+        JSON_Array* addrs_array = json_array(json_object_get_value_at(nets_object, net));
+        if (ssid == nullptr || addrs_array == nullptr) {
+            return false;
+        }
+        auto& addrs = addresses[ssid];
+        addrs.assign(hosts.size(), 0);
+        for (size_t idx = 0; idx < hosts.size() && idx < json_array_get_count(addrs_array); idx++) {
+            addrs[idx] = static_cast<uint32_t>(json_array_get_number(addrs_array, idx));
+        }
+    }
+    return true;
+}
+#endif
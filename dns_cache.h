@@ -0,0 +1,186 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "pico_w_connection_manager_config.h"
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+#include "parson.h"
+#endif
+#include "wifi_driver.h"
+
+namespace rppicomidi
+{
+/**
+ * @brief Remember the addresses of the hosts an application talks to, per
+ * network, and give them to lwIP as soon as the link comes up
+ *
+ * After link up the cache adds each remembered address to lwIP's local
+ * host list, so the application's first dns_gethostbyname() for a cached
+ * host returns immediately instead of waiting for the upstream resolver.
+ * poll() then refreshes the addresses one host at a time. lwIP does not
+ * report record TTLs to the application, so each address is refreshed
+ * refresh_interval_ms after it was last resolved, and retried after
+ * retry_interval_ms if the refresh fails. Addresses loaded from flash are
+ * used right away and refreshed right after link up. A seeded address
+ * stays in the local host list while its refresh is in flight, because
+ * the driver's queries skip the list. All lwIP calls go through the
+ * Wi-Fi driver, so a trace of the driver replays the refreshes.
+ *
+ * @note Cyw43_wifi_driver requires LWIP_DNS, DNS_LOCAL_HOSTLIST and
+ * DNS_LOCAL_HOSTLIST_IS_DYNAMIC in the application's lwipopts.h. Without
+ * them the cache never seeds or refreshes anything.
+ */
+class Dns_cache
+{
+public:
+    struct Config {
+        bool enabled;                   //!< true to seed and refresh while the link is up
+        uint32_t refresh_interval_ms;   //!< refresh an address this long after it was resolved
+        uint32_t retry_interval_ms;     //!< retry a failed refresh after this long
+        uint32_t query_timeout_ms;      //!< give up on a refresh after this long
+    };
+    static constexpr size_t MAX_HOSTS = 8;
+    static constexpr size_t MAX_HOSTNAME_LEN = 63;
+
+    /**
+     * @brief Construct a new cache
+     *
+     * @param driver_ the driver to seed and query through; it must outlive
+     * the cache
+     */
+    explicit Dns_cache(Wifi_driver& driver_);
+    ~Dns_cache();
+    Dns_cache(Dns_cache const&) = delete;
+    void operator=(Dns_cache const&) = delete;
+
+    void set_config(const Config& config_) { config = config_; }
+    const Config& get_config() const { return config; }
+
+    /**
+     * @brief Add a host name to cache on every network
+     *
+     * @param hostname the host name
+     * @return true if added or already present, false if the name is
+     * empty or too long, or MAX_HOSTS names are already cached
+     */
+    bool add_host(const std::string& hostname);
+
+    /**
+     * @brief Stop caching a host name and forget its addresses
+     *
+     * @return true if the name was cached
+     */
+    bool remove_host(const std::string& hostname);
+
+    /**
+     * @brief Get the cached host names
+     */
+    const std::vector<std::string>& get_hosts() const { return hosts; }
+
+    /**
+     * @brief Get the address cached for a host on a network
+     *
+     * @param ssid the network
+     * @param hostname the host
+     * @return the IPv4 address in network byte order or 0 if none is cached
+     */
+    uint32_t get_address(const std::string& ssid, const std::string& hostname) const;
+
+    /**
+     * @brief Seed lwIP with the addresses cached for a network and start
+     * refreshing them
+     *
+     * @param ssid the network the link is up on
+     * @param now_ms the current time in milliseconds
+     */
+    void link_up(const std::string& ssid, uint32_t now_ms);
+
+    /**
+     * @brief Remove the seeded addresses from lwIP and stop refreshing
+     */
+    void link_down();
+
+    /**
+     * @brief Start and complete refreshes
+     *
+     * Call this periodically while the link is up.
+     * @param now_ms the current time in milliseconds
+     * @return true if a cached address changed, false otherwise
+     */
+    bool poll(uint32_t now_ms);
+
+    /**
+     * @brief Forget the addresses of networks for which keep returns false
+     */
+    template <typename Predicate>
+    void retain_networks(Predicate keep)
+    {
+        for (auto it = addresses.begin(); it != addresses.end();) {
+            it = keep(it->first) ? std::next(it) : addresses.erase(it);
+        }
+    }
+
+    /**
+     * @brief Get the number of refreshes that completed and failed
+     */
+    uint32_t get_refreshes() const { return refreshes; }
+    uint32_t get_refresh_failures() const { return refresh_failures; }
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+    /**
+     * @brief Serialize the host names and the addresses of every network
+     *
+     * @param dns_object the object to receive the values
+     */
+    void serialize(JSON_Object* dns_object) const;
+
+    /**
+     * @brief Replace the host names and addresses with the ones in dns_object
+     *
+     * @param dns_object the object containing the values
+     * @return true if successful, false otherwise
+     */
+    bool deserialize(JSON_Object* dns_object);
+#endif
+private:
+    void seed(size_t idx);
+    void unseed(size_t idx);
+    bool start_refresh(size_t idx, uint32_t now_ms);
+    Wifi_driver& driver;
+    Config config;
+    std::vector<std::string> hosts;
+    std::unordered_map<std::string, std::vector<uint32_t>> addresses;  // by SSID, parallel to hosts
+    std::string active_ssid;
+    bool active;
+    std::vector<uint32_t> next_refresh_ms;      // parallel to hosts while active
+    std::vector<bool> seeded;                   // parallel to hosts while active
+    int pending;                                // index of the host being refreshed or -1
+    uint32_t pending_start_ms;
+    uint32_t refreshes;
+    uint32_t refresh_failures;
+};
+}
@@ -0,0 +1,115 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstring>
+#include "hardware/flash.h"
+#include "pico/flash.h"
+#include "flash_sector_settings_storage.h"
+
+// The end of the program image in flash, from the SDK linker scripts
+extern char __flash_binary_end;
+
+/**
+ * @brief One flash operation, run by flash_safe_execute() with the other
+ * core locked out and interrupts disabled
+ */
+class rppicomidi::Flash_sector_settings_storage::Flash_op
+{
+public:
+    static void erase(void* param)
+    {
+        auto op = reinterpret_cast<Flash_op*>(param);
+        flash_range_erase(op->offset, op->count);
+    }
+    static void program(void* param)
+    {
+        auto op = reinterpret_cast<Flash_op*>(param);
+        flash_range_program(op->offset, op->data, op->count);
+    }
+    uint32_t offset;
+    const uint8_t* data;
+    size_t count;
+};
+
+rppicomidi::Flash_sector_settings_storage::Flash_sector_settings_storage(uint32_t flash_offset_, uint32_t slot_size_, unsigned num_slots_) :
+    flash_offset{flash_offset_}, slot_size{slot_size_}, num_slots{num_slots_}
+{
+    // An unaligned area would erase flash outside of it, and an area that
+    // overlaps the program would erase the program; refuse to use them
+    uint32_t program_end = reinterpret_cast<uintptr_t>(&__flash_binary_end) - XIP_BASE;
+    uint64_t area_end = flash_offset + static_cast<uint64_t>(slot_size) * num_slots;
+    if ((flash_offset % FLASH_SECTOR_SIZE) != 0 || (slot_size % FLASH_SECTOR_SIZE) != 0 || slot_size == 0 ||
+            flash_offset < program_end || area_end > PICO_FLASH_SIZE_BYTES) {
+        num_slots = 0;
+    }
+}
+
+bool rppicomidi::Flash_sector_settings_storage::do_read(unsigned slot, std::string& data)
+{
+    auto slot_start = reinterpret_cast<const uint8_t*>(XIP_BASE + flash_offset + slot * slot_size);
+    Header header;
+    memcpy(&header, slot_start, sizeof(header));
+    if (header.magic != header_magic || header.length == 0 || header.length > slot_size - FLASH_PAGE_SIZE) {
+        return false;
+    }
+    data.assign(reinterpret_cast<const char*>(slot_start + FLASH_PAGE_SIZE), header.length);
+    return true;
+}
+
+bool rppicomidi::Flash_sector_settings_storage::do_write(unsigned slot, const char* data, size_t len)
+{
+    if (len == 0 || len > slot_size - FLASH_PAGE_SIZE) {
+        return false;
+    }
+    uint32_t slot_offset = flash_offset + slot * slot_size;
+    uint32_t used = FLASH_PAGE_SIZE + len;
+    uint8_t page[FLASH_PAGE_SIZE];
+
+    Flash_op op{slot_offset, nullptr, (used + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE};
+    if (flash_safe_execute(Flash_op::erase, &op, flash_timeout_ms) != PICO_OK) {
+        return false;
+    }
+    // Program the data pages first and the header page last
+    op.data = page;
+    op.count = FLASH_PAGE_SIZE;
+    for (size_t pos = 0; pos < len; pos += FLASH_PAGE_SIZE) {
+        size_t n = len - pos < FLASH_PAGE_SIZE ? len - pos : FLASH_PAGE_SIZE;
+        memset(page, 0xff, sizeof(page));
+        memcpy(page, data + pos, n);
+        op.offset = slot_offset + FLASH_PAGE_SIZE + pos;
+        if (flash_safe_execute(Flash_op::program, &op, flash_timeout_ms) != PICO_OK) {
+            return false;
+        }
+    }
+    Header header{header_magic, static_cast<uint32_t>(len)};
+    memset(page, 0xff, sizeof(page));
+    memcpy(page, &header, sizeof(header));
+    op.offset = slot_offset;
+    if (flash_safe_execute(Flash_op::program, &op, flash_timeout_ms) != PICO_OK) {
+        return false;
+    }
+
+    std::string readback;
+    return do_read(slot, readback) && readback.size() == len && memcmp(readback.data(), data, len) == 0;
+}
@@ -0,0 +1,77 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include "settings_storage.h"
+
+namespace rppicomidi
+{
+/**
+ * @brief Settings storage in reserved sectors of the program flash with no file system
+ *
+ * Each slot occupies slot_size bytes of flash starting at
+ * flash_offset + slot * slot_size. The first flash page of a slot holds
+ * a header with the data length; the data starts on the second page.
+ * The header is programmed last, so a slot whose write was interrupted
+ * reads as empty rather than as corrupt data.
+ *
+ * Flash is erased and programmed through flash_safe_execute(), which
+ * disables interrupts and keeps the other core out of flash.
+ * @note If the other core is running, it must have called
+ * flash_safe_execute_core_init() (or run under FreeRTOS SMP), or every
+ * write fails. The reserved area must not overlap a file system.
+ */
+class Flash_sector_settings_storage : public Settings_storage
+{
+public:
+    /**
+     * @brief Construct a new Flash_sector_settings_storage object
+     *
+     * If the area is not sector aligned, overlaps the program image or
+     * does not fit in flash, the object has no slots and every read and
+     * write fails.
+     * @param flash_offset_ the offset of the first slot from the start of flash;
+     * must be a multiple of FLASH_SECTOR_SIZE and past the end of the program
+     * @param slot_size_ the size of each slot; must be a multiple of FLASH_SECTOR_SIZE
+     * @param num_slots_ the number of slots
+     */
+    Flash_sector_settings_storage(uint32_t flash_offset_, uint32_t slot_size_, unsigned num_slots_ = 2);
+
+    unsigned get_num_slots() const override { return num_slots; }
+protected:
+    bool do_read(unsigned slot, std::string& data) override;
+    bool do_write(unsigned slot, const char* data, size_t len) override;
+private:
+    class Flash_op;
+    struct Header {
+        uint32_t magic;
+        uint32_t length;
+    };
+    uint32_t flash_offset;
+    uint32_t slot_size;
+    unsigned num_slots;
+    static constexpr uint32_t header_magic = 0x57494649; // "WIFI"
+    static constexpr uint32_t flash_timeout_ms = 100;   // to lock out the other core
+};
+}
@@ -0,0 +1,249 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "known_network_store.h"
+
+rppicomidi::Known_network_store::Known_network_store(size_t capacity_, Eviction_policy policy_) :
+    capacity{capacity_ > 0 ? capacity_ : 1}, policy{policy_}, pinned{INVALID_HANDLE}, next_handle{INVALID_HANDLE + 1}, use_clock{0}
+{
+}
+
+rppicomidi::Known_network_store::~Known_network_store()
+{
+    Memory_accounting::freed(MEM_CREDENTIAL_STORE, entries.capacity() * sizeof(Ssid_info));
+}
+
+size_t rppicomidi::Known_network_store::get_string_heap_bytes(size_t& blocks) const
+{
+    size_t bytes = 0;
+    blocks = 0;
+    for (const auto& entry: entries) {
+        for (const std::string* str: {&entry.ssid, &entry.passphrase, &entry.ssid}) {
+            // the SSID is counted twice because idx_by_ssid holds a copy
+            size_t nbytes = Memory_accounting::string_heap_bytes(*str);
+            if (nbytes != 0) {
+                bytes += nbytes;
+                ++blocks;
+            }
+        }
+    }
+    return bytes;
+}
+
+void rppicomidi::Known_network_store::set_capacity(size_t capacity_)
+{
+    capacity = capacity_ > 0 ? capacity_ : 1;
+    while (entries.size() > capacity) {
+        // capacity is at least 1, so there is always an unpinned victim
+        erase_idx(choose_victim());
+    }
+}
+
+rppicomidi::Known_network_store::Handle rppicomidi::Known_network_store::find(const std::string& ssid) const
+{
+    auto it = idx_by_ssid.find(ssid);
+    return it == idx_by_ssid.end() ? INVALID_HANDLE : meta[it->second].handle;
+}
+
+const rppicomidi::Ssid_info* rppicomidi::Known_network_store::get(Handle handle) const
+{
+    auto it = idx_by_handle.find(handle);
+    return it == idx_by_handle.end() ? nullptr : &entries[it->second];
+}
+
+rppicomidi::Known_network_store::Handle rppicomidi::Known_network_store::add(const Ssid_info& info, bool& changed)
+{
+    auto it = idx_by_ssid.find(info.ssid);
+    if (it == idx_by_ssid.end()) {
+        Handle handle = insert(info, use_clock + 1, 0, true);
+        changed = handle != INVALID_HANDLE;
+        if (changed) {
+            ++use_clock;
+        }
+        return handle;
+    }
+    Ssid_info& known = entries[it->second];
+    changed = known.passphrase != info.passphrase || known.security != info.security ||
+        known.power_profile != info.power_profile;
+    known.passphrase = info.passphrase;
+    known.security = info.security;
+    known.power_profile = info.power_profile;
+    meta[it->second].last_used = ++use_clock;
+    return meta[it->second].handle;
+}
+
+rppicomidi::Known_network_store::Handle rppicomidi::Known_network_store::restore(const Ssid_info& info, uint32_t last_used, uint32_t successes)
+{
+    auto it = idx_by_ssid.find(info.ssid);
+    if (last_used > use_clock) {
+        use_clock = last_used;
+    }
+    if (it != idx_by_ssid.end()) {
+        entries[it->second] = info;
+        meta[it->second].last_used = last_used;
+        meta[it->second].successes = successes;
+        return meta[it->second].handle;
+    }
+    return insert(info, last_used, successes, false);
+}
+
+bool rppicomidi::Known_network_store::erase(Handle handle)
+{
+    auto it = idx_by_handle.find(handle);
+    if (it == idx_by_handle.end()) {
+        return false;
+    }
+    erase_idx(it->second);
+    return true;
+}
+
+void rppicomidi::Known_network_store::clear()
+{
+    entries.clear();
+    meta.clear();
+    idx_by_ssid.clear();
+    idx_by_handle.clear();
+    pinned = INVALID_HANDLE;
+    use_clock = 0;
+}
+
+void rppicomidi::Known_network_store::mark_connected(Handle handle)
+{
+    auto it = idx_by_handle.find(handle);
+    if (it != idx_by_handle.end()) {
+        ++meta[it->second].successes;
+        meta[it->second].last_used = ++use_clock;
+    }
+}
+
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+void rppicomidi::Known_network_store::serialize(JSON_Array* known_array) const
+{
+    for (size_t idx = 0; idx < entries.size(); idx++) {
+        JSON_Value* ssid_value = json_value_init_object();
+        JSON_Object* ssid_object = json_value_get_object(ssid_value);
+        entries[idx].serialize(ssid_object);
+        json_object_set_number(ssid_object, "used", meta[idx].last_used);
+        json_object_set_number(ssid_object, "ok", meta[idx].successes);
+        json_array_append_value(known_array, ssid_value);
+    }
+}
+
+bool rppicomidi::Known_network_store::deserialize(JSON_Array* known_array)
+{
+    clear();
+    auto n_known = json_array_get_count(known_array);
+    size_t idx = 0;
+    for (; idx < n_known; idx++) {
+        Ssid_info info;
+        JSON_Object* item_object = json_array_get_object(known_array, idx);
+        if (item_object == nullptr || !info.deserialize(item_object)) {
+            break;
+        }
+        // Settings saved before usage statistics existed list the
+        // oldest entry first
+        uint32_t last_used = idx + 1;
+        uint32_t successes = 0;
+        JSON_Value* val = json_object_get_value(item_object, "used");
+        if (json_value_get_type(val) == JSONNumber) {
+            last_used = json_value_get_number(val);
+        }
+        val = json_object_get_value(item_object, "ok");
+        if (json_value_get_type(val) == JSONNumber) {
+            successes = json_value_get_number(val);
+        }
+        restore(info, last_used, successes);
+    }
+    return idx == n_known;
+}
+#endif
+
+rppicomidi::Known_network_store::Handle rppicomidi::Known_network_store::insert(const Ssid_info& info, uint32_t last_used, uint32_t successes, bool evict)
+{
+    if (evict && !entries.empty() && entries.size() >= capacity) {
+        size_t victim = choose_victim();
+        if (victim == entries.size()) {
+            return INVALID_HANDLE;
+        }
+        erase_idx(victim);
+    }
+    Handle handle = next_handle++;
+    if (next_handle == INVALID_HANDLE) {
+        ++next_handle;
+    }
+    size_t idx = entries.size();
+    size_t old_capacity = entries.capacity();
+    entries.push_back(info);
+    // entries is part of the public API, so it cannot use a tracking allocator
+    Memory_accounting::reallocated(MEM_CREDENTIAL_STORE, old_capacity * sizeof(Ssid_info), entries.capacity() * sizeof(Ssid_info));
+    meta.push_back({handle, last_used, successes});
+    idx_by_ssid[info.ssid] = idx;
+    idx_by_handle[handle] = idx;
+    return handle;
+}
+
+void rppicomidi::Known_network_store::erase_idx(size_t idx)
+{
+    size_t last = entries.size() - 1;
+    idx_by_ssid.erase(entries[idx].ssid);
+    idx_by_handle.erase(meta[idx].handle);
+    if (meta[idx].handle == pinned) {
+        pinned = INVALID_HANDLE;
+    }
+    if (idx != last) {
+        // move the last entry into the hole so the vector stays dense
+        entries[idx] = std::move(entries[last]);
+        meta[idx] = meta[last];
+        idx_by_ssid[entries[idx].ssid] = idx;
+        idx_by_handle[meta[idx].handle] = idx;
+    }
+    entries.pop_back();
+    meta.pop_back();
+}
+
+size_t rppicomidi::Known_network_store::choose_victim() const
+{
+    // entries.size() means there is no entry to evict
+    size_t victim = entries.size();
+    for (size_t idx = 0; idx < meta.size(); idx++) {
+        const Entry_meta& m = meta[idx];
+        if (m.handle == pinned) {
+            continue;
+        }
+        if (victim == entries.size()) {
+            victim = idx;
+            continue;
+        }
+        const Entry_meta& v = meta[victim];
+        if (policy == EVICT_LEAST_SUCCESSFUL) {
+            if (m.successes < v.successes || (m.successes == v.successes && m.last_used < v.last_used)) {
+                victim = idx;
+            }
+        }
+        else if (m.last_used < v.last_used) {
+            victim = idx;
+        }
+    }
+    return victim;
+}
@@ -0,0 +1,218 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "ssid_info.h"
+#include "memory_accounting.h"
+
+namespace rppicomidi
+{
+/**
+ * @brief A collection of known networks with hashed SSID lookup and an
+ * optional capacity
+ *
+ * Entries are stored contiguously so the whole list can be read as a
+ * std::vector<Ssid_info>. Each entry also has a Handle that stays valid
+ * until that entry is erased or evicted, even if other entries move.
+ * The store is unbounded unless the application sets a capacity. When
+ * the store is full, adding a new SSID evicts either the least recently
+ * used entry or the entry with the fewest successful connections.
+ * Loading saved entries never evicts, and the pinned entry is never
+ * chosen for eviction.
+ */
+class Known_network_store
+{
+public:
+    typedef uint32_t Handle;
+    static constexpr Handle INVALID_HANDLE = 0;
+    static constexpr size_t UNBOUNDED = SIZE_MAX;
+    static constexpr size_t DEFAULT_CAPACITY = UNBOUNDED;
+
+    enum Eviction_policy {
+        EVICT_LEAST_RECENTLY_USED,  //!< evict the entry that was used longest ago
+        EVICT_LEAST_SUCCESSFUL,     //!< evict the entry with the fewest successful connections
+    };
+
+    Known_network_store(size_t capacity_ = DEFAULT_CAPACITY, Eviction_policy policy_ = EVICT_LEAST_RECENTLY_USED);
+    ~Known_network_store();
+    Known_network_store(Known_network_store const&) = delete;
+    void operator=(Known_network_store const&) = delete;
+
+    /**
+     * @brief Set the maximum number of entries; evict entries if necessary
+     *
+     * @param capacity_ the new maximum number of entries, at least 1, or
+     * UNBOUNDED
+     */
+    void set_capacity(size_t capacity_);
+
+    size_t get_capacity() const { return capacity; }
+
+    void set_eviction_policy(Eviction_policy policy_) { policy = policy_; }
+
+    Eviction_policy get_eviction_policy() const { return policy; }
+
+    /**
+     * @brief Protect one entry from eviction, e.g. the network in use
+     *
+     * @param handle the handle of the entry to protect or INVALID_HANDLE
+     * to protect none. Erasing the entry also unpins it.
+     */
+    void set_pinned(Handle handle) { pinned = handle; }
+
+    Handle get_pinned() const { return pinned; }
+
+    size_t size() const { return entries.size(); }
+
+    /**
+     * @brief Get all the entries in no particular order
+     *
+     * @return const std::vector<Ssid_info>& the entries
+     */
+    const std::vector<Ssid_info>& get_entries() const { return entries; }
+
+    /**
+     * @brief Measure the heap the SSID and passphrase strings hold
+     *
+     * @param blocks receives the number of strings that hold heap
+     * @return size_t the number of bytes
+     */
+    size_t get_string_heap_bytes(size_t& blocks) const;
+
+    /**
+     * @brief Find the entry for an SSID
+     *
+     * @param ssid the SSID to look up
+     * @return Handle the handle of the entry or INVALID_HANDLE if not found
+     */
+    Handle find(const std::string& ssid) const;
+
+    /**
+     * @brief Get the entry for a handle
+     *
+     * @param handle the handle of the entry
+     * @return const Ssid_info* a pointer to the entry or nullptr if the
+     * handle is not valid. The pointer is invalidated by the next change to the store.
+     */
+    const Ssid_info* get(Handle handle) const;
+
+    /**
+     * @brief Get the handle for the entry at index idx of get_entries()
+     *
+     * @param idx the index
+     * @return Handle the handle or INVALID_HANDLE if idx is out of range
+     */
+    Handle get_handle(size_t idx) const { return idx < meta.size() ? meta[idx].handle : INVALID_HANDLE; }
+
+    /**
+     * @brief Add a new entry or update the entry with the same SSID
+     *
+     * If the SSID is new and the store is full, one entry is evicted first.
+     * If the only entry that could be evicted is the pinned one, the new
+     * SSID is not added.
+     * @param info the entry to add
+     * @param changed is set true if the store contents changed, false otherwise
+     * @return Handle the handle of the new or updated entry or INVALID_HANDLE
+     * if the store is full and its only entry is pinned
+     */
+    Handle add(const Ssid_info& info, bool& changed);
+
+    /**
+     * @brief Add a saved entry with its usage statistics without evicting
+     *
+     * If the store already holds more entries than the capacity, the
+     * extra entries stay until set_capacity() is called; each new SSID
+     * passed to add() evicts one entry, so the store does not grow.
+     * @param info the entry to add; replaces the entry with the same SSID
+     * and its statistics
+     * @param last_used the saved usage clock value
+     * @param successes the saved number of successful connections
+     * @return Handle the handle of the new or replaced entry
+     */
+    Handle restore(const Ssid_info& info, uint32_t last_used, uint32_t successes);
+
+    /**
+     * @brief Erase an entry
+     *
+     * @param handle the handle of the entry to erase
+     * @return true if the handle was valid, false otherwise
+     */
+    bool erase(Handle handle);
+
+    /**
+     * @brief Erase all entries
+     */
+    void clear();
+
+    /**
+     * @brief Record that the entry was used for a successful connection
+     *
+     * @param handle the handle of the entry
+     */
+    void mark_connected(Handle handle);
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+
+    /**
+     * @brief Append all entries, including usage statistics, to a JSON array
+     *
+     * @param known_array the array to receive the entries
+     */
+    void serialize(JSON_Array* known_array) const;
+
+    /**
+     * @brief Replace all entries with the ones in a JSON array
+     *
+     * Every entry is kept, even if the array holds more entries than
+     * the capacity; see restore().
+     * @param known_array the array containing the entries
+     * @return true if every entry deserialized successfully, false otherwise
+     */
+    bool deserialize(JSON_Array* known_array);
+#endif
+private:
+    struct Entry_meta {
+        Handle handle;
+        uint32_t last_used;     // value of use_clock the last time this entry was used
+        uint32_t successes;     // number of successful connections
+    };
+    Handle insert(const Ssid_info& info, uint32_t last_used, uint32_t successes, bool evict);
+    void erase_idx(size_t idx);
+    size_t choose_victim() const;
+    size_t capacity;
+    Eviction_policy policy;
+    Handle pinned;
+    Handle next_handle;
+    uint32_t use_clock;
+    std::vector<Ssid_info> entries;
+    std::vector<Entry_meta, Accounted_allocator<Entry_meta, MEM_CREDENTIAL_STORE>> meta;
+    std::unordered_map<std::string, size_t, std::hash<std::string>, std::equal_to<std::string>,
+        Accounted_allocator<std::pair<const std::string, size_t>, MEM_CREDENTIAL_STORE>> idx_by_ssid;
+    std::unordered_map<Handle, size_t, std::hash<Handle>, std::equal_to<Handle>,
+        Accounted_allocator<std::pair<const Handle, size_t>, MEM_CREDENTIAL_STORE>> idx_by_handle;
+};
+}
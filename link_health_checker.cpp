@@ -0,0 +1,100 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "link_health_checker.h"
+
+rppicomidi::Link_health_checker::Link_health_checker(Wifi_driver& driver_) :
+    driver{driver_}, config{false, 5000, 1000, 3}, running{false}, outstanding{false}, seq_num{0}, next_probe_ms{0},
+    probe_sent_ms{0}, last_reply_ms{0}, consecutive_failures{0}, detection_count{0}, total_time_to_detect_ms{0}
+{
+}
+
+rppicomidi::Link_health_checker::~Link_health_checker()
+{
+    stop();
+}
+
+bool rppicomidi::Link_health_checker::start(uint32_t gateway, uint32_t now_ms)
+{
+    stop();
+    if (!config.enabled || config.failure_budget == 0 || gateway == 0 || driver.open_ping(gateway) != 0) {
+        return false;
+    }
+    running = true;
+    outstanding = false;
+    consecutive_failures = 0;
+    last_reply_ms = now_ms;
+    next_probe_ms = now_ms + config.interval_ms;
+    return true;
+}
+
+void rppicomidi::Link_health_checker::stop()
+{
+    if (running) {
+        driver.close_ping();
+    }
+    running = false;
+    outstanding = false;
+}
+
+bool rppicomidi::Link_health_checker::poll(uint32_t now_ms)
+{
+    if (!running) {
+        return false;
+    }
+    if (outstanding) {
+        if (driver.get_ping_reply() == seq_num) {
+            outstanding = false;
+            consecutive_failures = 0;
+            last_reply_ms = now_ms;
+        }
+        else if (now_ms - probe_sent_ms >= config.timeout_ms) {
+            outstanding = false;
+            if (++consecutive_failures >= config.failure_budget) {
+                ++detection_count;
+                total_time_to_detect_ms += now_ms - last_reply_ms;
+                stop();
+                return true;
+            }
+        }
+    }
+    if (!outstanding && static_cast<int32_t>(now_ms - next_probe_ms) >= 0) {
+        next_probe_ms = now_ms + config.interval_ms;
+        // 0 means no reply, so skip it when the sequence number wraps
+        if (++seq_num == 0) {
+            ++seq_num;
+        }
+        // A probe that could not be sent, e.g. because lwIP is out of
+        // pbufs, gets no reply, so it counts as failed after timeout_ms
+        (void)driver.send_ping(seq_num);
+        outstanding = true;
+        probe_sent_ms = now_ms;
+    }
+    return false;
+}
+
+uint32_t rppicomidi::Link_health_checker::get_mean_time_to_detect_ms() const
+{
+    return detection_count == 0 ? 0 : static_cast<uint32_t>(total_time_to_detect_ms / detection_count);
+}
@@ -0,0 +1,141 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstdint>
+#include "wifi_driver.h"
+
+namespace rppicomidi
+{
+/**
+ * @brief Detect a dead upstream by pinging the gateway
+ *
+ * The Wi-Fi link status stays LINK_UP as long as the radio is
+ * associated with the AP, even if the gateway behind the AP stopped
+ * responding. This class sends an ICMP echo request to the gateway
+ * every interval_ms and declares the link degraded after failure_budget
+ * consecutive requests go unanswered for timeout_ms. A request that
+ * could not be sent counts as unanswered. The requests go
+ * through the Wi-Fi driver's ping methods, so a trace of the driver
+ * replays the checker's decisions.
+ *
+ * @note Cyw43_wifi_driver requires LWIP_RAW in the application's
+ * lwipopts.h to ping. If LWIP_RAW is 0, the checker never sends anything
+ * and never declares the link degraded.
+ */
+class Link_health_checker
+{
+public:
+    struct Config {
+        bool enabled;               //!< true to probe the gateway while the link is up
+        uint32_t interval_ms;       //!< time between the start of successive probes
+        uint32_t timeout_ms;        //!< time to wait for a reply before counting a failure
+        uint32_t failure_budget;    //!< consecutive failures that declare the link degraded
+    };
+
+    /**
+     * @brief Construct a new checker
+     *
+     * @param driver_ the driver to ping through; it must outlive the checker
+     */
+    explicit Link_health_checker(Wifi_driver& driver_);
+    ~Link_health_checker();
+    Link_health_checker(Link_health_checker const&) = delete;
+    void operator=(Link_health_checker const&) = delete;
+
+    /**
+     * @brief Set the probe configuration
+     *
+     * Takes effect on the next call to start()
+     * @param config_ the new configuration
+     */
+    void set_config(const Config& config_) { config = config_; }
+
+    /**
+     * @brief Get the probe configuration
+     */
+    const Config& get_config() const { return config; }
+
+    /**
+     * @brief Start probing the gateway
+     *
+     * @param gateway the IPv4 address of the gateway in network byte order
+     * @param now_ms the current time in milliseconds
+     * @return true if probing started, false if disabled, the gateway
+     * address is not set, or the driver could not open a ping
+     */
+    bool start(uint32_t gateway, uint32_t now_ms);
+
+    /**
+     * @brief Stop probing the gateway and close the driver's ping
+     */
+    void stop();
+
+    /**
+     * @brief Send probes and check for replies
+     *
+     * Call this periodically while the link is up. The checker stops
+     * itself when it declares the link degraded.
+     * @param now_ms the current time in milliseconds
+     * @return true if the link was just declared degraded, false otherwise
+     */
+    bool poll(uint32_t now_ms);
+
+    /**
+     * @brief return true if the checker is probing the gateway
+     */
+    bool is_running() const { return running; }
+
+    /**
+     * @brief Get the number of unanswered probes since the last reply
+     */
+    uint32_t get_consecutive_failures() const { return consecutive_failures; }
+
+    /**
+     * @brief Get the number of times the link was declared degraded
+     */
+    uint32_t get_detection_count() const { return detection_count; }
+
+    /**
+     * @brief Get the mean time from the last gateway reply to the link
+     * being declared degraded
+     *
+     * @return uint32_t the mean time in milliseconds or 0 if the link
+     * has never been declared degraded
+     */
+    uint32_t get_mean_time_to_detect_ms() const;
+private:
+    Wifi_driver& driver;
+    Config config;
+    bool running;
+    bool outstanding;
+    uint16_t seq_num;
+    uint32_t next_probe_ms;
+    uint32_t probe_sent_ms;
+    uint32_t last_reply_ms;
+    uint32_t consecutive_failures;
+    uint32_t detection_count;
+    uint64_t total_time_to_detect_ms;
+};
+}
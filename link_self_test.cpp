@@ -0,0 +1,434 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstring>
+#include "link_self_test.h"
+#if LWIP_TCP
+#include "lwip/tcp.h"
+#endif
+#if LWIP_UDP
+#include "lwip/udp.h"
+#endif
+
+// Every UDP datagram starts with the magic number, a sequence number and the time it was sent
+static const uint16_t datagram_header_len = 12;
+#if LWIP_TCP
+// TCP sends this buffer by reference, so it must never change
+static const uint8_t tcp_chunk[1460] = {0};
+#endif
+
+rppicomidi::Link_self_test::Link_self_test(Wifi_driver& driver_) :
+    driver{driver_}, phase{PHASE_IDLE}, phase_start_ms{0}, tcp{nullptr}, udp{nullptr}, tcp_connected{false},
+    tcp_failed{false}, tcp_acked{0}, tcp_sending{false}, tcp_start_ms{0}, udp_received{0}, udp_sent{0},
+    rtt_seq{0}, rtt_outstanding{false}, rtt_sent_ms{0}, rtt_reply{false}, rtt_us{0}, rtt_total_us{0}
+{
+    memset(&config, 0, sizeof(config));
+    memset(&results, 0, sizeof(results));
+}
+
+rppicomidi::Link_self_test::~Link_self_test()
+{
+    stop();
+}
+
+bool rppicomidi::Link_self_test::start(const Config& config_, int rssi, uint32_t now_ms)
+{
+    stop();
+    if ((config_.tests & TEST_ALL) == 0 || ip4_addr_get_u32(ip_2_ip4(&config_.peer)) == 0) {
+        return false;
+    }
+    config = config_;
+    if (config.udp_payload < datagram_header_len) {
+        config.udp_payload = datagram_header_len;
+    }
+    memset(&results, 0, sizeof(results));
+    results.rssi = rssi;
+    results.tcp_result = RESULT_NOT_RUN;
+    results.udp_result = RESULT_NOT_RUN;
+    results.rtt_result = RESULT_NOT_RUN;
+    phase = PHASE_IDLE;
+    next_phase(now_ms);
+    return true;
+}
+
+void rppicomidi::Link_self_test::stop()
+{
+    if (phase != PHASE_IDLE) {
+        end_phase(RESULT_ABORTED, 0);
+        phase = PHASE_IDLE;
+    }
+    release();
+}
+
+bool rppicomidi::Link_self_test::poll(uint32_t now_ms)
+{
+    bool phase_done = false;
+    switch (phase) {
+        case PHASE_TCP:
+            phase_done = poll_tcp(now_ms);
+            break;
+        case PHASE_UDP:
+            phase_done = poll_udp(now_ms);
+            break;
+        case PHASE_RTT:
+            phase_done = poll_rtt(now_ms);
+            break;
+        default:
+            return false;
+    }
+    if (phase_done) {
+        next_phase(now_ms);
+    }
+    return phase == PHASE_IDLE;
+}
+
+void rppicomidi::Link_self_test::next_phase(uint32_t now_ms)
+{
+    static const Phase order[] = {PHASE_TCP, PHASE_UDP, PHASE_RTT};
+    static const uint8_t test_bits[] = {TEST_TCP, TEST_UDP, TEST_RTT};
+    for (size_t idx = 0; idx < sizeof(order)/sizeof(order[0]); idx++) {
+        if (order[idx] > phase && (config.tests & test_bits[idx]) != 0 && start_phase(order[idx], now_ms)) {
+            return;
+        }
+    }
+    phase = PHASE_IDLE;
+    release();
+}
+
+void rppicomidi::Link_self_test::end_phase(Result_code code, uint32_t now_ms)
+{
+    (void)now_ms;
+    switch (phase) {
+        case PHASE_TCP:
+            results.tcp_result = code;
+            close_tcp();
+            break;
+        case PHASE_UDP:
+            results.udp_result = code;
+            break;
+        case PHASE_RTT:
+            results.rtt_result = code;
+            if (results.rtt_replies != 0) {
+                results.rtt_avg_us = static_cast<uint32_t>(rtt_total_us / results.rtt_replies);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+bool rppicomidi::Link_self_test::start_phase(Phase next, uint32_t now_ms)
+{
+    phase = next;
+    phase_start_ms = now_ms;
+    bool ok = false;
+    driver.lock();
+    if (next == PHASE_TCP) {
+#if LWIP_TCP
+        tcp_connected = false;
+        tcp_failed = false;
+        tcp_acked = 0;
+        tcp_sending = false;
+        tcp = tcp_new();
+        if (tcp != nullptr) {
+            tcp_arg(tcp, this);
+            tcp_err(tcp, static_tcp_err);
+            tcp_sent(tcp, static_tcp_sent);
+            tcp_recv(tcp, static_tcp_recv);
+            ok = tcp_connect(tcp, &config.peer, config.tcp_port, static_tcp_connected) == ERR_OK;
+        }
+#endif
+    }
+    else {
+#if LWIP_UDP
+        if (udp == nullptr) {
+            udp = udp_new();
+            if (udp != nullptr) {
+                udp_recv(udp, static_udp_recv, this);
+                udp_bind(udp, IP_ADDR_ANY, 0);
+            }
+        }
+        ok = udp != nullptr;
+        udp_sent = 0;
+        udp_received = 0;
+        rtt_seq = 0;
+        rtt_outstanding = false;
+        rtt_reply = false;
+        rtt_total_us = 0;
+#endif
+    }
+    driver.unlock();
+    if (driver.observe(ok) == 0) {
+        end_phase(RESULT_NO_RESOURCES, now_ms);
+    }
+    return ok;
+}
+
+bool rppicomidi::Link_self_test::poll_tcp(uint32_t now_ms)
+{
+    bool failed = driver.observe(tcp_failed) != 0;
+    if (!tcp_sending) {
+        if (driver.observe(tcp_connected) != 0) {
+            tcp_sending = true;
+            tcp_start_ms = now_ms;
+        }
+        else if (failed || now_ms - phase_start_ms >= config.timeout_ms) {
+            end_phase(RESULT_NO_PEER, now_ms);
+            return true;
+        }
+        else {
+            return false;
+        }
+    }
+    uint32_t elapsed = now_ms - tcp_start_ms;
+    results.tcp_bytes = driver.observe(tcp_acked);
+    results.tcp_bps = elapsed == 0 ? 0 : static_cast<uint32_t>(static_cast<uint64_t>(results.tcp_bytes) * 8000 / elapsed);
+    if (failed) {
+        end_phase(RESULT_ABORTED, now_ms);
+        return true;
+    }
+    if (elapsed >= config.duration_ms) {
+        end_phase(RESULT_OK, now_ms);
+        return true;
+    }
+    driver.lock();
+    fill_tcp();
+    driver.unlock();
+    return false;
+}
+
+void rppicomidi::Link_self_test::fill_tcp()
+{
+#if LWIP_TCP
+    if (tcp == nullptr || !tcp_sending) {
+        return;
+    }
+    bool queued = false;
+    for (uint16_t space = tcp_sndbuf(tcp); space > 0; space = tcp_sndbuf(tcp)) {
+        uint16_t len = space < sizeof(tcp_chunk) ? space : sizeof(tcp_chunk);
+        if (tcp_write(tcp, tcp_chunk, len, 0) != ERR_OK) {
+            break; // out of queue space; the sent callback will try again
+        }
+        queued = true;
+    }
+    if (queued) {
+        tcp_output(tcp);
+    }
+#endif
+}
+
+void rppicomidi::Link_self_test::close_tcp()
+{
+#if LWIP_TCP
+    tcp_sending = false;
+    // the error callback may free the pcb, so check it with lwIP locked
+    driver.lock();
+    if (tcp != nullptr) {
+        tcp_arg(tcp, nullptr);
+        tcp_err(tcp, nullptr);
+        tcp_sent(tcp, nullptr);
+        tcp_recv(tcp, nullptr);
+        if (tcp_close(tcp) != ERR_OK) {
+            tcp_abort(tcp);
+        }
+        tcp = nullptr;
+    }
+    driver.unlock();
+#endif
+}
+
+bool rppicomidi::Link_self_test::poll_udp(uint32_t now_ms)
+{
+    uint32_t elapsed = now_ms - phase_start_ms;
+    if (elapsed < config.duration_ms) {
+        // send whatever the offered rate says is due by now, in bursts of at most 16
+        uint64_t due = static_cast<uint64_t>(elapsed) * config.udp_rate_bps / (8000ull * config.udp_payload) + 1;
+        driver.lock();
+        for (int burst = 0; burst < 16 && udp_sent < due; burst++) {
+            if (!send_datagram(udp_magic, udp_sent, config.udp_payload)) {
+                break;
+            }
+            ++udp_sent;
+        }
+        driver.unlock();
+        udp_sent = driver.observe(udp_sent);
+        return false;
+    }
+    uint32_t received = driver.observe(udp_received);
+    if (received < udp_sent && elapsed < config.duration_ms + config.timeout_ms) {
+        return false; // wait for stragglers
+    }
+    uint64_t bits_per_datagram = static_cast<uint64_t>(config.udp_payload) * 8000;
+    results.udp_sent = udp_sent;
+    results.udp_received = received;
+    results.udp_sent_bps = static_cast<uint32_t>(udp_sent * bits_per_datagram / config.duration_ms);
+    results.udp_received_bps = static_cast<uint32_t>(received * bits_per_datagram / config.duration_ms);
+    end_phase(received == 0 ? RESULT_NO_PEER : RESULT_OK, now_ms);
+    return true;
+}
+
+bool rppicomidi::Link_self_test::poll_rtt(uint32_t now_ms)
+{
+    if (rtt_outstanding) {
+        if (driver.observe(rtt_reply) != 0) {
+            uint32_t rtt = driver.observe(rtt_us);
+            if (results.rtt_replies == 0 || rtt < results.rtt_min_us) {
+                results.rtt_min_us = rtt;
+            }
+            if (rtt > results.rtt_max_us) {
+                results.rtt_max_us = rtt;
+            }
+            rtt_total_us += rtt;
+            ++results.rtt_replies;
+            rtt_outstanding = false;
+        }
+        else if (now_ms - rtt_sent_ms >= config.timeout_ms) {
+            rtt_outstanding = false; // lost
+        }
+        else {
+            return false;
+        }
+    }
+    if (rtt_seq >= config.rtt_count) {
+        end_phase(results.rtt_replies == 0 ? RESULT_NO_PEER : RESULT_OK, now_ms);
+        return true;
+    }
+    rtt_reply = false;
+    ++rtt_seq;
+    driver.lock();
+    send_datagram(rtt_magic, rtt_seq, datagram_header_len);
+    driver.unlock();
+    // a datagram that could not be sent times out like a lost one
+    rtt_outstanding = true;
+    rtt_sent_ms = now_ms;
+    return false;
+}
+
+bool rppicomidi::Link_self_test::send_datagram(uint32_t magic, uint32_t seq, uint16_t len)
+{
+#if LWIP_UDP
+    if (udp == nullptr) {
+        return false;
+    }
+    struct pbuf* p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+    if (p == nullptr) {
+        return false;
+    }
+    uint8_t* payload = reinterpret_cast<uint8_t*>(p->payload);
+    uint32_t sent_us = driver.timestamp_us();
+    memset(payload, 0, len);
+    memcpy(payload, &magic, sizeof(magic));
+    memcpy(payload + 4, &seq, sizeof(seq));
+    memcpy(payload + 8, &sent_us, sizeof(sent_us));
+    bool result = udp_sendto(udp, p, &config.peer, config.udp_port) == ERR_OK;
+    pbuf_free(p);
+    return result;
+#else
+    (void)magic;
+    (void)seq;
+    (void)len;
+    return false;
+#endif
+}
+
+void rppicomidi::Link_self_test::release()
+{
+    close_tcp();
+#if LWIP_UDP
+    if (udp != nullptr) {
+        driver.lock();
+        udp_remove(udp);
+        driver.unlock();
+        udp = nullptr;
+    }
+#endif
+}
+
+int8_t rppicomidi::Link_self_test::static_tcp_connected(void* arg, struct tcp_pcb*, int8_t err)
+{
+    auto me = reinterpret_cast<Link_self_test*>(arg);
+    if (err == ERR_OK) {
+        me->tcp_connected = true;
+    }
+    else {
+        me->tcp_failed = true;
+    }
+    return ERR_OK;
+}
+
+int8_t rppicomidi::Link_self_test::static_tcp_sent(void* arg, struct tcp_pcb*, uint16_t len)
+{
+    auto me = reinterpret_cast<Link_self_test*>(arg);
+    me->tcp_acked = me->tcp_acked + len;
+    me->fill_tcp(); // already in the lwIP context
+    return ERR_OK;
+}
+
+int8_t rppicomidi::Link_self_test::static_tcp_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, int8_t)
+{
+#if LWIP_TCP
+    auto me = reinterpret_cast<Link_self_test*>(arg);
+    if (p == nullptr) {
+        me->tcp_failed = true; // the peer closed the connection
+        return ERR_OK;
+    }
+    // the sink should not send anything; discard whatever it does send
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+#else
+    (void)arg;
+    (void)pcb;
+    (void)p;
+#endif
+    return ERR_OK;
+}
+
+void rppicomidi::Link_self_test::static_tcp_err(void* arg, int8_t)
+{
+    // lwIP has already freed the pcb
+    auto me = reinterpret_cast<Link_self_test*>(arg);
+    me->tcp = nullptr;
+    me->tcp_failed = true;
+}
+
+void rppicomidi::Link_self_test::static_udp_recv(void* arg, struct udp_pcb*, struct pbuf* p, const ip_addr_t*, uint16_t)
+{
+    auto me = reinterpret_cast<Link_self_test*>(arg);
+    if (p->tot_len >= datagram_header_len) {
+        uint8_t header[datagram_header_len];
+        pbuf_copy_partial(p, header, sizeof(header), 0);
+        uint32_t magic, seq, sent_us;
+        memcpy(&magic, header, sizeof(magic));
+        memcpy(&seq, header + 4, sizeof(seq));
+        memcpy(&sent_us, header + 8, sizeof(sent_us));
+        if (magic == udp_magic && me->phase == PHASE_UDP) {
+            me->udp_received = me->udp_received + 1;
+        }
+        else if (magic == rtt_magic && me->phase == PHASE_RTT && seq == me->rtt_seq && !me->rtt_reply) {
+            me->rtt_us = me->driver.timestamp_us() - sent_us;
+            me->rtt_reply = true;
+        }
+    }
+    pbuf_free(p);
+}
@@ -0,0 +1,191 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstdint>
+#include "lwip/opt.h"
+#include "lwip/ip_addr.h"
+#include "wifi_driver.h"
+
+struct tcp_pcb;
+struct udp_pcb;
+struct pbuf;
+namespace rppicomidi
+{
+/**
+ * @brief Measure what the Wi-Fi link delivers to a peer on the network
+ *
+ * The self-test runs up to three tests one after the other:
+ * - TCP throughput: send as fast as TCP allows to a sink such as
+ * `iperf -s` (port 5001) or a discard server for duration_ms and count
+ * the bytes the peer acknowledged.
+ * - UDP throughput: send datagrams at udp_rate_bps to a UDP echo server
+ * for duration_ms and count the datagrams that come back.
+ * - Round trip time: send rtt_count datagrams one at a time to the same
+ * echo server and time each reply.
+ *
+ * Everything uses the lwIP raw APIs and is driven by calling poll() from
+ * the main loop. The time stamps, the lwIP lock and every outcome an
+ * lwIP callback reports go through the Wi-Fi driver, so a trace of the
+ * driver replays the results.
+ * @note requires LWIP_TCP and LWIP_UDP in the application's lwipopts.h.
+ */
+class Link_self_test
+{
+public:
+    enum Test {
+        TEST_TCP = 1,
+        TEST_UDP = 2,
+        TEST_RTT = 4,
+        TEST_ALL = TEST_TCP | TEST_UDP | TEST_RTT
+    };
+
+    struct Config {
+        ip_addr_t peer;             //!< the address of the peer
+        uint16_t tcp_port;          //!< the peer's TCP sink port
+        uint16_t udp_port;          //!< the peer's UDP echo port
+        uint8_t tests;              //!< the Test values to run ORed together
+        uint32_t duration_ms;       //!< how long each throughput test sends
+        uint16_t udp_payload;       //!< bytes of UDP payload per datagram
+        uint32_t udp_rate_bps;      //!< rate the UDP throughput test offers
+        uint32_t rtt_count;         //!< number of round trips to time
+        uint32_t timeout_ms;        //!< time to wait for a connection or a reply
+    };
+
+    enum Result_code {
+        RESULT_NOT_RUN,     //!< the test was not requested or has not finished
+        RESULT_OK,          //!< the test finished
+        RESULT_NO_RESOURCES,//!< lwIP could not allocate a pcb or pbuf
+        RESULT_NO_PEER,     //!< the peer did not accept a connection or never replied
+        RESULT_ABORTED,     //!< the test was stopped, for example because the link went down
+    };
+
+    struct Results {
+        int rssi;                   //!< the RSSI in dBm when the self-test started
+        Result_code tcp_result;
+        uint32_t tcp_bps;           //!< acknowledged TCP payload rate
+        uint32_t tcp_bytes;         //!< acknowledged TCP payload bytes
+        Result_code udp_result;
+        uint32_t udp_sent;          //!< datagrams sent
+        uint32_t udp_received;      //!< datagrams echoed back
+        uint32_t udp_sent_bps;      //!< rate of UDP payload sent
+        uint32_t udp_received_bps;  //!< rate of UDP payload echoed back
+        Result_code rtt_result;
+        uint32_t rtt_replies;       //!< number of round trips timed
+        uint32_t rtt_min_us;
+        uint32_t rtt_avg_us;
+        uint32_t rtt_max_us;
+    };
+
+    /**
+     * @brief Construct a new self-test
+     *
+     * @param driver_ the driver to lock lwIP and take time stamps through;
+     * it must outlive the self-test
+     */
+    explicit Link_self_test(Wifi_driver& driver_);
+    ~Link_self_test();
+    Link_self_test(Link_self_test const&) = delete;
+    void operator=(Link_self_test const&) = delete;
+
+    /**
+     * @brief Start the self-test
+     *
+     * The results of any previous self-test are discarded.
+     * @param config_ what to test and against which peer
+     * @param rssi the current RSSI in dBm, reported with the results
+     * @param now_ms the current time in milliseconds
+     * @return true if the self-test started, false if config_ requests no
+     * tests or has no peer address
+     */
+    bool start(const Config& config_, int rssi, uint32_t now_ms);
+
+    /**
+     * @brief Stop the self-test and release the lwIP resources
+     *
+     * Any test in progress reports RESULT_ABORTED.
+     */
+    void stop();
+
+    /**
+     * @brief Send data, collect replies and move on to the next test
+     *
+     * Call this periodically while the self-test is running
+     * @param now_ms the current time in milliseconds
+     * @return true if the self-test just finished, false otherwise
+     */
+    bool poll(uint32_t now_ms);
+
+    /**
+     * @brief return true if the self-test is running
+     */
+    bool is_running() const { return phase != PHASE_IDLE; }
+
+    /**
+     * @brief Get the results of the most recent self-test
+     *
+     * Results of tests that have not finished are RESULT_NOT_RUN.
+     */
+    const Results& get_results() const { return results; }
+private:
+    enum Phase {PHASE_IDLE, PHASE_TCP, PHASE_UDP, PHASE_RTT};
+    bool start_phase(Phase next, uint32_t now_ms);
+    void next_phase(uint32_t now_ms);
+    void end_phase(Result_code code, uint32_t now_ms);
+    bool poll_tcp(uint32_t now_ms);
+    bool poll_udp(uint32_t now_ms);
+    bool poll_rtt(uint32_t now_ms);
+    void fill_tcp();
+    void close_tcp();
+    bool send_datagram(uint32_t magic, uint32_t seq, uint16_t len);
+    void release();
+    static int8_t static_tcp_connected(void* arg, struct tcp_pcb* pcb, int8_t err);
+    static int8_t static_tcp_sent(void* arg, struct tcp_pcb* pcb, uint16_t len);
+    static int8_t static_tcp_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, int8_t err);
+    static void static_tcp_err(void* arg, int8_t err);
+    static void static_udp_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, uint16_t port);
+    Wifi_driver& driver;
+    Config config;
+    Results results;
+    Phase phase;
+    uint32_t phase_start_ms;
+    struct tcp_pcb* tcp;
+    struct udp_pcb* udp;
+    volatile bool tcp_connected;
+    volatile bool tcp_failed;
+    volatile uint32_t tcp_acked;
+    bool tcp_sending;
+    uint32_t tcp_start_ms;
+    volatile uint32_t udp_received;
+    uint32_t udp_sent;
+    uint32_t rtt_seq;
+    bool rtt_outstanding;
+    uint32_t rtt_sent_ms;
+    volatile bool rtt_reply;
+    volatile uint32_t rtt_us;
+    uint64_t rtt_total_us;
+    static const uint32_t udp_magic = 0x50575554; // "PWUT"
+    static const uint32_t rtt_magic = 0x50575254; // "PWRT"
+};
+}
@@ -0,0 +1,145 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstdio>
+#include "pico_hal.h"
+#include "littlefs_settings_storage.h"
+
+rppicomidi::Littlefs_settings_storage::~Littlefs_settings_storage()
+{
+    unmount();
+}
+
+void rppicomidi::Littlefs_settings_storage::unmount()
+{
+    if (mounted) {
+        pico_unmount();
+        mounted = false;
+    }
+}
+
+bool rppicomidi::Littlefs_settings_storage::mount(bool format_if_needed)
+{
+    if (mode == APPLICATION_MOUNTED || mounted) {
+        return true;
+    }
+    int error_code = pico_mount(false);
+    if (error_code != LFS_ERR_OK) {
+        if (!format_if_needed) {
+            return false;
+        }
+        error_code = pico_mount(true);
+        if (error_code != LFS_ERR_OK) {
+            return false;
+        }
+    }
+    ++stats.mounts;
+    mounted = true;
+    return true;
+}
+
+void rppicomidi::Littlefs_settings_storage::end_operation()
+{
+    if (mode == MOUNT_PER_OPERATION) {
+        unmount();
+    }
+}
+
+void rppicomidi::Littlefs_settings_storage::get_filename(unsigned slot, char* filename, size_t maxlen)
+{
+    if (slot == PRIMARY_SLOT) {
+        snprintf(filename, maxlen, "%s/wifi_info.json", wifi_info_dir);
+    }
+    else {
+        snprintf(filename, maxlen, "%s/wifi_info.%u.json", wifi_info_dir, slot);
+    }
+}
+
+bool rppicomidi::Littlefs_settings_storage::do_read(unsigned slot, std::string& data)
+{
+    if (!mount(false)) {
+        return false;
+    }
+    char filename[32];
+    get_filename(slot, filename, sizeof(filename));
+    lfs_file_t file;
+    int error_code = lfs_file_open(&file, filename, LFS_O_RDONLY);
+    if (error_code != LFS_ERR_OK) {
+        end_operation();
+        return false;
+    }
+    auto sz = lfs_file_size(&file);
+    if (sz <= 0) {
+        lfs_file_close(&file);
+        end_operation();
+        return false;
+    }
+    data.resize(sz);
+    error_code = lfs_file_read(&file, &data[0], sz);
+    lfs_file_close(&file);
+    end_operation();
+    if (error_code != sz) {
+        data.clear();
+        return false;
+    }
+    return true;
+}
+
+bool rppicomidi::Littlefs_settings_storage::do_write(unsigned slot, const char* data, size_t len)
+{
+    if (!mount(true)) {
+        return false;
+    }
+    lfs_dir_t dir;
+    int error_code = lfs_dir_open(&dir, wifi_info_dir);
+    if (error_code == LFS_ERR_OK) {
+        lfs_dir_close(&dir);
+    }
+    else if (error_code == LFS_ERR_NOENT) {
+        error_code = lfs_mkdir(wifi_info_dir);
+        if (error_code != LFS_ERR_OK) {
+            end_operation();
+            return false;
+        }
+    }
+    else {
+        end_operation();
+        return false;
+    }
+    char filename[32];
+    get_filename(slot, filename, sizeof(filename));
+    lfs_file_t file;
+    error_code = lfs_file_open(&file, filename, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+    if (error_code != LFS_ERR_OK) {
+        end_operation();
+        return false;
+    }
+    error_code = lfs_file_write(&file, data, len);
+    bool result = error_code >= 0 && static_cast<size_t>(error_code) == len;
+    if (lfs_file_close(&file) != LFS_ERR_OK) {
+        result = false;
+    }
+    end_operation();
+    return result;
+}
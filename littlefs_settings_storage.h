@@ -0,0 +1,75 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include "settings_storage.h"
+
+namespace rppicomidi
+{
+/**
+ * @brief Settings storage in files of the littlefs-lib file system
+ *
+ * Slot 0 is /wifi_info/wifi_info.json, the file earlier versions of
+ * this library used. Slot n is /wifi_info/wifi_info.n.json.
+ */
+class Littlefs_settings_storage : public Settings_storage
+{
+public:
+    enum Mount_mode {
+        MOUNT_PER_OPERATION,    //!< mount before and unmount after every read and write
+        KEEP_MOUNTED,           //!< mount on first use and unmount in the destructor
+        APPLICATION_MOUNTED,    //!< the application keeps the file system mounted; never mount or unmount
+    };
+
+    /**
+     * @brief Construct a new Littlefs_settings_storage object
+     *
+     * @param mode_ how to manage the file system mount
+     */
+    Littlefs_settings_storage(Mount_mode mode_ = KEEP_MOUNTED) : mode{mode_}, mounted{false} {}
+    ~Littlefs_settings_storage();
+    Littlefs_settings_storage(Littlefs_settings_storage const&) = delete;
+    void operator=(Littlefs_settings_storage const&) = delete;
+
+    unsigned get_num_slots() const override { return 2; }
+
+    /**
+     * @brief Unmount the file system if this object mounted it
+     *
+     * Call this before the application mounts the file system itself.
+     * The next read or write mounts it again.
+     */
+    void unmount();
+protected:
+    bool do_read(unsigned slot, std::string& data) override;
+    bool do_write(unsigned slot, const char* data, size_t len) override;
+private:
+    bool mount(bool format_if_needed);
+    void end_operation();
+    static void get_filename(unsigned slot, char* filename, size_t maxlen);
+    Mount_mode mode;
+    bool mounted;
+    static constexpr const char* wifi_info_dir{"/wifi_info"};
+};
+}
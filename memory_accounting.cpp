@@ -0,0 +1,149 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstdlib>
+#include <cstring>
+#include "memory_accounting.h"
+#include "hardware/sync.h"
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+#include "parson.h"
+#endif
+
+static rppicomidi::Memory_accounting::Usage usage_table[rppicomidi::MEM_NUM_SUBSYSTEMS];
+
+// Disabling interrupts only keeps out the calling core, so the table is
+// guarded by one of the SDK's shared striped spin locks. Static
+// initialization runs on one core before main().
+static spin_lock_t* const usage_lock = spin_lock_instance(next_striped_spin_lock_num());
+
+static const char* const subsystem_names[rppicomidi::MEM_NUM_SUBSYSTEMS] = {
+    "scan_results",
+    "settings_io",
+    "credential_store",
+    "strings",
+};
+
+void rppicomidi::Memory_accounting::record(Memory_subsystem subsystem, size_t bytes, bool allocate)
+{
+    if (subsystem >= MEM_NUM_SUBSYSTEMS) {
+        return;
+    }
+    uint32_t status = spin_lock_blocking(usage_lock);
+    Usage& usage = usage_table[subsystem];
+    if (allocate) {
+        usage.current_bytes += bytes;
+        ++usage.allocations;
+        if (usage.current_bytes > usage.peak_bytes) {
+            usage.peak_bytes = usage.current_bytes;
+        }
+    }
+    else {
+        usage.current_bytes = usage.current_bytes > bytes ? usage.current_bytes - bytes : 0;
+        ++usage.frees;
+    }
+    spin_unlock(usage_lock, status);
+}
+
+void rppicomidi::Memory_accounting::set_measured(Memory_subsystem subsystem, size_t bytes, size_t blocks)
+{
+    if (!PICO_W_CM_ENABLE_MEMORY_ACCOUNTING || subsystem >= MEM_NUM_SUBSYSTEMS) {
+        return;
+    }
+    uint32_t status = spin_lock_blocking(usage_lock);
+    Usage& usage = usage_table[subsystem];
+    usage.current_bytes = bytes;
+    usage.allocations = blocks;
+    usage.frees = 0;
+    if (usage.current_bytes > usage.peak_bytes) {
+        usage.peak_bytes = usage.current_bytes;
+    }
+    spin_unlock(usage_lock, status);
+}
+
+bool rppicomidi::Memory_accounting::get_usage(Memory_subsystem subsystem, Usage& usage)
+{
+    if (!PICO_W_CM_ENABLE_MEMORY_ACCOUNTING || subsystem >= MEM_NUM_SUBSYSTEMS) {
+        return false;
+    }
+    uint32_t status = spin_lock_blocking(usage_lock);
+    usage = usage_table[subsystem];
+    spin_unlock(usage_lock, status);
+    return true;
+}
+
+void rppicomidi::Memory_accounting::reset_peaks()
+{
+    uint32_t status = spin_lock_blocking(usage_lock);
+    for (auto& usage: usage_table) {
+        usage.peak_bytes = usage.current_bytes;
+    }
+    spin_unlock(usage_lock, status);
+}
+
+const char* rppicomidi::Memory_accounting::get_name(Memory_subsystem subsystem)
+{
+    return subsystem < MEM_NUM_SUBSYSTEMS ? subsystem_names[subsystem] : "unknown";
+}
+
+size_t rppicomidi::Memory_accounting::string_heap_bytes(const std::string& str)
+{
+    static const size_t small_capacity = std::string().capacity();
+    return str.capacity() > small_capacity ? str.capacity() + 1 : 0;
+}
+
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+// Each block starts with its size so the free hook knows how much to subtract.
+// The header is a full alignment unit so the caller's data stays aligned.
+static const size_t json_header_len = alignof(max_align_t);
+
+static void* tracked_json_malloc(size_t size)
+{
+    auto block = static_cast<uint8_t*>(malloc(size + json_header_len));
+    if (block == nullptr) {
+        return nullptr;
+    }
+    memcpy(block, &size, sizeof(size));
+    rppicomidi::Memory_accounting::allocated(rppicomidi::MEM_SETTINGS_IO, size);
+    return block + json_header_len;
+}
+
+static void tracked_json_free(void* ptr)
+{
+    if (ptr == nullptr) {
+        return;
+    }
+    auto block = static_cast<uint8_t*>(ptr) - json_header_len;
+    size_t size;
+    memcpy(&size, block, sizeof(size));
+    rppicomidi::Memory_accounting::freed(rppicomidi::MEM_SETTINGS_IO, size);
+    free(block);
+}
+#endif
+
+void rppicomidi::Memory_accounting::install_parson_hooks()
+{
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE && PICO_W_CM_ENABLE_MEMORY_ACCOUNTING
+    json_set_allocation_functions(tracked_json_malloc, tracked_json_free);
+#endif
+}
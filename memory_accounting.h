@@ -0,0 +1,197 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include "pico_w_connection_manager_config.h"
+
+namespace rppicomidi
+{
+/**
+ * @brief The parts of the connection manager whose heap use is accounted
+ */
+enum Memory_subsystem {
+    MEM_SCAN_RESULTS,       //!< the discovered SSID list
+    MEM_SETTINGS_IO,        //!< the parson DOM, serialized JSON and read buffers
+    MEM_CREDENTIAL_STORE,   //!< the known network list and its indexes
+    MEM_STRINGS,            //!< SSID and passphrase characters that do not fit in a std::string
+    MEM_NUM_SUBSYSTEMS
+};
+
+/**
+ * @brief Count the heap bytes each subsystem holds
+ *
+ * If PICO_W_CM_ENABLE_MEMORY_ACCOUNTING is 0, the recording functions do
+ * nothing and get_usage() returns false.
+ *
+ * The counters are shared by all connection manager objects and may be
+ * updated from the Wi-Fi driver's scan callback or from the other core,
+ * so updates hold a hardware spin lock with interrupts disabled.
+ */
+class Memory_accounting
+{
+public:
+    struct Usage {
+        uint32_t current_bytes;     //!< bytes held now
+        uint32_t peak_bytes;        //!< most bytes held since boot or reset_peaks()
+        uint32_t allocations;       //!< number of allocations
+        uint32_t frees;             //!< number of frees
+    };
+
+    /**
+     * @brief Record that subsystem allocated bytes
+     */
+    static void allocated(Memory_subsystem subsystem, size_t bytes)
+    {
+        if (PICO_W_CM_ENABLE_MEMORY_ACCOUNTING && bytes != 0) {
+            record(subsystem, bytes, true);
+        }
+    }
+
+    /**
+     * @brief Record that subsystem freed bytes
+     */
+    static void freed(Memory_subsystem subsystem, size_t bytes)
+    {
+        if (PICO_W_CM_ENABLE_MEMORY_ACCOUNTING && bytes != 0) {
+            record(subsystem, bytes, false);
+        }
+    }
+
+    /**
+     * @brief Record that a container's storage moved from a block of
+     * old_bytes to a block of new_bytes
+     *
+     * Use this for containers whose type is part of the public API and
+     * so cannot use Tracking_allocator; compare capacity() before and
+     * after each operation that can grow the container.
+     */
+    static void reallocated(Memory_subsystem subsystem, size_t old_bytes, size_t new_bytes)
+    {
+        if (old_bytes != new_bytes) {
+            freed(subsystem, old_bytes);
+            allocated(subsystem, new_bytes);
+        }
+    }
+
+    /**
+     * @brief Replace the current byte count of a subsystem that is
+     * measured instead of tracked
+     *
+     * @param subsystem the subsystem
+     * @param bytes the bytes held now
+     * @param blocks the number of heap blocks held now
+     */
+    static void set_measured(Memory_subsystem subsystem, size_t bytes, size_t blocks);
+
+    /**
+     * @brief Get the usage of one subsystem
+     *
+     * @param subsystem the subsystem
+     * @param usage receives the usage
+     * @return true if successful, false if accounting is compiled out or
+     * subsystem is out of range
+     */
+    static bool get_usage(Memory_subsystem subsystem, Usage& usage);
+
+    /**
+     * @brief Set every subsystem's peak to its current byte count
+     */
+    static void reset_peaks();
+
+    /**
+     * @brief Get the name of a subsystem, e.g., for a report
+     */
+    static const char* get_name(Memory_subsystem subsystem);
+
+    /**
+     * @brief Get the heap bytes a string holds beyond its own object
+     *
+     * @return the capacity plus the terminator, or 0 if the characters
+     * fit in the small string buffer
+     */
+    static size_t string_heap_bytes(const std::string& str);
+
+    /**
+     * @brief Route parson's allocations through the accounting so the
+     * JSON DOM counts against MEM_SETTINGS_IO
+     *
+     * The connection manager does not call this. Parson's allocation
+     * functions are global and parson cannot report the ones they
+     * replace, so the application must opt in by calling this once,
+     * before anything creates a parson value, and must not call
+     * json_set_allocation_functions() afterwards. A value allocated
+     * before the call would be freed through the accounting and corrupt
+     * the heap. Any JSON the application itself builds with parson is
+     * counted too. Does nothing unless both memory accounting and
+     * settings storage are compiled in.
+     */
+    static void install_parson_hooks();
+private:
+    static void record(Memory_subsystem subsystem, size_t bytes, bool allocate);
+};
+
+/**
+ * @brief A standard library allocator that records its allocations
+ * against a subsystem
+ */
+template <typename T, Memory_subsystem S>
+class Tracking_allocator
+{
+public:
+    typedef T value_type;
+    template <typename U> struct rebind { typedef Tracking_allocator<U, S> other; };
+
+    Tracking_allocator() noexcept = default;
+    template <typename U> Tracking_allocator(const Tracking_allocator<U, S>&) noexcept {}
+
+    T* allocate(size_t n)
+    {
+        T* ptr = std::allocator<T>().allocate(n);
+        Memory_accounting::allocated(S, n * sizeof(T));
+        return ptr;
+    }
+
+    void deallocate(T* ptr, size_t n) noexcept
+    {
+        Memory_accounting::freed(S, n * sizeof(T));
+        std::allocator<T>().deallocate(ptr, n);
+    }
+
+    template <typename U> bool operator==(const Tracking_allocator<U, S>&) const noexcept { return true; }
+    template <typename U> bool operator!=(const Tracking_allocator<U, S>&) const noexcept { return false; }
+};
+
+/**
+ * @brief Tracking_allocator if memory accounting is compiled in,
+ * std::allocator otherwise
+ */
+template <typename T, Memory_subsystem S>
+using Accounted_allocator = typename std::conditional<PICO_W_CM_ENABLE_MEMORY_ACCOUNTING,
+    Tracking_allocator<T, S>, std::allocator<T>>::type;
+}
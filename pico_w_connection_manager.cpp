@@ -29,119 +29,182 @@
 #undef NDEBUG
 #endif
 #include <algorithm>
+#include <climits>
 #include <cstring>
+#include <unordered_set>
 #include "pico_w_connection_manager.h"
+#include "settings_record.h"
 #include "pico/stdlib.h"
 #include "pico/stdio.h"
 #include "pico/assert.h"
-rppicomidi::Pico_w_connection_manager::Pico_w_connection_manager() :
+#include "cyw43_country.h"
+#if PICO_W_CM_ENABLE_LATENCY_MONITOR
+#define LATENCY_SCOPE(call) Latency_scope latency_scope{*this, Call_latency_monitor::call}
+#else
+#define LATENCY_SCOPE(call)
+#endif
+static const struct {
+    uint32_t code;
+    const char* name;
+} country_table[] = {
+    {CYW43_COUNTRY_WORLDWIDE, "Worldwide"},
+#if PICO_W_CM_ENABLE_COUNTRY_TABLE
+    {CYW43_COUNTRY_AUSTRALIA, "Australia"},
+    {CYW43_COUNTRY_BELGIUM, "Belgium"},
+    {CYW43_COUNTRY_BRAZIL, "Brazil"},
+    {CYW43_COUNTRY_CANADA, "Canada"},
+    {CYW43_COUNTRY_CHILE, "Chile"},
+    {CYW43_COUNTRY_CHINA, "China"},
+    {CYW43_COUNTRY_COLOMBIA, "Columbia"},
+    {CYW43_COUNTRY_CZECH_REPUBLIC, "Czech Republic"},
+    {CYW43_COUNTRY_DENMARK, "Denmark"},
+    {CYW43_COUNTRY_ESTONIA, "Estonia"},
+    {CYW43_COUNTRY_FINLAND, "Finland"},
+    {CYW43_COUNTRY_FRANCE, "France"},
+    {CYW43_COUNTRY_GERMANY, "Germany"},
+    {CYW43_COUNTRY_GREECE, "Greece"},
+    {CYW43_COUNTRY_HONG_KONG, "Honk Kong"},
+    {CYW43_COUNTRY_HUNGARY, "Hungary"},
+    {CYW43_COUNTRY_ICELAND, "Iceland"},
+    {CYW43_COUNTRY_INDIA, "India"},
+    {CYW43_COUNTRY_ISRAEL, "Israel"},
+    {CYW43_COUNTRY_ITALY, "Italy"},
+    {CYW43_COUNTRY_JAPAN, "Japan"},
+    {CYW43_COUNTRY_KENYA, "Kenya"},
+    {CYW43_COUNTRY_LATVIA, "Latvia"},
+    {CYW43_COUNTRY_LIECHTENSTEIN, "Liechtenstein"},
+    {CYW43_COUNTRY_LITHUANIA, "Lithuania"},
+    {CYW43_COUNTRY_LUXEMBOURG, "Luxembourg"},
+    {CYW43_COUNTRY_MALAYSIA, "Malaysia"},
+    {CYW43_COUNTRY_MALTA, "Malta"},
+    {CYW43_COUNTRY_MEXICO, "Mexico"},
+    {CYW43_COUNTRY_NETHERLANDS, "Netherlands"},
+    {CYW43_COUNTRY_NEW_ZEALAND, "New Zealand"},
+    {CYW43_COUNTRY_NIGERIA, "Nigeria"},
+    {CYW43_COUNTRY_NORWAY, "Norway"},
+    {CYW43_COUNTRY_PERU, "Peru"},
+    {CYW43_COUNTRY_PHILIPPINES, "Philippines"},
+    {CYW43_COUNTRY_POLAND, "Poland"},
+    {CYW43_COUNTRY_PORTUGAL, "Portugal"},
+    {CYW43_COUNTRY_SINGAPORE, "Singapore"},
+    {CYW43_COUNTRY_SLOVAKIA, "Slovakia"},
+    {CYW43_COUNTRY_SLOVENIA, "Slovenia"},
+    {CYW43_COUNTRY_SOUTH_AFRICA, "South Africa"},
+    {CYW43_COUNTRY_SOUTH_KOREA, "South Korea"},
+    {CYW43_COUNTRY_SPAIN, "Spain"},
+    {CYW43_COUNTRY_SWEDEN, "Sweden"},
+    {CYW43_COUNTRY_SWITZERLAND, "Switzerland"},
+    {CYW43_COUNTRY_TAIWAN, "Taiwan"},
+    {CYW43_COUNTRY_THAILAND, "Thailand"},
+    {CYW43_COUNTRY_TURKEY, "Turkey"},
+    {CYW43_COUNTRY_UK, "UK"},
+    {CYW43_COUNTRY_USA, "USA"},
+#endif
+};
+
+rppicomidi::Pico_w_connection_manager::Pico_w_connection_manager(Settings_storage* storage_, Wifi_driver* driver_) :
+    driver{driver_ != nullptr ? driver_ : &default_driver},
     country_code{CYW43_COUNTRY_WORLDWIDE}, state{DEINITIALIZED}, 
-    scan_test{nil_time}, link_up_callback{nullptr,0},
+    scan_holdoff{false}, scan_holdoff_start_ms{0},
+#if PICO_W_CM_ENABLE_SCAN
+    scan_complete_ms{0}, bssid_choice_allowed{false}, bssid_chosen{false},
+#endif
+#if PICO_W_CM_ENABLE_CALLBACKS
+    link_up_callback{nullptr,0},
     link_down_callback{nullptr,0},
     link_error_callback{nullptr,0},
     scan_complete_callback{nullptr, 0},
-    settings_saved_state{UNKNOWN}
-{
-    countries.insert({CYW43_COUNTRY_WORLDWIDE, "Worldwide"});
-    countries.insert({CYW43_COUNTRY_AUSTRALIA, "Australia"});
-    countries.insert({CYW43_COUNTRY_BELGIUM, "Belgium"});
-    countries.insert({CYW43_COUNTRY_BRAZIL, "Brazil"});
-    countries.insert({CYW43_COUNTRY_CANADA, "Canada"});
-    countries.insert({CYW43_COUNTRY_CHILE, "Chile"});
-    countries.insert({CYW43_COUNTRY_CHINA, "China"});
-    countries.insert({CYW43_COUNTRY_COLOMBIA, "Columbia"});
-    countries.insert({CYW43_COUNTRY_CZECH_REPUBLIC, "Czech Republic"});
-    countries.insert({CYW43_COUNTRY_DENMARK, "Denmark"});
-    countries.insert({CYW43_COUNTRY_ESTONIA, "Estonia"});
-    countries.insert({CYW43_COUNTRY_FINLAND, "Finland"});
-    countries.insert({CYW43_COUNTRY_FRANCE, "France"});
-    countries.insert({CYW43_COUNTRY_GERMANY, "Germany"});
-    countries.insert({CYW43_COUNTRY_GREECE, "Greece" });
-    countries.insert({CYW43_COUNTRY_HONG_KONG, "Honk Kong"});
-    countries.insert({CYW43_COUNTRY_HUNGARY, "Hungary"});
-    countries.insert({CYW43_COUNTRY_ICELAND, "Iceland"});
-    countries.insert({CYW43_COUNTRY_INDIA, "India"});
-    countries.insert({CYW43_COUNTRY_ISRAEL, "Israel"});
-    countries.insert({CYW43_COUNTRY_ITALY, "Italy"});
-    countries.insert({CYW43_COUNTRY_JAPAN, "Japan"});
-    countries.insert({CYW43_COUNTRY_KENYA, "Kenya"});
-    countries.insert({CYW43_COUNTRY_LATVIA, "Latvia" });
-    countries.insert({CYW43_COUNTRY_LIECHTENSTEIN, "Liechtenstein"});
-    countries.insert({CYW43_COUNTRY_LITHUANIA, "Lithuania"});
-    countries.insert({CYW43_COUNTRY_LUXEMBOURG, "Luxembourg"});
-    countries.insert({CYW43_COUNTRY_MALAYSIA, "Malaysia"});
-    countries.insert({CYW43_COUNTRY_MALTA, "Malta"});
-    countries.insert({CYW43_COUNTRY_MEXICO, "Mexico"});
-    countries.insert({CYW43_COUNTRY_NETHERLANDS, "Netherlands"});
-    countries.insert({CYW43_COUNTRY_NEW_ZEALAND, "New Zealand"});
-    countries.insert({CYW43_COUNTRY_NIGERIA, "Nigeria"});
-    countries.insert({CYW43_COUNTRY_NORWAY, "Norway"});
-    countries.insert({CYW43_COUNTRY_PERU, "Peru"});
-    countries.insert({CYW43_COUNTRY_PHILIPPINES, "Philippines"});
-    countries.insert({CYW43_COUNTRY_POLAND, "Poland"});
-    countries.insert({CYW43_COUNTRY_PORTUGAL, "Portugal"});
-    countries.insert({CYW43_COUNTRY_SINGAPORE, "Singapore"});
-    countries.insert({CYW43_COUNTRY_SLOVAKIA, "Slovakia"});
-    countries.insert({CYW43_COUNTRY_SLOVENIA, "Slovenia"});
-    countries.insert({CYW43_COUNTRY_SOUTH_AFRICA, "South Africa"});
-    countries.insert({CYW43_COUNTRY_SOUTH_KOREA, "South Korea"});
-    countries.insert({CYW43_COUNTRY_SPAIN, "Spain"});
-    countries.insert({CYW43_COUNTRY_SWEDEN, "Sweden"});
-    countries.insert({CYW43_COUNTRY_SWITZERLAND, "Switzerland"});
-    countries.insert({CYW43_COUNTRY_TAIWAN, "Taiwan"});
-    countries.insert({CYW43_COUNTRY_THAILAND, "Thailand"});
-    countries.insert({CYW43_COUNTRY_TURKEY, "Turkey"});
-    countries.insert({CYW43_COUNTRY_UK, "UK"});
-    countries.insert({CYW43_COUNTRY_USA, "USA"});
-    current_ssid.security = 0;
-    // Attempt to load settings; if it fails, save defaults
+#endif
+    settings_saved_state{UNKNOWN}, last_link_error{""}, health_checker{*driver},
+#if PICO_W_CM_ENABLE_SELF_TEST
+    self_test{*driver},
+#endif
+#if PICO_W_CM_ENABLE_DNS_CACHE
+    dns_cache{*driver}, dns_save_pending{false}, dns_saved{false}, dns_saved_ms{0},
+#endif
+    rssi_refresh_ms{0},
+    link_up_since_ms{0}, closed_link_uptime_ms{0}, restart_step{RESTART_NONE}, restart_after{AFTER_RESTART_NONE},
+    log_drain_per_task{PICO_W_CM_LOG_DRAIN_PER_TASK}
+{
+#if PICO_W_CM_ENABLE_LATENCY_MONITOR
+    restart_budget_us = 0;
+#endif
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+    storage = storage_ != nullptr ? storage_ : &default_storage;
+    settings_slot = 1;  // the first save goes to slot 0
+    settings_generation = 0;
+#else
+    (void)storage_;
+#endif
+    Wifi_event_log::instance().set_clock(driver);
+    memset(&current_status, 0, sizeof(current_status));
+    current_status.rssi = INT_MIN;
+    current_ssid.ssid = PICO_W_CM_DEFAULT_SSID;
+    current_ssid.passphrase = PICO_W_CM_DEFAULT_PASSPHRASE;
+    current_ssid.security = PICO_W_CM_DEFAULT_SECURITY;
+    current_ssid.power_profile = Wifi_power_governor::BALANCED;
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+    // Attempt to load settings; if the storage is empty, save defaults
     // It is important to have settings consistent with internal
-    // data structures.
-    if (!load_settings()) {
-        assert(save_settings());
+    // data structures. Settings that are present but did not load are
+    // left alone; they may be recoverable, and the next save goes to the
+    // other slot.
+    bool found;
+    if (!load_settings(found) && !found) {
+        save_settings();
     }
+#endif
+    publish_status();
 }
 
-void rppicomidi::Pico_w_connection_manager::Ssid_info::serialize(JSON_Object *ssid_object)
+rppicomidi::Pico_w_connection_manager::~Pico_w_connection_manager()
 {
-    json_object_set_string(ssid_object, "ssid", ssid.c_str());
-    json_object_set_string(ssid_object, "pw", passphrase.c_str());
-    json_object_set_number(ssid_object, "auth", security);
+    Memory_accounting::freed(MEM_SCAN_RESULTS, discovered_ssids.capacity() * sizeof(Wifi_driver::Scan_result));
+    Wifi_event_log::instance().clear_clock(driver);
 }
 
-bool rppicomidi::Pico_w_connection_manager::Ssid_info::deserialize(JSON_Object* root_object)
+bool rppicomidi::Pico_w_connection_manager::get_memory_usage(Memory_subsystem subsystem, Memory_accounting::Usage& usage)
 {
-    const char* ptr = json_object_get_string(root_object, "ssid");
-    if (ptr != nullptr) {
-        ssid = std::string(ptr);
-        ptr = json_object_get_string(root_object, "pw");
-        if (ptr != nullptr) {
-            passphrase = std::string(ptr);
-            JSON_Value* val = json_object_get_value(root_object, "auth");
-            if (json_value_get_type(val) == JSONNumber) {
-                security = json_value_get_number(val);
-                return true;
+    if (subsystem == MEM_STRINGS) {
+        size_t blocks;
+        size_t bytes = known_ssids.get_string_heap_bytes(blocks);
+        for (const std::string* str: {&current_ssid.ssid, &current_ssid.passphrase}) {
+            size_t nbytes = Memory_accounting::string_heap_bytes(*str);
+            if (nbytes != 0) {
+                bytes += nbytes;
+                ++blocks;
             }
         }
+        Memory_accounting::set_measured(MEM_STRINGS, bytes, blocks);
     }
-    return false;
+    return Memory_accounting::get_usage(subsystem, usage);
 }
 
 void rppicomidi::Pico_w_connection_manager::get_country_code(std::string& code_)
 {
-    uint32_t icode = (state != DEINITIALIZED) ? cyw43_arch_get_country_code() : country_code;
+    uint32_t icode = (state != DEINITIALIZED) ? driver->get_country_code() : country_code;
     char code_str[3] = {static_cast<char>(icode & 0xff),
         static_cast<char>((icode >> 8) & 0xff),
         '\0'};
     code_ = std::string(code_str);
 }
 
+const char* rppicomidi::Pico_w_connection_manager::find_country(uint32_t icode)
+{
+    for (auto& country: country_table) {
+        if (country.code == icode) {
+            return country.name;
+        }
+    }
+    return nullptr;
+}
+
 bool rppicomidi::Pico_w_connection_manager::get_country_from_code(const std::string& code_, std::string& country_)
 {
     bool result = false;
-    auto it = countries.find(CYW43_COUNTRY(code_.c_str()[0], code_.c_str()[1], 0));
-    if (it != countries.end()) {
-        country_ = it->second;
+    const char* name = find_country(CYW43_COUNTRY(code_.c_str()[0], code_.c_str()[1], 0));
+    if (name != nullptr) {
+        country_ = std::string(name);
         result = true;
     }
     return result;
@@ -149,33 +212,29 @@ bool rppicomidi::Pico_w_connection_manager::get_country_from_code(const std::str
 
 const char* rppicomidi::Pico_w_connection_manager::get_country_from_code(const std::string&code_)
 {
-    const char* result = nullptr;
-    int32_t icode = CYW43_COUNTRY(code_.c_str()[0], code_.c_str()[1], 0);
-    auto it = countries.find(icode);
-
-    if (it != countries.end()) {
-        result = it->second.c_str();
-    }
-    return result;
+    return find_country(CYW43_COUNTRY(code_.c_str()[0], code_.c_str()[1], 0));
 }
 
 void rppicomidi::Pico_w_connection_manager::get_all_country_codes(std::vector<std::string>& all_codes_)
 {
     char code[3]={'X', 'X', '\0'};
-    for(auto& country: countries) {
-        code[0] = country.first & 0xff;
-        code[1] = (country.first >> 8) & 0xff;
-        all_codes_.push_back(country.second + ":" + std::string(code));
+    for(auto& country: country_table) {
+        code[0] = country.code & 0xff;
+        code[1] = (country.code >> 8) & 0xff;
+        all_codes_.push_back(std::string(country.name) + ":" + std::string(code));
     }
     std::sort(all_codes_.begin(), all_codes_.end());
 }
 
 bool rppicomidi::Pico_w_connection_manager::initialize()
 {
+    LATENCY_SCOPE(CALL_INITIALIZE);
     if (state == DEINITIALIZED) {
-        if (cyw43_arch_init_with_country(country_code) == 0) {
-            state = INITIALIZED;
-            cyw43_arch_enable_sta_mode();
+        if (driver->init(country_code) == 0) {
+            set_state(INITIALIZED);
+            driver->enable_sta_mode();
+            // the driver starts in its default power management mode
+            power_governor.set_active(Wifi_power_governor::BALANCED, now_ms());
         }
     }
     return state != DEINITIALIZED;
@@ -183,50 +242,132 @@ bool rppicomidi::Pico_w_connection_manager::initialize()
 
 bool rppicomidi::Pico_w_connection_manager::deinitialize()
 {
+    LATENCY_SCOPE(CALL_DEINITIALIZE);
+    restart_step = RESTART_NONE;
     if (state != DEINITIALIZED) {
-        cyw43_arch_deinit();
-        state = DEINITIALIZED;
+        health_checker.stop();
+#if PICO_W_CM_ENABLE_SELF_TEST
+        self_test.stop();
+#endif
+#if PICO_W_CM_ENABLE_DNS_CACHE
+        dns_cache.link_down();
+#endif
+        driver->deinit();
+        set_state(DEINITIALIZED);
+        power_governor.stop_accounting(now_ms());
     }
     return true;
 }
 
-int rppicomidi::Pico_w_connection_manager::static_scan_result(void *env, const cyw43_ev_scan_result_t *result)
+#if PICO_W_CM_ENABLE_SCAN
+int rppicomidi::Pico_w_connection_manager::static_scan_result(void *env, const Wifi_driver::Scan_result *result)
 {
+    // This runs in the driver's interrupt context: only record the result.
+    // task() builds the channel survey and the scan view from the records
+    // when the scan completes.
     auto me = reinterpret_cast<Pico_w_connection_manager*>(env);
     if (result) {
-        for(auto it: me->discovered_ssids) {
+        for(const auto& it: me->discovered_ssids) {
             if (it.bssid[0] == result->bssid[0] && it.bssid[1] == result->bssid[1] && it.bssid[2] == result->bssid[2] &&
                 it.bssid[3] == result->bssid[3] && it.bssid[4] == result->bssid[4] && it.bssid[5] == result->bssid[5])
                 return 0; // already in the list
         }
         // otherwise, it's new. Add it to the list
+        size_t old_capacity = me->discovered_ssids.capacity();
         me->discovered_ssids.push_back(*result);
+        Memory_accounting::reallocated(MEM_SCAN_RESULTS, old_capacity * sizeof(*result),
+            me->discovered_ssids.capacity() * sizeof(*result));
     }
     return 0;
 }
 
 bool rppicomidi::Pico_w_connection_manager::start_scan()
 {
-    if (state == SCAN_REQUESTED || state == SCANNING)
+    LATENCY_SCOPE(CALL_START_SCAN);
+    if (is_restart_pending()) {
+        restart_after = AFTER_RESTART_SCAN;
+    }
+    else if (state == SCAN_REQUESTED || state == SCANNING)
         return false;
     else if (state == DEINITIALIZED) {
-        initialize();
+        restart_radio(AFTER_RESTART_SCAN);
     }
     else if (state == CONNECTED) {
         disconnect();
-        deinitialize();
-        initialize();
+        restart_radio(AFTER_RESTART_SCAN);
     }
     else if (state == CONNECTION_REQUESTED) {
-        deinitialize();
-        initialize();
+        restart_radio(AFTER_RESTART_SCAN);
     }
     // nothing to do for SCAN_COMPLETE or INITIALIZED
     discovered_ssids.clear();
-    state = SCAN_REQUESTED;
+    scan_view.clear();
+    bssid_choice_allowed = false;
+    if (!is_restart_pending()) {
+        set_state(SCAN_REQUESTED);
+    }
     return true;
 }
 
+void rppicomidi::Pico_w_connection_manager::update_scan_view()
+{
+    scan_view.clear();
+    for (const auto& result: discovered_ssids) {
+        scan_view.add(result.ssid, result.ssid_len, result.bssid, result.rssi, static_cast<uint8_t>(result.channel),
+            result.auth_mode, false);
+    }
+    update_scan_view_known();
+}
+
+void rppicomidi::Pico_w_connection_manager::update_channel_survey()
+{
+    channel_survey.begin_scan();
+    for (const auto& result: discovered_ssids) {
+        channel_survey.add_bssid(static_cast<uint8_t>(result.channel), result.rssi);
+    }
+    channel_survey.end_scan(now_ms());
+}
+
+const rppicomidi::Wifi_driver::Scan_result* rppicomidi::Pico_w_connection_manager::select_bssid()
+{
+    // Stale or partial results could pin the join to a BSSID that is gone
+    if (!bssid_choice_allowed || now_ms() - scan_complete_ms >= PICO_W_CM_SCAN_RESULT_MAX_AGE_MS) {
+        return nullptr;
+    }
+    std::vector<const Wifi_driver::Scan_result*> matches;
+    std::vector<Channel_survey::Candidate> candidates;
+    for (const auto& result: discovered_ssids) {
+        if (result.ssid_len == current_ssid.ssid.size() &&
+                memcmp(result.ssid, current_ssid.ssid.c_str(), result.ssid_len) == 0) {
+            matches.push_back(&result);
+            candidates.push_back({static_cast<uint8_t>(result.channel), result.rssi});
+        }
+    }
+    // Let the driver choose if there is nothing to choose between
+    if (matches.size() < 2) {
+        return nullptr;
+    }
+    int idx = channel_survey.select(candidates.data(), candidates.size());
+    return idx < 0 ? nullptr : matches[idx];
+}
+#endif
+
+void rppicomidi::Pico_w_connection_manager::update_scan_view_known()
+{
+#if PICO_W_CM_ENABLE_SCAN
+    scan_view.refresh_known([this](const std::string& ssid) {
+        return known_ssids.find(ssid) != Known_network_store::INVALID_HANDLE;
+    });
+#endif
+}
+
+#if !PICO_W_CM_ENABLE_SCAN
+bool rppicomidi::Pico_w_connection_manager::start_scan()
+{
+    return false;
+}
+#endif
+
 bool rppicomidi::Pico_w_connection_manager::set_country_code(const std::string& code_)
 {
     bool result = false;
@@ -234,55 +375,29 @@ bool rppicomidi::Pico_w_connection_manager::set_country_code(const std::string&
         char c0 = std::toupper(code_.c_str()[0]);
         char c1 = std::toupper(code_.c_str()[1]);
         int32_t icode = CYW43_COUNTRY(c0, c1, 0);
-        auto it = countries.find(icode);
-        if (it != countries.end()) {
+        const char* name = find_country(icode);
+#if !PICO_W_CM_ENABLE_COUNTRY_TABLE
+        if (name == nullptr && std::isalpha(c0) && std::isalpha(c1)) {
+            name = "";
+        }
+#endif
+        if (name != nullptr) {
             country_code = icode;
             result = true;
-            printf("new country code %s=%s\r\n", code_.c_str(), it->second.c_str());
+            PICO_W_CM_LOG_INFO(COUNTRY_CODE_SET, c0, c1, name);
         }
         else {
-            std::string oldcode;
-            get_country_code(oldcode);
-            printf("invalid country code %s; using previous code %s=%s\r\n", code_.c_str(),
-                oldcode.c_str(), countries.at(country_code).c_str());
+            PICO_W_CM_LOG_WARN(COUNTRY_CODE_INVALID, c0, c1, static_cast<char>(country_code & 0xff),
+                static_cast<char>((country_code >> 8) & 0xff));
         }
     }
     return result;
 }
 
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
 bool rppicomidi::Pico_w_connection_manager::save_settings()
 {
-    int error_code = pico_mount(false);
-    if (error_code != LFS_ERR_OK) {
-        error_code = pico_mount(true);
-        if (error_code != LFS_ERR_OK) {
-            return false;
-        }
-    }
-    lfs_dir_t dir;
-    error_code = lfs_dir_open(&dir, wifi_info_dir);
-    if (error_code == LFS_ERR_OK) {
-        lfs_dir_close(&dir);
-    }
-    else if (error_code == LFS_ERR_NOENT) {
-        error_code = lfs_mkdir(wifi_info_dir);
-        if (error_code != LFS_ERR_OK) {
-            pico_unmount();
-            return false;
-        }
-    }
-    else {
-        pico_unmount();
-        return false;
-    }
-    lfs_file_t file;
-    error_code = lfs_file_open(&file, wifi_info_file, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
-    if (error_code != LFS_ERR_OK) {
-        pico_unmount();
-        return false;
-    }
-    // file is open for writing.
-
+    LATENCY_SCOPE(CALL_SAVE_SETTINGS);
     // Serialize the data to json
     JSON_Value *root_value = json_value_init_object();
     JSON_Object *root_object = json_value_get_object(root_value);
@@ -298,57 +413,95 @@ bool rppicomidi::Pico_w_connection_manager::save_settings()
     JSON_Value* known_array_value = json_value_init_array();
     JSON_Array* known_array = json_value_get_array(known_array_value);
 
-    for (auto known: known_ssids) {
-        ssid_value = json_value_init_object();
-        ssid_object = json_value_get_object(ssid_value);
-        known.serialize(ssid_object);
-        json_array_append_value(known_array, ssid_value);
-    }
+    known_ssids.serialize(known_array);
     json_object_set_value(root_object, "known_ssids", known_array_value);
+#if PICO_W_CM_ENABLE_DNS_CACHE
+    // keep the addresses of known networks only
+    dns_cache.retain_networks([this](const std::string& ssid) {
+        return ssid == current_ssid.ssid || known_ssids.find(ssid) != Known_network_store::INVALID_HANDLE;
+    });
+    JSON_Value* dns_value = json_value_init_object();
+    dns_cache.serialize(json_value_get_object(dns_value));
+    json_object_set_value(root_object, "dns", dns_value);
+#endif
     json_set_float_serialization_format("%.0f");
-    char* serialized_string = json_serialize_to_string(root_value);
+    // Write to the slot that does not hold the newest settings so a write
+    // that is cut short leaves them intact
+    unsigned slot = storage->get_num_slots() >= 2 ? settings_slot ^ 1 : Settings_storage::PRIMARY_SLOT;
+    uint32_t generation = settings_generation + 1;
+    size_t json_size = json_serialization_size(root_value); // includes the NUL
+    std::string record(Settings_record::HEADER_LEN + json_size, '\0');
+    size_t record_buffer_bytes = Memory_accounting::string_heap_bytes(record);
+    Memory_accounting::allocated(MEM_SETTINGS_IO, record_buffer_bytes);
+    bool result = json_size != 0 &&
+        json_serialize_to_buffer(root_value, &record[Settings_record::HEADER_LEN], json_size) == JSONSuccess;
     json_value_free(root_value);
-    error_code = lfs_file_write(&file, serialized_string, strlen(serialized_string));
-    bool result = true;
-    if (error_code < 0) {
-        result = false;
-    }
-    lfs_file_close(&file);
-    pico_unmount();
-    json_free_serialized_string(serialized_string);
+    if (result) {
+        record.resize(record.size() - 1);
+        Settings_record::encode_header(&record[0], generation, record.data() + Settings_record::HEADER_LEN,
+            record.size() - Settings_record::HEADER_LEN);
+        result = storage->write(slot, record.data(), record.size());
+    }
+    Memory_accounting::freed(MEM_SETTINGS_IO, record_buffer_bytes);
+    if (result) {
+        settings_slot = slot;
+        settings_generation = generation;
+    }
+    else {
+        ++current_status.settings_save_failures;
+    }
     settings_saved_state = result ? SAVED:NOT_SAVED;
     return result;
 }
 
 bool rppicomidi::Pico_w_connection_manager::load_settings()
 {
-    int error_code = pico_mount(false);
-    if (error_code != LFS_ERR_OK) {
-        return false;
-    }
-    lfs_file_t file;
-    error_code = lfs_file_open(&file, wifi_info_file, LFS_O_RDONLY);
-    if (error_code != LFS_ERR_OK) {
-        pico_unmount();
-        return false;
+    LATENCY_SCOPE(CALL_LOAD_SETTINGS);
+    bool found;
+    return load_settings(found);
+}
+
+bool rppicomidi::Pico_w_connection_manager::load_settings(bool& found)
+{
+    found = false;
+    unsigned num_slots = storage->get_num_slots() >= 2 ? 2 : 1;
+    std::string records[2];
+    uint32_t generations[2] = {0, 0};
+    size_t offsets[2] = {0, 0};
+    bool intact[2] = {false, false};
+    size_t read_buffer_bytes = 0;
+    for (unsigned slot = 0; slot < num_slots; slot++) {
+        if (storage->read(slot, records[slot]) && !records[slot].empty()) {
+            found = true;
+            read_buffer_bytes += Memory_accounting::string_heap_bytes(records[slot]);
+            intact[slot] = Settings_record::decode(records[slot], generations[slot], offsets[slot]);
+        }
     }
-    auto sz = lfs_file_size(&file);
-    if (sz < 0) {
-        lfs_file_close(&file);
-        pico_unmount();
-        return false;
+    Memory_accounting::allocated(MEM_SETTINGS_IO, read_buffer_bytes);
+    // Try the newest intact record first, then the older one
+    unsigned newest = num_slots == 2 && intact[1] && (!intact[0] || Settings_record::is_newer(generations[1], generations[0])) ? 1 : 0;
+    bool result = false;
+    for (unsigned attempt = 0; attempt < num_slots && !result; attempt++) {
+        unsigned slot = newest ^ attempt;
+        if (intact[slot] && apply_settings(records[slot].c_str() + offsets[slot])) {
+            settings_slot = slot;
+            settings_generation = generations[slot];
+            result = true;
+        }
     }
-    char* serialized_string = new char[sz+1];
-    error_code = lfs_file_read(&file, serialized_string, sz);
-    lfs_file_close(&file);
-    pico_unmount();
-    if (error_code <= 0) {
-        delete[] serialized_string;
-        return false;
+    if (!result) {
+        // The next save must not overwrite a record that might still be recovered
+        settings_slot = intact[newest] ? newest : 1;
+        settings_generation = intact[newest] ? generations[newest] : 0;
     }
-    serialized_string[sz] = '\0';
-    JSON_Value* root_value = json_parse_string(serialized_string);
-    delete[] serialized_string;
+    Memory_accounting::freed(MEM_SETTINGS_IO, read_buffer_bytes);
+    settings_saved_state = result ? SAVED:NOT_SAVED;
+    return result;
+}
+
+bool rppicomidi::Pico_w_connection_manager::apply_settings(const char* json)
+{
+    JSON_Value* root_value = json_parse_string(json);
     bool result = false;
     if (root_value != nullptr) {
         JSON_Object* root_object = json_value_get_object(root_value);
@@ -363,22 +516,15 @@ bool rppicomidi::Pico_w_connection_manager::load_settings()
                         JSON_Value* known_ssids_value = json_object_get_value(root_object, "known_ssids");
                         if (known_ssids_value != nullptr) {
                             JSON_Array* known_array = json_value_get_array(known_ssids_value);
-                            auto n_known = json_array_get_count(known_array);
-                            size_t idx = 0;
-                            known_ssids.clear();
-                            for (; idx < n_known; idx++) {
-                                Ssid_info info;
-                                JSON_Object* item_object = json_array_get_object(known_array, idx);
-                                if (item_object != nullptr) {
-                                    if (info.deserialize(item_object)) {
-                                        known_ssids.push_back(info);
-                                    }
-                                    else {
-                                        break;
-                                    }
-                                }
+                            result = known_ssids.deserialize(known_array);
+                            update_scan_view_known();
+#if PICO_W_CM_ENABLE_DNS_CACHE
+                            // settings saved before the cache existed have no "dns" object
+                            JSON_Object* dns_object = json_object_get_object(root_object, "dns");
+                            if (result && dns_object != nullptr) {
+                                dns_cache.deserialize(dns_object);
                             }
-                            result = idx == n_known;
+#endif
                         }
                     }
                 }
@@ -386,10 +532,21 @@ bool rppicomidi::Pico_w_connection_manager::load_settings()
         }
         json_value_free(root_value);
     }
-    settings_saved_state = result ? SAVED:NOT_SAVED;
     return result;
 }
+#else
+bool rppicomidi::Pico_w_connection_manager::save_settings()
+{
+    settings_saved_state = NOT_SAVED;
+    return false;
+}
 
+bool rppicomidi::Pico_w_connection_manager::load_settings()
+{
+    settings_saved_state = NOT_SAVED;
+    return false;
+}
+#endif
 
 void rppicomidi::Pico_w_connection_manager::set_current_passphrase(const std::string& pw)
 {
@@ -407,27 +564,164 @@ void rppicomidi::Pico_w_connection_manager::set_current_ssid(const std::string&
     }
 }
 
+bool rppicomidi::Pico_w_connection_manager::set_current_power_profile(Power_profile profile)
+{
+    if (profile < Wifi_power_governor::LOWEST_LATENCY || profile > Wifi_power_governor::ADAPTIVE) {
+        return false;
+    }
+    uint32_t bytes;
+    if (profile == Wifi_power_governor::ADAPTIVE && driver->get_byte_count(bytes) != 0) {
+        PICO_W_CM_LOG_WARN(ADAPTIVE_UNAVAILABLE);
+        return false;
+    }
+    if (current_ssid.power_profile != profile) {
+        current_ssid.power_profile = profile;
+        settings_saved_state = NOT_SAVED;
+        if (state == CONNECTED) {
+            if (profile == Wifi_power_governor::ADAPTIVE) {
+                power_governor.restart_sampling(bytes, now_ms());
+            }
+            else {
+                apply_power_profile(profile);
+            }
+        }
+    }
+    return true;
+}
+
+bool rppicomidi::Pico_w_connection_manager::set_known_ssid_power_profile(const std::string& ssid, Power_profile profile)
+{
+    if (profile < Wifi_power_governor::LOWEST_LATENCY || profile > Wifi_power_governor::ADAPTIVE) {
+        return false;
+    }
+    uint32_t bytes;
+    if (profile == Wifi_power_governor::ADAPTIVE && driver->get_byte_count(bytes) != 0) {
+        PICO_W_CM_LOG_WARN(ADAPTIVE_UNAVAILABLE);
+        return false;
+    }
+    const Ssid_info* known = known_ssids.get(known_ssids.find(ssid));
+    if (known == nullptr) {
+        return false;
+    }
+    Ssid_info info = *known;
+    info.power_profile = profile;
+    bool changed;
+    known_ssids.add(info, changed);
+    if (ssid == current_ssid.ssid) {
+        set_current_power_profile(profile);
+    }
+    return save_settings();
+}
+
+bool rppicomidi::Pico_w_connection_manager::apply_power_profile(Power_profile profile)
+{
+    uint32_t pm;
+    switch(profile) {
+        case Wifi_power_governor::LOWEST_LATENCY:
+            pm = Wifi_driver::PM_NONE;
+            break;
+        case Wifi_power_governor::LOWEST_POWER:
+            pm = Wifi_driver::PM_PM1;
+            break;
+        case Wifi_power_governor::BALANCED:
+            pm = Wifi_driver::PM_DEFAULT;
+            break;
+        default:
+            return false;
+    }
+    if (driver->set_power_management(pm) != 0) {
+        return false;
+    }
+    power_governor.set_active(profile, now_ms());
+    return true;
+}
+
 void rppicomidi::Pico_w_connection_manager::add_known_ssid(const Ssid_info& info)
 {
-    for (auto& known: known_ssids) {
-        if (known.ssid == info.ssid) {
-            settings_saved_state = (settings_saved_state == SAVED && known.passphrase == info.passphrase && known.security == info.security) ? SAVED:NOT_SAVED;
-            known.passphrase = info.passphrase;
-            known.security = info.security;
-            return;
+    bool changed;
+    auto handle = known_ssids.add(info, changed);
+    // Usage statistics are saved with the next settings change, not on every connection
+    known_ssids.mark_connected(handle);
+    // keep the record for the network in use until the link goes down
+    known_ssids.set_pinned(handle);
+    if (changed) {
+        settings_saved_state = NOT_SAVED;
+        update_scan_view_known();
+    }
+}
+
+bool rppicomidi::Pico_w_connection_manager::is_valid_known_ssid(const Ssid_info& info)
+{
+    if (info.ssid.size() == 0 || info.ssid.size() > 32) {
+        return false;
+    }
+    if (info.power_profile < Wifi_power_governor::LOWEST_LATENCY || info.power_profile > Wifi_power_governor::ADAPTIVE) {
+        return false;
+    }
+    if (info.security == OPEN) {
+        return true;
+    }
+    // WEP is not supported
+    if ((info.security & ~(WEP | MIXED)) != 0 || (info.security & MIXED) == 0) {
+        return false;
+    }
+    return info.passphrase.size() >= 8 && info.passphrase.size() <= 64;
+}
+
+bool rppicomidi::Pico_w_connection_manager::import_known_ssids(const std::vector<Ssid_info>& batch, size_t* n_rejected)
+{
+    size_t rejected = 0;
+    std::vector<const Ssid_info*> accepted;
+    std::unordered_set<std::string> seen;
+    accepted.reserve(batch.size());
+    // Walk backwards so the last record for each SSID wins
+    for (auto it = batch.rbegin(); it != batch.rend(); ++it) {
+        if (!is_valid_known_ssid(*it)) {
+            ++rejected;
+        }
+        else if (seen.insert(it->ssid).second) {
+            accepted.push_back(&(*it));
         }
     }
-    known_ssids.push_back(info);
-    settings_saved_state = NOT_SAVED;
+    if (n_rejected != nullptr) {
+        *n_rejected = rejected;
+    }
+    bool any_changed = false;
+    for (auto it = accepted.rbegin(); it != accepted.rend(); ++it) {
+        bool changed;
+        known_ssids.add(**it, changed);
+        any_changed = any_changed || changed;
+    }
+    if (any_changed) {
+        settings_saved_state = NOT_SAVED;
+        update_scan_view_known();
+    }
+    return settings_saved_state == SAVED || save_settings();
 }
 
 void rppicomidi::Pico_w_connection_manager::link_up_action()
 {
-    state = CONNECTED;
-    last_link_error = "";
-    if (link_up_callback.cb != nullptr) {
-        link_up_callback.cb(link_up_callback.context);
+    set_state(CONNECTED);
+    set_link_error(LINK_ERROR_NONE);
+    ++current_status.link_ups;
+    uint32_t bytes;
+    if (current_ssid.power_profile != Wifi_power_governor::ADAPTIVE) {
+        apply_power_profile(current_ssid.power_profile);
+    }
+    else if (driver->get_byte_count(bytes) == 0) {
+        power_governor.restart_sampling(bytes, now_ms());
     }
+    else {
+        // e.g., settings saved by a build with MIB2_STATS
+        PICO_W_CM_LOG_WARN(ADAPTIVE_UNAVAILABLE);
+        apply_power_profile(Wifi_power_governor::BALANCED);
+    }
+    health_checker.start(driver->get_gateway(), now_ms());
+#if PICO_W_CM_ENABLE_DNS_CACHE
+    // seed the resolver before the application's first lookup
+    dns_cache.link_up(current_ssid.ssid, now_ms());
+#endif
+    notify_link_up();
     add_known_ssid(current_ssid);
     if (settings_saved_state != SAVED) {
         save_settings();
@@ -436,144 +730,451 @@ void rppicomidi::Pico_w_connection_manager::link_up_action()
 
 void rppicomidi::Pico_w_connection_manager::task()
 {
+    LATENCY_SCOPE(CALL_TASK);
+    if (is_restart_pending()) {
+        // one firmware load or unload per call
+        restart_step_task();
+        publish_status();
+        drain_log();
+        return;
+    }
     if (state != DEINITIALIZED) {
-        if ((state == SCAN_REQUESTED || state == SCANNING) && absolute_time_diff_us(get_absolute_time(), scan_test) < 0) {
-            last_link_error = "";
+#if PICO_W_CM_ENABLE_SCAN
+        if ((state == SCAN_REQUESTED || state == SCANNING) &&
+                (!scan_holdoff || now_ms() - scan_holdoff_start_ms >= scan_holdoff_ms)) {
+            set_link_error(LINK_ERROR_NONE);
+            scan_holdoff = false;
             if (state == SCAN_REQUESTED) {
-                cyw43_wifi_scan_options_t scan_options;
-                memset(&scan_options, 0, sizeof(scan_options));
-                int err = cyw43_wifi_scan(&cyw43_state, &scan_options, this, static_scan_result);
+                int err = driver->scan(static_scan_result, this);
                 if (err == 0) {
-                    printf("\nPerforming wifi scan\n");
-                    state = SCANNING;
+                    PICO_W_CM_LOG_INFO(SCAN_STARTED);
+                    set_state(SCANNING);
                 } else {
-                    printf("Failed to start scan: %d\n", err);
-                    scan_test = make_timeout_time_ms(10000); // wait 10s and scan again
+                    PICO_W_CM_LOG_WARN(SCAN_START_FAILED, err);
+                    // wait 10s and scan again
+                    scan_holdoff = true;
+                    scan_holdoff_start_ms = now_ms();
                 }
             } 
-            else if (!cyw43_wifi_scan_active(&cyw43_state)) {
-                scan_test = make_timeout_time_ms(10000); // wait 10s before can scan again 
-                state = is_link_up() ? CONNECTED : SCAN_COMPLETE;
-                if (scan_complete_callback.cb != nullptr) {
-                    scan_complete_callback.cb(scan_complete_callback.context);
-                }
+            else if (!driver->is_scan_active()) {
+                // wait 10s before can scan again
+                scan_holdoff = true;
+                scan_holdoff_start_ms = now_ms();
+                set_state(is_link_up() ? CONNECTED : SCAN_COMPLETE);
+                ++current_status.scans;
+                scan_complete_ms = now_ms();
+                bssid_choice_allowed = true;
+                update_channel_survey();
+                update_scan_view();
+                notify_scan_complete();
                 if (state == CONNECTED) {
                     link_up_action();
                 }
             }
         }
+#endif
         if (state == SCAN_COMPLETE && is_link_up()) {
             link_up_action();
         }
         else if (state == CONNECTION_REQUESTED || state == CONNECTED) {
-            int status = cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA);
+            int status = driver->link_status();
             if (status < 0) {
                 switch(status) {
-                    case CYW43_LINK_BADAUTH:
-                        last_link_error = "not authorized";
+                    case Wifi_driver::LINK_BADAUTH:
+                        set_link_error(LINK_ERROR_BADAUTH);
                         break;
-                    case CYW43_LINK_NONET:
-                        last_link_error = "cannot find SSID";
+                    case Wifi_driver::LINK_NONET:
+                        set_link_error(LINK_ERROR_NONET);
                         break;
-                    case CYW43_LINK_FAIL:
-                        last_link_error = "link failure";
+                    case Wifi_driver::LINK_FAIL:
+                        set_link_error(LINK_ERROR_FAIL);
                         break;
                     default:
-                        last_link_error = "unknown error";
+                        set_link_error(LINK_ERROR_UNKNOWN);
                         break;
                 }
-                printf("Connection error %s\r\n", last_link_error.c_str());
-                // clear the error? I am not sure why I have to toggle Wi-Fi off and on
-                deinitialize();
-                initialize();
-                if (link_error_callback.cb) {
-                    link_error_callback.cb(link_error_callback.context, last_link_error.c_str());
+                ++current_status.link_errors;
+                ++current_status.errors_by_type[current_status.last_error];
+                PICO_W_CM_LOG_ERROR(LINK_ERROR, last_link_error);
+#if PICO_W_CM_ENABLE_SCAN
+                if (bssid_chosen) {
+                    // the access point may have moved; let the driver choose until the next scan
+                    bssid_choice_allowed = false;
+                    bssid_chosen = false;
                 }
+#endif
+                // clear the error? I am not sure why I have to toggle Wi-Fi off and on
+                restart_radio(AFTER_RESTART_NONE);
+                notify_link_error();
             }
-            else if (status == CYW43_LINK_UP && state == CONNECTION_REQUESTED) {
+            else if (status == Wifi_driver::LINK_UP && state == CONNECTION_REQUESTED) {
                 link_up_action();
             }
-            else if (status != CYW43_LINK_UP && state == CONNECTED) {
-                if (status != CYW43_LINK_DOWN && status >= 0) {
-                    state = CONNECTION_REQUESTED;
-                    printf("Attempting to reconnect\r\n");
+            else if (status == Wifi_driver::LINK_UP && health_checker.poll(now_ms())) {
+                ++current_status.link_downs;
+                ++current_status.errors_by_type[LINK_ERROR_GATEWAY];
+#if PICO_W_CM_ENABLE_DNS_CACHE
+                dns_cache.link_down();
+#endif
+                notify_link_down();
+                PICO_W_CM_LOG_INFO(RECONNECTING);
+                ++current_status.reconnects;
+                connect();
+                // connect() clears the error; keep the reason until the link comes back up
+                set_link_error(LINK_ERROR_GATEWAY);
+                PICO_W_CM_LOG_WARN(LINK_DEGRADED, last_link_error);
+                notify_link_error();
+            }
+            else if (status == Wifi_driver::LINK_UP && current_ssid.power_profile == Wifi_power_governor::ADAPTIVE) {
+                uint32_t bytes;
+                if (driver->get_byte_count(bytes) == 0) {
+                    Power_profile wanted = power_governor.update(bytes, now_ms());
+                    if (wanted != power_governor.get_active()) {
+                        apply_power_profile(wanted);
+                    }
+                }
+            }
+            else if (status != Wifi_driver::LINK_UP && state == CONNECTED) {
+                health_checker.stop();
+#if PICO_W_CM_ENABLE_DNS_CACHE
+                dns_cache.link_down();
+#endif
+                ++current_status.link_downs;
+                if (status != Wifi_driver::LINK_DOWN && status >= 0) {
+                    set_state(CONNECTION_REQUESTED);
+                    PICO_W_CM_LOG_INFO(RECONNECTING);
+                    ++current_status.reconnects;
                 }
                 else {
-                    state = INITIALIZED;
-                }
-                if (link_down_callback.cb != nullptr) {
-                    link_down_callback.cb(link_down_callback.context);
+                    set_state(INITIALIZED);
                 }
+                notify_link_down();
             }
         }
     }
+#if PICO_W_CM_ENABLE_SELF_TEST
+    if (self_test.is_running()) {
+        if (state != CONNECTED) {
+            self_test.stop();
+        }
+        else if (self_test.poll(now_ms())) {
+            const auto& results = self_test.get_results();
+            PICO_W_CM_LOG_INFO(SELF_TEST_DONE, results.tcp_bps, results.udp_received_bps, results.rtt_avg_us, results.rssi);
+        }
+    }
+#endif
+#if PICO_W_CM_ENABLE_DNS_CACHE
+    if (state == CONNECTED && dns_cache.poll(now_ms())) {
+        PICO_W_CM_LOG_DEBUG(DNS_ADDRESS_CHANGED, dns_cache.get_refreshes(), dns_cache.get_refresh_failures());
+        settings_saved_state = NOT_SAVED;
+        dns_save_pending = true;
+    }
+    // A DNS change is worth a flash erase at most once per interval
+    if (dns_save_pending && (!dns_saved || now_ms() - dns_saved_ms >= PICO_W_CM_DNS_CACHE_SAVE_INTERVAL_MS)) {
+        dns_save_pending = false;
+        if (settings_saved_state != SAVED) {
+            dns_saved = true;
+            dns_saved_ms = now_ms();
+            save_settings();
+        }
+    }
+#endif
+    publish_status();
+    drain_log();
+}
+
+#if PICO_W_CM_ENABLE_SELF_TEST
+bool rppicomidi::Pico_w_connection_manager::start_self_test(const Link_self_test::Config& config)
+{
+    if (state != CONNECTED) {
+        return false;
+    }
+    return self_test.start(config, get_rssi(), now_ms());
+}
+#endif
+
+#if PICO_W_CM_ENABLE_DNS_CACHE
+bool rppicomidi::Pico_w_connection_manager::add_dns_cache_host(const std::string& hostname)
+{
+    size_t nhosts = dns_cache.get_hosts().size();
+    if (!dns_cache.add_host(hostname)) {
+        return false;
+    }
+    if (dns_cache.get_hosts().size() != nhosts) {
+        settings_saved_state = NOT_SAVED;
+    }
+    return true;
+}
+
+bool rppicomidi::Pico_w_connection_manager::remove_dns_cache_host(const std::string& hostname)
+{
+    if (!dns_cache.remove_host(hostname)) {
+        return false;
+    }
+    settings_saved_state = NOT_SAVED;
+    return true;
+}
+#endif
+
+void rppicomidi::Pico_w_connection_manager::notify_link_up()
+{
+#if PICO_W_CM_ENABLE_CALLBACKS
+    if (link_up_callback.cb != nullptr) {
+        link_up_callback.cb(link_up_callback.context);
+    }
+#endif
+}
+
+void rppicomidi::Pico_w_connection_manager::notify_link_down()
+{
+#if PICO_W_CM_ENABLE_CALLBACKS
+    if (link_down_callback.cb != nullptr) {
+        link_down_callback.cb(link_down_callback.context);
+    }
+#endif
+}
+
+void rppicomidi::Pico_w_connection_manager::notify_link_error()
+{
+#if PICO_W_CM_ENABLE_CALLBACKS
+    if (link_error_callback.cb != nullptr) {
+        link_error_callback.cb(link_error_callback.context, last_link_error);
+    }
+#endif
+}
+
+void rppicomidi::Pico_w_connection_manager::notify_scan_complete()
+{
+#if PICO_W_CM_ENABLE_CALLBACKS
+    if (scan_complete_callback.cb != nullptr) {
+        scan_complete_callback.cb(scan_complete_callback.context);
+    }
+#endif
+}
+
+void rppicomidi::Pico_w_connection_manager::set_link_error(Link_error code)
+{
+    current_status.last_error = code;
+    switch(code) {
+        case LINK_ERROR_NONE:
+            last_link_error = "";
+            break;
+        case LINK_ERROR_BADAUTH:
+            last_link_error = "not authorized";
+            break;
+        case LINK_ERROR_NONET:
+            last_link_error = "cannot find SSID";
+            break;
+        case LINK_ERROR_FAIL:
+            last_link_error = "link failure";
+            break;
+        case LINK_ERROR_GATEWAY:
+            last_link_error = "gateway not responding";
+            break;
+        default:
+            last_link_error = "unknown error";
+            break;
+    }
+}
+
+void rppicomidi::Pico_w_connection_manager::set_state(Wifi_state new_state)
+{
+    if (new_state == state) {
+        return;
+    }
+    if (state == CONNECTED) {
+        closed_link_uptime_ms += now_ms() - link_up_since_ms;
+    }
+    else if (new_state == CONNECTED) {
+        link_up_since_ms = now_ms();
+    }
+    state = new_state;
+    if (new_state == DEINITIALIZED || new_state == INITIALIZED || new_state == CONNECTION_REQUESTED) {
+        known_ssids.set_pinned(Known_network_store::INVALID_HANDLE);
+    }
+    ++current_status.state_changes;
+    ++current_status.state_entries[new_state];
+}
+
+bool rppicomidi::Pico_w_connection_manager::restart_radio(After_restart after)
+{
+#if PICO_W_CM_ENABLE_LATENCY_MONITOR
+    // Traces do not record the time stamps the measurements come from, so
+    // pass the decision through the driver for replays to make it the same
+    uint32_t estimate_us = latency_monitor.get_restart_estimate_us();
+    if (driver->observe(restart_budget_us != 0 && (estimate_us == 0 || estimate_us > restart_budget_us))) {
+        restart_step = state == DEINITIALIZED ? RESTART_INIT : RESTART_DEINIT;
+        restart_after = after;
+        if (state != DEINITIALIZED) {
+            // the link is gone now, not when task() unloads the firmware
+            set_state(INITIALIZED);
+        }
+        return true;
+    }
+#else
+    (void)after;
+#endif
+    deinitialize();
+    return initialize();
+}
+
+void rppicomidi::Pico_w_connection_manager::restart_step_task()
+{
+    if (restart_step == RESTART_DEINIT) {
+        deinitialize();     // also clears restart_step
+        restart_step = RESTART_INIT;
+    }
+    else if (restart_step == RESTART_INIT) {
+        restart_step = RESTART_NONE;
+        if (!initialize()) {
+            PICO_W_CM_LOG_ERROR(INITIALIZE_FAILED);
+        }
+        else if (restart_after == AFTER_RESTART_CONNECT) {
+            connect();
+        }
+        else if (restart_after == AFTER_RESTART_SCAN) {
+#if PICO_W_CM_ENABLE_SCAN
+            start_scan();
+#endif
+        }
+        restart_after = AFTER_RESTART_NONE;
+    }
+}
+
+void rppicomidi::Pico_w_connection_manager::drain_log()
+{
+#if PICO_W_CM_LOG_LEVEL > PICO_W_CM_LOG_LEVEL_NONE
+    if (log_drain_per_task != 0) {
+        Wifi_event_log::instance().drain(log_drain_per_task);
+    }
+#endif
+}
+
+void rppicomidi::Pico_w_connection_manager::publish_status()
+{
+    uint32_t now = now_ms();
+    current_status.state = state;
+    if (state == CONNECTED) {
+        current_status.ip_address = driver->get_ip_address();
+        current_status.gateway = driver->get_gateway();
+        if (current_status.rssi == INT_MIN || now - rssi_refresh_ms >= 1000) {
+            current_status.rssi = get_rssi();
+            rssi_refresh_ms = now;
+        }
+    }
+    else {
+        current_status.ip_address = 0;
+        current_status.gateway = 0;
+        current_status.rssi = INT_MIN;
+    }
+    strncpy(current_status.ssid, current_ssid.ssid.c_str(), sizeof(current_status.ssid) - 1);
+    current_status.ssid[sizeof(current_status.ssid) - 1] = '\0';
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+    const auto& storage_stats = storage->get_stats();
+    current_status.settings_saves = storage_stats.writes;
+    current_status.settings_save_us = storage_stats.write_us;
+    current_status.max_settings_save_us = storage_stats.max_write_us;
+#endif
+    current_status.link_uptime_ms = state == CONNECTED ? now - link_up_since_ms : 0;
+    current_status.total_link_uptime_ms = closed_link_uptime_ms + current_status.link_uptime_ms;
+    current_status.timestamp_ms = now;
+    published_status.write(current_status);
 }
 
 bool rppicomidi::Pico_w_connection_manager::is_link_up()
 {
-    int status = cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA);
-    return status == CYW43_LINK_UP;
+    int status = driver->link_status();
+    return status == Wifi_driver::LINK_UP;
 }
 
 bool rppicomidi::Pico_w_connection_manager::connect()
 {
+    LATENCY_SCOPE(CALL_CONNECT);
     if (current_ssid.ssid.size() == 0) {
-        printf("No SSID specified\r\n");
+        PICO_W_CM_LOG_ERROR(NO_SSID);
         return false;
     }
     else if (current_ssid.passphrase.size() == 0 && current_ssid.security != 0) {
-        printf("No password specified\r\n");
+        PICO_W_CM_LOG_ERROR(NO_PASSPHRASE);
         return false;
     }
-    uint32_t auth = CYW43_AUTH_OPEN;
+    uint32_t auth = Wifi_driver::AUTH_OPEN;
     if ((current_ssid.security & MIXED) == MIXED) {
-        auth = CYW43_AUTH_WPA2_MIXED_PSK;
+        auth = Wifi_driver::AUTH_WPA2_MIXED_PSK;
     }
     else if ((current_ssid.security & WPA2) == WPA2) {
-        auth = CYW43_AUTH_WPA2_AES_PSK;
+        auth = Wifi_driver::AUTH_WPA2_AES_PSK;
     }
     else if ((current_ssid.security & WPA) == WPA) {
-        auth = CYW43_AUTH_WPA_TKIP_PSK;
+        auth = Wifi_driver::AUTH_WPA_TKIP_PSK;
     }
-    const char* pw = (auth == CYW43_AUTH_OPEN) ? nullptr : current_ssid.passphrase.c_str();
+    const char* pw = (auth == Wifi_driver::AUTH_OPEN) ? nullptr : current_ssid.passphrase.c_str();
 
     // Make sure the hardware will let us make a connection
-    if (state == DEINITIALIZED) {
-        initialize();
+    if (is_restart_pending()) {
+        restart_after = AFTER_RESTART_CONNECT;
+    }
+    else if (state == DEINITIALIZED) {
+        restart_radio(AFTER_RESTART_CONNECT);
     }
     else if (state == CONNECTED) {
         disconnect();
-        deinitialize();
-        initialize();
+        restart_radio(AFTER_RESTART_CONNECT);
     }
     else if (state == CONNECTION_REQUESTED ||
             state == SCANNING ||
             state == SCAN_REQUESTED) {
-        deinitialize();
-        initialize();
+        restart_radio(AFTER_RESTART_CONNECT);
+    }
+    if (is_restart_pending()) {
+        // task() connects when the radio is back up
+        return true;
     }
 
-    if (cyw43_arch_wifi_connect_async(current_ssid.ssid.c_str(), pw, auth) != 0) {
+    // If more than one discovered access point serves the SSID, join the
+    // one on the least congested channel
+    const Wifi_driver::Scan_result* bssid = nullptr;
+#if PICO_W_CM_ENABLE_SCAN
+    bssid = select_bssid();
+    bssid_chosen = bssid != nullptr;
+#endif
+    int err;
+    if (bssid != nullptr) {
+        PICO_W_CM_LOG_INFO(BSSID_SELECTED, bssid->channel, bssid->rssi);
+        err = driver->connect(current_ssid.ssid.c_str(), pw, auth, bssid->bssid, bssid->channel);
+    }
+    else {
+        err = driver->connect(current_ssid.ssid.c_str(), pw, auth, nullptr, 0);
+    }
+    if (err != 0) {
         return false;
     }
     else {
-        state = CONNECTION_REQUESTED;
-        last_link_error = "";
+        set_state(CONNECTION_REQUESTED);
+        set_link_error(LINK_ERROR_NONE);
     }
     return true;
 }
 
 bool rppicomidi::Pico_w_connection_manager::disconnect()
 {
+    LATENCY_SCOPE(CALL_DISCONNECT);
     bool result = false;
+    health_checker.stop();
+#if PICO_W_CM_ENABLE_DNS_CACHE
+    dns_cache.link_down();
+#endif
     if (state == CONNECTED) {
-        result = cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA) == 0;
+        result = driver->leave() == 0;
+    }
+    else if (is_restart_pending()) {
+        // do not connect or scan when the restart finishes
+        restart_after = AFTER_RESTART_NONE;
+        result = true;
     }
     else if (state == CONNECTION_REQUESTED) {
         // stop trying to reconnect
-        if (deinitialize()) {
-            result = initialize();
-        }
+        result = restart_radio(AFTER_RESTART_NONE);
     }
 
     return result;
@@ -581,7 +1182,7 @@ bool rppicomidi::Pico_w_connection_manager::disconnect()
 
 uint32_t rppicomidi::Pico_w_connection_manager::get_ip_address()
 {
-    return is_link_up() ? cyw43_state.netif->ip_addr.addr : 0;
+    return is_link_up() ? driver->get_ip_address() : 0;
 }
 
 void rppicomidi::Pico_w_connection_manager::get_ip_address_string(std::string& addr_str)
@@ -595,11 +1196,11 @@ void rppicomidi::Pico_w_connection_manager::get_ip_address_string(std::string& a
 
 int rppicomidi::Pico_w_connection_manager::get_rssi()
 {
-    // See https://forums.raspberrypi.com/viewtopic.php?t=341774
-    int rssi = INT_MIN;
+    LATENCY_SCOPE(CALL_GET_RSSI);
+    int32_t rssi = INT_MIN;
     if (state == CONNECTED) {
         // RSSI is only valid if the link is up
-        if (cyw43_ioctl(&cyw43_state, 254, sizeof(rssi), (uint8_t *)&rssi, CYW43_ITF_STA) != 0) {
+        if (driver->get_rssi(rssi) != 0) {
             rssi = INT_MIN;
         }
     }
@@ -608,47 +1209,49 @@ int rppicomidi::Pico_w_connection_manager::get_rssi()
 
 bool rppicomidi::Pico_w_connection_manager::autoconnect()
 {
+    LATENCY_SCOPE(CALL_AUTOCONNECT);
     if (state != DEINITIALIZED) {
         // de-initialize so can initialize with the correct country code
         if (!deinitialize())
             return false;
     }
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+    if (!load_settings()) {
+        PICO_W_CM_LOG_ERROR(LOAD_SETTINGS_FAILED);
+        return false;
+    }
+#endif
     bool success = false;
-    if (load_settings()) {
-        std::string ssid;
-        get_current_ssid(ssid);
-        if (initialize()) {
-            if (connect()) {
-                printf("Requesting connection to %s\r\n", ssid.c_str());
-                success = true;
-            }
-            else {
-                printf("failed to connect to %s\r\n", ssid.c_str());
-            }
+    if (initialize()) {
+        if (connect()) {
+            PICO_W_CM_LOG_INFO(CONNECT_REQUESTED, Wifi_event_log::copy(current_ssid.ssid.c_str()));
+            success = true;
         }
         else {
-            printf("initialze failed\r\n");
+            PICO_W_CM_LOG_ERROR(CONNECT_FAILED, Wifi_event_log::copy(current_ssid.ssid.c_str()));
         }
     }
     else {
-        printf("load settings failed\r\n");
+        PICO_W_CM_LOG_ERROR(INITIALIZE_FAILED);
     }
     return success;
 }
 
-bool rppicomidi::Pico_w_connection_manager::erase_known_ssid_by_idx(size_t idx)
+bool rppicomidi::Pico_w_connection_manager::erase_known_ssid(Known_ssid_handle handle)
 {
     bool success = false;
-    if (idx < known_ssids.size()) {
+    const Ssid_info* known = known_ssids.get(handle);
+    if (known != nullptr) {
         if (state == CONNECTED || state == CONNECTION_REQUESTED) {
-            if (known_ssids[idx].ssid == current_ssid.ssid) {
+            if (known->ssid == current_ssid.ssid) {
                 disconnect();
                 current_ssid.ssid.clear();
                 current_ssid.passphrase.clear();
                 current_ssid.security = 0;
             }
         }
-        known_ssids.erase(known_ssids.begin() + idx);
+        known_ssids.erase(handle);
+        update_scan_view_known();
         success = save_settings();
     }
     return success;
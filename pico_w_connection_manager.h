@@ -25,10 +25,30 @@
 #pragma once
 #include <string>
 #include <vector>
-#include <map>
-#include "pico/cyw43_arch.h"
+#include "pico_w_connection_manager_config.h"
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
 #include "pico_hal.h"
 #include "parson.h"
+#endif
+#include "wifi_power_governor.h"
+#include "link_health_checker.h"
+#include "ssid_info.h"
+#include "known_network_store.h"
+#include "provisioning_blob.h"
+#include "seqlock.h"
+#include "channel_survey.h"
+#include "scan_view.h"
+#include "link_self_test.h"
+#include "dns_cache.h"
+#include "call_latency_monitor.h"
+#include "wifi_driver.h"
+#include "memory_accounting.h"
+#include "cyw43_wifi_driver.h"
+#include "wifi_event_log.h"
+#include "settings_storage.h"
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+#include "littlefs_settings_storage.h"
+#endif
 
 namespace rppicomidi
 {
@@ -48,6 +68,51 @@ public:
         SCAN_COMPLETE,  //!< A Wi-Fi scan is complete
         CONNECTION_REQUESTED,   //!< the Wi-Fi radio is attempting to connect to the current_ssid
         CONNECTED,      //!< The Wi-Fi radio has connected to the current_ssid and an IP address has been assigned
+        NUM_WIFI_STATES
+    };
+
+    typedef Wifi_power_governor::Power_profile Power_profile;
+    typedef rppicomidi::Ssid_info Ssid_info;
+    typedef Known_network_store::Handle Known_ssid_handle;
+
+    /**
+     * @brief The reason the link last failed or went down
+     */
+    enum Link_error {
+        LINK_ERROR_NONE,            //!< no error since the last connection attempt
+        LINK_ERROR_BADAUTH,         //!< not authorized
+        LINK_ERROR_NONET,           //!< cannot find SSID
+        LINK_ERROR_FAIL,            //!< link failure
+        LINK_ERROR_UNKNOWN,         //!< unknown error
+        LINK_ERROR_GATEWAY,         //!< the gateway stopped responding to liveness probes
+        NUM_LINK_ERRORS
+    };
+
+    /**
+     * @brief A consistent copy of the connection status published by task()
+     */
+    struct Status_snapshot {
+        Wifi_state state;       //!< the Wi-Fi system state
+        uint32_t ip_address;    //!< same format as get_ip_address(); 0 if the link is not up
+        uint32_t gateway;       //!< the gateway address in the same format; 0 if the link is not up
+        int rssi;               //!< the RSSI, refreshed at most once per second; INT_MIN if the link is not up
+        char ssid[33];          //!< the SSID of the AP to which the Wi-Fi has last attempted to connect
+        Link_error last_error;  //!< the reason the link last failed
+        uint32_t timestamp_ms;  //!< the time this snapshot was published
+        uint32_t link_ups;      //!< number of times the link came up
+        uint32_t link_downs;    //!< number of times the link went down or was declared degraded
+        uint32_t link_errors;   //!< number of connection errors
+        uint32_t scans;         //!< number of completed scans
+        uint32_t state_changes; //!< number of state transitions
+        uint32_t state_entries[NUM_WIFI_STATES];    //!< number of times each state was entered
+        uint32_t errors_by_type[NUM_LINK_ERRORS];   //!< number of link errors and degradations of each type
+        uint32_t reconnects;    //!< number of times the driver was left to reconnect or connect() was called again
+        uint32_t link_uptime_ms;        //!< time since the link came up; 0 if the link is not up
+        uint64_t total_link_uptime_ms;  //!< total time the link has been up, including the current link
+        uint32_t settings_saves;        //!< number of writes to the settings storage
+        uint32_t settings_save_failures;//!< number of save_settings() calls that failed
+        uint64_t settings_save_us;      //!< total time spent writing settings
+        uint32_t max_settings_save_us;  //!< longest settings write
     };
 
     enum Settings_saved_state {
@@ -55,31 +120,6 @@ public:
         NOT_SAVED,
         SAVED
     };
-    /**
-     * @brief Describes the information required to connected an SSID
-     * 
-     */
-    struct Ssid_info {
-        std::string ssid; //!< The SSID name
-        std::string passphrase; //!< The password or passphrase; may be empty if security is 0
-        int security; //!< 
-        /**
-         * @brief Serialize the fields in this struct to the the given root_object
-         *
-         * @param root_object the object to receive the value
-         */
-        void serialize(JSON_Object* root_object);
-
-        /**
-         * @brief Deserialize from the root_object the 3 fields
-         * in this struct
-         *
-         * @param root_object the object containing the values
-         * @return true if deserialization is successful, false otherwise
-         */
-        bool deserialize(JSON_Object* root_object);
-    };
-
     static const int OPEN=0;                //!< security will be 0 if the SSID requires no passphrase
     static const int WEP=1;                 //!< scan ORs this value to security if SSID supports WEP; not supported
     static const int WPA=2;                 //!< scan ORs this value to security if SSID supports WPA-PSK
@@ -88,12 +128,20 @@ public:
 
     Pico_w_connection_manager(Pico_w_connection_manager const&) = delete;
     void operator=(Pico_w_connection_manager const&) = delete;
-    ~Pico_w_connection_manager()=default;
+    ~Pico_w_connection_manager();
     /**
      * @brief Construct a new Pico_w_connection_manager object
      * 
+     * @param storage_ the backend that stores the settings, or nullptr to
+     * store them in littlefs-lib files with the file system kept mounted
+     * for the lifetime of this object. The backend must outlive this object.
+     * Ignored if PICO_W_CM_ENABLE_SETTINGS_STORAGE is 0.
+     * @param driver_ the Wi-Fi driver, or nullptr to use the CYW43 driver.
+     * Pass a Wifi_trace_recorder to record a trace or a
+     * Wifi_trace_replay_driver to play one back. The driver must outlive
+     * this object.
      */
-    Pico_w_connection_manager();
+    Pico_w_connection_manager(Settings_storage* storage_ = nullptr, Wifi_driver* driver_ = nullptr);
 
     /**
      * @brief Initialize the Wi-Fi hardware
@@ -156,14 +204,21 @@ public:
      * attempt was made (with corresponding security configuration and password),
      * and a list of all previously connected SSIDs and security information.
      *
-     * Data is stored in JSON format to the LittleFS file system
+     * Data is stored in JSON format to the settings storage backend. Each
+     * save goes to the slot that does not hold the newest settings, with a
+     * generation number and CRC, so a save that is cut short by a reset
+     * leaves the previous settings loadable.
      * @return true if save is successful, false otherwise
+     * @note always returns false if PICO_W_CM_ENABLE_SETTINGS_STORAGE is 0
      */
     bool save_settings();
 
     /**
      * @brief recall all previously saved settings
-     * 
+     *
+     * Settings are saved to two storage slots in turn. The newest intact
+     * copy is loaded; if it is damaged or cannot be applied, the older
+     * copy is loaded instead.
      * @return true if successful, false otherwise
      */
     bool load_settings();
@@ -215,16 +270,42 @@ public:
     /**
      * @brief update the Wi-Fi state based on the current Wi-Fi hardware status
      *
-     * You must call this function periodically in your main "super-loop"
+     * You must call this function periodically in your main "super-loop".
+     * It does not print the event log unless set_log_drain_per_task()
+     * asks it to.
      */
     void task();
 
+    /**
+     * @brief Set how many event log entries each task() call prints
+     *
+     * The default is PICO_W_CM_LOG_DRAIN_PER_TASK, 0, which leaves
+     * draining Wifi_event_log::instance() to the application, for example
+     * from its idle loop or the other core; only one place may drain it.
+     * Printing blocks on stdio, and time task() spends printing counts
+     * as task() time in the latency monitor.
+     * @param max_entries the maximum number of entries per call
+     */
+    void set_log_drain_per_task(size_t max_entries) {log_drain_per_task = max_entries; }
+
     /**
      * @brief Return a pointer to the list of discovered SSIDs
      * 
-     * @return const std::vector<cyw43_ev_scan_result_t>* 
+     * @return const std::vector<Wifi_driver::Scan_result>* 
+     */
+    const std::vector<Wifi_driver::Scan_result>* get_discovered_ssids() {return &discovered_ssids; }
+
+#if PICO_W_CM_ENABLE_SCAN
+    /**
+     * @brief Get the discovered networks grouped by SSID, strongest first
+     *
+     * task() builds the view when a scan completes, before it calls the
+     * scan complete callback, and keeps it up to date as known SSIDs are
+     * added or erased. The view is empty while a scan is in progress.
+     * @return const Scan_view& the view
      */
-    const std::vector<cyw43_ev_scan_result_t>* get_discovered_ssids() {return &discovered_ssids; }
+    const Scan_view& get_scan_view() const {return scan_view; }
+#endif
 
     /**
      * @brief Get the SSID of the AP to which the Wi-Fi has last attempted to connect
@@ -275,6 +356,210 @@ public:
         }
     }
 
+    /**
+     * @brief Set the power management profile for the SSID set by set_current_ssid()
+     *
+     * If the link is up, the new profile takes effect immediately.
+     * ADAPTIVE measures traffic with the lwIP interface byte counters,
+     * which only exist if the application's lwipopts.h sets MIB2_STATS
+     * to 1.
+     * @param profile one of LOWEST_LATENCY, BALANCED, LOWEST_POWER or ADAPTIVE
+     * @return true if successful, false if profile is not valid, or is
+     * ADAPTIVE and the driver does not count bytes
+     */
+    bool set_current_power_profile(Power_profile profile);
+
+    /**
+     * @brief Get the power management profile setting for the current SSID
+     *
+     * @return Power_profile the setting, which may be ADAPTIVE
+     */
+    Power_profile get_current_power_profile() {return current_ssid.power_profile; }
+
+    /**
+     * @brief Set the power management profile of a known SSID; store the settings in flash
+     *
+     * @param ssid the SSID of the known network
+     * @param profile one of LOWEST_LATENCY, BALANCED, LOWEST_POWER or ADAPTIVE;
+     * see set_current_power_profile() for the ADAPTIVE requirements
+     * @return true if ssid is known and the settings were saved, false otherwise
+     */
+    bool set_known_ssid_power_profile(const std::string& ssid, Power_profile profile);
+
+    /**
+     * @brief Get the power management profile the radio is using now
+     *
+     * @return Power_profile one of LOWEST_LATENCY, BALANCED or LOWEST_POWER
+     */
+    Power_profile get_active_power_profile() {return power_governor.get_active(); }
+
+    /**
+     * @brief Get the total time the radio has spent in a power management profile
+     *
+     * @param profile one of LOWEST_LATENCY, BALANCED or LOWEST_POWER
+     * @return uint32_t the time in milliseconds
+     */
+    uint32_t get_time_in_power_profile_ms(Power_profile profile) {return power_governor.get_time_in_profile_ms(profile, now_ms()); }
+
+    /**
+     * @brief Set the traffic thresholds the ADAPTIVE power profile uses
+     *
+     * @param config the new thresholds
+     */
+    void set_adaptive_power_config(const Wifi_power_governor::Config& config) {power_governor.set_config(config); }
+
+    /**
+     * @brief Configure gateway liveness probing
+     *
+     * If enabled, the gateway is pinged while the link is up. When the
+     * failure budget is exhausted the link is declared degraded: the
+     * link down callback is called and a reconnection is requested.
+     * Takes effect the next time the link comes up.
+     * @param config the probe interval, reply timeout and failure budget
+     */
+    void set_link_health_config(const Link_health_checker::Config& config) {health_checker.set_config(config); }
+
+    /**
+     * @brief Get the gateway liveness checker for statistics
+     *
+     * @return const Link_health_checker& the checker
+     */
+    const Link_health_checker& get_link_health_checker() {return health_checker; }
+
+#if PICO_W_CM_ENABLE_SELF_TEST
+    /**
+     * @brief Start measuring TCP and UDP throughput and round trip time
+     * to a peer
+     *
+     * The link must be up. task() runs the self-test and stops it if the
+     * link goes down.
+     * @param config the peer and the tests to run
+     * @return true if the self-test started, false otherwise
+     */
+    bool start_self_test(const Link_self_test::Config& config);
+
+    /**
+     * @brief Stop the self-test if it is running
+     */
+    void stop_self_test() {self_test.stop(); }
+
+    /**
+     * @brief return true if the self-test is running
+     */
+    bool is_self_test_running() const {return self_test.is_running(); }
+
+    /**
+     * @brief Get the results of the most recent self-test, including the
+     * RSSI when it started
+     */
+    const Link_self_test::Results& get_self_test_results() const {return self_test.get_results(); }
+#endif
+
+#if PICO_W_CM_ENABLE_DNS_CACHE
+    /**
+     * @brief Remember the address of a host on every network
+     *
+     * The address resolved on each network is stored with the settings.
+     * After link up the cached address is added to lwIP's local host
+     * list before the link up callback is called, and task() refreshes
+     * it in the background. When an address changes, task() saves the
+     * settings at most once every PICO_W_CM_DNS_CACHE_SAVE_INTERVAL_MS.
+     * @param hostname the host name to cache
+     * @return true if the host is cached, false otherwise
+     */
+    bool add_dns_cache_host(const std::string& hostname);
+
+    /**
+     * @brief Stop caching the address of a host
+     *
+     * @param hostname the host name
+     * @return true if the host was cached, false otherwise
+     */
+    bool remove_dns_cache_host(const std::string& hostname);
+
+    /**
+     * @brief Set the DNS cache refresh intervals
+     *
+     * Takes effect the next time the link comes up.
+     * @param config the new configuration
+     */
+    void set_dns_cache_config(const Dns_cache::Config& config) {dns_cache.set_config(config); }
+
+    /**
+     * @brief Get the DNS cache for its hosts, addresses and statistics
+     */
+    const Dns_cache& get_dns_cache() const {return dns_cache; }
+#endif
+
+#if PICO_W_CM_ENABLE_SCAN
+    /**
+     * @brief Set how the channel survey averages scans and steers connect()
+     *
+     * @param config the new configuration
+     */
+    void set_channel_survey_config(const Channel_survey::Config& config) {channel_survey.set_config(config); }
+
+    /**
+     * @brief Get the per-channel occupancy and interference table
+     *
+     * Every completed scan updates the table. When more than one
+     * discovered BSSID serves the SSID connect() is asked to join,
+     * connect() uses the table to choose the BSSID, as long as the scan
+     * completed less than PICO_W_CM_SCAN_RESULT_MAX_AGE_MS ago. If a join
+     * to the chosen BSSID fails, connect() lets the driver choose until
+     * the next scan completes.
+     * @return const Channel_survey& the survey
+     */
+    const Channel_survey& get_channel_survey() const {return channel_survey; }
+#endif
+
+#if PICO_W_CM_ENABLE_LATENCY_MONITOR
+    /**
+     * @brief Get how long the public calls and task() took to return
+     *
+     * Every call to task(), initialize(), deinitialize(), connect(),
+     * disconnect(), start_scan(), autoconnect(), save_settings(),
+     * load_settings() and get_rssi() is measured with the driver's
+     * microsecond clock, including the calls they make to each other.
+     * @return const Call_latency_monitor& the histograms and worst cases
+     */
+    const Call_latency_monitor& get_latency_monitor() const {return latency_monitor; }
+
+    /**
+     * @brief Forget the latency measurements
+     *
+     * The restart budget uses the measurements, so after a reset the
+     * next restart is deferred if the budget is set.
+     */
+    void reset_latency_monitor() {latency_monitor.reset(); }
+
+    /**
+     * @brief Bound the time connect(), start_scan(), disconnect() and
+     * task() spend restarting the radio
+     *
+     * Restarting the radio reloads the CYW43 firmware. If the worst
+     * measured deinitialize() plus initialize() is longer than the
+     * budget, or has not been measured yet, those calls only request the
+     * restart and return. The link is left at once and the state is
+     * INITIALIZED until task() deinitializes the radio on one call,
+     * initializes it on the next, and finishes the connect() or
+     * start_scan() that requested the restart. No single call can then
+     * take longer than one firmware load.
+     * @param budget_us the budget in microseconds; 0 never defers a restart (the default)
+     */
+    void set_restart_latency_budget_us(uint32_t budget_us) {restart_budget_us = budget_us; }
+
+    /**
+     * @brief Get the restart latency budget in microseconds
+     */
+    uint32_t get_restart_latency_budget_us() const {return restart_budget_us; }
+#endif
+
+    /**
+     * @brief return true if task() has a deferred radio restart to finish
+     */
+    bool is_restart_pending() const {return restart_step != RESTART_NONE; }
+
     /**
      * @brief Get the ip address if the link is up or 0 if it is not
      * 
@@ -308,7 +593,11 @@ public:
      */
     void register_link_up_callback(void (*cb)(void*), void* context)
     {
+#if PICO_W_CM_ENABLE_CALLBACKS
         link_up_callback.cb = cb; link_up_callback.context = context;
+#else
+        (void)cb; (void)context;
+#endif
     }
 
     /**
@@ -320,19 +609,29 @@ public:
      */
     void register_link_down_callback(void (*cb)(void*), void* context)
     {
+#if PICO_W_CM_ENABLE_CALLBACKS
         link_down_callback.cb = cb; link_down_callback.context = context;
+#else
+        (void)cb; (void)context;
+#endif
     }
 
     /**
      * @brief register the callback function to call if the link is in an error state
      *
+     * Also called with "gateway not responding" when the link health
+     * checker declares the link degraded, after the link down callback.
      * To unregister the callback, call this function again with cb==nullptr
      * @param cb
      * @param context
      */
     void register_link_error_callback(void (*cb)(void*, const char*), void* context)
     {
+#if PICO_W_CM_ENABLE_CALLBACKS
         link_error_callback.cb = cb; link_error_callback.context = context;
+#else
+        (void)cb; (void)context;
+#endif
     }
 
     /**
@@ -344,7 +643,11 @@ public:
      */
     void register_scan_complete_callback(void (*cb)(void*), void* context)
     {
+#if PICO_W_CM_ENABLE_CALLBACKS
         scan_complete_callback.cb = cb; scan_complete_callback.context = context;
+#else
+        (void)cb; (void)context;
+#endif
     }
 
     /**
@@ -359,8 +662,28 @@ public:
      * @brief Get the known SSIDs vector
      * 
      * @return const std::vector<Ssid_info>& the known SSIDs
+     * @note the order of the entries changes when an entry is erased
      */
-    const std::vector<Ssid_info>& get_known_ssids() {return known_ssids; }
+    const std::vector<Ssid_info>& get_known_ssids() {return known_ssids.get_entries(); }
+
+    /**
+     * @brief Find the known SSID record for an SSID
+     *
+     * @param ssid the SSID to look up
+     * @return Known_ssid_handle the handle of the record or
+     * Known_network_store::INVALID_HANDLE if the SSID is not known
+     */
+    Known_ssid_handle find_known_ssid(const std::string& ssid) const {return known_ssids.find(ssid); }
+
+    /**
+     * @brief Get the handle of item idx of the known SSIDs vector
+     *
+     * A handle stays valid until its record is erased or evicted.
+     * @param idx the index of the known SSID record
+     * @return Known_ssid_handle the handle or Known_network_store::INVALID_HANDLE
+     * if idx is out of range
+     */
+    Known_ssid_handle get_known_ssid_handle(size_t idx) const {return known_ssids.get_handle(idx); }
 
     /**
      * @brief delete item idx from the known SSIDs vector; store the settings in flash
@@ -369,11 +692,126 @@ public:
      * @param idx the index of the known SSID record to erase
      * @return true if idx is in range and the erase was successful, false otherwise
      */
-    bool erase_known_ssid_by_idx(size_t idx);
+    bool erase_known_ssid_by_idx(size_t idx) {return erase_known_ssid(known_ssids.get_handle(idx)); }
+
+    /**
+     * @brief delete a known SSID record; store the settings in flash
+     *
+     * @note if connected to the SSID to be erased, will also disconnecte and clear current_ssid.
+     * @param handle the handle of the known SSID record to erase
+     * @return true if the handle is valid and the erase was successful, false otherwise
+     */
+    bool erase_known_ssid(Known_ssid_handle handle);
+
+    /**
+     * @brief Set the maximum number of known SSIDs and how to choose
+     * a record to evict when a new SSID is added to a full list
+     *
+     * While connected, the record for the current SSID is never evicted.
+     * Does not store the settings in flash if records are evicted.
+     * @param capacity the maximum number of known SSID records
+     * @param policy the eviction policy
+     */
+    void set_known_ssid_capacity(size_t capacity, Known_network_store::Eviction_policy policy)
+    {
+        known_ssids.set_eviction_policy(policy);
+        if (known_ssids.size() > capacity) {
+            settings_saved_state = NOT_SAVED;
+        }
+        known_ssids.set_capacity(capacity);
+        update_scan_view_known();
+    }
+
+    /**
+     * @brief Add or update many known SSID records and store the settings
+     * in flash once
+     *
+     * Invalid records (empty or too long SSID, unsupported security, or a
+     * passphrase that is not 8-64 characters for a secure network) are
+     * skipped. If the batch contains the same SSID more than once, the last
+     * record wins. Records are added in batch order, and each new SSID
+     * added to a full list evicts one record per the eviction policy. With
+     * EVICT_LEAST_RECENTLY_USED, the records that were already known and
+     * are not in the batch are evicted first, then the earliest records of
+     * the batch. With EVICT_LEAST_SUCCESSFUL, known records that never
+     * connected are evicted first, then the earliest records of the batch,
+     * then the known records with the fewest successful connections.
+     * While connected, the record for the current SSID is never evicted.
+     * @param batch the records to import
+     * @param n_rejected if not nullptr, receives the number of invalid records
+     * @return true if the settings were saved or did not change, false otherwise
+     */
+    bool import_known_ssids(const std::vector<Ssid_info>& batch, size_t* n_rejected = nullptr);
+
+    /**
+     * @brief Import the records of a fully parsed provisioning blob
+     *
+     * @param parser the parser that received the whole blob
+     * @param n_rejected if not nullptr, receives the number of invalid records
+     * @return true if the blob is complete and import_known_ssids() succeeded, false otherwise
+     */
+    bool import_known_ssids(const Provisioning_blob_parser& parser, size_t* n_rejected = nullptr)
+    {
+        if (parser.get_parse_state() != Provisioning_blob_parser::COMPLETE) {
+            return false;
+        }
+        return import_known_ssids(parser.get_records(), n_rejected);
+    }
+
+    /**
+     * @brief Copy all known SSID records
+     *
+     * @param batch receives the records
+     */
+    void export_known_ssids(std::vector<Ssid_info>& batch) {batch = known_ssids.get_entries(); }
+
+    /**
+     * @brief Encode all known SSID records as a provisioning blob
+     *
+     * @param blob receives the encoded records
+     * @return size_t the number of records encoded
+     */
+    size_t export_known_ssids(std::vector<uint8_t>& blob) {return Provisioning_blob_parser::encode(known_ssids.get_entries(), blob); }
+
+    /**
+     * @brief Get the heap bytes one subsystem holds now and at most
+     *
+     * The scan results, settings I/O and credential store are tracked as
+     * they allocate and free; the strings are measured by this call. The
+     * parson DOM counts against settings I/O only if the application
+     * called Memory_accounting::install_parson_hooks() first.
+     * @param subsystem the subsystem
+     * @param usage receives the current and peak bytes and allocation counts
+     * @return true if successful, false if PICO_W_CM_ENABLE_MEMORY_ACCOUNTING is 0
+     */
+    bool get_memory_usage(Memory_subsystem subsystem, Memory_accounting::Usage& usage);
+
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+    /**
+     * @brief Get the settings storage backend, for example to read its statistics
+     *
+     * @return Settings_storage* the backend
+     */
+    Settings_storage* get_settings_storage() {return storage; }
+#endif
 
     Settings_saved_state get_settings_saved_state() { return settings_saved_state; }
 
-    const char* get_last_link_error() {return last_link_error.c_str(); }
+    const char* get_last_link_error() {return last_link_error; }
+
+    /**
+     * @brief Get the reason the link last failed as a code
+     */
+    Link_error get_last_link_error_code() {return current_status.last_error; }
+
+    /**
+     * @brief Copy the status snapshot task() most recently published
+     *
+     * Safe to call from either core and from interrupt handlers. It does
+     * not take any lock and does not call the Wi-Fi driver.
+     * @param snapshot receives the status
+     */
+    void get_status_snapshot(Status_snapshot& snapshot) const {published_status.read(snapshot); }
 private:
     struct wifi_callback {
         void (*cb)(void*);
@@ -383,24 +821,121 @@ private:
         void (*cb)(void*, const char*); // context, error string
         void* context;
     };
-    static int static_scan_result(void *env, const cyw43_ev_scan_result_t *result);
+    static int static_scan_result(void *env, const Wifi_driver::Scan_result *result);
+#if PICO_W_CM_ENABLE_SCAN
+    void update_channel_survey();
+    void update_scan_view();
+    const Wifi_driver::Scan_result* select_bssid();
+#endif
+    void update_scan_view_known();
+    void set_state(Wifi_state new_state);
+    enum Restart_step {
+        RESTART_NONE,
+        RESTART_DEINIT,     // task() must deinitialize the radio next
+        RESTART_INIT        // task() must initialize the radio next
+    };
+    enum After_restart {
+        AFTER_RESTART_NONE,
+        AFTER_RESTART_CONNECT,
+        AFTER_RESTART_SCAN
+    };
+    bool restart_radio(After_restart after);
+    void restart_step_task();
+#if PICO_W_CM_ENABLE_LATENCY_MONITOR
+    /**
+     * @brief Record the duration of the enclosing scope and the state
+     * transition it made
+     */
+    class Latency_scope
+    {
+    public:
+        Latency_scope(Pico_w_connection_manager& cm_, Call_latency_monitor::Call call_) :
+            cm{cm_}, call{call_}, from_state{static_cast<uint8_t>(cm_.state)}, start_us{cm_.driver->timestamp_us()} {}
+        ~Latency_scope()
+        {
+            uint32_t now = cm.driver->timestamp_us();
+            cm.latency_monitor.record(call, now - start_us, from_state, static_cast<uint8_t>(cm.state), now);
+        }
+        Latency_scope(Latency_scope const&) = delete;
+        void operator=(Latency_scope const&) = delete;
+    private:
+        Pico_w_connection_manager& cm;
+        Call_latency_monitor::Call call;
+        uint8_t from_state;
+        uint32_t start_us;
+    };
+#endif
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+    bool load_settings(bool& found);
+    bool apply_settings(const char* json);
+#endif
     
     void add_known_ssid(const Ssid_info& info);
+    static bool is_valid_known_ssid(const Ssid_info& info);
     void link_up_action();
+    void notify_link_up();
+    void notify_link_down();
+    void notify_link_error();
+    void notify_scan_complete();
+    static const char* find_country(uint32_t icode);
+    void set_link_error(Link_error code);
+    void publish_status();
+    void drain_log();
+    bool apply_power_profile(Power_profile profile);
+    uint32_t now_ms() {return driver->now_ms(); }
+    Cyw43_wifi_driver default_driver;
+    Wifi_driver* driver;
     uint32_t country_code;
-    std::map<uint32_t, std::string> countries;
     Wifi_state state;
     Ssid_info current_ssid;
-    std::vector<Ssid_info> known_ssids;
-    absolute_time_t scan_test;
-    std::vector<cyw43_ev_scan_result_t> discovered_ssids;
+    Known_network_store known_ssids;
+    bool scan_holdoff;              // true to wait scan_holdoff_ms after scan_holdoff_start_ms before scanning
+    uint32_t scan_holdoff_start_ms;
+    static const uint32_t scan_holdoff_ms = 10000;
+    std::vector<Wifi_driver::Scan_result> discovered_ssids;
+#if PICO_W_CM_ENABLE_SCAN
+    Channel_survey channel_survey;
+    Scan_view scan_view;
+    uint32_t scan_complete_ms;
+    bool bssid_choice_allowed;      // false until a scan completes and after a join to the chosen BSSID fails
+    bool bssid_chosen;              // true if the last connect() joined a BSSID select_bssid() chose
+#endif
+#if PICO_W_CM_ENABLE_CALLBACKS
     wifi_callback link_up_callback;
     wifi_callback link_down_callback;
     wifi_err_cb link_error_callback;
     wifi_callback scan_complete_callback;
+#endif
     Settings_saved_state settings_saved_state;
-    std::string last_link_error;
-    static constexpr const char* wifi_info_dir{"/wifi_info"};
-    static constexpr const char* wifi_info_file{"/wifi_info/wifi_info.json"};
+    const char* last_link_error;      // always a string literal so the event log can refer to it
+    Wifi_power_governor power_governor;
+    Link_health_checker health_checker;
+#if PICO_W_CM_ENABLE_SELF_TEST
+    Link_self_test self_test;
+#endif
+#if PICO_W_CM_ENABLE_DNS_CACHE
+    Dns_cache dns_cache;
+    bool dns_save_pending;              // a cached address changed since the last save
+    bool dns_saved;                     // task() has saved a changed address before
+    uint32_t dns_saved_ms;              // when task() last saved a changed address
+#endif
+    Status_snapshot current_status;
+    Seqlock<Status_snapshot> published_status;
+    uint32_t rssi_refresh_ms;
+    uint32_t link_up_since_ms;
+    uint64_t closed_link_uptime_ms;     // total uptime of the links that went down
+    Restart_step restart_step;
+    After_restart restart_after;        // what to do when the deferred restart finishes
+    size_t log_drain_per_task;
+#if PICO_W_CM_ENABLE_LATENCY_MONITOR
+    Call_latency_monitor latency_monitor;
+    uint32_t restart_budget_us;
+#endif
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+    Littlefs_settings_storage default_storage;
+    Settings_storage* storage;
+    unsigned settings_slot;         // the slot that holds the newest settings
+    uint32_t settings_generation;   // the generation of those settings
+#endif
 };
 }
\ No newline at end of file
@@ -0,0 +1,215 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+/**
+ * @file pico_w_connection_manager_config.h
+ * @brief Compile-time configuration of the Pico_w_connection_manager class
+ *
+ * Each PICO_W_CM_ENABLE_xxx option selects whether a subsystem is built.
+ * A subsystem that is set to 0 is compiled out completely and its public
+ * functions become stubs that return failure, so application code does
+ * not need to change. The defaults build everything except memory
+ * accounting, which is the original behavior of this class. Set the options with
+ * target_compile_definitions() or the CMake cache variables of the
+ * same name (see CMakeLists.txt).
+ */
+
+/**
+ * @brief Store settings and known SSIDs as JSON in flash
+ *
+ * If 0, parson and littlefs are not required, save_settings() and
+ * load_settings() return false, and autoconnect() connects to the
+ * network described by PICO_W_CM_DEFAULT_SSID, PICO_W_CM_DEFAULT_PASSPHRASE
+ * and PICO_W_CM_DEFAULT_SECURITY.
+ */
+#ifndef PICO_W_CM_ENABLE_SETTINGS_STORAGE
+#define PICO_W_CM_ENABLE_SETTINGS_STORAGE 1
+#endif
+
+/**
+ * @brief Support scanning for access points
+ *
+ * If 0, start_scan() returns false and get_discovered_ssids() is always empty.
+ */
+#ifndef PICO_W_CM_ENABLE_SCAN
+#define PICO_W_CM_ENABLE_SCAN 1
+#endif
+
+/**
+ * @brief How long connect() may use scan results to choose a BSSID
+ *
+ * Access points move channel and go away. After this many milliseconds
+ * without a completed scan, connect() lets the driver choose the BSSID.
+ */
+#ifndef PICO_W_CM_SCAN_RESULT_MAX_AGE_MS
+#define PICO_W_CM_SCAN_RESULT_MAX_AGE_MS 60000
+#endif
+
+/**
+ * @brief Include the table of country names
+ *
+ * If 0, set_country_code() accepts any 2-letter code, and the only
+ * country with a name is Worldwide.
+ */
+#ifndef PICO_W_CM_ENABLE_COUNTRY_TABLE
+#define PICO_W_CM_ENABLE_COUNTRY_TABLE 1
+#endif
+
+/**
+ * @brief Support the link up, link down, link error and scan complete callbacks
+ *
+ * If 0, the register_xxx_callback() functions do nothing.
+ */
+#ifndef PICO_W_CM_ENABLE_CALLBACKS
+#define PICO_W_CM_ENABLE_CALLBACKS 1
+#endif
+
+/**
+ * @brief Support the on-demand throughput and latency self-test
+ *
+ * If 0, start_self_test() and the related functions do not exist.
+ */
+#ifndef PICO_W_CM_ENABLE_SELF_TEST
+#define PICO_W_CM_ENABLE_SELF_TEST 1
+#endif
+
+/**
+ * @brief Remember the addresses of the application's hosts per network
+ * and hand them to lwIP after link up
+ *
+ * If 0, add_dns_cache_host() and the related functions do not exist.
+ */
+#ifndef PICO_W_CM_ENABLE_DNS_CACHE
+#define PICO_W_CM_ENABLE_DNS_CACHE 1
+#endif
+
+/**
+ * @brief The shortest time between two saves of the settings that task()
+ * makes because a cached DNS address changed
+ *
+ * Each save erases flash. Until the next save, changed addresses are
+ * lost if the power goes off, and get_settings_saved_state() reports
+ * NOT_SAVED.
+ */
+#ifndef PICO_W_CM_DNS_CACHE_SAVE_INTERVAL_MS
+#define PICO_W_CM_DNS_CACHE_SAVE_INTERVAL_MS 3600000
+#endif
+
+/**
+ * @brief Measure how long the public calls and task() take and allow
+ * radio restarts to be deferred to task()
+ *
+ * If 0, get_latency_monitor() and the related functions do not exist,
+ * and radio restarts always complete before the call returns.
+ */
+#ifndef PICO_W_CM_ENABLE_LATENCY_MONITOR
+#define PICO_W_CM_ENABLE_LATENCY_MONITOR 1
+#endif
+
+/**
+ * @brief Build Wifi_metrics_server, which serves the status snapshot to
+ * Prometheus over HTTP
+ *
+ * If 0, wifi_metrics_server.cpp is not built, so Wifi_metrics_server
+ * cannot be used.
+ */
+#ifndef PICO_W_CM_ENABLE_METRICS
+#define PICO_W_CM_ENABLE_METRICS 1
+#endif
+
+/**
+ * @brief Count the heap bytes the scan results, settings I/O, credential
+ * store and strings hold
+ *
+ * Off by default because every tracked allocation briefly disables
+ * interrupts. See memory_accounting.h.
+ */
+#ifndef PICO_W_CM_ENABLE_MEMORY_ACCOUNTING
+#define PICO_W_CM_ENABLE_MEMORY_ACCOUNTING 0
+#endif
+
+/**
+ * @brief Record progress and error messages in the event log
+ *
+ * See wifi_event_log.h and PICO_W_CM_LOG_LEVEL.
+ */
+#ifndef PICO_W_CM_ENABLE_LOGGING
+#define PICO_W_CM_ENABLE_LOGGING 1
+#endif
+
+#ifndef PICO_W_CM_DEFAULT_SSID
+#define PICO_W_CM_DEFAULT_SSID ""
+#endif
+
+#ifndef PICO_W_CM_DEFAULT_PASSPHRASE
+#define PICO_W_CM_DEFAULT_PASSPHRASE ""
+#endif
+
+#ifndef PICO_W_CM_DEFAULT_SECURITY
+#define PICO_W_CM_DEFAULT_SECURITY 0
+#endif
+
+#define PICO_W_CM_LOG_LEVEL_NONE 0
+#define PICO_W_CM_LOG_LEVEL_ERROR 1
+#define PICO_W_CM_LOG_LEVEL_WARN 2
+#define PICO_W_CM_LOG_LEVEL_INFO 3
+#define PICO_W_CM_LOG_LEVEL_DEBUG 4
+
+/**
+ * @brief The least severe log level that is compiled in
+ *
+ * Log calls below this level generate no code. If PICO_W_CM_ENABLE_LOGGING
+ * is 0, nothing is logged regardless of this setting.
+ */
+#ifndef PICO_W_CM_LOG_LEVEL
+#define PICO_W_CM_LOG_LEVEL PICO_W_CM_LOG_LEVEL_INFO
+#endif
+#if !PICO_W_CM_ENABLE_LOGGING
+#undef PICO_W_CM_LOG_LEVEL
+#define PICO_W_CM_LOG_LEVEL PICO_W_CM_LOG_LEVEL_NONE
+#endif
+
+/**
+ * @brief The number of entries the log ring buffer holds; must be a power of 2
+ */
+#ifndef PICO_W_CM_LOG_ENTRIES
+#define PICO_W_CM_LOG_ENTRIES 32
+#endif
+
+/**
+ * @brief The number of log entries each Pico_w_connection_manager::task()
+ * call prints; 0 (the default) to leave draining the log to the
+ * application, so that task() never blocks on stdio
+ */
+#ifndef PICO_W_CM_LOG_DRAIN_PER_TASK
+#define PICO_W_CM_LOG_DRAIN_PER_TASK 0
+#endif
+
+/**
+ * @brief The size of the buffer Wifi_metrics_server renders a response into
+ */
+#ifndef PICO_W_CM_METRICS_BUFFER_SIZE
+#define PICO_W_CM_METRICS_BUFFER_SIZE 2560
+#endif
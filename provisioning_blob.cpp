@@ -0,0 +1,184 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "provisioning_blob.h"
+#include "crc32.h"
+
+void rppicomidi::Provisioning_blob_parser::reset()
+{
+    parse_state = IN_PROGRESS;
+    field = MAGIC;
+    field_pos = 0;
+    field_len = 4;
+    value = 0;
+    crc = 0;
+    n_records = 0;
+    records.clear();
+}
+
+rppicomidi::Provisioning_blob_parser::Parse_state rppicomidi::Provisioning_blob_parser::feed(const uint8_t* data, size_t len)
+{
+    for (size_t idx = 0; idx < len; idx++) {
+        if (parse_state != IN_PROGRESS) {
+            parse_state = FAILED;
+            break;
+        }
+        parse_state = parse_byte(data[idx]);
+    }
+    return parse_state;
+}
+
+void rppicomidi::Provisioning_blob_parser::next_record()
+{
+    if (records.size() < n_records) {
+        record.ssid.clear();
+        record.passphrase.clear();
+        field = SSID_LEN;
+        field_len = 1;
+    }
+    else {
+        field = CRC;
+        field_len = 4;
+    }
+    field_pos = 0;
+    value = 0;
+}
+
+rppicomidi::Provisioning_blob_parser::Parse_state rppicomidi::Provisioning_blob_parser::parse_byte(uint8_t byte)
+{
+    if (field != CRC) {
+        crc = crc32_update(crc, &byte, 1);
+    }
+    // accumulate little endian integers
+    value |= static_cast<uint32_t>(byte) << (8 * (field_pos < 4 ? field_pos : 0));
+    if (++field_pos < field_len) {
+        if (field == MAGIC && byte != static_cast<uint8_t>(magic[field_pos - 1])) {
+            return FAILED;
+        }
+        if (field == SSID) {
+            record.ssid.push_back(static_cast<char>(byte));
+        }
+        else if (field == PW) {
+            record.passphrase.push_back(static_cast<char>(byte));
+        }
+        return IN_PROGRESS;
+    }
+    // the last byte of the field
+    switch (field) {
+        case MAGIC:
+            if (byte != static_cast<uint8_t>(magic[field_pos - 1])) {
+                return FAILED;
+            }
+            field = VERSION;
+            field_len = 1;
+            break;
+        case VERSION:
+            if (byte != BLOB_VERSION) {
+                return FAILED;
+            }
+            field = COUNT;
+            field_len = 2;
+            break;
+        case COUNT:
+            // the count is not trusted with an allocation; records grow
+            // only as fast as the bytes that describe them arrive
+            n_records = value;
+            next_record();
+            return IN_PROGRESS;
+        case SSID_LEN:
+            if (value == 0 || value > max_ssid_len) {
+                return FAILED;
+            }
+            field = SSID;
+            field_len = value;
+            break;
+        case SSID:
+            record.ssid.push_back(static_cast<char>(byte));
+            field = PW_LEN;
+            field_len = 1;
+            break;
+        case PW_LEN:
+            if (value > max_pw_len) {
+                return FAILED;
+            }
+            field = value == 0 ? SECURITY : PW;
+            field_len = value == 0 ? 1 : value;
+            break;
+        case PW:
+            record.passphrase.push_back(static_cast<char>(byte));
+            field = SECURITY;
+            field_len = 1;
+            break;
+        case SECURITY:
+            record.security = byte;
+            field = POWER_PROFILE;
+            field_len = 1;
+            break;
+        case POWER_PROFILE:
+            if (byte > Wifi_power_governor::ADAPTIVE) {
+                return FAILED;
+            }
+            record.power_profile = static_cast<Wifi_power_governor::Power_profile>(byte);
+            records.push_back(record);
+            next_record();
+            return IN_PROGRESS;
+        case CRC:
+            return value == crc ? COMPLETE : FAILED;
+    }
+    field_pos = 0;
+    value = 0;
+    return IN_PROGRESS;
+}
+
+size_t rppicomidi::Provisioning_blob_parser::encode(const std::vector<Ssid_info>& records_, std::vector<uint8_t>& blob)
+{
+    blob.assign(magic, magic + 4);
+    blob.push_back(BLOB_VERSION);
+    size_t count_pos = blob.size();
+    blob.push_back(0);
+    blob.push_back(0);
+    uint16_t count = 0;
+    for (auto& info: records_) {
+        if (count == UINT16_MAX) {
+            break;
+        }
+        if (info.ssid.size() == 0 || info.ssid.size() > max_ssid_len || info.passphrase.size() > max_pw_len) {
+            continue;
+        }
+        blob.push_back(info.ssid.size());
+        blob.insert(blob.end(), info.ssid.begin(), info.ssid.end());
+        blob.push_back(info.passphrase.size());
+        blob.insert(blob.end(), info.passphrase.begin(), info.passphrase.end());
+        blob.push_back(static_cast<uint8_t>(info.security));
+        blob.push_back(static_cast<uint8_t>(info.power_profile));
+        ++count;
+    }
+    blob[count_pos] = count & 0xff;
+    blob[count_pos + 1] = (count >> 8) & 0xff;
+    uint32_t blob_crc = crc32_update(0, blob.data(), blob.size());
+    for (int byte = 0; byte < 4; byte++) {
+        blob.push_back((blob_crc >> (8 * byte)) & 0xff);
+    }
+    return count;
+}
@@ -0,0 +1,113 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ssid_info.h"
+
+namespace rppicomidi
+{
+/**
+ * @brief Encode and incrementally decode a provisioning blob of known networks
+ *
+ * A provisioning blob is a compact binary list of Ssid_info records
+ * that can arrive in arbitrarily sized pieces, for example from a
+ * serial port or a TCP connection. All integers are little endian.
+ *
+ *     "PWKN" magic
+ *     uint8_t  version (1)
+ *     uint16_t record count
+ *     record count times:
+ *         uint8_t ssid length (1-32), ssid bytes
+ *         uint8_t passphrase length (0-64), passphrase bytes
+ *         uint8_t security
+ *         uint8_t power profile
+ *     uint32_t CRC-32 of all preceding bytes
+ */
+class Provisioning_blob_parser
+{
+public:
+    enum Parse_state {
+        IN_PROGRESS,    //!< more bytes are required
+        COMPLETE,       //!< a whole blob with a correct CRC was parsed
+        FAILED,         //!< the blob is malformed
+    };
+    static constexpr uint8_t BLOB_VERSION = 1;
+
+    Provisioning_blob_parser() { reset(); }
+
+    /**
+     * @brief Discard all records and prepare to parse a new blob
+     */
+    void reset();
+
+    /**
+     * @brief Parse the next piece of the blob
+     *
+     * @param data the next bytes of the blob
+     * @param len the number of bytes in data
+     * @return Parse_state the state after parsing the bytes; once the
+     * state is COMPLETE or FAILED, any more bytes cause FAILED
+     */
+    Parse_state feed(const uint8_t* data, size_t len);
+
+    Parse_state get_parse_state() const { return parse_state; }
+
+    /**
+     * @brief Get the records parsed so far
+     *
+     * @return const std::vector<Ssid_info>& the records; only trust them
+     * when get_parse_state() returns COMPLETE
+     */
+    const std::vector<Ssid_info>& get_records() const { return records; }
+
+    /**
+     * @brief Encode records as a provisioning blob
+     *
+     * Records that do not fit the format limits are skipped.
+     * @param records the records to encode
+     * @param blob receives the encoded blob
+     * @return size_t the number of records encoded
+     */
+    static size_t encode(const std::vector<Ssid_info>& records, std::vector<uint8_t>& blob);
+private:
+    enum Field { MAGIC, VERSION, COUNT, SSID_LEN, SSID, PW_LEN, PW, SECURITY, POWER_PROFILE, CRC };
+    Parse_state parse_byte(uint8_t byte);
+    void next_record();
+    Parse_state parse_state;
+    Field field;
+    size_t field_pos;
+    size_t field_len;
+    uint32_t value;
+    uint32_t crc;
+    uint16_t n_records;
+    Ssid_info record;
+    std::vector<Ssid_info> records;
+    static constexpr const char* magic{"PWKN"};
+    static constexpr size_t max_ssid_len = 32;
+    static constexpr size_t max_pw_len = 64;
+};
+}
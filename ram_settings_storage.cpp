@@ -0,0 +1,47 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "ram_settings_storage.h"
+
+bool rppicomidi::Ram_settings_storage::do_read(unsigned slot, std::string& data)
+{
+    if (!valid[slot]) {
+        return false;
+    }
+    data = slots[slot];
+    return true;
+}
+
+bool rppicomidi::Ram_settings_storage::do_write(unsigned slot, const char* data, size_t len)
+{
+    if (fault_armed) {
+        fault_armed = false;
+        slots[slot].assign(data, fault_offset < len ? fault_offset : len);
+        valid[slot] = true;
+        return false;
+    }
+    slots[slot].assign(data, len);
+    valid[slot] = true;
+    return true;
+}
@@ -0,0 +1,80 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <vector>
+#include "settings_storage.h"
+
+namespace rppicomidi
+{
+/**
+ * @brief Settings storage in RAM
+ *
+ * Nothing survives a reset. Use it to test and simulate code that
+ * stores settings, or for products that provision the network at
+ * every boot.
+ */
+class Ram_settings_storage : public Settings_storage
+{
+public:
+    /**
+     * @brief Construct a new Ram_settings_storage object
+     *
+     * @param num_slots_ the number of slots
+     */
+    Ram_settings_storage(unsigned num_slots_ = 2) : slots(num_slots_), valid(num_slots_, false),
+        fault_armed{false}, fault_offset{0} {}
+
+    unsigned get_num_slots() const override { return slots.size(); }
+
+    /**
+     * @brief Erase a slot so that read() fails for it
+     *
+     * @param slot the slot number
+     */
+    void erase(unsigned slot) { if (slot < valid.size()) { valid[slot] = false; slots[slot].clear(); } }
+
+    /**
+     * @brief Simulate a power cut during the next write
+     *
+     * The next write replaces the slot with only the first offset bytes
+     * of its data and fails, as if the device lost power after storing
+     * them. Later writes succeed.
+     * @param offset the number of bytes the interrupted write stores
+     */
+    void set_write_fault(size_t offset) { fault_armed = true; fault_offset = offset; }
+
+    /**
+     * @brief Cancel a fault set with set_write_fault() that has not happened
+     */
+    void clear_write_fault() { fault_armed = false; }
+protected:
+    bool do_read(unsigned slot, std::string& data) override;
+    bool do_write(unsigned slot, const char* data, size_t len) override;
+    std::vector<std::string> slots;
+    std::vector<bool> valid;
+    bool fault_armed;
+    size_t fault_offset;
+};
+}
@@ -0,0 +1,136 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <algorithm>
+#include <cstring>
+#include "scan_view.h"
+
+void rppicomidi::Scan_view::clear()
+{
+    groups.clear();
+    order.clear();
+    group_by_hash.clear();
+}
+
+uint32_t rppicomidi::Scan_view::hash_ssid(const uint8_t* ssid, uint8_t ssid_len)
+{
+    uint32_t hash = 2166136261u;
+    for (uint8_t idx = 0; idx < ssid_len; idx++) {
+        hash = (hash ^ ssid[idx]) * 16777619u;
+    }
+    return hash;
+}
+
+int rppicomidi::Scan_view::compare_ssid(const Group& group, const uint8_t* ssid, uint8_t ssid_len)
+{
+    int result = memcmp(group.ssid, ssid, std::min(group.ssid_len, ssid_len));
+    if (result != 0) {
+        return result;
+    }
+    return static_cast<int>(group.ssid_len) - static_cast<int>(ssid_len);
+}
+
+uint16_t rppicomidi::Scan_view::find_group(const uint8_t* ssid, uint8_t ssid_len, uint32_t hash) const
+{
+    auto first = group_by_hash.find(hash);
+    if (first == group_by_hash.end()) {
+        return NO_GROUP;
+    }
+    for (uint16_t idx = first->second; idx != NO_GROUP; idx = groups[idx].next_same_hash) {
+        if (compare_ssid(groups[idx], ssid, ssid_len) == 0) {
+            return idx;
+        }
+    }
+    return NO_GROUP;
+}
+
+bool rppicomidi::Scan_view::ranks_before(uint16_t lhs, uint16_t rhs) const
+{
+    const Group& left = groups[lhs];
+    const Group& right = groups[rhs];
+    if (left.rssi != right.rssi) {
+        return left.rssi > right.rssi;
+    }
+    return compare_ssid(left, reinterpret_cast<const uint8_t*>(right.ssid), right.ssid_len) < 0;
+}
+
+void rppicomidi::Scan_view::add(const uint8_t* ssid, uint8_t ssid_len, const uint8_t* bssid, int16_t rssi,
+    uint8_t channel, uint8_t auth_mode, bool known)
+{
+    if (ssid_len > 32) {
+        ssid_len = 32;
+    }
+    uint32_t hash = hash_ssid(ssid, ssid_len);
+    auto cmp = [this](uint16_t lhs, uint16_t rhs) { return ranks_before(lhs, rhs); };
+    uint16_t idx = find_group(ssid, ssid_len, hash);
+    if (idx != NO_GROUP) {
+        Group& group = groups[idx];
+        ++group.num_bssids;
+        if (rssi <= group.rssi) {
+            return;
+        }
+        // No two groups rank the same, so a binary search with the old
+        // RSSI finds the group. It only gets stronger, so it can only
+        // move towards the front.
+        auto old_pos = std::lower_bound(order.begin(), order.end(), idx, cmp);
+        memcpy(group.bssid, bssid, sizeof(group.bssid));
+        group.rssi = rssi;
+        group.channel = channel;
+        group.auth_mode = auth_mode;
+        auto new_pos = std::upper_bound(order.begin(), old_pos, idx, cmp);
+        std::rotate(new_pos, old_pos, old_pos + 1);
+        return;
+    }
+    if (groups.size() >= NO_GROUP) {
+        return;
+    }
+    Group group;
+    memcpy(group.ssid, ssid, ssid_len);
+    group.ssid[ssid_len] = '\0';
+    group.ssid_len = ssid_len;
+    memcpy(group.bssid, bssid, sizeof(group.bssid));
+    group.rssi = rssi;
+    group.channel = channel;
+    group.auth_mode = auth_mode;
+    group.num_bssids = 1;
+    group.known = known;
+    group.hash = hash;
+    idx = static_cast<uint16_t>(groups.size());
+    auto first = group_by_hash.emplace(hash, idx);
+    group.next_same_hash = first.second ? NO_GROUP : first.first->second;
+    first.first->second = idx;
+    groups.push_back(group);
+    order.insert(std::upper_bound(order.begin(), order.end(), idx, cmp), idx);
+}
+
+const rppicomidi::Scan_view::Group* rppicomidi::Scan_view::find(const std::string& ssid) const
+{
+    if (ssid.size() > 32) {
+        return nullptr;
+    }
+    auto bytes = reinterpret_cast<const uint8_t*>(ssid.data());
+    auto len = static_cast<uint8_t>(ssid.size());
+    uint16_t idx = find_group(bytes, len, hash_ssid(bytes, len));
+    return idx != NO_GROUP ? &groups[idx] : nullptr;
+}
@@ -0,0 +1,139 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "memory_accounting.h"
+
+namespace rppicomidi
+{
+/**
+ * @brief The networks a scan found, one group per SSID, sorted by signal
+ * strength
+ *
+ * Feed the view every new BSSID a scan finds. It merges BSSIDs that serve
+ * the same SSID into one group that remembers the strongest BSSID, and it
+ * keeps the groups sorted strongest first as results are added, so a user
+ * interface can list the networks without sorting or comparing strings.
+ * Groups with the same RSSI are sorted by SSID bytes. A BSSID finds its
+ * group through a hash of the SSID, and SSIDs are only compared, by
+ * length and bytes, when the hashes match, so an SSID with NUL bytes is
+ * not the same as a shorter or empty one. Each group also records
+ * whether its SSID is a known network.
+ *
+ * Like Channel_survey, this class does not talk to the Wi-Fi driver, so
+ * it can run on any host.
+ */
+class Scan_view
+{
+public:
+    struct Group {
+        char ssid[33];          //!< the SSID, NUL terminated; empty for hidden networks
+        uint8_t ssid_len;       //!< the number of SSID bytes, which may include NUL bytes
+        uint8_t bssid[6];       //!< the strongest BSSID that serves the SSID
+        int16_t rssi;           //!< the RSSI of the strongest BSSID in dBm
+        uint8_t channel;        //!< the channel of the strongest BSSID
+        uint8_t auth_mode;      //!< the authentication mode the scan reported for the strongest BSSID
+        uint16_t num_bssids;    //!< the number of BSSIDs that serve the SSID
+        bool known;             //!< true if the SSID is a known network
+        uint32_t hash;          //!< FNV-1a hash of the SSID, to find the group quickly
+        uint16_t next_same_hash; //!< the next group whose SSID has the same hash, or NO_GROUP
+    };
+    static constexpr uint16_t NO_GROUP = UINT16_MAX;
+
+    Scan_view() = default;
+    Scan_view(Scan_view const&) = delete;
+    void operator=(Scan_view const&) = delete;
+
+    /**
+     * @brief Forget all groups before a new scan
+     */
+    void clear();
+
+    /**
+     * @brief Add a BSSID the scan found
+     *
+     * Call this once per BSSID.
+     * @param ssid the SSID bytes, not NUL terminated
+     * @param ssid_len the number of SSID bytes; at most 32
+     * @param bssid the 6 byte BSSID
+     * @param rssi the RSSI in dBm
+     * @param channel the channel
+     * @param auth_mode the authentication mode the scan reported
+     * @param known true if the SSID is a known network
+     */
+    void add(const uint8_t* ssid, uint8_t ssid_len, const uint8_t* bssid, int16_t rssi,
+        uint8_t channel, uint8_t auth_mode, bool known);
+
+    /**
+     * @brief Update every group's known flag
+     *
+     * Call this after the known networks change.
+     * @param is_known returns true if the SSID passed to it is a known network
+     */
+    template <typename Predicate>
+    void refresh_known(Predicate is_known)
+    {
+        for (auto& group: groups) {
+            group.known = is_known(std::string(group.ssid, group.ssid_len));
+        }
+    }
+
+    /**
+     * @brief Get the number of groups
+     */
+    size_t size() const { return order.size(); }
+
+    /**
+     * @brief Get a group by rank
+     *
+     * @param rank 0 for the group with the strongest BSSID, size()-1 for
+     * the weakest
+     * @return const Group& the group
+     */
+    const Group& get(size_t rank) const { return groups[order[rank]]; }
+
+    /**
+     * @brief Find the group for an SSID
+     *
+     * @param ssid the SSID
+     * @return const Group* the group or nullptr if the scan did not find the SSID
+     */
+    const Group* find(const std::string& ssid) const;
+private:
+    static uint32_t hash_ssid(const uint8_t* ssid, uint8_t ssid_len);
+    static int compare_ssid(const Group& group, const uint8_t* ssid, uint8_t ssid_len);
+    uint16_t find_group(const uint8_t* ssid, uint8_t ssid_len, uint32_t hash) const;
+    bool ranks_before(uint16_t lhs, uint16_t rhs) const;
+    std::vector<Group, Accounted_allocator<Group, MEM_SCAN_RESULTS>> groups;       // in the order found
+    std::vector<uint16_t, Accounted_allocator<uint16_t, MEM_SCAN_RESULTS>> order;  // indices into groups, strongest first
+    // the first group for each SSID hash; the others are chained through next_same_hash
+    std::unordered_map<uint32_t, uint16_t, std::hash<uint32_t>, std::equal_to<uint32_t>,
+        Accounted_allocator<std::pair<const uint32_t, uint16_t>, MEM_SCAN_RESULTS>> group_by_hash;
+};
+}
@@ -0,0 +1,121 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace rppicomidi
+{
+/**
+ * @brief Publish a value from one writer to readers on any core or in
+ * any interrupt handler without locks
+ *
+ * The value is double buffered and each buffer has its own sequence
+ * counter. The writer always fills the buffer readers are not directed
+ * to, so an interrupt handler that preempts the writer on the same core
+ * still finds a consistent copy on its first or second attempt. Only
+ * atomic loads and stores are used, which the RP2040 Cortex-M0+ supports
+ * without library lock helpers.
+ *
+ * @tparam T a trivially copyable type
+ */
+template <typename T>
+class Seqlock
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Seqlock requires a trivially copyable type");
+public:
+    Seqlock() : newest{0}
+    {
+        for (auto& slot: slots) {
+            slot.sequence.store(0, std::memory_order_relaxed);
+            memset(&slot.value, 0, sizeof(slot.value));
+        }
+    }
+
+    /**
+     * @brief Publish a new value
+     *
+     * Only one thread of execution may call this function.
+     * @param value the value to publish
+     */
+    void write(const T& value)
+    {
+        uint32_t idx = newest.load(std::memory_order_relaxed) ^ 1;
+        Slot& slot = slots[idx];
+        uint32_t seq = slot.sequence.load(std::memory_order_relaxed);
+        slot.sequence.store(seq + 1, std::memory_order_relaxed); // odd: write in progress
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&slot.value, &value, sizeof(T));
+        slot.sequence.store(seq + 2, std::memory_order_release);
+        newest.store(idx, std::memory_order_release);
+    }
+
+    /**
+     * @brief Try once to copy a consistent published value
+     *
+     * @param value receives the value
+     * @return true if value is consistent, false if the writer changed
+     * both buffers during the copy
+     */
+    bool try_read(T& value) const
+    {
+        uint32_t idx = newest.load(std::memory_order_acquire);
+        return read_slot(slots[idx], value) || read_slot(slots[idx ^ 1], value);
+    }
+
+    /**
+     * @brief Copy a consistent published value
+     *
+     * From an interrupt handler on the writer's core this always
+     * completes within one call to try_read(). From another core it
+     * retries only if the writer publishes twice during a copy.
+     * @param value receives the value
+     */
+    void read(T& value) const
+    {
+        while (!try_read(value)) {
+        }
+    }
+private:
+    struct Slot {
+        std::atomic<uint32_t> sequence;
+        T value;
+    };
+    static bool read_slot(const Slot& slot, T& value)
+    {
+        uint32_t seq1 = slot.sequence.load(std::memory_order_acquire);
+        if (seq1 & 1) {
+            return false;
+        }
+        memcpy(&value, &slot.value, sizeof(T));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == seq1;
+    }
+    Slot slots[2];
+    std::atomic<uint32_t> newest;
+};
+}
@@ -0,0 +1,70 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "settings_record.h"
+#include "crc32.h"
+
+static const char record_magic[] = "PWS1 ";
+
+void rppicomidi::Settings_record::encode_header(char* header, uint32_t generation, const char* payload, size_t len)
+{
+    char text[HEADER_LEN + 1];
+    snprintf(text, sizeof(text), "%s%08" PRIx32 " %08" PRIx32 "\n", record_magic, generation, crc32_update(0, payload, len));
+    memcpy(header, text, HEADER_LEN);
+}
+
+bool rppicomidi::Settings_record::decode(const std::string& record, uint32_t& generation, size_t& payload_offset)
+{
+    if (!record.empty() && record[0] == '{') {
+        // legacy plain JSON; the JSON parser decides whether it is intact
+        generation = 0;
+        payload_offset = 0;
+        return true;
+    }
+    const size_t magic_len = sizeof(record_magic) - 1;
+    if (record.size() <= HEADER_LEN || record.compare(0, magic_len, record_magic) != 0 ||
+            record[magic_len + 8] != ' ' || record[HEADER_LEN - 1] != '\n') {
+        return false;
+    }
+    char field[9];
+    field[8] = '\0';
+    char* end;
+    memcpy(field, record.data() + magic_len, 8);
+    uint32_t gen = static_cast<uint32_t>(strtoul(field, &end, 16));
+    if (end != field + 8) {
+        return false;
+    }
+    memcpy(field, record.data() + magic_len + 9, 8);
+    uint32_t crc = static_cast<uint32_t>(strtoul(field, &end, 16));
+    if (end != field + 8 || crc32_update(0, record.data() + HEADER_LEN, record.size() - HEADER_LEN) != crc) {
+        return false;
+    }
+    generation = gen;
+    payload_offset = HEADER_LEN;
+    return true;
+}
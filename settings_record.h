@@ -0,0 +1,78 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace rppicomidi
+{
+/**
+ * @brief The framing that makes a settings slot safe to overwrite
+ *
+ * The connection manager alternates settings writes between two storage
+ * slots. Each record starts with a HEADER_LEN byte text header,
+ *
+ *     PWS1 <generation> <crc>\n
+ *
+ * with the generation and the CRC-32 of the payload in 8 hex digits each,
+ * followed by the JSON payload. A write that was cut short fails the CRC
+ * check, so the other slot, which holds the previous generation, is
+ * loaded instead. A slot that holds plain JSON from before records were
+ * introduced is accepted as generation 0.
+ */
+class Settings_record
+{
+public:
+    static constexpr size_t HEADER_LEN = 23;
+
+    /**
+     * @brief Fill in the header of a record
+     *
+     * @param header receives HEADER_LEN bytes; not NUL terminated
+     * @param generation the generation of the record
+     * @param payload the payload that follows the header
+     * @param len the number of bytes in payload
+     */
+    static void encode_header(char* header, uint32_t generation, const char* payload, size_t len);
+
+    /**
+     * @brief Check a record read from a slot
+     *
+     * @param record the slot contents
+     * @param generation receives the generation of the record
+     * @param payload_offset receives the offset of the payload in record
+     * @return true if the record is intact or is legacy plain JSON, false otherwise
+     */
+    static bool decode(const std::string& record, uint32_t& generation, size_t& payload_offset);
+
+    /**
+     * @brief return true if generation a was written after generation b
+     *
+     * Works across generation counter wrap-around.
+     */
+    static bool is_newer(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) > 0; }
+};
+}
@@ -0,0 +1,70 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstring>
+#include "pico/time.h"
+#include "settings_storage.h"
+
+void rppicomidi::Settings_storage::reset_stats()
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool rppicomidi::Settings_storage::read(unsigned slot, std::string& data)
+{
+    if (slot >= get_num_slots()) {
+        return false;
+    }
+    uint64_t start = time_us_64();
+    bool result = do_read(slot, data);
+    uint32_t elapsed = time_us_64() - start;
+    ++stats.reads;
+    stats.read_us += elapsed;
+    if (elapsed > stats.max_read_us) {
+        stats.max_read_us = elapsed;
+    }
+    if (!result) {
+        ++stats.failures;
+    }
+    return result;
+}
+
+bool rppicomidi::Settings_storage::write(unsigned slot, const char* data, size_t len)
+{
+    if (slot >= get_num_slots()) {
+        return false;
+    }
+    uint64_t start = time_us_64();
+    bool result = do_write(slot, data, len);
+    uint32_t elapsed = time_us_64() - start;
+    ++stats.writes;
+    stats.write_us += elapsed;
+    if (elapsed > stats.max_write_us) {
+        stats.max_write_us = elapsed;
+    }
+    if (!result) {
+        ++stats.failures;
+    }
+    return result;
+}
@@ -0,0 +1,93 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace rppicomidi
+{
+/**
+ * @brief Interface to nonvolatile storage for the connection manager settings
+ *
+ * A storage backend holds a small number of independent slots. Each
+ * slot holds one block of bytes that is replaced completely on every
+ * write. The base class counts operations and measures how long they
+ * take so backends can be compared.
+ */
+class Settings_storage
+{
+public:
+    struct Stats {
+        uint32_t mounts;        //!< number of times the backend mounted a file system
+        uint32_t reads;         //!< number of read() calls
+        uint32_t writes;        //!< number of write() calls
+        uint32_t failures;      //!< number of read() or write() calls that failed
+        uint64_t read_us;       //!< total time spent in read()
+        uint64_t write_us;      //!< total time spent in write()
+        uint32_t max_read_us;   //!< longest read() call
+        uint32_t max_write_us;  //!< longest write() call
+    };
+    static constexpr unsigned PRIMARY_SLOT = 0;
+
+    Settings_storage() { reset_stats(); }
+    virtual ~Settings_storage() = default;
+
+    /**
+     * @brief Read the contents of a slot
+     *
+     * @param slot the slot number; less than get_num_slots()
+     * @param data receives the contents of the slot
+     * @return true if the slot holds data and it was read, false otherwise
+     */
+    bool read(unsigned slot, std::string& data);
+
+    /**
+     * @brief Replace the contents of a slot
+     *
+     * @param slot the slot number; less than get_num_slots()
+     * @param data the new contents
+     * @param len the number of bytes in data
+     * @return true if successful, false otherwise
+     */
+    bool write(unsigned slot, const char* data, size_t len);
+
+    /**
+     * @brief Get the number of slots the backend supports
+     */
+    virtual unsigned get_num_slots() const = 0;
+
+    /**
+     * @brief Get the operation counts and timing
+     */
+    const Stats& get_stats() const { return stats; }
+
+    void reset_stats();
+protected:
+    virtual bool do_read(unsigned slot, std::string& data) = 0;
+    virtual bool do_write(unsigned slot, const char* data, size_t len) = 0;
+    Stats stats;
+};
+}
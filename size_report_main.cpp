@@ -0,0 +1,124 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+/**
+ * @file size_report_main.cpp
+ * @brief A program that calls every public subsystem of the
+ * Pico_w_connection_manager class so the linker keeps whatever the
+ * compile-time configuration includes.
+ *
+ * It is only built if the CMake option PICO_W_CM_SIZE_REPORT is ON. It is
+ * not meant to be run.
+ */
+#include <vector>
+#include <string>
+#include "pico/stdlib.h"
+#include "pico_w_connection_manager.h"
+#if PICO_W_CM_ENABLE_METRICS
+#include "wifi_metrics_server.h"
+#endif
+
+static void link_up(void*) {}
+static void link_down(void*) {}
+static void link_error(void*, const char*) {}
+// Read by nothing; keeps the scan view code from being optimized away
+static volatile int strongest_known_rssi;
+
+static void scan_complete(void* context)
+{
+#if PICO_W_CM_ENABLE_SCAN
+    auto wifi = reinterpret_cast<rppicomidi::Pico_w_connection_manager*>(context);
+    const auto& view = wifi->get_scan_view();
+    for (size_t rank = 0; rank < view.size(); rank++) {
+        if (view.get(rank).known) {
+            strongest_known_rssi = view.get(rank).rssi;
+            break;
+        }
+    }
+#else
+    (void)context;
+#endif
+}
+
+int main()
+{
+    stdio_init_all();
+    rppicomidi::Memory_accounting::install_parson_hooks();
+    static rppicomidi::Pico_w_connection_manager wifi;
+    wifi.register_link_up_callback(link_up, nullptr);
+    wifi.register_link_down_callback(link_down, nullptr);
+    wifi.register_link_error_callback(link_error, nullptr);
+    wifi.register_scan_complete_callback(scan_complete, &wifi);
+    std::vector<std::string> codes;
+    wifi.get_all_country_codes(codes);
+    wifi.set_country_code(codes.size() > 1 ? "US" : "XX");
+    wifi.start_scan();
+#if PICO_W_CM_ENABLE_DNS_CACHE
+    wifi.add_dns_cache_host("pool.ntp.org");
+#endif
+#if PICO_W_CM_ENABLE_LATENCY_MONITOR
+    wifi.set_restart_latency_budget_us(50000);
+#endif
+    wifi.autoconnect();
+#if PICO_W_CM_ENABLE_METRICS
+    static rppicomidi::Wifi_metrics_server metrics{wifi};
+    metrics.start();
+#endif
+#if PICO_W_CM_ENABLE_SELF_TEST
+    rppicomidi::Link_self_test::Config self_test_config = {};
+    ip4_addr_set_u32(ip_2_ip4(&self_test_config.peer), 0x0100a8c0); // 192.168.0.1
+    self_test_config.tcp_port = 5001;
+    self_test_config.udp_port = 7;
+    self_test_config.tests = rppicomidi::Link_self_test::TEST_ALL;
+    self_test_config.duration_ms = 5000;
+    self_test_config.udp_payload = 1024;
+    self_test_config.udp_rate_bps = 1000000;
+    self_test_config.rtt_count = 10;
+    self_test_config.timeout_ms = 1000;
+    bool self_test_started = false;
+#endif
+    for (;;) {
+        wifi.task();
+#if PICO_W_CM_ENABLE_SELF_TEST
+        if (!self_test_started && wifi.is_link_up()) {
+            self_test_started = wifi.start_self_test(self_test_config);
+        }
+#endif
+#if PICO_W_CM_LOG_LEVEL > PICO_W_CM_LOG_LEVEL_NONE
+        rppicomidi::Wifi_event_log::instance().drain(4);
+#endif
+#if PICO_W_CM_ENABLE_LATENCY_MONITOR
+        const auto& latency = wifi.get_latency_monitor();
+        if (latency.get_percentile_us(rppicomidi::Call_latency_monitor::CALL_TASK, 99) > 50000) {
+            wifi.reset_latency_monitor();
+        }
+#endif
+        rppicomidi::Memory_accounting::Usage usage;
+        wifi.get_memory_usage(rppicomidi::MEM_STRINGS, usage);
+        if (wifi.get_settings_saved_state() != rppicomidi::Pico_w_connection_manager::SAVED) {
+            wifi.save_settings();
+        }
+    }
+    return 0;
+}
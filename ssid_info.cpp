@@ -0,0 +1,61 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "ssid_info.h"
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+
+void rppicomidi::Ssid_info::serialize(JSON_Object *ssid_object) const
+{
+    json_object_set_string(ssid_object, "ssid", ssid.c_str());
+    json_object_set_string(ssid_object, "pw", passphrase.c_str());
+    json_object_set_number(ssid_object, "auth", security);
+    json_object_set_number(ssid_object, "pm", power_profile);
+}
+
+bool rppicomidi::Ssid_info::deserialize(JSON_Object* root_object)
+{
+    const char* ptr = json_object_get_string(root_object, "ssid");
+    if (ptr != nullptr) {
+        ssid = std::string(ptr);
+        ptr = json_object_get_string(root_object, "pw");
+        if (ptr != nullptr) {
+            passphrase = std::string(ptr);
+            JSON_Value* val = json_object_get_value(root_object, "auth");
+            if (json_value_get_type(val) == JSONNumber) {
+                security = json_value_get_number(val);
+                power_profile = Wifi_power_governor::BALANCED;
+                val = json_object_get_value(root_object, "pm");
+                if (json_value_get_type(val) == JSONNumber) {
+                    int pm = json_value_get_number(val);
+                    if (pm >= Wifi_power_governor::LOWEST_LATENCY && pm <= Wifi_power_governor::ADAPTIVE) {
+                        power_profile = static_cast<Wifi_power_governor::Power_profile>(pm);
+                    }
+                }
+                return true;
+            }
+        }
+    }
+    return false;
+}
+#endif
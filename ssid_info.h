@@ -0,0 +1,65 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <string>
+#include "pico_w_connection_manager_config.h"
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+#include "parson.h"
+#endif
+#include "wifi_power_governor.h"
+
+namespace rppicomidi
+{
+/**
+ * @brief Describes the information required to connected an SSID
+ * 
+ */
+struct Ssid_info {
+    std::string ssid; //!< The SSID name
+    std::string passphrase; //!< The password or passphrase; may be empty if security is 0
+    int security = 0; //!< The CYW43 authentication type; 0 for an open network
+    //! radio power management profile to use when connected
+    Wifi_power_governor::Power_profile power_profile = Wifi_power_governor::BALANCED;
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+    /**
+     * @brief Serialize the fields in this struct to the the given root_object
+     *
+     * @param root_object the object to receive the value
+     */
+    void serialize(JSON_Object* root_object) const;
+
+    /**
+     * @brief Deserialize from the root_object the fields
+     * in this struct
+     *
+     * power_profile is optional for compatibility with settings
+     * saved before it existed; it defaults to BALANCED.
+     * @param root_object the object containing the values
+     * @return true if deserialization is successful, false otherwise
+     */
+    bool deserialize(JSON_Object* root_object);
+#endif
+};
+}
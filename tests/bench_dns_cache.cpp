@@ -0,0 +1,184 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstdio>
+#include <string>
+#include "benchmark_support.h"
+#include "test_support.h"
+#include "fake_wifi_driver.h"
+#include "dns_cache.h"
+#include "pico_w_connection_manager.h"
+
+using rppicomidi::Dns_cache;
+using rppicomidi::Pico_w_connection_manager;
+using test::Fake_wifi_driver;
+
+namespace
+{
+const char* const host = "time.example.com";
+const uint32_t address_a = 0x0a00000a;
+const uint32_t address_b = 0x0b00000a;
+
+// Learn the address on one link, then bring the link up again so the
+// cache seeds it
+void seed_host(Dns_cache& cache, Fake_wifi_driver& driver)
+{
+    CHECK(cache.add_host(host));
+    driver.dns_server[host] = address_a;
+    cache.link_up("home", driver.time_ms);
+    for (int step = 0; step < 100 && cache.get_address("home", host) == 0; step++) {
+        driver.time_ms += 10;
+        cache.poll(driver.time_ms);
+    }
+    CHECK_EQ(cache.get_address("home", host), address_a);
+    cache.link_down();
+    CHECK(driver.local_hosts.empty());
+}
+
+// The refresh right after link up must not take the seeded address away
+// from the application while the query is in flight
+void test_seed_kept_during_refresh()
+{
+    Fake_wifi_driver driver;
+    driver.dns_delay_ms = 200;
+    Dns_cache cache(driver);
+    seed_host(cache, driver);
+    uint32_t queries = driver.dns_queries;
+    cache.link_up("home", driver.time_ms);
+    CHECK_EQ(driver.local_hosts[host], address_a);
+    driver.dns_server[host] = address_b;
+    cache.poll(driver.time_ms);
+    CHECK_EQ(driver.dns_queries, queries + 1);
+    for (uint32_t elapsed = 0; elapsed < driver.dns_delay_ms; elapsed += 10) {
+        CHECK_EQ(driver.local_hosts.count(host), 1u);
+        CHECK_EQ(driver.local_hosts[host], address_a);
+        driver.time_ms += 10;
+        cache.poll(driver.time_ms);
+    }
+    // the query went to the server, not to the local host list
+    CHECK_EQ(cache.get_address("home", host), address_b);
+    CHECK_EQ(driver.local_hosts[host], address_b);
+
+    // a failed refresh keeps the seeded address too
+    driver.dns_server.clear();
+    driver.time_ms += cache.get_config().refresh_interval_ms;
+    for (int step = 0; step < 50; step++) {
+        driver.time_ms += 10;
+        cache.poll(driver.time_ms);
+        CHECK_EQ(driver.local_hosts[host], address_b);
+    }
+    CHECK(cache.get_refresh_failures() > 0);
+}
+
+void run_tasks(Pico_w_connection_manager& wifi, Fake_wifi_driver& driver, int steps)
+{
+    for (int step = 0; step < steps; step++) {
+        driver.time_ms += 10;
+        wifi.task();
+    }
+}
+
+// Reconnect, then time the application's first lookup from the link up
+// until lwIP answers it
+uint32_t reconnect_lookup_ms(uint32_t upstream_ms, bool use_cache)
+{
+    Fake_wifi_driver driver;
+    driver.dns_delay_ms = upstream_ms;
+    driver.dns_server[host] = address_a;
+    Pico_w_connection_manager wifi(nullptr, &driver);
+    wifi.set_log_drain_per_task(0);
+    wifi.set_current_ssid("home");
+    if (use_cache) {
+        CHECK(wifi.add_dns_cache_host(host));
+    }
+    CHECK(wifi.initialize());
+    CHECK(wifi.connect());
+    run_tasks(wifi, driver, 100);
+    CHECK(wifi.disconnect());
+    run_tasks(wifi, driver, 2);
+    CHECK(wifi.connect());
+    driver.time_ms += 10;
+    wifi.task();
+    CHECK(wifi.is_link_up());
+
+    // the application looks the host up as soon as the link is up
+    uint32_t start_ms = driver.time_ms;
+    uint32_t queries = driver.app_dns_queries;
+    uint32_t addr = 0;
+    int result = driver.start_app_lookup(host, addr);
+    while (result == 1 && driver.time_ms - start_ms < 10 * upstream_ms) {
+        driver.time_ms += 10;
+        wifi.task();
+        result = driver.poll_app_lookup(addr);
+    }
+    CHECK_EQ(result, 0);
+    CHECK_EQ(addr, address_a);
+    CHECK_EQ(driver.app_dns_queries, queries + (use_cache ? 0 : 1));
+    return driver.time_ms - start_ms;
+}
+
+void bench_first_lookup()
+{
+    static const uint32_t upstream_ms[] = {20, 100, 500};
+    for (auto delay: upstream_ms) {
+        uint32_t without = reconnect_lookup_ms(delay, false);
+        uint32_t with = reconnect_lookup_ms(delay, true);
+        printf("first lookup after reconnect, server answers in %3u ms: %3u ms without the cache, %3u ms with it\n",
+            delay, without, with);
+        // without the cache the lookup waits for the server; with it,
+        // the seeded address answers it at once
+        CHECK_EQ(without, delay);
+        CHECK_EQ(with, 0u);
+    }
+
+    // what seeding costs the link up action, for a full cache
+    Fake_wifi_driver driver;
+    Dns_cache cache(driver);
+    for (size_t idx = 0; idx < Dns_cache::MAX_HOSTS; idx++) {
+        std::string name = "host" + std::to_string(idx) + ".example.com";
+        CHECK(cache.add_host(name));
+        driver.dns_server[name] = static_cast<uint32_t>(idx + 1);
+    }
+    cache.link_up("home", driver.time_ms);
+    for (int step = 0; step < 1000; step++) {
+        driver.time_ms += 10;
+        cache.poll(driver.time_ms);
+    }
+    const uint64_t n_link_ups = 20000;
+    test::Stopwatch stopwatch;
+    for (uint64_t idx = 0; idx < n_link_ups; idx++) {
+        cache.link_up("home", driver.time_ms);
+    }
+    uint64_t elapsed_ns = stopwatch.elapsed_ns();
+    CHECK_EQ(driver.local_hosts.size(), Dns_cache::MAX_HOSTS);
+    test::report("link up seeding, full cache", Dns_cache::MAX_HOSTS, elapsed_ns, n_link_ups);
+}
+}
+
+int main()
+{
+    test_seed_kept_during_refresh();
+    bench_first_lookup();
+    return test::result();
+}
@@ -0,0 +1,177 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <string>
+#include <vector>
+#include "benchmark_support.h"
+#include "test_support.h"
+#include "known_network_store.h"
+
+using rppicomidi::Known_network_store;
+using rppicomidi::Ssid_info;
+
+namespace
+{
+const size_t sizes[] = {10, 100, 500};
+const int repeats = 50;
+
+std::vector<Ssid_info> make_networks(size_t n)
+{
+    std::vector<Ssid_info> networks(n);
+    for (size_t idx = 0; idx < n; idx++) {
+        networks[idx].ssid = "site-" + std::to_string(idx) + "-floor";
+        networks[idx].passphrase = "passphrase" + std::to_string(idx);
+        networks[idx].security = 4;
+    }
+    return networks;
+}
+
+// what add_known_ssid() did before the store: a linear search of a vector
+const Ssid_info* linear_find(const std::vector<Ssid_info>& networks, const std::string& ssid)
+{
+    for (const auto& info: networks) {
+        if (info.ssid == ssid) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+void bench_insert(size_t n)
+{
+    auto networks = make_networks(n);
+    uint64_t total_ns = 0;
+    for (int rep = 0; rep < repeats; rep++) {
+        Known_network_store store;
+        test::Stopwatch stopwatch;
+        for (const auto& info: networks) {
+            bool changed;
+            store.add(info, changed);
+        }
+        total_ns += stopwatch.elapsed_ns();
+        CHECK_EQ(store.size(), n);
+    }
+    test::report("insert", n, total_ns, n * repeats);
+}
+
+void bench_lookup(size_t n)
+{
+    auto networks = make_networks(n);
+    Known_network_store store;
+    for (const auto& info: networks) {
+        bool changed;
+        store.add(info, changed);
+    }
+    size_t found = 0;
+    for (const auto& info: networks) {
+        found += store.find(info.ssid) != Known_network_store::INVALID_HANDLE;
+    }
+    CHECK_EQ(found, n);
+    found = 0;
+    test::Stopwatch stopwatch;
+    for (int rep = 0; rep < repeats; rep++) {
+        for (const auto& info: networks) {
+            found += store.find(info.ssid) != Known_network_store::INVALID_HANDLE;
+        }
+        found += store.find("not-a-known-network") != Known_network_store::INVALID_HANDLE;
+    }
+    test::report("lookup, hashed", n, stopwatch.elapsed_ns(), (n + 1) * repeats);
+    CHECK_EQ(found, n * repeats);
+
+    found = 0;
+    stopwatch.restart();
+    for (int rep = 0; rep < repeats; rep++) {
+        for (const auto& info: networks) {
+            found += linear_find(networks, info.ssid) != nullptr;
+        }
+        found += linear_find(networks, "not-a-known-network") != nullptr;
+    }
+    test::report("lookup, linear vector", n, stopwatch.elapsed_ns(), (n + 1) * repeats);
+    CHECK_EQ(found, n * repeats);
+}
+
+// The store side of load_settings(): JSON parsing is not included
+// because the host build has no parson
+void bench_load(size_t n)
+{
+    auto networks = make_networks(n);
+    Known_network_store store;
+    uint64_t total_ns = 0;
+    for (int rep = 0; rep < repeats; rep++) {
+        test::Stopwatch stopwatch;
+        store.clear();
+        for (size_t idx = 0; idx < n; idx++) {
+            store.restore(networks[idx], idx + 1, 0);
+        }
+        total_ns += stopwatch.elapsed_ns();
+        CHECK_EQ(store.size(), n);
+    }
+    test::report("load", n, total_ns, n * repeats);
+}
+
+void test_load_does_not_evict()
+{
+    auto networks = make_networks(40);
+    Known_network_store store;
+    CHECK_EQ(store.get_capacity(), Known_network_store::UNBOUNDED);
+    for (size_t idx = 0; idx < networks.size(); idx++) {
+        bool changed;
+        store.add(networks[idx], changed);
+    }
+    CHECK_EQ(store.size(), networks.size());
+
+    // saved by a build with a larger capacity
+    Known_network_store bounded(8);
+    for (size_t idx = 0; idx < networks.size(); idx++) {
+        CHECK(bounded.restore(networks[idx], idx + 1, idx % 3) != Known_network_store::INVALID_HANDLE);
+    }
+    CHECK_EQ(bounded.size(), networks.size());
+    // a new SSID replaces the least recently used one instead of growing the store
+    Ssid_info extra;
+    extra.ssid = "visitor";
+    bool changed;
+    bounded.add(extra, changed);
+    CHECK(changed);
+    CHECK_EQ(bounded.size(), networks.size());
+    CHECK_EQ(bounded.find(networks[0].ssid), Known_network_store::INVALID_HANDLE);
+    CHECK(bounded.find("visitor") != Known_network_store::INVALID_HANDLE);
+    // restoring an SSID again replaces it rather than adding a second entry
+    bounded.restore(networks[5], 100, 0);
+    CHECK_EQ(bounded.size(), networks.size());
+    bounded.set_capacity(8);
+    CHECK_EQ(bounded.size(), 8u);
+    CHECK(bounded.find(networks[5].ssid) != Known_network_store::INVALID_HANDLE);
+}
+}
+
+int main()
+{
+    test_load_does_not_evict();
+    for (size_t n: sizes) {
+        bench_insert(n);
+        bench_lookup(n);
+        bench_load(n);
+    }
+    return test::result();
+}
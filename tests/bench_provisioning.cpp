@@ -0,0 +1,132 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <string>
+#include <vector>
+#include "benchmark_support.h"
+#include "test_support.h"
+#include "fake_wifi_driver.h"
+#include "pico_w_connection_manager.h"
+#include "ram_settings_storage.h"
+
+using rppicomidi::Pico_w_connection_manager;
+using rppicomidi::Ssid_info;
+using test::Fake_wifi_driver;
+
+namespace
+{
+const size_t n_networks = 100;
+
+/**
+ * @brief RAM settings storage that also counts the bytes written, which
+ * is what a flash backend erases and programs
+ */
+class Counting_storage : public rppicomidi::Ram_settings_storage
+{
+public:
+    uint64_t bytes_written = 0;
+protected:
+    bool do_write(unsigned slot, const char* data, size_t len) override
+    {
+        bytes_written += len;
+        return Ram_settings_storage::do_write(slot, data, len);
+    }
+};
+
+std::vector<Ssid_info> make_networks(size_t n)
+{
+    std::vector<Ssid_info> networks(n);
+    for (size_t idx = 0; idx < n; idx++) {
+        networks[idx].ssid = "site-" + std::to_string(idx);
+        networks[idx].passphrase = "passphrase" + std::to_string(idx);
+        networks[idx].security = Pico_w_connection_manager::WPA2;
+    }
+    return networks;
+}
+
+void print_result(const char* path, const Counting_storage& storage, uint64_t elapsed_ns)
+{
+    std::printf("%-32s %zu networks: %4u flash writes, %8llu bytes written, %8.3f ms\n", path, n_networks,
+        storage.get_stats().writes, static_cast<unsigned long long>(storage.bytes_written), elapsed_ns / 1e6);
+}
+
+// set_current_ssid() and connect() per network, each saving the
+// settings when the link comes up
+void bench_per_network(const std::vector<Ssid_info>& networks, std::vector<Ssid_info>& saved)
+{
+    Fake_wifi_driver driver;
+    Counting_storage storage;
+    Pico_w_connection_manager wifi(&storage, &driver);
+    CHECK(wifi.initialize());
+    storage.reset_stats();
+    storage.bytes_written = 0;
+    test::Stopwatch stopwatch;
+    for (const auto& info: networks) {
+        wifi.set_current_ssid(info.ssid);
+        wifi.set_current_passphrase(info.passphrase);
+        wifi.set_current_security(info.security);
+        CHECK(wifi.connect());
+        driver.time_ms += 10;
+        wifi.task();
+        CHECK(wifi.is_link_up());
+    }
+    uint64_t elapsed_ns = stopwatch.elapsed_ns();
+    print_result("set_current_ssid() + connect()", storage, elapsed_ns);
+    CHECK(storage.get_stats().writes >= networks.size());
+    wifi.export_known_ssids(saved);
+}
+
+void bench_import(const std::vector<Ssid_info>& networks, std::vector<Ssid_info>& saved)
+{
+    Fake_wifi_driver driver;
+    Counting_storage storage;
+    Pico_w_connection_manager wifi(&storage, &driver);
+    CHECK(wifi.initialize());
+    storage.reset_stats();
+    storage.bytes_written = 0;
+    test::Stopwatch stopwatch;
+    size_t n_rejected = 1;
+    CHECK(wifi.import_known_ssids(networks, &n_rejected));
+    uint64_t elapsed_ns = stopwatch.elapsed_ns();
+    print_result("import_known_ssids()", storage, elapsed_ns);
+    CHECK_EQ(n_rejected, 0u);
+    CHECK_EQ(storage.get_stats().writes, 1u);
+    wifi.export_known_ssids(saved);
+
+    // the settings load back with every network
+    Pico_w_connection_manager reloaded(&storage, &driver);
+    CHECK_EQ(reloaded.get_known_ssids().size(), networks.size());
+}
+}
+
+int main()
+{
+    auto networks = make_networks(n_networks);
+    std::vector<Ssid_info> per_network, imported;
+    bench_per_network(networks, per_network);
+    bench_import(networks, imported);
+    CHECK_EQ(per_network.size(), networks.size());
+    CHECK_EQ(imported.size(), networks.size());
+    return test::result();
+}
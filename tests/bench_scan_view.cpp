@@ -0,0 +1,274 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstring>
+#include <string>
+#include <vector>
+#include "benchmark_support.h"
+#include "test_support.h"
+#include "fake_wifi_driver.h"
+#include "known_network_store.h"
+#include "pico_w_connection_manager.h"
+#include "scan_view.h"
+
+using rppicomidi::Known_network_store;
+using rppicomidi::Pico_w_connection_manager;
+using rppicomidi::Scan_view;
+using rppicomidi::Wifi_driver;
+using test::Fake_wifi_driver;
+
+namespace
+{
+const uint8_t bssid[6] = {0x02, 0, 0, 0, 0, 1};
+
+void add(Scan_view& view, const char* ssid, uint8_t ssid_len, int16_t rssi)
+{
+    view.add(reinterpret_cast<const uint8_t*>(ssid), ssid_len, bssid, rssi, 6, 7, false);
+}
+
+// An SSID of NUL bytes is neither the empty SSID nor equal to it, and a
+// group that gets stronger must move from where it really is
+void test_ssids_with_nul_bytes()
+{
+    Scan_view view;
+    add(view, "\0\0\0", 3, -70);
+    add(view, "", 0, -70);
+    add(view, "x", 1, -60);
+    add(view, "", 0, -40);
+    CHECK_EQ(view.size(), 3u);
+    CHECK_EQ(view.get(0).rssi, -40);
+    CHECK_EQ(view.get(0).ssid_len, 0);
+    CHECK_EQ(view.get(0).num_bssids, 2);
+    CHECK_EQ(view.get(1).rssi, -60);
+    CHECK_EQ(view.get(2).rssi, -70);
+    CHECK_EQ(view.get(2).ssid_len, 3);
+    CHECK(view.find(std::string(3, '\0')) == &view.get(2));
+    CHECK(view.find("") == &view.get(0));
+    CHECK(view.find(std::string(1, '\0')) == nullptr);
+}
+
+uint32_t random_state = 2024;
+uint32_t next_random(uint32_t range)
+{
+    random_state = random_state * 1664525u + 1013904223u;
+    return (random_state >> 8) % range;
+}
+
+// n_bssids access points serving about a quarter as many SSIDs, some
+// hidden and some that differ only in trailing NUL bytes
+std::vector<Wifi_driver::Scan_result> make_environment(size_t n_bssids)
+{
+    std::vector<Wifi_driver::Scan_result> results;
+    size_t n_ssids = n_bssids / 4 + 1;
+    for (size_t idx = 0; idx < n_bssids; idx++) {
+        size_t ssid_idx = next_random(static_cast<uint32_t>(n_ssids));
+        std::string ssid = ssid_idx % 17 == 0 ? "" : "network " + std::to_string(ssid_idx);
+        auto result = Fake_wifi_driver::make_ap(ssid.c_str(), static_cast<uint8_t>(idx), 1 + idx % 11,
+            static_cast<int16_t>(-95 + static_cast<int>(next_random(60))));
+        result.bssid[4] = static_cast<uint8_t>(idx >> 8);
+        if (ssid_idx % 13 == 0) {
+            result.ssid_len = static_cast<uint8_t>(1 + ssid_idx % 5); // all NUL bytes
+            memset(result.ssid, 0, sizeof(result.ssid));
+        }
+        results.push_back(result);
+    }
+    return results;
+}
+
+void build(Scan_view& view, const std::vector<Wifi_driver::Scan_result>& results)
+{
+    view.clear();
+    for (const auto& result: results) {
+        view.add(result.ssid, result.ssid_len, result.bssid, result.rssi, static_cast<uint8_t>(result.channel),
+            result.auth_mode, false);
+    }
+}
+
+// Check the view against the records: one group per SSID with the
+// strongest record, sorted by RSSI, then SSID bytes
+void test_matches_records()
+{
+    for (size_t n_bssids: {1, 10, 200, 1000}) {
+        auto results = make_environment(n_bssids);
+        Scan_view view;
+        build(view, results);
+        size_t total_bssids = 0;
+        for (size_t rank = 0; rank < view.size(); rank++) {
+            const auto& group = view.get(rank);
+            std::string ssid(group.ssid, group.ssid_len);
+            int16_t strongest = INT16_MIN;
+            uint16_t count = 0;
+            for (const auto& result: results) {
+                if (result.ssid_len == group.ssid_len && memcmp(result.ssid, group.ssid, group.ssid_len) == 0) {
+                    ++count;
+                    strongest = result.rssi > strongest ? result.rssi : strongest;
+                }
+            }
+            CHECK_EQ(group.num_bssids, count);
+            CHECK_EQ(group.rssi, strongest);
+            CHECK(view.find(ssid) == &group);
+            total_bssids += group.num_bssids;
+            if (rank > 0) {
+                const auto& before = view.get(rank - 1);
+                std::string before_ssid(before.ssid, before.ssid_len);
+                CHECK(before.rssi > group.rssi || (before.rssi == group.rssi && before_ssid < ssid));
+            }
+        }
+        CHECK_EQ(total_bssids, n_bssids);
+    }
+}
+
+// Two SSIDs with the same FNV-1a hash keep their own groups
+void test_hash_collision()
+{
+    Scan_view view;
+    add(view, "net162789", 9, -70);
+    add(view, "net379192", 9, -60);
+    add(view, "net162789", 9, -50);
+    add(view, "net379192", 9, -80);
+    CHECK_EQ(view.size(), 2u);
+    auto first = view.find("net162789");
+    auto second = view.find("net379192");
+    CHECK(first != nullptr && second != nullptr && first != second);
+    CHECK(first != nullptr && first->hash == second->hash);
+    CHECK(first == &view.get(0));
+    CHECK_EQ(view.get(0).rssi, -50);
+    CHECK_EQ(view.get(0).num_bssids, 2u);
+    CHECK(second == &view.get(1));
+    CHECK_EQ(view.get(1).rssi, -60);
+    CHECK_EQ(view.get(1).num_bssids, 2u);
+    CHECK(view.find("net000000") == nullptr);
+}
+
+// The manager builds the view from the records when the scan completes
+void test_manager_builds_view_on_completion()
+{
+    Fake_wifi_driver driver;
+    driver.access_points.push_back(Fake_wifi_driver::make_ap("home", 1, 1, -60));
+    driver.access_points.push_back(Fake_wifi_driver::make_ap("home", 2, 6, -50));
+    driver.access_points.push_back(Fake_wifi_driver::make_ap("cafe", 3, 11, -55));
+    Pico_w_connection_manager wifi(nullptr, &driver);
+    wifi.set_log_drain_per_task(0);
+    std::vector<rppicomidi::Ssid_info> known(1);
+    known[0].ssid = "cafe";
+    wifi.import_known_ssids(known);
+    CHECK(wifi.initialize());
+    CHECK(wifi.start_scan());
+    wifi.task();
+    CHECK_EQ(wifi.get_state(), Pico_w_connection_manager::SCANNING);
+    CHECK_EQ(wifi.get_scan_view().size(), 0u);
+    wifi.task();
+    CHECK_EQ(wifi.get_state(), Pico_w_connection_manager::SCAN_COMPLETE);
+    const auto& view = wifi.get_scan_view();
+    CHECK_EQ(view.size(), 2u);
+    CHECK(strcmp(view.get(0).ssid, "home") == 0);
+    CHECK_EQ(view.get(0).num_bssids, 2);
+    CHECK(!view.get(0).known);
+    CHECK(strcmp(view.get(1).ssid, "cafe") == 0);
+    CHECK(view.get(1).known);
+}
+
+// What a user interface did without the view: compare every record with
+// every known network and drop repeated SSIDs
+size_t naive_refresh(const std::vector<Wifi_driver::Scan_result>& results, const std::vector<std::string>& known,
+    std::vector<std::string>& listed)
+{
+    size_t n_known = 0;
+    listed.clear();
+    for (const auto& result: results) {
+        std::string ssid(reinterpret_cast<const char*>(result.ssid), result.ssid_len);
+        bool seen = false;
+        for (const auto& other: listed) {
+            seen = seen || other == ssid;
+        }
+        if (seen) {
+            continue;
+        }
+        listed.push_back(ssid);
+        for (const auto& name: known) {
+            if (name == ssid) {
+                ++n_known;
+                break;
+            }
+        }
+    }
+    return n_known;
+}
+
+void bench_view(size_t n_bssids)
+{
+    auto results = make_environment(n_bssids);
+    Known_network_store store;
+    std::vector<std::string> known;
+    for (size_t idx = 0; idx < 50; idx++) {
+        rppicomidi::Ssid_info info;
+        info.ssid = "network " + std::to_string(idx * 3);
+        bool changed;
+        store.add(info, changed);
+        known.push_back(info.ssid);
+    }
+    const int repeats = n_bssids >= 1000 ? 20 : 200;
+    Scan_view view;
+    test::Stopwatch stopwatch;
+    for (int repeat = 0; repeat < repeats; repeat++) {
+        build(view, results);
+    }
+    test::report("build view, per scan", n_bssids, stopwatch.elapsed_ns(), repeats);
+
+    size_t n_known_view = 0;
+    stopwatch.restart();
+    for (int repeat = 0; repeat < repeats; repeat++) {
+        view.refresh_known([&store](const std::string& ssid) {
+            return store.find(ssid) != Known_network_store::INVALID_HANDLE;
+        });
+        n_known_view = 0;
+        for (size_t rank = 0; rank < view.size(); rank++) {
+            n_known_view += view.get(rank).known ? 1 : 0;
+        }
+    }
+    test::report("refresh known flags, view", n_bssids, stopwatch.elapsed_ns(), repeats);
+
+    std::vector<std::string> listed;
+    size_t n_known_naive = 0;
+    stopwatch.restart();
+    for (int repeat = 0; repeat < repeats; repeat++) {
+        n_known_naive = naive_refresh(results, known, listed);
+    }
+    test::report("refresh known flags, scan x known", n_bssids, stopwatch.elapsed_ns(), repeats);
+    CHECK_EQ(n_known_view, n_known_naive);
+    CHECK_EQ(view.size(), listed.size());
+}
+}
+
+int main()
+{
+    test_ssids_with_nul_bytes();
+    test_matches_records();
+    test_hash_collision();
+    test_manager_builds_view_on_completion();
+    for (size_t n_bssids: {100, 1000, 4000}) {
+        bench_view(n_bssids);
+    }
+    return test::result();
+}
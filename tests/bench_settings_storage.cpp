@@ -0,0 +1,171 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstdio>
+#include <string>
+#include "benchmark_support.h"
+#include "test_support.h"
+#include "fake_wifi_driver.h"
+#include "hardware/flash.h"
+#include "host_littlefs.h"
+#include "pico_hal.h"
+#include "flash_sector_settings_storage.h"
+#include "littlefs_settings_storage.h"
+#include "pico_w_connection_manager.h"
+#include "ram_settings_storage.h"
+
+using rppicomidi::Flash_sector_settings_storage;
+using rppicomidi::Littlefs_settings_storage;
+using rppicomidi::Pico_w_connection_manager;
+using rppicomidi::Ram_settings_storage;
+using rppicomidi::Settings_storage;
+using test::Fake_wifi_driver;
+
+namespace
+{
+const int n_saves = 50;
+// tests/CMakeLists.txt links this benchmark with the program image ending at 128 KiB
+const uint32_t flash_area = 0x40000;
+
+// Boot on blank storage, which saves the defaults, save n_saves changes,
+// and boot again
+void run_session(Settings_storage& storage)
+{
+    {
+        Fake_wifi_driver driver;
+        Pico_w_connection_manager wifi(&storage, &driver);
+        wifi.set_log_drain_per_task(0);
+        for (int idx = 0; idx < n_saves; idx++) {
+            wifi.set_current_ssid("network " + std::to_string(idx));
+            CHECK(wifi.save_settings());
+        }
+    }
+    Fake_wifi_driver driver;
+    Pico_w_connection_manager wifi(&storage, &driver);
+    wifi.set_log_drain_per_task(0);
+    CHECK_EQ(wifi.get_settings_saved_state(), Pico_w_connection_manager::SAVED);
+    std::string ssid;
+    wifi.get_current_ssid(ssid);
+    CHECK(ssid == "network " + std::to_string(n_saves - 1));
+}
+
+void report(const char* backend, const Settings_storage& storage)
+{
+    const auto& stats = storage.get_stats();
+    std::printf("%-32s %6u %6u %6u %9.1f %9u %9.1f %9u\n", backend, stats.mounts, stats.reads, stats.writes,
+        stats.reads == 0 ? 0.0 : static_cast<double>(stats.read_us) / stats.reads, stats.max_read_us,
+        stats.writes == 0 ? 0.0 : static_cast<double>(stats.write_us) / stats.writes, stats.max_write_us);
+    // only the first boot's reads of both slots of the blank storage fail
+    CHECK_EQ(stats.failures, 2u);
+}
+
+void bench_backends()
+{
+    std::printf("%d saves and two boots; host timings\n", n_saves);
+    std::printf("%-32s %6s %6s %6s %9s %9s %9s %9s\n", "backend", "mounts", "reads", "writes", "read us",
+        "max", "write us", "max");
+    {
+        Ram_settings_storage storage;
+        run_session(storage);
+        report("RAM", storage);
+        CHECK_EQ(storage.get_stats().mounts, 0u);
+    }
+    {
+        host_littlefs_reset();
+        Littlefs_settings_storage storage(Littlefs_settings_storage::MOUNT_PER_OPERATION);
+        run_session(storage);
+        report("littlefs, mount per operation", storage);
+        // every read and write but the reads of the blank file system mounts
+        CHECK_EQ(storage.get_stats().mounts, storage.get_stats().writes + 2);
+        CHECK_EQ(host_littlefs_stats.mounts, storage.get_stats().mounts);
+    }
+    {
+        host_littlefs_reset();
+        Littlefs_settings_storage storage(Littlefs_settings_storage::KEEP_MOUNTED);
+        run_session(storage);
+        report("littlefs, kept mounted", storage);
+        CHECK_EQ(storage.get_stats().mounts, 1u);
+        CHECK_EQ(host_littlefs_stats.mounts, 1u);
+    }
+    {
+        host_littlefs_reset();
+        CHECK_EQ(pico_mount(true), LFS_ERR_OK);
+        Littlefs_settings_storage storage(Littlefs_settings_storage::APPLICATION_MOUNTED);
+        run_session(storage);
+        report("littlefs, application mounted", storage);
+        CHECK_EQ(storage.get_stats().mounts, 0u);
+        CHECK_EQ(host_littlefs_stats.mounts, 1u);
+        pico_unmount();
+    }
+    {
+        Flash_sector_settings_storage storage(flash_area, FLASH_SECTOR_SIZE);
+        auto before = host_flash_stats;
+        run_session(storage);
+        report("flash sectors", storage);
+        CHECK_EQ(storage.get_stats().mounts, 0u);
+        // one sector erase per write
+        CHECK_EQ(host_flash_stats.erases - before.erases, storage.get_stats().writes);
+    }
+}
+
+// A littlefs backend that mounts on first use keeps the file system
+// mounted until it is destroyed or told to unmount
+void test_littlefs_mount_session()
+{
+    host_littlefs_reset();
+    std::string data;
+    {
+        Littlefs_settings_storage storage(Littlefs_settings_storage::KEEP_MOUNTED);
+        CHECK(!storage.read(0, data));
+        CHECK(storage.write(1, "{\"a\":1}", 7));
+        CHECK(storage.read(1, data));
+        CHECK(data == "{\"a\":1}");
+        CHECK_EQ(host_littlefs_stats.formats, 1u);
+        storage.unmount();
+        // the application may mount it now
+        CHECK_EQ(pico_mount(false), LFS_ERR_OK);
+        pico_unmount();
+        CHECK(storage.read(1, data));
+        CHECK_EQ(host_littlefs_stats.mounts, 3u);
+    }
+    // the destructor unmounted it
+    CHECK_EQ(pico_mount(false), LFS_ERR_OK);
+    pico_unmount();
+    Littlefs_settings_storage storage(Littlefs_settings_storage::MOUNT_PER_OPERATION);
+    CHECK(storage.read(1, data));
+    CHECK(data == "{\"a\":1}");
+    CHECK(!storage.read(0, data));
+}
+}
+
+int main()
+{
+    if (!host_flash_map()) {
+        std::printf("cannot map host flash at XIP_BASE\n");
+        return 1;
+    }
+    test_littlefs_mount_session();
+    bench_backends();
+    return test::result();
+}
@@ -0,0 +1,181 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstring>
+#include <string>
+#include "benchmark_support.h"
+#include "test_support.h"
+#include "fake_wifi_driver.h"
+#include "pico_w_connection_manager.h"
+#include "wifi_event_log.h"
+
+using rppicomidi::Pico_w_connection_manager;
+using rppicomidi::Wifi_event_log;
+
+namespace
+{
+const uint64_t n_calls = 200000;
+
+size_t empty_log(Wifi_event_log& log)
+{
+    Wifi_event_log::Entry entry;
+    size_t count = 0;
+    while (log.pop(entry)) {
+        ++count;
+    }
+    return count;
+}
+
+void test_copied_string()
+{
+    auto& log = Wifi_event_log::instance();
+    empty_log(log);
+    std::string ssid = "home";
+    log.record(Wifi_event_log::LEVEL_INFO, Wifi_event_log::CONNECT_REQUESTED, Wifi_event_log::copy(ssid.c_str()));
+    ssid = "changed before the entry was formatted";
+    std::string long_ssid(40, 'x');
+    log.record(Wifi_event_log::LEVEL_ERROR, Wifi_event_log::CONNECT_FAILED, Wifi_event_log::copy(long_ssid.c_str()));
+    log.record(Wifi_event_log::LEVEL_WARN, Wifi_event_log::LINK_DEGRADED, "gateway not responding");
+    Wifi_event_log::Entry entry;
+    char line[128];
+    CHECK(log.pop(entry));
+    Wifi_event_log::format(entry, line, sizeof(line));
+    CHECK(strcmp(line, "[0.000000] I Requesting connection to home") == 0);
+    CHECK(log.pop(entry));
+    Wifi_event_log::format(entry, line, sizeof(line));
+    CHECK(strstr(line, "E failed to connect to ") != nullptr);
+    CHECK_EQ(strlen(strrchr(line, ' ') + 1), Wifi_event_log::MAX_COPY);
+    CHECK(log.pop(entry));
+    Wifi_event_log::format(entry, line, sizeof(line));
+    CHECK(strcmp(line, "[0.000000] W Link degraded: gateway not responding") == 0);
+    CHECK(!log.pop(entry));
+}
+
+void test_full_ring_drops()
+{
+    auto& log = Wifi_event_log::instance();
+    empty_log(log);
+    CHECK_EQ(log.drain(), 0u);
+    for (int idx = 0; idx < PICO_W_CM_LOG_ENTRIES + 3; idx++) {
+        log.record(Wifi_event_log::LEVEL_DEBUG, Wifi_event_log::SCAN_START_FAILED, idx);
+    }
+    CHECK_EQ(log.get_dropped(), 3u);
+    Wifi_event_log::Entry entry;
+    CHECK(log.pop(entry));
+    CHECK_EQ(static_cast<int>(entry.args[0]), 0);
+    empty_log(log);
+    log.drain();
+    CHECK_EQ(log.get_dropped(), 0u);
+}
+
+// By default task() leaves the log to the application; asked to, it
+// prints a bounded number of entries each call
+void test_task_drains()
+{
+    test::Fake_wifi_driver driver;
+    Pico_w_connection_manager wifi(nullptr, &driver);
+    auto& log = Wifi_event_log::instance();
+    empty_log(log);
+    for (int idx = 0; idx < 6; idx++) {
+        log.record(Wifi_event_log::LEVEL_INFO, Wifi_event_log::SCAN_STARTED);
+    }
+    wifi.task();
+    CHECK_EQ(empty_log(log), 6u);
+
+    wifi.set_log_drain_per_task(4);
+    for (int idx = 0; idx < 6; idx++) {
+        log.record(Wifi_event_log::LEVEL_INFO, Wifi_event_log::SCAN_STARTED);
+    }
+    wifi.task();
+    CHECK_EQ(empty_log(log), 2u);
+}
+
+// What one log call costs the caller, against calling printf() there
+void bench_log_call()
+{
+    auto& log = Wifi_event_log::instance();
+    empty_log(log);
+    Wifi_event_log::Entry entry;
+    test::Stopwatch stopwatch;
+    // time the recording calls only, in batches that fit the ring
+    uint64_t record_ns = 0;
+    for (uint64_t idx = 0; idx < n_calls; idx += 16) {
+        stopwatch.restart();
+        for (int batch = 0; batch < 16; batch++) {
+            log.record(Wifi_event_log::LEVEL_INFO, Wifi_event_log::BSSID_SELECTED, 6u, -60);
+        }
+        record_ns += stopwatch.elapsed_ns();
+        empty_log(log);
+    }
+    test::report("log call, integer arguments", 2, record_ns, n_calls);
+
+    record_ns = 0;
+    std::string ssid = "a typical network name";
+    for (uint64_t idx = 0; idx < n_calls; idx += 16) {
+        stopwatch.restart();
+        for (int batch = 0; batch < 16; batch++) {
+            log.record(Wifi_event_log::LEVEL_INFO, Wifi_event_log::CONNECT_REQUESTED, Wifi_event_log::copy(ssid.c_str()));
+        }
+        record_ns += stopwatch.elapsed_ns();
+        empty_log(log);
+    }
+    test::report("log call, copied SSID", 1, record_ns, n_calls);
+    CHECK_EQ(log.get_dropped(), 0u);
+
+    // the deferred work drain() does later, less the output itself
+    log.record(Wifi_event_log::LEVEL_INFO, Wifi_event_log::BSSID_SELECTED, 6u, -60);
+    CHECK(log.pop(entry));
+    char line[128];
+    size_t total_len = 0;
+    stopwatch.restart();
+    for (uint64_t idx = 0; idx < n_calls; idx++) {
+        total_len += Wifi_event_log::format(entry, line, sizeof(line));
+    }
+    test::report("deferred format", 2, stopwatch.elapsed_ns(), n_calls);
+    CHECK(total_len > 0);
+
+    // printf() at the call site to a line buffered stream, as stdio is on
+    // the Pico, discarding the output
+    FILE* out = fopen("/dev/null", "w");
+    CHECK(out != nullptr);
+    if (out != nullptr) {
+        setvbuf(out, nullptr, _IOLBF, 256);
+        stopwatch.restart();
+        for (uint64_t idx = 0; idx < n_calls; idx++) {
+            fprintf(out, "Joining the access point on channel %u (%d dBm)\r\n", 6u, -60);
+        }
+        test::report("printf at the call site", 2, stopwatch.elapsed_ns(), n_calls);
+        fclose(out);
+    }
+}
+}
+
+int main()
+{
+    test_copied_string();
+    test_full_ring_drops();
+    test_task_drains();
+    bench_log_call();
+    return test::result();
+}
@@ -0,0 +1,154 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstdio>
+#include <vector>
+#include "benchmark_support.h"
+#include "test_support.h"
+#include "fake_wifi_driver.h"
+#include "pico_w_connection_manager.h"
+#include "wifi_trace.h"
+
+using rppicomidi::Pico_w_connection_manager;
+using rppicomidi::Wifi_driver;
+using rppicomidi::Wifi_trace_recorder;
+using rppicomidi::Wifi_trace_replay_driver;
+using test::Fake_wifi_driver;
+
+namespace
+{
+const uint32_t hours = 6;
+const uint32_t step_ms = 100;
+const int steps_per_hour = 3600 * 1000 / step_ms;
+// a replay of hours of traffic has to take seconds on the host
+const uint64_t max_replay_ns = 2ull * 1000 * 1000 * 1000;
+
+void append(void* context, const uint8_t* data, size_t len)
+{
+    auto trace = reinterpret_cast<std::vector<uint8_t>*>(context);
+    trace->insert(trace->end(), data, data + len);
+}
+
+/**
+ * @brief Run hours of an application's life against any driver
+ *
+ * Each hour starts with a scan and a join. While the link is up the
+ * gateway is probed every 5 s and the DNS cache refreshes every minute;
+ * the name moves to a new address every 20 minutes. The gateway stops
+ * answering for a minute at 20 minutes past, the access point drops the
+ * link at 40 minutes past, and the application disconnects at the end
+ * of the hour.
+ * @param driver the driver the manager uses
+ * @param fake the driver underneath while recording; nullptr while replaying
+ * @param final_status receives the status after the last task() call
+ */
+void run_session(Wifi_driver& driver, Fake_wifi_driver* fake, Pico_w_connection_manager::Status_snapshot& final_status)
+{
+    if (fake != nullptr) {
+        fake->access_points.push_back(Fake_wifi_driver::make_ap("home", 1, 1, -70));
+        fake->access_points.push_back(Fake_wifi_driver::make_ap("home", 2, 6, -48));
+        fake->access_points.push_back(Fake_wifi_driver::make_ap("neighbor", 3, 6, -60));
+        fake->dns_server["example.com"] = 0x04030201;
+    }
+    Pico_w_connection_manager wifi(nullptr, &driver);
+    wifi.set_log_drain_per_task(0);
+    wifi.set_link_health_config({true, 5000, 500, 3});
+    wifi.set_dns_cache_config({true, 60000, 10000, 1000});
+    wifi.add_dns_cache_host("example.com");
+    wifi.set_current_ssid("home");
+    wifi.initialize();
+    for (int step = 0; step < static_cast<int>(hours) * steps_per_hour; step++) {
+        int minute_step = step % steps_per_hour;
+        if (fake != nullptr) {
+            fake->time_ms += step_ms;
+            if (minute_step % (20 * 600) == 0) {
+                fake->dns_server["example.com"] = 0x04030201 + step;
+            }
+            if (minute_step == 20 * 600) {
+                fake->gateway_answers = false;
+            }
+            else if (minute_step == 21 * 600) {
+                fake->gateway_answers = true;
+            }
+            else if (minute_step == 40 * 600) {
+                fake->link = Wifi_driver::LINK_DOWN;
+            }
+        }
+        if (minute_step == 0) {
+            wifi.start_scan();
+        }
+        else if (minute_step == 50) {
+            wifi.connect();
+        }
+        else if (minute_step == steps_per_hour - 100) {
+            wifi.disconnect();
+        }
+        wifi.task();
+    }
+    wifi.get_status_snapshot(final_status);
+}
+
+void bench_replay()
+{
+    Fake_wifi_driver fake;
+    std::vector<uint8_t> trace;
+    Wifi_trace_recorder recorder(fake, append, &trace);
+    Pico_w_connection_manager::Status_snapshot recorded;
+    run_session(recorder, &fake, recorded);
+
+    // the session did what it set out to do every hour
+    CHECK(recorded.scans >= hours);
+    CHECK(recorded.link_ups >= 3 * hours);
+    CHECK(recorded.reconnects >= 2 * hours);
+    CHECK(recorded.errors_by_type[Pico_w_connection_manager::LINK_ERROR_GATEWAY] >= hours);
+    CHECK(fake.pings_sent >= hours * 400);
+    CHECK(fake.dns_queries >= hours * 40);
+
+    test::Stopwatch stopwatch;
+    Wifi_trace_replay_driver replay(trace.data(), trace.size());
+    Pico_w_connection_manager::Status_snapshot replayed;
+    run_session(replay, nullptr, replayed);
+    uint64_t elapsed_ns = stopwatch.elapsed_ns();
+    CHECK(!replay.is_diverged());
+    CHECK(replay.is_finished());
+    CHECK_EQ(replayed.link_ups, recorded.link_ups);
+    CHECK_EQ(replayed.reconnects, recorded.reconnects);
+    CHECK_EQ(replayed.state_changes, recorded.state_changes);
+    CHECK_EQ(replayed.total_link_uptime_ms, recorded.total_link_uptime_ms);
+    CHECK_EQ(replayed.timestamp_ms, recorded.timestamp_ms);
+
+    double seconds = elapsed_ns / 1e9;
+    std::printf("%u h session: %zu trace bytes (%.1f bytes/min), %u records\n", hours, trace.size(),
+        static_cast<double>(trace.size()) / (hours * 60), replay.get_records_played());
+    std::printf("replay: %.3f s, %.0f records/s, %.0fx simulated time\n", seconds,
+        replay.get_records_played() / seconds, hours * 3600 / seconds);
+    CHECK(elapsed_ns < max_replay_ns);
+}
+}
+
+int main()
+{
+    bench_replay();
+    return test::result();
+}
@@ -0,0 +1,59 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+/**
+ * @brief Timing for the host benchmarks
+ *
+ * Benchmarks are host tests that also print what they measure. Host
+ * timings only compare one approach with another; they are not Pico W
+ * timings.
+ */
+namespace test
+{
+class Stopwatch
+{
+public:
+    Stopwatch() : start{std::chrono::steady_clock::now()} {}
+    void restart() { start = std::chrono::steady_clock::now(); }
+    uint64_t elapsed_ns() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * @brief Print one benchmark result as "<what>: <ns per op> ns/op"
+ */
+inline void report(const char* what, size_t n, uint64_t total_ns, uint64_t ops)
+{
+    std::printf("%-40s n=%-5zu %10.1f ns/op\n", what, n, ops == 0 ? 0.0 : static_cast<double>(total_ns) / ops);
+}
+}
@@ -0,0 +1,277 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "wifi_driver.h"
+
+namespace test
+{
+/**
+ * @brief A scripted Wi-Fi driver: the test sets the time, the access
+ * points a scan finds, how joins end and how the gateway and the DNS
+ * server answer
+ */
+class Fake_wifi_driver : public rppicomidi::Wifi_driver
+{
+public:
+    uint32_t time_ms = 0;
+    bool initialized = false;
+    int link = LINK_DOWN;                   //!< what link_status() returns
+    int join_result = LINK_UP;              //!< the link status a join ends with
+    std::vector<Scan_result> access_points; //!< what a scan finds
+    uint32_t ip_address = 0x6400a8c0;       //!< 192.168.0.100
+    uint32_t gateway = 0x0100a8c0;          //!< 192.168.0.1
+    bool gateway_answers = true;
+    bool ping_send_fails = false;   //!< send_ping() fails, e.g. lwIP is out of pbufs
+    uint32_t bytes = 0;
+    int32_t rssi = -55;
+    uint32_t pm = PM_DEFAULT;
+    std::map<std::string, uint32_t> dns_server;     //!< what the upstream server answers
+    uint32_t dns_delay_ms = 50;                     //!< how long the server takes to answer
+    std::map<std::string, uint32_t> local_hosts;    //!< lwIP's local host list; start_dns_query() skips it
+    uint32_t firmware_load_us = 0;  //!< how far init() moves the time stamp clock, but not now_ms()
+
+    // what the manager did
+    uint32_t inits = 0;
+    uint32_t connects = 0;
+    uint32_t pings_sent = 0;
+    uint32_t dns_queries = 0;
+    uint32_t app_dns_queries = 0;   //!< lookups start_app_lookup() sent to the server
+    std::string joined_ssid;
+    bool joined_bssid = false;
+    uint8_t bssid[6] = {};
+    int lock_depth = 0;
+
+    static Scan_result make_ap(const char* ssid, uint8_t last_bssid_byte, uint16_t channel, int16_t rssi_)
+    {
+        Scan_result ap;
+        memset(&ap, 0, sizeof(ap));
+        ap.ssid_len = static_cast<uint8_t>(strlen(ssid));
+        memcpy(ap.ssid, ssid, ap.ssid_len);
+        ap.bssid[0] = 0x02;
+        ap.bssid[5] = last_bssid_byte;
+        ap.channel = channel;
+        ap.auth_mode = 7;
+        ap.rssi = rssi_;
+        return ap;
+    }
+
+    uint32_t now_ms() override { return time_ms; }
+    uint32_t timestamp_us() override { return time_ms * 1000 + loading_us; }
+    int init(uint32_t country) override
+    {
+        country_code = country;
+        initialized = true;
+        ++inits;
+        loading_us += firmware_load_us;
+        return 0;
+    }
+    void deinit() override
+    {
+        initialized = false;
+        link = LINK_DOWN;
+    }
+    void enable_sta_mode() override {}
+    uint32_t get_country_code() override { return country_code; }
+    int link_status() override { return initialized ? link : LINK_DOWN; }
+    int scan(Scan_result_cb cb, void* env) override
+    {
+        if (!initialized) {
+            return -1;
+        }
+        scan_cb = cb;
+        scan_env = env;
+        return 0;
+    }
+    bool is_scan_active() override
+    {
+        // like the radio, deliver the results after scan() has returned
+        if (scan_cb != nullptr) {
+            for (const auto& ap: access_points) {
+                scan_cb(scan_env, &ap);
+            }
+            scan_cb = nullptr;
+        }
+        return false;
+    }
+    int connect(const char* ssid, const char*, uint32_t, const uint8_t* bssid_, uint32_t channel) override
+    {
+        if (!initialized) {
+            return -1;
+        }
+        ++connects;
+        joined_ssid = ssid;
+        joined_bssid = bssid_ != nullptr;
+        link = join_result;
+        if (bssid_ != nullptr) {
+            memcpy(bssid, bssid_, sizeof(bssid));
+            // a join pinned to an access point that is gone or has moved channel fails
+            bool found = false;
+            for (const auto& ap: access_points) {
+                found = found || (memcmp(ap.bssid, bssid_, sizeof(ap.bssid)) == 0 && ap.channel == channel);
+            }
+            if (!found) {
+                link = LINK_NONET;
+            }
+        }
+        return 0;
+    }
+    int leave() override
+    {
+        link = LINK_DOWN;
+        return 0;
+    }
+    int set_power_management(uint32_t pm_) override
+    {
+        pm = pm_;
+        return 0;
+    }
+    int get_rssi(int32_t& rssi_) override
+    {
+        rssi_ = rssi;
+        return 0;
+    }
+    uint32_t get_ip_address() override { return ip_address; }
+    uint32_t get_gateway() override { return gateway; }
+    int get_byte_count(uint32_t& bytes_) override
+    {
+        bytes_ = bytes;
+        return 0;
+    }
+    int open_ping(uint32_t addr) override
+    {
+        ping_addr = addr;
+        ping_reply = 0;
+        return 0;
+    }
+    void close_ping() override { ping_addr = 0; }
+    int send_ping(uint16_t seq) override
+    {
+        if (ping_addr == 0 || ping_send_fails) {
+            return -1;
+        }
+        ++pings_sent;
+        if (gateway_answers && ping_addr == gateway) {
+            ping_reply = seq;
+        }
+        return 0;
+    }
+    uint16_t get_ping_reply() override { return ping_reply; }
+    int add_local_host(const char* name, uint32_t addr) override
+    {
+        local_hosts[name] = addr;
+        return 0;
+    }
+    void remove_local_host(const char* name) override { local_hosts.erase(name); }
+    int start_dns_query(const char* name) override
+    {
+        ++dns_queries;
+        query = name;
+        query_start_ms = time_ms;
+        return 0;
+    }
+    int poll_dns_query(uint32_t& addr) override
+    {
+        addr = 0;
+        if (query.empty()) {
+            return -1;
+        }
+        if (time_ms - query_start_ms < dns_delay_ms) {
+            return 1;
+        }
+        auto record = dns_server.find(query);
+        if (record == dns_server.end()) {
+            return -1;
+        }
+        addr = record->second;
+        return 0;
+    }
+    void cancel_dns_query() override { query.clear(); }
+
+    /**
+     * @brief Start a lookup the way the application does, with
+     * dns_gethostbyname(): lwIP answers from the local host list at
+     * once and asks the server for any other name
+     *
+     * @return 0 when addr is valid, or 1 while the server is asked;
+     * poll_app_lookup() reports the answer
+     */
+    int start_app_lookup(const char* name, uint32_t& addr)
+    {
+        app_query = name;
+        app_query_start_ms = time_ms;
+        auto local = local_hosts.find(app_query);
+        if (local != local_hosts.end()) {
+            app_query.clear();
+            addr = local->second;
+            return 0;
+        }
+        ++app_dns_queries;
+        addr = 0;
+        return 1;
+    }
+
+    /**
+     * @brief Check on the lookup start_app_lookup() started
+     *
+     * @return 1 while the server is asked, 0 when addr is valid, or -1 if
+     * the lookup failed or none is in progress
+     */
+    int poll_app_lookup(uint32_t& addr)
+    {
+        addr = 0;
+        if (app_query.empty()) {
+            return -1;
+        }
+        if (time_ms - app_query_start_ms < dns_delay_ms) {
+            return 1;
+        }
+        auto record = dns_server.find(app_query);
+        app_query.clear();
+        if (record == dns_server.end()) {
+            return -1;
+        }
+        addr = record->second;
+        return 0;
+    }
+
+    void lock() override { ++lock_depth; }
+    void unlock() override { --lock_depth; }
+private:
+    uint32_t country_code = 0;
+    uint32_t ping_addr = 0;
+    uint16_t ping_reply = 0;
+    Scan_result_cb scan_cb = nullptr;
+    void* scan_env = nullptr;
+    std::string query;
+    uint32_t query_start_ms = 0;
+    std::string app_query;
+    uint32_t app_query_start_ms = 0;
+    uint32_t loading_us = 0;
+};
+}
@@ -0,0 +1,86 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+/**
+ * @file host_flash.cpp
+ * @brief Host implementations of the Pico SDK flash functions
+ *
+ * Flash is anonymous memory mapped at XIP_BASE, so code that reads it
+ * through XIP addresses works unchanged. Programming ANDs the data into
+ * flash as NOR flash does, so programming a page that was not erased
+ * shows up as corrupt data.
+ */
+#include <sys/mman.h>
+#include <cstring>
+#include "hardware/flash.h"
+#include "pico/flash.h"
+
+Host_flash_stats host_flash_stats;
+int host_flash_safe_execute_result = PICO_OK;
+
+bool host_flash_map(void)
+{
+    void* flash = mmap(reinterpret_cast<void*>(XIP_BASE), PICO_FLASH_SIZE_BYTES, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (flash != reinterpret_cast<void*>(XIP_BASE)) {
+        return false;
+    }
+    memset(flash, 0xff, PICO_FLASH_SIZE_BYTES);
+    return true;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    if (flash_offs % FLASH_SECTOR_SIZE != 0 || count % FLASH_SECTOR_SIZE != 0 ||
+            flash_offs + count > PICO_FLASH_SIZE_BYTES) {
+        ++host_flash_stats.outside_writes;
+        return;
+    }
+    memset(reinterpret_cast<uint8_t*>(XIP_BASE + flash_offs), 0xff, count);
+    ++host_flash_stats.erases;
+    host_flash_stats.erased_bytes += count;
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t* data, size_t count)
+{
+    if (flash_offs % FLASH_PAGE_SIZE != 0 || count % FLASH_PAGE_SIZE != 0 ||
+            flash_offs + count > PICO_FLASH_SIZE_BYTES) {
+        ++host_flash_stats.outside_writes;
+        return;
+    }
+    auto flash = reinterpret_cast<uint8_t*>(XIP_BASE + flash_offs);
+    for (size_t idx = 0; idx < count; idx++) {
+        flash[idx] &= data[idx];
+    }
+    ++host_flash_stats.programs;
+}
+
+int flash_safe_execute(void (*func)(void*), void* param, uint32_t)
+{
+    if (host_flash_safe_execute_result != PICO_OK) {
+        return host_flash_safe_execute_result;
+    }
+    func(param);
+    return PICO_OK;
+}
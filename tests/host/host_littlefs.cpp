@@ -0,0 +1,185 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+/**
+ * @file host_littlefs.cpp
+ * @brief Host implementations of the littlefs-lib functions the
+ * littlefs settings storage calls
+ *
+ * The file system is kept in RAM. It must be formatted once before it
+ * mounts, as a blank flash would be, and every call but pico_mount()
+ * fails while it is not mounted. host_littlefs.h counts what the code
+ * under test did.
+ */
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "host_littlefs.h"
+#include "pico_hal.h"
+
+struct Host_open_file {
+    std::string path;
+    size_t position;
+    bool is_open;
+};
+
+Host_littlefs_stats host_littlefs_stats;
+static bool formatted;
+static bool mounted;
+static std::set<std::string> dirs;
+static std::map<std::string, std::string> files;
+static std::vector<Host_open_file> open_files;
+
+void host_littlefs_reset(void)
+{
+    formatted = false;
+    mounted = false;
+    dirs.clear();
+    files.clear();
+    open_files.clear();
+    host_littlefs_stats = Host_littlefs_stats{};
+}
+
+static Host_open_file* find_open_file(lfs_file_t* file)
+{
+    if (!mounted || file->handle < 0 || static_cast<size_t>(file->handle) >= open_files.size() ||
+            !open_files[file->handle].is_open) {
+        return nullptr;
+    }
+    return &open_files[file->handle];
+}
+
+int pico_mount(bool format)
+{
+    if (mounted) {
+        return LFS_ERR_IO;
+    }
+    if (format) {
+        dirs.clear();
+        files.clear();
+        formatted = true;
+        ++host_littlefs_stats.formats;
+    }
+    if (!formatted) {
+        return LFS_ERR_CORRUPT;
+    }
+    mounted = true;
+    ++host_littlefs_stats.mounts;
+    return LFS_ERR_OK;
+}
+
+int pico_unmount(void)
+{
+    mounted = false;
+    open_files.clear();
+    return LFS_ERR_OK;
+}
+
+int lfs_dir_open(lfs_dir_t*, const char* path)
+{
+    if (!mounted) {
+        return LFS_ERR_IO;
+    }
+    return dirs.count(path) != 0 ? LFS_ERR_OK : LFS_ERR_NOENT;
+}
+
+int lfs_dir_close(lfs_dir_t*)
+{
+    return LFS_ERR_OK;
+}
+
+int lfs_mkdir(const char* path)
+{
+    if (!mounted) {
+        return LFS_ERR_IO;
+    }
+    dirs.insert(path);
+    return LFS_ERR_OK;
+}
+
+int lfs_file_open(lfs_file_t* file, const char* path, int flags)
+{
+    if (!mounted) {
+        return LFS_ERR_IO;
+    }
+    if (files.count(path) == 0) {
+        if ((flags & LFS_O_CREAT) == 0) {
+            return LFS_ERR_NOENT;
+        }
+        files[path] = "";
+    }
+    if ((flags & LFS_O_TRUNC) != 0) {
+        files[path].clear();
+    }
+    file->handle = static_cast<int>(open_files.size());
+    open_files.push_back({path, 0, true});
+    return LFS_ERR_OK;
+}
+
+int lfs_file_close(lfs_file_t* file)
+{
+    Host_open_file* open_file = find_open_file(file);
+    if (open_file == nullptr) {
+        return LFS_ERR_IO;
+    }
+    open_file->is_open = false;
+    return LFS_ERR_OK;
+}
+
+lfs_ssize_t lfs_file_read(lfs_file_t* file, void* buffer, lfs_size_t size)
+{
+    Host_open_file* open_file = find_open_file(file);
+    if (open_file == nullptr) {
+        return LFS_ERR_IO;
+    }
+    const std::string& data = files[open_file->path];
+    size_t len = open_file->position < data.size() ? data.size() - open_file->position : 0;
+    len = len < size ? len : size;
+    data.copy(static_cast<char*>(buffer), len, open_file->position);
+    open_file->position += len;
+    return static_cast<lfs_ssize_t>(len);
+}
+
+lfs_ssize_t lfs_file_write(lfs_file_t* file, const void* buffer, lfs_size_t size)
+{
+    Host_open_file* open_file = find_open_file(file);
+    if (open_file == nullptr) {
+        return LFS_ERR_IO;
+    }
+    std::string& data = files[open_file->path];
+    data.replace(open_file->position, size, static_cast<const char*>(buffer), size);
+    open_file->position += size;
+    host_littlefs_stats.bytes_written += size;
+    return static_cast<lfs_ssize_t>(size);
+}
+
+lfs_soff_t lfs_file_size(lfs_file_t* file)
+{
+    Host_open_file* open_file = find_open_file(file);
+    if (open_file == nullptr) {
+        return LFS_ERR_IO;
+    }
+    return static_cast<lfs_soff_t>(files[open_file->path].size());
+}
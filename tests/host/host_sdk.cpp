@@ -0,0 +1,708 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+/**
+ * @file host_sdk.cpp
+ * @brief Host implementations of the Pico SDK, CYW43 driver and lwIP
+ * functions the connection manager calls
+ *
+ * There is no radio: it initializes but never links up, and tests that
+ * need Wi-Fi behavior pass a fake Wifi_driver to the manager instead.
+ * TCP and UDP reach one scripted peer described in host_lwip.h, a TCP
+ * sink, a UDP echo server and TCP clients that connect to listeners,
+ * whose callbacks run from host_lwip_poll().
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "host_lwip.h"
+#include "pico/cyw43_arch.h"
+#include "hardware/sync.h"
+#include "lwip/dns.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/raw.h"
+#include "lwip/tcp.h"
+#include "lwip/udp.h"
+
+cyw43_t cyw43_state;
+const ip_addr_t ip_addr_any = {0};
+static uint32_t country_code;
+
+uint64_t time_us_64(void)
+{
+    static const auto start = std::chrono::steady_clock::now();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+uint32_t save_and_disable_interrupts(void)
+{
+    return 0;
+}
+
+void restore_interrupts(uint32_t)
+{
+}
+
+// The host has no interrupts to disable; threads stand in for the second core
+static spin_lock_t spin_locks[32];
+
+uint next_striped_spin_lock_num(void)
+{
+    static uint next = 16;
+    uint lock_num = next;
+    next = next == 23 ? 16 : next + 1;
+    return lock_num;
+}
+
+spin_lock_t* spin_lock_instance(uint lock_num)
+{
+    return &spin_locks[lock_num];
+}
+
+uint32_t spin_lock_blocking(spin_lock_t* lock)
+{
+    while (__atomic_exchange_n(lock, 1u, __ATOMIC_ACQUIRE) != 0) {
+    }
+    return 0;
+}
+
+void spin_unlock(spin_lock_t* lock, uint32_t)
+{
+    __atomic_store_n(lock, 0u, __ATOMIC_RELEASE);
+}
+
+int cyw43_arch_init_with_country(uint32_t country)
+{
+    country_code = country;
+    return 0;
+}
+
+void cyw43_arch_deinit(void)
+{
+}
+
+void cyw43_arch_enable_sta_mode(void)
+{
+}
+
+uint32_t cyw43_arch_get_country_code(void)
+{
+    return country_code;
+}
+
+int cyw43_arch_wifi_connect_async(const char*, const char*, uint32_t)
+{
+    return -1;
+}
+
+void cyw43_arch_lwip_begin(void)
+{
+}
+
+void cyw43_arch_lwip_end(void)
+{
+}
+
+int cyw43_wifi_scan(cyw43_t*, cyw43_wifi_scan_options_t*, void*, int (*)(void*, const cyw43_ev_scan_result_t*))
+{
+    return 0; // finds nothing
+}
+
+bool cyw43_wifi_scan_active(cyw43_t*)
+{
+    return false;
+}
+
+int cyw43_tcpip_link_status(cyw43_t*, int)
+{
+    return CYW43_LINK_DOWN;
+}
+
+int cyw43_wifi_join(cyw43_t*, size_t, const uint8_t*, size_t, const uint8_t*, uint32_t, const uint8_t*, uint32_t)
+{
+    return -1;
+}
+
+int cyw43_wifi_leave(cyw43_t*, int)
+{
+    return 0;
+}
+
+int cyw43_wifi_pm(cyw43_t*, uint32_t)
+{
+    return 0;
+}
+
+int cyw43_ioctl(cyw43_t*, uint32_t, size_t, uint8_t*, uint32_t)
+{
+    return -1;
+}
+
+struct pbuf* pbuf_alloc(pbuf_layer, u16_t length, pbuf_type)
+{
+    auto p = static_cast<struct pbuf*>(malloc(sizeof(struct pbuf) + PBUF_IP_HLEN + length));
+    if (p != nullptr) {
+        p->next = nullptr;
+        p->payload = reinterpret_cast<uint8_t*>(p + 1) + PBUF_IP_HLEN;
+        p->tot_len = length;
+        p->len = length;
+    }
+    return p;
+}
+
+u8_t pbuf_free(struct pbuf* p)
+{
+    free(p);
+    return 1;
+}
+
+u8_t pbuf_remove_header(struct pbuf* p, size_t header_size)
+{
+    if (header_size > p->len) {
+        return 1;
+    }
+    p->payload = static_cast<uint8_t*>(p->payload) + header_size;
+    p->len = static_cast<u16_t>(p->len - header_size);
+    p->tot_len = p->len;
+    return 0;
+}
+
+u8_t pbuf_add_header(struct pbuf* p, size_t header_size)
+{
+    p->payload = static_cast<uint8_t*>(p->payload) - header_size;
+    p->len = static_cast<u16_t>(p->len + header_size);
+    p->tot_len = p->len;
+    return 0;
+}
+
+u16_t pbuf_copy_partial(const struct pbuf* p, void* dataptr, u16_t len, u16_t offset)
+{
+    if (offset >= p->len) {
+        return 0;
+    }
+    u16_t n = static_cast<u16_t>(len < p->len - offset ? len : p->len - offset);
+    memcpy(dataptr, static_cast<const uint8_t*>(p->payload) + offset, n);
+    return n;
+}
+
+u16_t inet_chksum(const void* dataptr, u16_t len)
+{
+    auto bytes = static_cast<const uint8_t*>(dataptr);
+    uint32_t sum = 0;
+    for (u16_t idx = 0; idx + 1 < len; idx += 2) {
+        sum += static_cast<uint32_t>(bytes[idx] | (bytes[idx + 1] << 8));
+    }
+    if (len & 1) {
+        sum += bytes[len - 1];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return static_cast<u16_t>(~sum);
+}
+
+struct raw_pcb* raw_new(u8_t)
+{
+    return nullptr;
+}
+
+void raw_remove(struct raw_pcb*)
+{
+}
+
+void raw_recv(struct raw_pcb*, raw_recv_fn, void*)
+{
+}
+
+err_t raw_bind(struct raw_pcb*, const ip_addr_t*)
+{
+    return ERR_VAL;
+}
+
+err_t raw_sendto(struct raw_pcb*, struct pbuf*, const ip_addr_t*)
+{
+    return ERR_RTE;
+}
+
+// lwIP's default send buffer: four maximum size segments
+static const u16_t tcp_snd_buf = 4 * 1460;
+
+struct tcp_pcb {
+    void* arg;
+    tcp_err_fn err;
+    tcp_sent_fn sent;
+    tcp_recv_fn recv;
+    tcp_connected_fn connected;
+    tcp_accept_fn accept;
+    tcp_poll_fn poll;
+    u8_t poll_interval;     // in host_lwip_poll() calls
+    u8_t poll_ticks;
+    ip_addr_t remote;
+    u16_t remote_port;
+    u16_t local_port;
+    bool is_listener;
+    bool is_connected;
+    u16_t snd_buf;
+    uint32_t unacked;
+    int client;             // for a connection a client opened, its number; otherwise 0
+};
+
+struct udp_pcb {
+    udp_recv_fn recv;
+    void* recv_arg;
+};
+
+struct Host_datagram {
+    struct udp_pcb* pcb;
+    std::vector<uint8_t> data;
+};
+
+// A connection the peer opens to a listener
+struct Host_client {
+    u16_t port;
+    struct tcp_pcb* pcb;    // nullptr until accepted and after it is freed
+    std::string request;    // sent by the client and not yet received
+    std::string response;   // written by the device
+    bool accepted;
+    bool close_requested;
+    bool fin_received;
+    bool closed;
+    bool aborted;
+};
+
+Host_lwip_peer host_lwip_peer;
+Host_lwip_stats host_lwip_stats;
+static std::vector<struct tcp_pcb*> tcp_pcbs;
+static std::vector<struct udp_pcb*> udp_pcbs;
+static std::vector<Host_datagram> echoes;
+static uint32_t echo_count;
+static std::vector<Host_client> clients;
+
+template<typename T> static bool forget_pcb(std::vector<T*>& pcbs, T* pcb)
+{
+    auto it = std::find(pcbs.begin(), pcbs.end(), pcb);
+    if (it == pcbs.end()) {
+        return false;
+    }
+    pcbs.erase(it);
+    delete pcb;
+    return true;
+}
+
+static bool is_live(struct tcp_pcb* pcb)
+{
+    return std::find(tcp_pcbs.begin(), tcp_pcbs.end(), pcb) != tcp_pcbs.end();
+}
+
+// Free a TCP pcb and tell its client, if any, that the connection ended
+static bool release_tcp(struct tcp_pcb* pcb, bool aborted)
+{
+    if (pcb->client != 0) {
+        Host_client& client = clients[pcb->client - 1];
+        client.pcb = nullptr;
+        client.closed = true;
+        client.aborted = aborted;
+    }
+    if (!forget_pcb(tcp_pcbs, pcb)) {
+        return false;
+    }
+    --host_lwip_stats.tcp_pcbs;
+    return true;
+}
+
+// As lwIP does, free the pcb before telling its owner
+static void fail_tcp(struct tcp_pcb* pcb, err_t err)
+{
+    tcp_err_fn err_fn = pcb->err;
+    void* arg = pcb->arg;
+    release_tcp(pcb, true);
+    if (err_fn != nullptr) {
+        err_fn(arg, err);
+    }
+}
+
+// Hand a client's request and its FIN to the device. Returns false if
+// the device freed the pcb
+static bool deliver_to_device(struct tcp_pcb* pcb)
+{
+    Host_client& client = clients[pcb->client - 1];
+    if (!client.request.empty()) {
+        struct pbuf* p = pbuf_alloc(PBUF_TRANSPORT, static_cast<u16_t>(client.request.size()), PBUF_RAM);
+        memcpy(p->payload, client.request.data(), client.request.size());
+        client.request.clear();
+        if (pcb->recv == nullptr) {
+            pbuf_free(p);
+        }
+        else if (pcb->recv(pcb->arg, pcb, p, ERR_OK) == ERR_ABRT || !is_live(pcb)) {
+            return false;
+        }
+    }
+    if (client.close_requested && !client.fin_received) {
+        client.fin_received = true;
+        if (pcb->recv == nullptr) {
+            tcp_close(pcb);
+            return false;
+        }
+        if (pcb->recv(pcb->arg, pcb, nullptr, ERR_OK) == ERR_ABRT || !is_live(pcb)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A listener accepts the clients that connected to its port since the
+// last poll; the others are refused
+static void accept_clients()
+{
+    for (size_t idx = 0; idx < clients.size(); idx++) {
+        if (clients[idx].accepted || clients[idx].closed) {
+            continue;
+        }
+        clients[idx].accepted = true;
+        auto it = std::find_if(tcp_pcbs.begin(), tcp_pcbs.end(), [idx](const struct tcp_pcb* pcb) {
+            return pcb->is_listener && pcb->local_port == clients[idx].port && pcb->accept != nullptr;
+        });
+        if (it == tcp_pcbs.end()) {
+            clients[idx].closed = true;
+            clients[idx].aborted = true;
+            continue;
+        }
+        struct tcp_pcb* listener = *it;
+        struct tcp_pcb* pcb = tcp_new();
+        pcb->arg = listener->arg;
+        pcb->local_port = clients[idx].port;
+        pcb->remote.addr = host_lwip_peer.address;
+        pcb->is_connected = true;
+        pcb->snd_buf = host_lwip_peer.tcp_snd_buf != 0 ? host_lwip_peer.tcp_snd_buf : tcp_snd_buf;
+        pcb->client = static_cast<int>(idx) + 1;
+        clients[idx].pcb = pcb;
+        err_t err = listener->accept(pcb->arg, pcb, ERR_OK);
+        if (err != ERR_OK && err != ERR_ABRT && is_live(pcb)) {
+            tcp_abort(pcb);
+        }
+    }
+}
+
+static void poll_tcp(struct tcp_pcb* pcb)
+{
+    if (pcb->is_listener) {
+        return;
+    }
+    bool sink = host_lwip_peer.tcp_port != 0 && pcb->remote_port == host_lwip_peer.tcp_port &&
+        pcb->remote.addr == host_lwip_peer.address;
+    if (!pcb->is_connected) {
+        if (!sink) {
+            fail_tcp(pcb, ERR_RST);
+            return;
+        }
+        pcb->is_connected = true;
+        pcb->snd_buf = tcp_snd_buf;
+        if (pcb->connected != nullptr) {
+            pcb->connected(pcb->arg, pcb, ERR_OK);
+        }
+        return;
+    }
+    if (host_lwip_peer.tcp_reset) {
+        fail_tcp(pcb, ERR_RST);
+        return;
+    }
+    if (pcb->client != 0 && !deliver_to_device(pcb)) {
+        return;
+    }
+    uint32_t acked = pcb->unacked < host_lwip_peer.tcp_ack_bytes ? pcb->unacked : host_lwip_peer.tcp_ack_bytes;
+    if (acked != 0) {
+        pcb->unacked -= acked;
+        pcb->snd_buf = static_cast<u16_t>(pcb->snd_buf + acked);
+        if (pcb->sent != nullptr && (pcb->sent(pcb->arg, pcb, static_cast<u16_t>(acked)) == ERR_ABRT || !is_live(pcb))) {
+            return;
+        }
+    }
+    // each host_lwip_poll() is one tick of lwIP's 500 ms slow timer
+    if (pcb->poll != nullptr && ++pcb->poll_ticks >= pcb->poll_interval) {
+        pcb->poll_ticks = 0;
+        pcb->poll(pcb->arg, pcb);
+    }
+}
+
+void host_lwip_poll(void)
+{
+    // a callback may free any pcb, so look each one up again before using it
+    std::vector<struct tcp_pcb*> polled = tcp_pcbs;
+    for (auto pcb: polled) {
+        if (is_live(pcb)) {
+            poll_tcp(pcb);
+        }
+    }
+    host_lwip_peer.tcp_reset = false;
+    accept_clients();
+    std::vector<Host_datagram> arrived;
+    arrived.swap(echoes);
+    for (const auto& datagram: arrived) {
+        if (std::find(udp_pcbs.begin(), udp_pcbs.end(), datagram.pcb) == udp_pcbs.end()) {
+            continue;
+        }
+        struct pbuf* p = pbuf_alloc(PBUF_TRANSPORT, static_cast<u16_t>(datagram.data.size()), PBUF_RAM);
+        memcpy(p->payload, datagram.data.data(), datagram.data.size());
+        if (datagram.pcb->recv == nullptr) {
+            pbuf_free(p);
+            continue;
+        }
+        ip_addr_t from;
+        from.addr = host_lwip_peer.address;
+        datagram.pcb->recv(datagram.pcb->recv_arg, datagram.pcb, p, &from, host_lwip_peer.udp_echo_port);
+    }
+}
+
+void host_lwip_reset(void)
+{
+    memset(&host_lwip_peer, 0, sizeof(host_lwip_peer));
+    memset(&host_lwip_stats, 0, sizeof(host_lwip_stats));
+    host_lwip_stats.tcp_pcbs = static_cast<int>(tcp_pcbs.size());
+    host_lwip_stats.udp_pcbs = static_cast<int>(udp_pcbs.size());
+    echoes.clear();
+    echo_count = 0;
+    for (auto pcb: tcp_pcbs) {
+        pcb->client = 0;
+    }
+    clients.clear();
+}
+
+int host_lwip_client_connect(u16_t port)
+{
+    clients.push_back({port, nullptr, "", "", false, false, false, false, false});
+    return static_cast<int>(clients.size());
+}
+
+void host_lwip_client_send(int client, const char* data)
+{
+    clients[client - 1].request += data;
+}
+
+void host_lwip_client_close(int client)
+{
+    clients[client - 1].close_requested = true;
+}
+
+size_t host_lwip_client_received(int client, char* buffer, size_t size)
+{
+    const std::string& response = clients[client - 1].response;
+    size_t len = response.size() < size ? response.size() : size - 1;
+    memcpy(buffer, response.data(), len);
+    buffer[len] = '\0';
+    return len;
+}
+
+bool host_lwip_client_is_closed(int client)
+{
+    return clients[client - 1].closed;
+}
+
+bool host_lwip_client_was_aborted(int client)
+{
+    return clients[client - 1].aborted;
+}
+
+struct udp_pcb* udp_new(void)
+{
+    auto pcb = new udp_pcb{nullptr, nullptr};
+    udp_pcbs.push_back(pcb);
+    ++host_lwip_stats.udp_pcbs;
+    return pcb;
+}
+
+void udp_remove(struct udp_pcb* pcb)
+{
+    if (forget_pcb(udp_pcbs, pcb)) {
+        --host_lwip_stats.udp_pcbs;
+    }
+}
+
+void udp_recv(struct udp_pcb* pcb, udp_recv_fn recv, void* recv_arg)
+{
+    pcb->recv = recv;
+    pcb->recv_arg = recv_arg;
+}
+
+err_t udp_bind(struct udp_pcb*, const ip_addr_t*, u16_t)
+{
+    return ERR_OK;
+}
+
+err_t udp_sendto(struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* dst_ip, u16_t dst_port)
+{
+    ++host_lwip_stats.udp_datagrams_sent;
+    if (host_lwip_peer.udp_echo_port == 0 || dst_port != host_lwip_peer.udp_echo_port ||
+            dst_ip->addr != host_lwip_peer.address) {
+        return ERR_OK; // nobody listens
+    }
+    ++echo_count;
+    if (host_lwip_peer.udp_drop_every == 0 || echo_count % host_lwip_peer.udp_drop_every != 0) {
+        const uint8_t* payload = static_cast<const uint8_t*>(p->payload);
+        echoes.push_back({pcb, std::vector<uint8_t>(payload, payload + p->len)});
+    }
+    return ERR_OK;
+}
+
+struct tcp_pcb* tcp_new(void)
+{
+    auto pcb = new tcp_pcb{};
+    tcp_pcbs.push_back(pcb);
+    ++host_lwip_stats.tcp_pcbs;
+    return pcb;
+}
+
+struct tcp_pcb* tcp_new_ip_type(u8_t)
+{
+    return tcp_new();
+}
+
+void tcp_arg(struct tcp_pcb* pcb, void* arg)
+{
+    pcb->arg = arg;
+}
+
+void tcp_err(struct tcp_pcb* pcb, tcp_err_fn err)
+{
+    pcb->err = err;
+}
+
+void tcp_sent(struct tcp_pcb* pcb, tcp_sent_fn sent)
+{
+    pcb->sent = sent;
+}
+
+void tcp_recv(struct tcp_pcb* pcb, tcp_recv_fn recv)
+{
+    pcb->recv = recv;
+}
+
+void tcp_poll(struct tcp_pcb* pcb, tcp_poll_fn poll, u8_t interval)
+{
+    pcb->poll = poll;
+    pcb->poll_interval = interval;
+    pcb->poll_ticks = 0;
+}
+
+void tcp_accept(struct tcp_pcb* pcb, tcp_accept_fn accept)
+{
+    pcb->accept = accept;
+}
+
+err_t tcp_bind(struct tcp_pcb* pcb, const ip_addr_t*, u16_t port)
+{
+    for (auto other: tcp_pcbs) {
+        if (other != pcb && other->local_port == port && other->is_listener) {
+            return ERR_USE;
+        }
+    }
+    pcb->local_port = port;
+    return ERR_OK;
+}
+
+struct tcp_pcb* tcp_listen_with_backlog(struct tcp_pcb* pcb, u8_t)
+{
+    // as lwIP does, replace the pcb with a smaller listening one
+    struct tcp_pcb* listener = tcp_new();
+    listener->arg = pcb->arg;
+    listener->local_port = pcb->local_port;
+    listener->is_listener = true;
+    tcp_close(pcb);
+    return listener;
+}
+
+err_t tcp_connect(struct tcp_pcb* pcb, const ip_addr_t* ipaddr, u16_t port, tcp_connected_fn connected)
+{
+    // the outcome arrives on the next host_lwip_poll()
+    pcb->remote = *ipaddr;
+    pcb->remote_port = port;
+    pcb->connected = connected;
+    return ERR_OK;
+}
+
+err_t tcp_write(struct tcp_pcb* pcb, const void* dataptr, u16_t len, u8_t)
+{
+    if (!pcb->is_connected) {
+        return ERR_CONN;
+    }
+    if (len > pcb->snd_buf) {
+        return ERR_MEM;
+    }
+    pcb->snd_buf = static_cast<u16_t>(pcb->snd_buf - len);
+    pcb->unacked += len;
+    host_lwip_stats.tcp_bytes_written += len;
+    if (pcb->client != 0) {
+        clients[pcb->client - 1].response.append(static_cast<const char*>(dataptr), len);
+    }
+    return ERR_OK;
+}
+
+err_t tcp_output(struct tcp_pcb* pcb)
+{
+    return pcb->is_connected ? ERR_OK : ERR_CONN;
+}
+
+void tcp_recved(struct tcp_pcb*, u16_t)
+{
+}
+
+u16_t tcp_sndbuf(const struct tcp_pcb* pcb)
+{
+    return pcb->snd_buf;
+}
+
+err_t tcp_close(struct tcp_pcb* pcb)
+{
+    // the client gets the data already written before the FIN
+    release_tcp(pcb, false);
+    return ERR_OK;
+}
+
+void tcp_abort(struct tcp_pcb* pcb)
+{
+    fail_tcp(pcb, ERR_ABRT);
+}
+
+err_t dns_gethostbyname(const char*, ip_addr_t*, dns_found_callback, void*)
+{
+    return ERR_ARG;
+}
+
+err_t dns_local_addhost(const char*, const ip_addr_t*)
+{
+    return ERR_MEM;
+}
+
+int dns_local_removehost(const char*, const ip_addr_t*)
+{
+    return 0;
+}
+
+err_t dns_local_lookup(const char*, ip_addr_t*, u8_t)
+{
+    return ERR_ARG;
+}
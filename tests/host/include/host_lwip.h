@@ -0,0 +1,80 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+// Host only: the network peer the lwIP functions in tests/host/host_sdk.cpp
+// talk to. Nothing answers until a test describes the peer.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "lwip/ip_addr.h"
+
+struct Host_lwip_peer {
+    uint32_t address;           // the peer's IPv4 address; other addresses never answer
+    u16_t tcp_port;             // the port of a TCP sink, or 0 to refuse connections
+    uint32_t tcp_ack_bytes;     // bytes the sink acknowledges per host_lwip_poll()
+    bool tcp_reset;             // the sink and the clients reset their connections on the next host_lwip_poll()
+    u16_t tcp_snd_buf;          // the send buffer of connections the clients open, or 0 for lwIP's default
+    u16_t udp_echo_port;        // the port of a UDP echo server, or 0 for none
+    uint32_t udp_drop_every;    // lose every udp_drop_every-th datagram to the echo server; 0 loses none
+};
+extern Host_lwip_peer host_lwip_peer;
+
+// Host only: what the code under test did with lwIP
+struct Host_lwip_stats {
+    int tcp_pcbs;                   // allocated and not yet closed, aborted or reset
+    int udp_pcbs;                   // allocated and not yet removed
+    uint32_t tcp_bytes_written;
+    uint32_t udp_datagrams_sent;
+};
+extern Host_lwip_stats host_lwip_stats;
+
+// Host only: run the lwIP callbacks that are due, as the driver's
+// background processing does on the Pico: connections complete or fail,
+// the sink acknowledges data and the echo server's replies arrive
+void host_lwip_poll(void);
+
+// Host only: forget the peer, the replies in flight, the clients and the statistics
+void host_lwip_reset(void);
+
+// Host only: a client on the peer connects to a port on the device. The
+// listener on the port accepts it on the next host_lwip_poll(); without
+// one, the connection is refused. Returns the client's number
+int host_lwip_client_connect(u16_t port);
+
+// Host only: the client sends text, which the device receives on the next host_lwip_poll()
+void host_lwip_client_send(int client, const char* data);
+
+// Host only: the client closes its end on the next host_lwip_poll()
+void host_lwip_client_close(int client);
+
+// Host only: copy what the device wrote to the client into buffer, NUL
+// terminated, and return its length. The peer acknowledges the data
+// tcp_ack_bytes at a time
+size_t host_lwip_client_received(int client, char* buffer, size_t size);
+
+// Host only: true once the device closed or aborted the connection or it was refused
+bool host_lwip_client_is_closed(int client);
+
+// Host only: true if the connection was aborted, reset or refused rather than closed
+bool host_lwip_client_was_aborted(int client);
@@ -0,0 +1,46 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+// Host stand-in for the lwIP header of the same name; IPv4 only
+#pragma once
+#include "lwip/arch.h"
+
+typedef struct ip4_addr {
+    u32_t addr;
+} ip4_addr_t;
+typedef ip4_addr_t ip_addr_t;
+
+extern const ip_addr_t ip_addr_any;
+#define IP_ADDR_ANY (&ip_addr_any)
+#define IP_ANY_TYPE IP_ADDR_ANY
+#define IPADDR_TYPE_V4 0
+#define IPADDR_TYPE_ANY 46
+#define IP_IS_V4(ipaddr) 1
+#define ip_2_ip4(ipaddr) (ipaddr)
+#define ip4_addr_get_u32(src) ((src)->addr)
+#define ip4_addr_set_u32(dest, src) ((dest)->addr = (src))
+#define ip_addr_set_ip4_u32(ipaddr, val) ((ipaddr)->addr = (val))
+#define ip_addr_copy(dest, src) ((dest) = (src))
+#define ip_addr_cmp(addr1, addr2) ((addr1)->addr == (addr2)->addr)
+#define ip_addr_isany(ipaddr) ((ipaddr) == NULL || (ipaddr)->addr == 0)
@@ -0,0 +1,37 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+// Host stand-in for the lwIP header of the same name; see tests/host/host_sdk.cpp
+#pragma once
+#include "lwip/ip_addr.h"
+#include "lwip/pbuf.h"
+
+struct raw_pcb;
+typedef u8_t (*raw_recv_fn)(void* arg, struct raw_pcb* pcb, struct pbuf* p, const ip_addr_t* addr);
+
+struct raw_pcb* raw_new(u8_t proto);
+void raw_remove(struct raw_pcb* pcb);
+void raw_recv(struct raw_pcb* pcb, raw_recv_fn recv, void* recv_arg);
+err_t raw_bind(struct raw_pcb* pcb, const ip_addr_t* ipaddr);
+err_t raw_sendto(struct raw_pcb* pcb, struct pbuf* p, const ip_addr_t* ipaddr);
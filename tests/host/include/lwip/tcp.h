@@ -0,0 +1,58 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+// Host stand-in for the lwIP header of the same name; see tests/host/host_sdk.cpp
+#pragma once
+#include "lwip/ip_addr.h"
+#include "lwip/pbuf.h"
+
+#define TCP_WRITE_FLAG_COPY 0x01
+#define TCP_WRITE_FLAG_MORE 0x02
+
+struct tcp_pcb;
+typedef err_t (*tcp_accept_fn)(void* arg, struct tcp_pcb* newpcb, err_t err);
+typedef err_t (*tcp_connected_fn)(void* arg, struct tcp_pcb* tpcb, err_t err);
+typedef err_t (*tcp_sent_fn)(void* arg, struct tcp_pcb* tpcb, u16_t len);
+typedef err_t (*tcp_recv_fn)(void* arg, struct tcp_pcb* tpcb, struct pbuf* p, err_t err);
+typedef err_t (*tcp_poll_fn)(void* arg, struct tcp_pcb* tpcb);
+typedef void (*tcp_err_fn)(void* arg, err_t err);
+
+struct tcp_pcb* tcp_new(void);
+struct tcp_pcb* tcp_new_ip_type(u8_t type);
+void tcp_arg(struct tcp_pcb* pcb, void* arg);
+void tcp_err(struct tcp_pcb* pcb, tcp_err_fn err);
+void tcp_sent(struct tcp_pcb* pcb, tcp_sent_fn sent);
+void tcp_recv(struct tcp_pcb* pcb, tcp_recv_fn recv);
+void tcp_poll(struct tcp_pcb* pcb, tcp_poll_fn poll, u8_t interval);
+void tcp_accept(struct tcp_pcb* pcb, tcp_accept_fn accept);
+err_t tcp_bind(struct tcp_pcb* pcb, const ip_addr_t* ipaddr, u16_t port);
+struct tcp_pcb* tcp_listen_with_backlog(struct tcp_pcb* pcb, u8_t backlog);
+#define tcp_listen(pcb) tcp_listen_with_backlog(pcb, 0xff)
+err_t tcp_connect(struct tcp_pcb* pcb, const ip_addr_t* ipaddr, u16_t port, tcp_connected_fn connected);
+err_t tcp_write(struct tcp_pcb* pcb, const void* dataptr, u16_t len, u8_t apiflags);
+err_t tcp_output(struct tcp_pcb* pcb);
+void tcp_recved(struct tcp_pcb* pcb, u16_t len);
+u16_t tcp_sndbuf(const struct tcp_pcb* pcb);
+err_t tcp_close(struct tcp_pcb* pcb);
+void tcp_abort(struct tcp_pcb* pcb);
@@ -0,0 +1,95 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+// Host stand-in for the Pico SDK header of the same name. There is no
+// radio: initialization succeeds and everything else reports that the
+// link is down. See tests/host/host_sdk.cpp.
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cyw43_country.h"
+#include "lwip/netif.h"
+#include "pico/time.h"
+
+#define CYW43_ITF_STA 0
+#define CYW43_ITF_AP 1
+
+#define CYW43_LINK_DOWN 0
+#define CYW43_LINK_JOIN 1
+#define CYW43_LINK_NOIP 2
+#define CYW43_LINK_UP 3
+#define CYW43_LINK_FAIL -1
+#define CYW43_LINK_NONET -2
+#define CYW43_LINK_BADAUTH -3
+
+#define CYW43_AUTH_OPEN 0
+#define CYW43_AUTH_WPA_TKIP_PSK 0x00200002
+#define CYW43_AUTH_WPA2_AES_PSK 0x00400004
+#define CYW43_AUTH_WPA2_MIXED_PSK 0x00400006
+
+#define CYW43_NO_POWERSAVE_MODE 0
+#define CYW43_PM1_POWERSAVE_MODE 1
+#define CYW43_PM2_POWERSAVE_MODE 2
+#define cyw43_pm_value(pm_mode, pm2_sleep_ret_ms, li_beacon_period, li_dtim_period, li_assoc) \
+    ((li_assoc) << 20 | (li_dtim_period) << 16 | (li_beacon_period) << 12 | ((pm2_sleep_ret_ms) / 10) << 4 | (pm_mode))
+#define CYW43_DEFAULT_PM cyw43_pm_value(CYW43_PM2_POWERSAVE_MODE, 200, 1, 1, 10)
+
+typedef struct {
+    uint8_t bssid[6];
+    uint16_t channel;
+    uint8_t auth_mode;
+    int16_t rssi;
+    uint8_t ssid_len;
+    uint8_t ssid[32];
+} cyw43_ev_scan_result_t;
+
+typedef struct {
+    uint32_t version;
+    uint32_t ssid_len;
+    uint8_t ssid[32];
+} cyw43_wifi_scan_options_t;
+
+typedef struct {
+    struct netif netif[2];
+} cyw43_t;
+
+extern cyw43_t cyw43_state;
+
+int cyw43_arch_init_with_country(uint32_t country);
+void cyw43_arch_deinit(void);
+void cyw43_arch_enable_sta_mode(void);
+uint32_t cyw43_arch_get_country_code(void);
+int cyw43_arch_wifi_connect_async(const char* ssid, const char* pw, uint32_t auth);
+void cyw43_arch_lwip_begin(void);
+void cyw43_arch_lwip_end(void);
+int cyw43_wifi_scan(cyw43_t* self, cyw43_wifi_scan_options_t* opts, void* env,
+    int (*result_cb)(void*, const cyw43_ev_scan_result_t*));
+bool cyw43_wifi_scan_active(cyw43_t* self);
+int cyw43_tcpip_link_status(cyw43_t* self, int itf);
+int cyw43_wifi_join(cyw43_t* self, size_t ssid_len, const uint8_t* ssid, size_t key_len, const uint8_t* key,
+    uint32_t auth_type, const uint8_t* bssid, uint32_t channel);
+int cyw43_wifi_leave(cyw43_t* self, int itf);
+int cyw43_wifi_pm(cyw43_t* self, uint32_t pm);
+int cyw43_ioctl(cyw43_t* self, uint32_t cmd, size_t len, uint8_t* buf, uint32_t iface);
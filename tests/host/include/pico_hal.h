@@ -0,0 +1,54 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+// Host stand-in for the littlefs-lib header of the same name; see tests/host/host_littlefs.cpp
+#pragma once
+#include <stdint.h>
+
+#define LFS_ERR_OK 0
+#define LFS_ERR_IO -5
+#define LFS_ERR_NOENT -2
+#define LFS_ERR_CORRUPT -84
+#define LFS_O_RDONLY 1
+#define LFS_O_WRONLY 2
+#define LFS_O_RDWR 3
+#define LFS_O_CREAT 0x0100
+#define LFS_O_TRUNC 0x0400
+
+typedef int32_t lfs_ssize_t;
+typedef int32_t lfs_soff_t;
+typedef uint32_t lfs_size_t;
+typedef struct {int unused;} lfs_dir_t;
+typedef struct {int handle;} lfs_file_t;
+
+int pico_mount(bool format);
+int pico_unmount(void);
+int lfs_dir_open(lfs_dir_t* dir, const char* path);
+int lfs_dir_close(lfs_dir_t* dir);
+int lfs_mkdir(const char* path);
+int lfs_file_open(lfs_file_t* file, const char* path, int flags);
+int lfs_file_close(lfs_file_t* file);
+lfs_ssize_t lfs_file_read(lfs_file_t* file, void* buffer, lfs_size_t size);
+lfs_ssize_t lfs_file_write(lfs_file_t* file, const void* buffer, lfs_size_t size);
+lfs_soff_t lfs_file_size(lfs_file_t* file);
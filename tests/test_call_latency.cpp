@@ -0,0 +1,209 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <vector>
+#include "test_support.h"
+#include "fake_wifi_driver.h"
+#include "pico_w_connection_manager.h"
+#include "wifi_trace.h"
+
+using rppicomidi::Call_latency_monitor;
+using rppicomidi::Pico_w_connection_manager;
+using rppicomidi::Wifi_driver;
+using rppicomidi::Wifi_trace_recorder;
+using rppicomidi::Wifi_trace_replay_driver;
+using test::Fake_wifi_driver;
+
+namespace
+{
+const uint32_t firmware_load_us = 250000;
+
+void run_until(Pico_w_connection_manager& wifi, Fake_wifi_driver& driver, Pico_w_connection_manager::Wifi_state state)
+{
+    for (int idx = 0; idx < 100 && wifi.get_state() != state; idx++) {
+        driver.time_ms += 10;
+        wifi.task();
+    }
+    CHECK_EQ(wifi.get_state(), state);
+}
+
+void test_calls_are_measured()
+{
+    Fake_wifi_driver driver;
+    driver.firmware_load_us = firmware_load_us;
+    Pico_w_connection_manager wifi(nullptr, &driver);
+    wifi.set_log_drain_per_task(0);
+    wifi.set_current_ssid("home");
+    CHECK(wifi.initialize());
+    CHECK(wifi.connect());
+    run_until(wifi, driver, Pico_w_connection_manager::CONNECTED);
+    const auto& monitor = wifi.get_latency_monitor();
+    CHECK_EQ(monitor.get_calls(Call_latency_monitor::CALL_INITIALIZE), 1u);
+    const auto& worst = monitor.get_worst(Call_latency_monitor::CALL_INITIALIZE);
+    CHECK_EQ(worst.duration_us, firmware_load_us);
+    CHECK_EQ(worst.from_state, Pico_w_connection_manager::DEINITIALIZED);
+    CHECK_EQ(worst.to_state, Pico_w_connection_manager::INITIALIZED);
+    CHECK_EQ(monitor.get_bucket_count(Call_latency_monitor::CALL_INITIALIZE,
+        Call_latency_monitor::get_bucket(firmware_load_us)), 1u);
+    CHECK(monitor.get_calls(Call_latency_monitor::CALL_TASK) > 0);
+    CHECK_EQ(monitor.get_worst(Call_latency_monitor::CALL_TASK).duration_us, 0u);
+
+    // connect() from CONNECTED restarts the radio in the call
+    CHECK(wifi.connect());
+    CHECK_EQ(monitor.get_worst(Call_latency_monitor::CALL_CONNECT).duration_us, firmware_load_us);
+    CHECK_EQ(monitor.get_restart_estimate_us(), firmware_load_us);
+}
+
+// A deferred restart leaves the link at once; the state must say so
+// before task() unloads the firmware
+void test_deferred_restart_states()
+{
+    Fake_wifi_driver driver;
+    Pico_w_connection_manager wifi(nullptr, &driver);
+    wifi.set_log_drain_per_task(0);
+    wifi.set_current_ssid("home");
+    wifi.set_restart_latency_budget_us(1000);
+    CHECK(wifi.initialize());
+    CHECK(wifi.connect());
+    run_until(wifi, driver, Pico_w_connection_manager::CONNECTED);
+
+    CHECK(wifi.start_scan());
+    CHECK(wifi.is_restart_pending());
+    CHECK_EQ(wifi.get_state(), Pico_w_connection_manager::INITIALIZED);
+    CHECK(!wifi.is_link_up());
+    CHECK(driver.initialized);
+    wifi.task();
+    CHECK_EQ(wifi.get_state(), Pico_w_connection_manager::DEINITIALIZED);
+    CHECK(!driver.initialized);
+    wifi.task();
+    CHECK(!wifi.is_restart_pending());
+    CHECK_EQ(wifi.get_state(), Pico_w_connection_manager::SCAN_REQUESTED);
+    run_until(wifi, driver, Pico_w_connection_manager::SCAN_COMPLETE);
+
+    CHECK(wifi.connect());
+    run_until(wifi, driver, Pico_w_connection_manager::CONNECTED);
+    uint32_t link_uptime_ms = 0;
+    driver.time_ms += 5000;
+    CHECK(wifi.connect());
+    CHECK_EQ(wifi.get_state(), Pico_w_connection_manager::INITIALIZED);
+    wifi.task();
+    Pico_w_connection_manager::Status_snapshot status;
+    wifi.get_status_snapshot(status);
+    // the link time stops when connect() leaves the link
+    link_uptime_ms = static_cast<uint32_t>(status.total_link_uptime_ms);
+    driver.time_ms += 10;
+    wifi.task();
+    run_until(wifi, driver, Pico_w_connection_manager::CONNECTED);
+    wifi.get_status_snapshot(status);
+    CHECK(link_uptime_ms >= 5000 && link_uptime_ms < 5100);
+
+    // disconnect() while joining
+    driver.join_result = Wifi_driver::LINK_JOIN;
+    CHECK(wifi.connect());
+    wifi.task();
+    wifi.task();
+    CHECK_EQ(wifi.get_state(), Pico_w_connection_manager::CONNECTION_REQUESTED);
+    CHECK(wifi.disconnect());
+    CHECK(wifi.is_restart_pending());
+    CHECK_EQ(wifi.get_state(), Pico_w_connection_manager::INITIALIZED);
+    wifi.task();
+    wifi.task();
+    CHECK(!wifi.is_restart_pending());
+    CHECK_EQ(wifi.get_state(), Pico_w_connection_manager::INITIALIZED);
+}
+
+void append(void* context, const uint8_t* data, size_t len)
+{
+    auto trace = reinterpret_cast<std::vector<uint8_t>*>(context);
+    trace->insert(trace->end(), data, data + len);
+}
+
+// Rescan and reconnect a few times with a budget shorter than a
+// firmware load
+std::vector<int> run_session(Wifi_driver& driver, Fake_wifi_driver* fake)
+{
+    std::vector<int> states;
+    Pico_w_connection_manager wifi(nullptr, &driver);
+    wifi.set_log_drain_per_task(0);
+    wifi.set_current_ssid("home");
+    wifi.set_restart_latency_budget_us(firmware_load_us / 2);
+    wifi.initialize();
+    wifi.reset_latency_monitor();
+    for (int round = 0; round < 3; round++) {
+        wifi.connect();
+        states.push_back(wifi.get_state());
+        states.push_back(wifi.is_restart_pending());
+        for (int step = 0; step < 5; step++) {
+            if (fake != nullptr) {
+                fake->time_ms += 10;
+            }
+            wifi.task();
+            states.push_back(wifi.get_state());
+        }
+        wifi.start_scan();
+        states.push_back(wifi.get_state());
+        states.push_back(wifi.is_restart_pending());
+        for (int step = 0; step < 5; step++) {
+            if (fake != nullptr) {
+                fake->time_ms += 10;
+            }
+            wifi.task();
+            states.push_back(wifi.get_state());
+        }
+    }
+    return states;
+}
+
+// Measuring calls adds nothing to a trace, and the restart decisions the
+// measurements make replay the same even though the replay's time stamps,
+// taken from the recorded now_ms() times, measure no firmware load
+void test_measurements_replay()
+{
+    Fake_wifi_driver fake;
+    fake.firmware_load_us = firmware_load_us;
+    std::vector<uint8_t> trace;
+    Wifi_trace_recorder recorder(fake, append, &trace);
+    auto recorded = run_session(recorder, &fake);
+    // every rescan restarts the radio: the first because nothing has been
+    // measured, the others because a load takes longer than the budget
+    for (int round = 0; round < 3; round++) {
+        CHECK_EQ(recorded[round * 14 + 7], Pico_w_connection_manager::INITIALIZED);
+        CHECK_EQ(recorded[round * 14 + 8], 1);
+    }
+
+    Wifi_trace_replay_driver replay(trace.data(), trace.size());
+    auto replayed = run_session(replay, nullptr);
+    CHECK(!replay.is_diverged());
+    CHECK(replay.is_finished());
+    CHECK(replayed == recorded);
+}
+}
+
+int main()
+{
+    test_calls_are_measured();
+    test_deferred_restart_states();
+    test_measurements_replay();
+    return test::result();
+}
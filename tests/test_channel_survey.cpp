@@ -0,0 +1,226 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstdio>
+#include <vector>
+#include "test_support.h"
+#include "fake_wifi_driver.h"
+#include "channel_survey.h"
+#include "pico_w_connection_manager.h"
+
+using rppicomidi::Channel_survey;
+using rppicomidi::Pico_w_connection_manager;
+using test::Fake_wifi_driver;
+
+namespace
+{
+// A small deterministic generator so failures reproduce
+uint32_t random_state = 12345;
+uint32_t next_random(uint32_t range)
+{
+    random_state = random_state * 1664525u + 1013904223u;
+    return (random_state >> 8) % range;
+}
+
+// Neighbours crowd channels 1, 6 and 11 and a few use the channels between
+uint8_t random_channel()
+{
+    static const uint8_t common[] = {1, 6, 11};
+    if (next_random(4) != 0) {
+        return common[next_random(3)];
+    }
+    return static_cast<uint8_t>(1 + next_random(13));
+}
+
+int16_t random_rssi()
+{
+    return static_cast<int16_t>(-90 + static_cast<int>(next_random(50)));
+}
+
+/**
+ * Check select() against a brute force search in many simulated dense
+ * environments: the choice must qualify on signal strength and no other
+ * qualifying candidate may see less congestion
+ */
+void test_dense_environments()
+{
+    const int num_trials = 500;
+    uint64_t chosen_total = 0;
+    uint64_t strongest_total = 0;
+    int steered = 0;
+    for (int trial = 0; trial < num_trials; trial++) {
+        Channel_survey survey;
+        std::vector<Channel_survey::Candidate> neighbours;
+        int num_neighbours = 20 + static_cast<int>(next_random(41));
+        for (int idx = 0; idx < num_neighbours; idx++) {
+            neighbours.push_back({random_channel(), random_rssi()});
+        }
+        std::vector<Channel_survey::Candidate> candidates;
+        int num_candidates = 2 + static_cast<int>(next_random(3));
+        for (int idx = 0; idx < num_candidates; idx++) {
+            candidates.push_back({random_channel(), static_cast<int16_t>(-75 + static_cast<int>(next_random(35)))});
+        }
+        // a few scans of the same neighbourhood, as the manager would make
+        for (int scan = 0; scan < 3; scan++) {
+            survey.begin_scan();
+            for (const auto& bss: neighbours) {
+                survey.add_bssid(bss.channel, bss.rssi);
+            }
+            for (const auto& bss: candidates) {
+                survey.add_bssid(bss.channel, bss.rssi);
+            }
+            survey.end_scan(static_cast<uint32_t>(scan) * 10000);
+        }
+        int chosen = survey.select(candidates.data(), candidates.size());
+        CHECK(chosen >= 0 && chosen < num_candidates);
+        if (chosen < 0) {
+            continue;
+        }
+        int strongest = 0;
+        for (int idx = 1; idx < num_candidates; idx++) {
+            if (candidates[idx].rssi > candidates[strongest].rssi) {
+                strongest = idx;
+            }
+        }
+        const auto& config = survey.get_config();
+        int floor_rssi = candidates[strongest].rssi - config.rssi_margin_db;
+        if (floor_rssi < config.min_rssi_dbm) {
+            floor_rssi = config.min_rssi_dbm;
+        }
+        uint32_t chosen_congestion = survey.get_congestion_x256(candidates[chosen].channel, candidates[chosen].rssi);
+        uint32_t strongest_congestion = survey.get_congestion_x256(candidates[strongest].channel, candidates[strongest].rssi);
+        CHECK(chosen == strongest || candidates[chosen].rssi >= floor_rssi);
+        CHECK(chosen_congestion <= strongest_congestion);
+        for (int idx = 0; idx < num_candidates; idx++) {
+            if (candidates[idx].rssi >= floor_rssi) {
+                CHECK(survey.get_congestion_x256(candidates[idx].channel, candidates[idx].rssi) >= chosen_congestion);
+            }
+        }
+        chosen_total += chosen_congestion;
+        strongest_total += strongest_congestion;
+        steered += chosen != strongest ? 1 : 0;
+    }
+    printf("%d dense environments: steered away from the strongest AP in %d, average congestion %.1f instead of %.1f\n",
+        num_trials, steered, chosen_total / 256.0 / num_trials, strongest_total / 256.0 / num_trials);
+    CHECK(steered > 0);
+    CHECK(chosen_total < strongest_total);
+}
+
+const uint32_t poll_ms = 10;
+
+void run_tasks(Pico_w_connection_manager& wifi, Fake_wifi_driver& driver, int steps)
+{
+    for (int step = 0; step < steps; step++) {
+        driver.time_ms += poll_ms;
+        wifi.task();
+    }
+}
+
+// "home" from a strong AP on crowded channel 1 and a slightly weaker one
+// alone on channel 11
+void make_dense_environment(Fake_wifi_driver& driver)
+{
+    driver.access_points.clear();
+    driver.access_points.push_back(Fake_wifi_driver::make_ap("home", 1, 1, -50));
+    driver.access_points.push_back(Fake_wifi_driver::make_ap("home", 2, 11, -56));
+    char name[16];
+    for (uint8_t idx = 0; idx < 15; idx++) {
+        snprintf(name, sizeof(name), "neighbour%u", idx);
+        driver.access_points.push_back(Fake_wifi_driver::make_ap(name, static_cast<uint8_t>(10 + idx), 1 + idx % 3, -60));
+    }
+}
+
+void scan(Pico_w_connection_manager& wifi, Fake_wifi_driver& driver)
+{
+    CHECK(wifi.start_scan());
+    run_tasks(wifi, driver, 5);
+    CHECK_EQ(wifi.get_state(), Pico_w_connection_manager::SCAN_COMPLETE);
+}
+
+void test_manager_steers()
+{
+    Fake_wifi_driver driver;
+    make_dense_environment(driver);
+    Pico_w_connection_manager wifi(nullptr, &driver);
+    wifi.set_current_ssid("home");
+    CHECK(wifi.initialize());
+    scan(wifi, driver);
+    CHECK(wifi.connect());
+    CHECK(driver.joined_bssid);
+    CHECK_EQ(driver.bssid[5], 2);
+    run_tasks(wifi, driver, 5);
+    CHECK_EQ(wifi.get_state(), Pico_w_connection_manager::CONNECTED);
+}
+
+void test_stale_results_are_not_used()
+{
+    Fake_wifi_driver driver;
+    make_dense_environment(driver);
+    Pico_w_connection_manager wifi(nullptr, &driver);
+    wifi.set_current_ssid("home");
+    CHECK(wifi.initialize());
+    scan(wifi, driver);
+    driver.time_ms += PICO_W_CM_SCAN_RESULT_MAX_AGE_MS;
+    CHECK(wifi.connect());
+    CHECK(!driver.joined_bssid);
+    run_tasks(wifi, driver, 5);
+    CHECK_EQ(wifi.get_state(), Pico_w_connection_manager::CONNECTED);
+}
+
+void test_moved_access_point()
+{
+    Fake_wifi_driver driver;
+    make_dense_environment(driver);
+    Pico_w_connection_manager wifi(nullptr, &driver);
+    wifi.set_current_ssid("home");
+    CHECK(wifi.initialize());
+    scan(wifi, driver);
+    // the quiet AP moves to channel 3 after the scan
+    driver.access_points[1].channel = 3;
+    CHECK(wifi.connect());
+    CHECK(driver.joined_bssid);
+    run_tasks(wifi, driver, 10);
+    CHECK_EQ(wifi.get_last_link_error_code(), Pico_w_connection_manager::LINK_ERROR_NONET);
+    // the next join lets the driver choose
+    CHECK(wifi.connect());
+    run_tasks(wifi, driver, 10);
+    CHECK(!driver.joined_bssid);
+    CHECK_EQ(wifi.get_state(), Pico_w_connection_manager::CONNECTED);
+    // a new scan allows choosing again
+    wifi.disconnect();
+    driver.time_ms += 10000;    // scans are at least 10 s apart
+    scan(wifi, driver);
+    CHECK(wifi.connect());
+    CHECK(driver.joined_bssid);
+}
+}
+
+int main()
+{
+    test_dense_environments();
+    test_manager_steers();
+    test_stale_results_are_not_used();
+    test_moved_access_point();
+    return test::result();
+}
@@ -0,0 +1,91 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstdio>
+#include "test_support.h"
+#include "fake_wifi_driver.h"
+#include "pico_w_connection_manager.h"
+#include "ram_settings_storage.h"
+
+using rppicomidi::Pico_w_connection_manager;
+using test::Fake_wifi_driver;
+
+namespace
+{
+// A host whose address changes on every refresh must not cost a flash
+// erase per refresh
+void test_saves_are_rate_limited()
+{
+    const char* host = "flaky.example.com";
+    Fake_wifi_driver driver;
+    rppicomidi::Ram_settings_storage storage;
+    Pico_w_connection_manager wifi(&storage, &driver);
+    wifi.set_log_drain_per_task(0);
+    auto config = wifi.get_dns_cache().get_config();
+    config.refresh_interval_ms = 60000;
+    wifi.set_dns_cache_config(config);
+    CHECK(wifi.add_dns_cache_host(host));
+    wifi.set_current_ssid("home");
+    CHECK(wifi.initialize());
+    CHECK(wifi.connect());
+    driver.time_ms += 10;
+    wifi.task();
+    CHECK(wifi.is_link_up());
+    storage.reset_stats();
+
+    const uint32_t hours = 3;
+    uint32_t address = 1;
+    uint32_t changes = 0;
+    uint32_t refreshes = wifi.get_dns_cache().get_refreshes();
+    for (uint32_t elapsed = 0; elapsed < hours * 3600000; elapsed += 100) {
+        driver.dns_server[host] = address;
+        driver.time_ms += 100;
+        wifi.task();
+        if (wifi.get_dns_cache().get_refreshes() != refreshes) {
+            refreshes = wifi.get_dns_cache().get_refreshes();
+            ++address;
+            ++changes;
+        }
+    }
+    uint32_t writes = storage.get_stats().writes;
+    printf("%u address changes in %u hours: %u settings writes\n", changes, hours, writes);
+    CHECK(changes >= hours * 60);
+    // the first change saves at once, then one save per interval
+    CHECK(writes >= 1 && writes <= 1 + hours * 3600000 / PICO_W_CM_DNS_CACHE_SAVE_INTERVAL_MS);
+    CHECK_EQ(wifi.get_settings_saved_state(), Pico_w_connection_manager::NOT_SAVED);
+
+    // a save the application makes itself counts
+    CHECK(wifi.save_settings());
+    uint32_t saved_writes = storage.get_stats().writes;
+    driver.time_ms += PICO_W_CM_DNS_CACHE_SAVE_INTERVAL_MS;
+    wifi.task();
+    CHECK_EQ(storage.get_stats().writes, saved_writes);
+}
+}
+
+int main()
+{
+    test_saves_are_rate_limited();
+    return test::result();
+}
@@ -0,0 +1,113 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstring>
+#include <string>
+#include "test_support.h"
+#include "hardware/flash.h"
+#include "pico/flash.h"
+#include "flash_sector_settings_storage.h"
+
+using rppicomidi::Flash_sector_settings_storage;
+
+namespace
+{
+// tests/CMakeLists.txt links this test with the program image ending here
+const uint32_t program_end = 0x20000;
+const uint32_t area = 0x40000;
+
+void test_rejects_bad_areas()
+{
+    CHECK_EQ(Flash_sector_settings_storage(area, FLASH_SECTOR_SIZE).get_num_slots(), 2u);
+    // not sector aligned
+    CHECK_EQ(Flash_sector_settings_storage(area + FLASH_PAGE_SIZE, FLASH_SECTOR_SIZE).get_num_slots(), 0u);
+    CHECK_EQ(Flash_sector_settings_storage(area, FLASH_SECTOR_SIZE + FLASH_PAGE_SIZE).get_num_slots(), 0u);
+    CHECK_EQ(Flash_sector_settings_storage(area, 0).get_num_slots(), 0u);
+    // overlaps the program image
+    CHECK_EQ(Flash_sector_settings_storage(0, FLASH_SECTOR_SIZE).get_num_slots(), 0u);
+    CHECK_EQ(Flash_sector_settings_storage(program_end - FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE).get_num_slots(), 0u);
+    CHECK_EQ(Flash_sector_settings_storage(program_end, FLASH_SECTOR_SIZE).get_num_slots(), 2u);
+    // past the end of flash, including when the size overflows 32 bits
+    CHECK_EQ(Flash_sector_settings_storage(PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE, 2).get_num_slots(), 0u);
+    CHECK_EQ(Flash_sector_settings_storage(PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE, 1).get_num_slots(), 1u);
+    CHECK_EQ(Flash_sector_settings_storage(area, 0x80000000u, 2).get_num_slots(), 0u);
+
+    // a refused area is never written
+    Flash_sector_settings_storage overlapping(0, FLASH_SECTOR_SIZE);
+    auto before = host_flash_stats;
+    CHECK(!overlapping.write(0, "{}", 2));
+    CHECK_EQ(host_flash_stats.erases, before.erases);
+    CHECK_EQ(host_flash_stats.programs, before.programs);
+}
+
+void test_round_trip()
+{
+    Flash_sector_settings_storage storage(area, 2 * FLASH_SECTOR_SIZE);
+    std::string data;
+    CHECK(!storage.read(0, data));
+    // longer than one sector, so the write erases two
+    std::string settings(FLASH_SECTOR_SIZE + 100, 'x');
+    settings.front() = '{';
+    settings.back() = '}';
+    auto before = host_flash_stats;
+    CHECK(storage.write(1, settings.data(), settings.size()));
+    CHECK_EQ(host_flash_stats.erased_bytes - before.erased_bytes, 2 * FLASH_SECTOR_SIZE);
+    CHECK(storage.read(1, data));
+    CHECK(data == settings);
+    CHECK(!storage.read(0, data));
+    CHECK(storage.write(1, "{}", 2));
+    CHECK(storage.read(1, data));
+    CHECK(data == "{}");
+    // too big for the slot
+    std::string too_big(2 * FLASH_SECTOR_SIZE, 'x');
+    CHECK(!storage.write(0, too_big.data(), too_big.size()));
+    CHECK_EQ(host_flash_stats.outside_writes, 0u);
+}
+
+void test_other_core_not_locked_out()
+{
+    Flash_sector_settings_storage storage(area, FLASH_SECTOR_SIZE);
+    CHECK(storage.write(0, "{\"a\":1}", 7));
+    auto before = host_flash_stats;
+    host_flash_safe_execute_result = PICO_ERROR_NOT_PERMITTED;
+    CHECK(!storage.write(0, "{\"a\":2}", 7));
+    host_flash_safe_execute_result = PICO_OK;
+    CHECK_EQ(host_flash_stats.erases, before.erases);
+    std::string data;
+    CHECK(storage.read(0, data));
+    CHECK(data == "{\"a\":1}");
+}
+}
+
+int main()
+{
+    if (!host_flash_map()) {
+        std::printf("cannot map host flash at XIP_BASE\n");
+        return 1;
+    }
+    test_rejects_bad_areas();
+    test_round_trip();
+    test_other_core_not_locked_out();
+    return test::result();
+}
@@ -0,0 +1,242 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <string>
+#include <vector>
+#include "test_support.h"
+#include "fake_wifi_driver.h"
+#include "known_network_store.h"
+#include "pico_w_connection_manager.h"
+
+using rppicomidi::Known_network_store;
+using rppicomidi::Pico_w_connection_manager;
+using rppicomidi::Ssid_info;
+using test::Fake_wifi_driver;
+
+namespace
+{
+Ssid_info make_info(const std::string& ssid)
+{
+    Ssid_info info;
+    info.ssid = ssid;
+    info.passphrase = "passphrase for " + ssid;
+    info.security = Pico_w_connection_manager::WPA2;
+    return info;
+}
+
+void test_evict_least_recently_used()
+{
+    Known_network_store store(3, Known_network_store::EVICT_LEAST_RECENTLY_USED);
+    bool changed;
+    auto a = store.add(make_info("a"), changed);
+    auto b = store.add(make_info("b"), changed);
+    auto c = store.add(make_info("c"), changed);
+    // a connects often but b was used most recently
+    for (int count = 0; count < 5; count++) {
+        store.mark_connected(a);
+    }
+    store.mark_connected(b);
+    store.add(make_info("d"), changed);
+    CHECK(changed);
+    CHECK_EQ(store.size(), 3u);
+    CHECK(store.get(c) == nullptr);
+    CHECK(store.get(a) != nullptr);
+    CHECK(store.get(b) != nullptr);
+    CHECK_EQ(store.find("c"), Known_network_store::INVALID_HANDLE);
+}
+
+void test_evict_least_successful()
+{
+    Known_network_store store(3, Known_network_store::EVICT_LEAST_SUCCESSFUL);
+    bool changed;
+    auto a = store.add(make_info("a"), changed);
+    auto b = store.add(make_info("b"), changed);
+    auto c = store.add(make_info("c"), changed);
+    store.mark_connected(a);
+    store.mark_connected(a);
+    store.mark_connected(c);
+    // b never connected, so it goes even though a was used longer ago
+    store.mark_connected(b);
+    store.mark_connected(c);
+    store.mark_connected(a);
+    store.add(make_info("d"), changed);
+    CHECK(store.get(b) == nullptr);
+    CHECK(store.get(a) != nullptr);
+    CHECK(store.get(c) != nullptr);
+    // d has no successes now, so it goes next even though it is the newest
+    store.add(make_info("e"), changed);
+    CHECK_EQ(store.find("d"), Known_network_store::INVALID_HANDLE);
+    CHECK(store.get(a) != nullptr);
+    CHECK(store.get(c) != nullptr);
+    // with equal successes, the least recently used goes
+    store.mark_connected(store.find("e"));
+    store.mark_connected(store.find("e"));
+    store.add(make_info("f"), changed);
+    CHECK(store.get(c) == nullptr);
+    CHECK(store.get(a) != nullptr);
+}
+
+void test_handles_survive_erase()
+{
+    Known_network_store store;
+    bool changed;
+    std::vector<Known_network_store::Handle> handles;
+    for (int idx = 0; idx < 8; idx++) {
+        handles.push_back(store.add(make_info("net" + std::to_string(idx)), changed));
+    }
+    // erasing the first entry moves the last one into its slot
+    CHECK(store.erase(handles[0]));
+    CHECK(store.get(handles[0]) == nullptr);
+    CHECK_EQ(store.find("net0"), Known_network_store::INVALID_HANDLE);
+    CHECK(!store.erase(handles[0]));
+    CHECK(store.get_entries()[0].ssid == "net7");
+    CHECK(store.erase(handles[3]));
+    CHECK(store.erase(handles[7]));
+    CHECK_EQ(store.size(), 5u);
+    for (size_t idx = 0; idx < handles.size(); idx++) {
+        const Ssid_info* info = store.get(handles[idx]);
+        if (idx == 0 || idx == 3 || idx == 7) {
+            CHECK(info == nullptr);
+            continue;
+        }
+        CHECK(info != nullptr);
+        if (info != nullptr) {
+            CHECK(info->ssid == "net" + std::to_string(idx));
+        }
+        CHECK_EQ(store.find("net" + std::to_string(idx)), handles[idx]);
+    }
+    for (size_t idx = 0; idx < store.size(); idx++) {
+        const Ssid_info* info = store.get(store.get_handle(idx));
+        CHECK(info == &store.get_entries()[idx]);
+    }
+    CHECK_EQ(store.get_handle(store.size()), Known_network_store::INVALID_HANDLE);
+    // handles are not reused
+    auto again = store.add(make_info("net0"), changed);
+    CHECK(again != handles[0]);
+    CHECK(store.get(handles[0]) == nullptr);
+    store.clear();
+    CHECK(store.get(handles[1]) == nullptr);
+    CHECK_EQ(store.find("net1"), Known_network_store::INVALID_HANDLE);
+}
+
+void test_restore_does_not_evict()
+{
+    Known_network_store store(2, Known_network_store::EVICT_LEAST_RECENTLY_USED);
+    auto a = store.restore(make_info("a"), 10, 0);
+    auto b = store.restore(make_info("b"), 30, 0);
+    auto c = store.restore(make_info("c"), 20, 0);
+    CHECK_EQ(store.size(), 3u);
+    CHECK(store.get(a) != nullptr);
+    CHECK(store.get(b) != nullptr);
+    CHECK(store.get(c) != nullptr);
+    // a new SSID evicts one entry, so the store does not grow
+    bool changed;
+    auto d = store.add(make_info("d"), changed);
+    CHECK_EQ(store.size(), 3u);
+    CHECK(store.get(a) == nullptr);
+    CHECK(store.get(d) != nullptr);
+    // the restored clock makes d newer than every saved entry
+    store.set_capacity(2);
+    CHECK(store.get(c) == nullptr);
+    CHECK(store.get(b) != nullptr);
+    CHECK(store.get(d) != nullptr);
+}
+
+void test_pinned_entry_is_not_evicted()
+{
+    Known_network_store store(2, Known_network_store::EVICT_LEAST_RECENTLY_USED);
+    bool changed;
+    auto a = store.add(make_info("a"), changed);
+    auto b = store.add(make_info("b"), changed);
+    store.set_pinned(a);
+    auto c = store.add(make_info("c"), changed);
+    CHECK(store.get(a) != nullptr);
+    CHECK(store.get(b) == nullptr);
+    store.set_capacity(1);
+    CHECK(store.get(a) != nullptr);
+    CHECK(store.get(c) == nullptr);
+    // the pinned entry is the only one, so a new SSID cannot be added
+    CHECK_EQ(store.add(make_info("d"), changed), Known_network_store::INVALID_HANDLE);
+    CHECK(!changed);
+    CHECK_EQ(store.size(), 1u);
+    CHECK(store.get(a) != nullptr);
+    // updating the pinned entry still works
+    Ssid_info info = make_info("a");
+    info.passphrase = "a new passphrase";
+    CHECK_EQ(store.add(info, changed), a);
+    CHECK(changed);
+    CHECK(store.erase(a));
+    CHECK_EQ(store.get_pinned(), Known_network_store::INVALID_HANDLE);
+    CHECK(store.add(make_info("d"), changed) != Known_network_store::INVALID_HANDLE);
+}
+
+void test_manager_keeps_current_ssid()
+{
+    Fake_wifi_driver driver;
+    Pico_w_connection_manager wifi(nullptr, &driver);
+    wifi.set_known_ssid_capacity(2, Known_network_store::EVICT_LEAST_RECENTLY_USED);
+    wifi.set_current_ssid("home");
+    wifi.set_current_passphrase("passphrase for home");
+    wifi.set_current_security(Pico_w_connection_manager::WPA2);
+    CHECK(wifi.initialize());
+    CHECK(wifi.connect());
+    for (int step = 0; step < 100 && wifi.get_state() != Pico_w_connection_manager::CONNECTED; step++) {
+        driver.time_ms += 10;
+        wifi.task();
+    }
+    CHECK(wifi.is_link_up());
+    auto home = wifi.find_known_ssid("home");
+    CHECK(home != Known_network_store::INVALID_HANDLE);
+    // home is the least recently used record after the import
+    wifi.import_known_ssids({make_info("cafe"), make_info("office"), make_info("library")});
+    CHECK(wifi.find_known_ssid("home") == home);
+    CHECK_EQ(wifi.get_known_ssids().size(), 2u);
+    CHECK(wifi.find_known_ssid("library") != Known_network_store::INVALID_HANDLE);
+    wifi.set_known_ssid_capacity(1, Known_network_store::EVICT_LEAST_RECENTLY_USED);
+    CHECK(wifi.find_known_ssid("home") == home);
+    CHECK_EQ(wifi.get_known_ssids().size(), 1u);
+
+    // once the link is down, the record may be evicted again
+    CHECK(wifi.disconnect());
+    for (int step = 0; step < 10; step++) {
+        driver.time_ms += 10;
+        wifi.task();
+    }
+    CHECK(!wifi.is_link_up());
+    wifi.import_known_ssids({make_info("cafe")});
+    CHECK_EQ(wifi.find_known_ssid("home"), Known_network_store::INVALID_HANDLE);
+    CHECK(wifi.find_known_ssid("cafe") != Known_network_store::INVALID_HANDLE);
+}
+}
+
+int main()
+{
+    test_evict_least_recently_used();
+    test_evict_least_successful();
+    test_handles_survive_erase();
+    test_restore_does_not_evict();
+    test_pinned_entry_is_not_evicted();
+    test_manager_keeps_current_ssid();
+    return test::result();
+}
@@ -0,0 +1,215 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <string>
+#include <vector>
+#include "test_support.h"
+#include "fake_wifi_driver.h"
+#include "link_health_checker.h"
+#include "pico_w_connection_manager.h"
+
+using rppicomidi::Link_health_checker;
+using rppicomidi::Pico_w_connection_manager;
+using test::Fake_wifi_driver;
+
+namespace
+{
+const Link_health_checker::Config config = {true, 1000, 300, 3};
+const uint32_t poll_ms = 10;
+
+// The detection time after the last reply is at least the failed probes
+// after the first and one timeout, and at most one more interval
+const uint32_t min_time_to_detect_ms = (config.failure_budget - 1) * config.interval_ms + config.timeout_ms;
+const uint32_t max_time_to_detect_ms = config.failure_budget * config.interval_ms + config.timeout_ms + poll_ms;
+
+/**
+ * @brief Poll the checker until it declares the link degraded
+ *
+ * @return the time it took or UINT32_MAX if it did not within limit_ms
+ */
+uint32_t poll_until_detected(Link_health_checker& checker, Fake_wifi_driver& driver, uint32_t limit_ms)
+{
+    uint32_t start_ms = driver.time_ms;
+    while (driver.time_ms - start_ms < limit_ms) {
+        driver.time_ms += poll_ms;
+        if (checker.poll(driver.time_ms)) {
+            return driver.time_ms - start_ms;
+        }
+    }
+    return UINT32_MAX;
+}
+
+void test_time_to_detect()
+{
+    Fake_wifi_driver driver;
+    Link_health_checker checker(driver);
+    checker.set_config(config);
+    for (uint32_t outage = 0; outage < 5; outage++) {
+        driver.gateway_answers = true;
+        CHECK(checker.start(driver.gateway, driver.time_ms));
+        // healthy for a while; the gateway dies at a different point in the probe interval each time
+        CHECK_EQ(poll_until_detected(checker, driver, 5000 + outage * 170), UINT32_MAX);
+        driver.gateway_answers = false;
+        uint32_t detect_ms = poll_until_detected(checker, driver, 10000);
+        CHECK(detect_ms <= max_time_to_detect_ms);
+        CHECK(!checker.is_running());
+        CHECK_EQ(checker.get_detection_count(), outage + 1);
+    }
+    uint32_t mttd = checker.get_mean_time_to_detect_ms();
+    std::printf("gateway MTTD %u ms (interval %u ms, timeout %u ms, budget %u)\n", mttd, config.interval_ms,
+        config.timeout_ms, config.failure_budget);
+    CHECK(mttd >= min_time_to_detect_ms);
+    CHECK(mttd <= max_time_to_detect_ms);
+}
+
+void test_lossy_gateway_is_not_degraded()
+{
+    Fake_wifi_driver driver;
+    Link_health_checker checker(driver);
+    checker.set_config(config);
+    CHECK(checker.start(driver.gateway, driver.time_ms));
+    // every third probe is answered
+    uint32_t sent = driver.pings_sent;
+    for (int step = 0; step < 3000; step++) {
+        driver.gateway_answers = driver.pings_sent % config.failure_budget == 2;
+        driver.time_ms += poll_ms;
+        CHECK(!checker.poll(driver.time_ms));
+    }
+    CHECK(driver.pings_sent - sent >= 20);
+    CHECK_EQ(checker.get_detection_count(), 0u);
+    checker.stop();
+    CHECK(!checker.is_running());
+}
+
+void test_send_failures_are_degraded()
+{
+    Fake_wifi_driver driver;
+    Link_health_checker checker(driver);
+    checker.set_config(config);
+    CHECK(checker.start(driver.gateway, driver.time_ms));
+    CHECK_EQ(poll_until_detected(checker, driver, 3000), UINT32_MAX);
+    // the gateway would answer, but nothing can be sent
+    driver.ping_send_fails = true;
+    uint32_t detect_ms = poll_until_detected(checker, driver, 10000);
+    CHECK(detect_ms >= min_time_to_detect_ms);
+    CHECK(detect_ms <= max_time_to_detect_ms);
+    CHECK(!checker.is_running());
+    CHECK_EQ(checker.get_detection_count(), 1u);
+
+    // one failed send in a row of answered probes is not enough
+    driver.ping_send_fails = false;
+    CHECK(checker.start(driver.gateway, driver.time_ms));
+    for (uint32_t step = 0; step < 3000; step++) {
+        driver.ping_send_fails = step % 500 < config.interval_ms / poll_ms;
+        driver.time_ms += poll_ms;
+        CHECK(!checker.poll(driver.time_ms));
+    }
+    CHECK_EQ(checker.get_detection_count(), 1u);
+}
+
+void test_start_needs_gateway()
+{
+    Fake_wifi_driver driver;
+    Link_health_checker checker(driver);
+    CHECK(!checker.start(driver.gateway, 0));  // disabled by default
+    checker.set_config(config);
+    CHECK(!checker.start(0, 0));
+    CHECK(checker.start(driver.gateway, 0));
+}
+
+struct Link_errors
+{
+    std::vector<std::string> reasons;
+    std::vector<uint32_t> times_ms;
+    Fake_wifi_driver* driver;
+};
+
+void link_error_cb(void* context, const char* reason)
+{
+    auto errors = reinterpret_cast<Link_errors*>(context);
+    errors->reasons.push_back(reason);
+    errors->times_ms.push_back(errors->driver->time_ms);
+}
+
+void test_manager_reports_gateway_failure()
+{
+    Fake_wifi_driver driver;
+    Link_errors errors;
+    errors.driver = &driver;
+    Pico_w_connection_manager wifi(nullptr, &driver);
+    wifi.set_link_health_config(config);
+    wifi.register_link_error_callback(link_error_cb, &errors);
+    wifi.set_current_ssid("home");
+    CHECK(wifi.initialize());
+    CHECK(wifi.connect());
+    for (int step = 0; step < 500; step++) {
+        driver.time_ms += poll_ms;
+        wifi.task();
+    }
+    CHECK(wifi.is_link_up());
+
+    // the gateway dies but the AP stays associated, so the rejoin is not up yet
+    driver.gateway_answers = false;
+    driver.join_result = Fake_wifi_driver::LINK_JOIN;
+    uint32_t outage_ms = driver.time_ms;
+    for (int step = 0; step < 500 && errors.reasons.empty(); step++) {
+        driver.time_ms += poll_ms;
+        wifi.task();
+    }
+    CHECK_EQ(errors.reasons.size(), 1u);
+    if (!errors.reasons.empty()) {
+        CHECK(errors.reasons[0] == "gateway not responding");
+        CHECK(errors.times_ms[0] - outage_ms <= max_time_to_detect_ms);
+    }
+    CHECK_EQ(wifi.get_last_link_error_code(), Pico_w_connection_manager::LINK_ERROR_GATEWAY);
+    CHECK(std::string(wifi.get_last_link_error()) == "gateway not responding");
+    CHECK_EQ(wifi.get_state(), Pico_w_connection_manager::CONNECTION_REQUESTED);
+    Pico_w_connection_manager::Status_snapshot status;
+    wifi.get_status_snapshot(status);
+    CHECK_EQ(status.last_error, Pico_w_connection_manager::LINK_ERROR_GATEWAY);
+    CHECK_EQ(status.errors_by_type[Pico_w_connection_manager::LINK_ERROR_GATEWAY], 1u);
+
+    // the reason holds while rejoining and clears once the link is back
+    driver.time_ms += poll_ms;
+    wifi.task();
+    CHECK_EQ(wifi.get_last_link_error_code(), Pico_w_connection_manager::LINK_ERROR_GATEWAY);
+    driver.gateway_answers = true;
+    driver.link = Fake_wifi_driver::LINK_UP;
+    driver.time_ms += poll_ms;
+    wifi.task();
+    CHECK(wifi.is_link_up());
+    CHECK_EQ(wifi.get_last_link_error_code(), Pico_w_connection_manager::LINK_ERROR_NONE);
+    CHECK_EQ(errors.reasons.size(), 1u);
+}
+}
+
+int main()
+{
+    test_time_to_detect();
+    test_lossy_gateway_is_not_degraded();
+    test_send_failures_are_degraded();
+    test_start_needs_gateway();
+    test_manager_reports_gateway_failure();
+    return test::result();
+}
@@ -0,0 +1,225 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "test_support.h"
+#include "fake_wifi_driver.h"
+#include "host_lwip.h"
+#include "link_self_test.h"
+#include "pico_w_connection_manager.h"
+
+using rppicomidi::Link_self_test;
+using rppicomidi::Pico_w_connection_manager;
+using test::Fake_wifi_driver;
+
+namespace
+{
+const uint32_t poll_ms = 10;
+const uint32_t peer_address = 0x0200a8c0; // 192.168.0.2
+
+Link_self_test::Config make_config()
+{
+    Link_self_test::Config config = {};
+    ip4_addr_set_u32(ip_2_ip4(&config.peer), peer_address);
+    config.tcp_port = 5001;
+    config.udp_port = 7;
+    config.tests = Link_self_test::TEST_ALL;
+    config.duration_ms = 1000;
+    config.udp_payload = 512;
+    config.udp_rate_bps = 1000000;
+    config.rtt_count = 10;
+    config.timeout_ms = 200;
+    return config;
+}
+
+// An iperf-like sink that acknowledges one segment per poll and an echo
+// server that loses every tenth datagram
+void make_peer()
+{
+    host_lwip_reset();
+    host_lwip_peer.address = peer_address;
+    host_lwip_peer.tcp_port = 5001;
+    host_lwip_peer.tcp_ack_bytes = 1460;
+    host_lwip_peer.udp_echo_port = 7;
+    host_lwip_peer.udp_drop_every = 10;
+}
+
+// Run the self-test to the end; return how long it took
+uint32_t run(Link_self_test& self_test, Fake_wifi_driver& driver, uint32_t limit_ms = 10000)
+{
+    uint32_t start_ms = driver.time_ms;
+    while (self_test.is_running() && driver.time_ms - start_ms < limit_ms) {
+        driver.time_ms += poll_ms;
+        host_lwip_poll();
+        self_test.poll(driver.time_ms);
+    }
+    return driver.time_ms - start_ms;
+}
+
+void test_all_tests_against_a_peer()
+{
+    make_peer();
+    Fake_wifi_driver driver;
+    Link_self_test self_test(driver);
+    CHECK(self_test.start(make_config(), -55, driver.time_ms));
+    CHECK(self_test.is_running());
+    run(self_test, driver);
+    CHECK(!self_test.is_running());
+    const auto& results = self_test.get_results();
+    CHECK_EQ(results.rssi, -55);
+
+    // the sink acknowledges 1460 bytes every 10 ms: 1.168 Mbit/s
+    CHECK_EQ(results.tcp_result, Link_self_test::RESULT_OK);
+    CHECK(results.tcp_bps > 1100000 && results.tcp_bps < 1250000);
+    CHECK(results.tcp_bytes <= host_lwip_stats.tcp_bytes_written);
+
+    CHECK_EQ(results.udp_result, Link_self_test::RESULT_OK);
+    CHECK(results.udp_sent > 200);
+    CHECK_EQ(results.udp_received, results.udp_sent - results.udp_sent / 10);
+    CHECK(results.udp_sent_bps > 950000 && results.udp_sent_bps < 1050000);
+    CHECK(results.udp_received_bps < results.udp_sent_bps);
+
+    // every reply arrives on the next poll. The tenth datagram of the
+    // throughput test and the RTT datagrams share the echo server's loss
+    CHECK_EQ(results.rtt_result, Link_self_test::RESULT_OK);
+    CHECK(results.rtt_replies >= 8 && results.rtt_replies <= 10);
+    CHECK_EQ(results.rtt_min_us, poll_ms * 1000);
+    CHECK_EQ(results.rtt_avg_us, poll_ms * 1000);
+    CHECK_EQ(results.rtt_max_us, poll_ms * 1000);
+
+    CHECK_EQ(host_lwip_stats.tcp_pcbs, 0);
+    CHECK_EQ(host_lwip_stats.udp_pcbs, 0);
+    CHECK_EQ(driver.lock_depth, 0);
+}
+
+void test_no_peer()
+{
+    host_lwip_reset();
+    Fake_wifi_driver driver;
+    Link_self_test self_test(driver);
+    auto config = make_config();
+    CHECK(self_test.start(config, -55, driver.time_ms));
+    uint32_t elapsed = run(self_test, driver);
+    const auto& results = self_test.get_results();
+    CHECK_EQ(results.tcp_result, Link_self_test::RESULT_NO_PEER);
+    CHECK_EQ(results.udp_result, Link_self_test::RESULT_NO_PEER);
+    CHECK_EQ(results.udp_received, 0u);
+    CHECK_EQ(results.rtt_result, Link_self_test::RESULT_NO_PEER);
+    CHECK_EQ(results.rtt_replies, 0u);
+    // the refused connection ends at once; the rest wait for replies
+    CHECK(elapsed <= config.duration_ms + config.timeout_ms * (config.rtt_count + 1) + 4 * poll_ms);
+    CHECK_EQ(host_lwip_stats.tcp_pcbs, 0);
+    CHECK_EQ(host_lwip_stats.udp_pcbs, 0);
+}
+
+void test_sink_resets_the_connection()
+{
+    make_peer();
+    Fake_wifi_driver driver;
+    Link_self_test self_test(driver);
+    auto config = make_config();
+    config.tests = Link_self_test::TEST_TCP;
+    CHECK(self_test.start(config, -55, driver.time_ms));
+    for (int step = 0; step < 20; step++) {
+        driver.time_ms += poll_ms;
+        host_lwip_poll();
+        self_test.poll(driver.time_ms);
+    }
+    host_lwip_peer.tcp_reset = true;
+    run(self_test, driver);
+    const auto& results = self_test.get_results();
+    CHECK_EQ(results.tcp_result, Link_self_test::RESULT_ABORTED);
+    CHECK(results.tcp_bytes > 0);
+    CHECK_EQ(host_lwip_stats.tcp_pcbs, 0);
+}
+
+void test_stop_with_replies_in_flight()
+{
+    make_peer();
+    Fake_wifi_driver driver;
+    {
+        Link_self_test self_test(driver);
+        auto config = make_config();
+        config.tests = Link_self_test::TEST_UDP;
+        CHECK(self_test.start(config, -55, driver.time_ms));
+        driver.time_ms += poll_ms;
+        self_test.poll(driver.time_ms);
+        CHECK(host_lwip_stats.udp_datagrams_sent > 0);
+        self_test.stop();
+        CHECK_EQ(self_test.get_results().udp_result, Link_self_test::RESULT_ABORTED);
+        CHECK_EQ(host_lwip_stats.udp_pcbs, 0);
+    }
+    // the echoes must not reach the destroyed self-test
+    host_lwip_poll();
+}
+
+void test_manager_runs_the_self_test()
+{
+    make_peer();
+    Fake_wifi_driver driver;
+    Pico_w_connection_manager wifi(nullptr, &driver);
+    wifi.set_current_ssid("home");
+    CHECK(wifi.initialize());
+    CHECK(!wifi.start_self_test(make_config()));
+    CHECK(wifi.connect());
+    for (int step = 0; step < 5; step++) {
+        driver.time_ms += poll_ms;
+        wifi.task();
+    }
+    CHECK(wifi.start_self_test(make_config()));
+    for (int step = 0; step < 1000 && wifi.is_self_test_running(); step++) {
+        driver.time_ms += poll_ms;
+        host_lwip_poll();
+        wifi.task();
+    }
+    CHECK(!wifi.is_self_test_running());
+    const auto& results = wifi.get_self_test_results();
+    CHECK_EQ(results.tcp_result, Link_self_test::RESULT_OK);
+    CHECK_EQ(results.udp_result, Link_self_test::RESULT_OK);
+    CHECK_EQ(results.rtt_result, Link_self_test::RESULT_OK);
+    CHECK_EQ(results.rssi, driver.rssi);
+
+    // the link going down aborts a self-test in progress
+    CHECK(wifi.start_self_test(make_config()));
+    driver.time_ms += poll_ms;
+    host_lwip_poll();
+    wifi.task();
+    CHECK(wifi.is_self_test_running());
+    driver.link = Fake_wifi_driver::LINK_DOWN;
+    wifi.task();
+    CHECK(!wifi.is_self_test_running());
+    CHECK_EQ(wifi.get_self_test_results().tcp_result, Link_self_test::RESULT_ABORTED);
+    CHECK_EQ(host_lwip_stats.tcp_pcbs, 0);
+    CHECK_EQ(host_lwip_stats.udp_pcbs, 0);
+}
+}
+
+int main()
+{
+    test_all_tests_against_a_peer();
+    test_no_peer();
+    test_sink_resets_the_connection();
+    test_stop_with_replies_in_flight();
+    test_manager_runs_the_self_test();
+    return test::result();
+}
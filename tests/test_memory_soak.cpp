@@ -0,0 +1,200 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "test_support.h"
+#include "fake_wifi_driver.h"
+#include "memory_accounting.h"
+#include "pico_w_connection_manager.h"
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+#include "ram_settings_storage.h"
+#endif
+
+using rppicomidi::Memory_accounting;
+using rppicomidi::Pico_w_connection_manager;
+using test::Fake_wifi_driver;
+
+namespace
+{
+const uint32_t poll_ms = 10;
+const int warmup_cycles = 50;
+const int soak_cycles = 2000;
+
+void run_tasks(Pico_w_connection_manager& wifi, Fake_wifi_driver& driver, int steps)
+{
+    for (int step = 0; step < steps; step++) {
+        driver.time_ms += poll_ms;
+        wifi.task();
+    }
+}
+
+void make_environment(Fake_wifi_driver& driver)
+{
+    char name[32];
+    driver.access_points.push_back(Fake_wifi_driver::make_ap("home", 1, 6, -50));
+    for (uint8_t idx = 0; idx < 40; idx++) {
+        snprintf(name, sizeof(name), "a neighbour with a long name %u", idx);
+        driver.access_points.push_back(Fake_wifi_driver::make_ap(name, static_cast<uint8_t>(10 + idx), 1 + idx % 11, -70));
+    }
+}
+
+// One day in the life of a device: provisioning, a scan, a join, DNS
+// hosts coming and going, a link flap and a disconnect
+void cycle(Pico_w_connection_manager& wifi, Fake_wifi_driver& driver, int count)
+{
+    std::vector<rppicomidi::Ssid_info> batch;
+    for (int idx = 0; idx < 8; idx++) {
+        rppicomidi::Ssid_info info;
+        info.ssid = "provisioned network " + std::to_string((count * 8 + idx) % 200);
+        info.passphrase = "a passphrase that does not fit in the small string buffer";
+        info.security = 4;
+        batch.push_back(info);
+    }
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+    CHECK(wifi.import_known_ssids(batch));
+#else
+    // without settings storage the import cannot be saved, so it returns false
+    wifi.import_known_ssids(batch);
+#endif
+
+    driver.time_ms += 10000; // scans are at least 10 s apart
+    CHECK(wifi.start_scan());
+    run_tasks(wifi, driver, 5);
+
+    wifi.set_current_ssid("home");
+    CHECK(wifi.connect());
+    run_tasks(wifi, driver, 5);
+    CHECK(wifi.is_link_up());
+#if PICO_W_CM_ENABLE_DNS_CACHE
+    std::string host = "host" + std::to_string(count % 7) + ".example.com";
+    driver.dns_server[host] = 0x0a000001;
+    wifi.add_dns_cache_host(host);
+    run_tasks(wifi, driver, 20);
+    wifi.remove_dns_cache_host(host);
+#endif
+    driver.link = Fake_wifi_driver::LINK_DOWN;
+    run_tasks(wifi, driver, 2);
+    CHECK(wifi.connect());
+    run_tasks(wifi, driver, 5);
+    wifi.disconnect();
+    run_tasks(wifi, driver, 2);
+}
+
+void take_usage(Pico_w_connection_manager& wifi, Memory_accounting::Usage (&usage)[rppicomidi::MEM_NUM_SUBSYSTEMS])
+{
+    for (int idx = 0; idx < rppicomidi::MEM_NUM_SUBSYSTEMS; idx++) {
+        CHECK(wifi.get_memory_usage(static_cast<rppicomidi::Memory_subsystem>(idx), usage[idx]));
+    }
+}
+
+/**
+ * Soak the manager through many connection cycles with a bounded
+ * known network list. After the warm-up nothing may grow; print each
+ * subsystem's high-water mark for sizing the heap. Built with settings
+ * storage, every import and join also saves the settings.
+ */
+void test_soak()
+{
+    Fake_wifi_driver driver;
+    make_environment(driver);
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+    // before the manager creates any parson value
+    Memory_accounting::install_parson_hooks();
+    Memory_accounting::Usage settings_io_before;
+    CHECK(Memory_accounting::get_usage(rppicomidi::MEM_SETTINGS_IO, settings_io_before));
+    rppicomidi::Ram_settings_storage storage;
+    Pico_w_connection_manager wifi(&storage, &driver);
+#else
+    Pico_w_connection_manager wifi(nullptr, &driver);
+#endif
+    wifi.set_log_drain_per_task(0); // keep the output to the report
+    wifi.set_known_ssid_capacity(64, rppicomidi::Known_network_store::EVICT_LEAST_RECENTLY_USED);
+    CHECK(wifi.initialize());
+    for (int count = 0; count < warmup_cycles; count++) {
+        cycle(wifi, driver, count);
+    }
+    Memory_accounting::reset_peaks();
+    Memory_accounting::Usage baseline[rppicomidi::MEM_NUM_SUBSYSTEMS];
+    take_usage(wifi, baseline);
+    for (int count = warmup_cycles; count < warmup_cycles + soak_cycles; count++) {
+        cycle(wifi, driver, count);
+    }
+    Memory_accounting::Usage usage[rppicomidi::MEM_NUM_SUBSYSTEMS];
+    take_usage(wifi, usage);
+    printf("%-18s %10s %10s %12s %12s\n", "subsystem", "bytes", "peak", "allocations", "frees");
+    for (int idx = 0; idx < rppicomidi::MEM_NUM_SUBSYSTEMS; idx++) {
+        printf("%-18s %10u %10u %12u %12u\n", Memory_accounting::get_name(static_cast<rppicomidi::Memory_subsystem>(idx)),
+            usage[idx].current_bytes, usage[idx].peak_bytes, usage[idx].allocations, usage[idx].frees);
+        CHECK_EQ(usage[idx].current_bytes, baseline[idx].current_bytes);
+        CHECK(usage[idx].peak_bytes >= usage[idx].current_bytes);
+    }
+    CHECK(usage[rppicomidi::MEM_SCAN_RESULTS].peak_bytes > 0);
+    CHECK(usage[rppicomidi::MEM_CREDENTIAL_STORE].peak_bytes > 0);
+    CHECK_EQ(usage[rppicomidi::MEM_CREDENTIAL_STORE].allocations, usage[rppicomidi::MEM_CREDENTIAL_STORE].frees +
+        baseline[rppicomidi::MEM_CREDENTIAL_STORE].allocations - baseline[rppicomidi::MEM_CREDENTIAL_STORE].frees);
+#if PICO_W_CM_ENABLE_SETTINGS_STORAGE
+    // the DOM and the buffers exist only while settings load or save
+    CHECK(storage.get_stats().writes >= static_cast<uint32_t>(soak_cycles));
+    CHECK(usage[rppicomidi::MEM_SETTINGS_IO].peak_bytes > 0);
+    CHECK(usage[rppicomidi::MEM_SETTINGS_IO].allocations > baseline[rppicomidi::MEM_SETTINGS_IO].allocations);
+    CHECK_EQ(usage[rppicomidi::MEM_SETTINGS_IO].current_bytes, settings_io_before.current_bytes);
+#endif
+}
+
+// The second core and the scan callback update the counters while the
+// main loop does; no update may be lost
+void test_concurrent_updates()
+{
+    const uint32_t pairs = 200000;
+    Memory_accounting::Usage before;
+    CHECK(Memory_accounting::get_usage(rppicomidi::MEM_SCAN_RESULTS, before));
+    std::thread other_core([]() {
+        for (uint32_t idx = 0; idx < pairs; idx++) {
+            Memory_accounting::allocated(rppicomidi::MEM_SCAN_RESULTS, 8);
+            Memory_accounting::freed(rppicomidi::MEM_SCAN_RESULTS, 8);
+        }
+    });
+    for (uint32_t idx = 0; idx < pairs; idx++) {
+        Memory_accounting::allocated(rppicomidi::MEM_SCAN_RESULTS, 16);
+        Memory_accounting::freed(rppicomidi::MEM_SCAN_RESULTS, 16);
+    }
+    other_core.join();
+    Memory_accounting::Usage after;
+    CHECK(Memory_accounting::get_usage(rppicomidi::MEM_SCAN_RESULTS, after));
+    CHECK_EQ(after.current_bytes, before.current_bytes);
+    CHECK_EQ(after.allocations, before.allocations + 2 * pairs);
+    CHECK_EQ(after.frees, before.frees + 2 * pairs);
+    CHECK(after.peak_bytes <= before.peak_bytes + 24 || after.peak_bytes <= before.current_bytes + 24);
+}
+}
+
+int main()
+{
+    test_soak();
+    test_concurrent_updates();
+    return test::result();
+}
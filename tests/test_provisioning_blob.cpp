@@ -0,0 +1,309 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <string>
+#include <vector>
+#include "test_support.h"
+#include "crc32.h"
+#include "fake_wifi_driver.h"
+#include "pico_w_connection_manager.h"
+#include "provisioning_blob.h"
+
+using rppicomidi::Pico_w_connection_manager;
+using rppicomidi::Provisioning_blob_parser;
+using rppicomidi::Ssid_info;
+using rppicomidi::Wifi_power_governor;
+using test::Fake_wifi_driver;
+
+namespace
+{
+uint32_t random_state = 2029;
+uint32_t next_random(uint32_t range)
+{
+    random_state = random_state * 1664525u + 1013904223u;
+    return (random_state >> 8) % range;
+}
+
+Ssid_info make_info(const std::string& ssid, const std::string& passphrase, int security,
+    Wifi_power_governor::Power_profile profile = Wifi_power_governor::BALANCED)
+{
+    Ssid_info info;
+    info.ssid = ssid;
+    info.passphrase = passphrase;
+    info.security = security;
+    info.power_profile = profile;
+    return info;
+}
+
+std::vector<Ssid_info> make_records()
+{
+    return {
+        make_info("open cafe", "", Pico_w_connection_manager::OPEN, Wifi_power_governor::LOWEST_LATENCY),
+        make_info("home", "correct horse battery", Pico_w_connection_manager::WPA2),
+        make_info(std::string(32, 'x'), std::string(64, 'p'), Pico_w_connection_manager::MIXED,
+            Wifi_power_governor::ADAPTIVE),
+    };
+}
+
+bool same_records(const std::vector<Ssid_info>& actual, const std::vector<Ssid_info>& expected)
+{
+    if (actual.size() != expected.size()) {
+        return false;
+    }
+    for (size_t idx = 0; idx < actual.size(); idx++) {
+        if (actual[idx].ssid != expected[idx].ssid || actual[idx].passphrase != expected[idx].passphrase ||
+                actual[idx].security != expected[idx].security ||
+                actual[idx].power_profile != expected[idx].power_profile) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Replace the CRC at the end of a blob edited by a test
+void recrc(std::vector<uint8_t>& blob)
+{
+    blob.resize(blob.size() - 4);
+    uint32_t crc = rppicomidi::crc32_update(0, blob.data(), blob.size());
+    for (int byte = 0; byte < 4; byte++) {
+        blob.push_back((crc >> (8 * byte)) & 0xff);
+    }
+}
+
+Provisioning_blob_parser::Parse_state parse(const std::vector<uint8_t>& blob)
+{
+    Provisioning_blob_parser parser;
+    return parser.feed(blob.data(), blob.size());
+}
+
+void test_whole_and_byte_at_a_time()
+{
+    auto records = make_records();
+    std::vector<uint8_t> blob;
+    CHECK_EQ(Provisioning_blob_parser::encode(records, blob), records.size());
+    Provisioning_blob_parser parser;
+    CHECK_EQ(parser.feed(blob.data(), blob.size()), Provisioning_blob_parser::COMPLETE);
+    CHECK(same_records(parser.get_records(), records));
+
+    parser.reset();
+    CHECK(parser.get_records().empty());
+    for (size_t idx = 0; idx + 1 < blob.size(); idx++) {
+        CHECK_EQ(parser.feed(&blob[idx], 1), Provisioning_blob_parser::IN_PROGRESS);
+    }
+    CHECK_EQ(parser.feed(&blob.back(), 1), Provisioning_blob_parser::COMPLETE);
+    CHECK(same_records(parser.get_records(), records));
+}
+
+void test_random_chunks()
+{
+    auto records = make_records();
+    std::vector<uint8_t> blob;
+    Provisioning_blob_parser::encode(records, blob);
+    Provisioning_blob_parser parser;
+    for (int trial = 0; trial < 200; trial++) {
+        parser.reset();
+        size_t pos = 0;
+        while (pos < blob.size()) {
+            CHECK_EQ(parser.get_parse_state(), Provisioning_blob_parser::IN_PROGRESS);
+            size_t len = std::min<size_t>(next_random(20), blob.size() - pos);
+            parser.feed(blob.data() + pos, len);
+            pos += len;
+        }
+        CHECK_EQ(parser.get_parse_state(), Provisioning_blob_parser::COMPLETE);
+        CHECK(same_records(parser.get_records(), records));
+    }
+}
+
+void test_empty_blob()
+{
+    std::vector<uint8_t> blob;
+    CHECK_EQ(Provisioning_blob_parser::encode({}, blob), 0u);
+    CHECK_EQ(blob.size(), 11u);
+    CHECK_EQ(parse(blob), Provisioning_blob_parser::COMPLETE);
+}
+
+void test_malformed()
+{
+    std::vector<Ssid_info> one = {make_info("home", "correct horse battery", Pico_w_connection_manager::WPA2)};
+    std::vector<uint8_t> good;
+    Provisioning_blob_parser::encode(one, good);
+    const size_t ssid_len_pos = 7;
+    const size_t pw_len_pos = ssid_len_pos + 1 + 4;
+    const size_t profile_pos = pw_len_pos + 1 + 21 + 1;
+
+    // every byte of the magic is checked
+    for (size_t idx = 0; idx < 4; idx++) {
+        auto blob = good;
+        blob[idx] ^= 0x20;
+        CHECK_EQ(parse(blob), Provisioning_blob_parser::FAILED);
+    }
+    auto blob = good;
+    blob[4] = Provisioning_blob_parser::BLOB_VERSION + 1;
+    CHECK_EQ(parse(blob), Provisioning_blob_parser::FAILED);
+
+    // a changed byte or CRC
+    blob = good;
+    blob[ssid_len_pos + 1] = 'H';
+    CHECK_EQ(parse(blob), Provisioning_blob_parser::FAILED);
+    blob = good;
+    blob.back() ^= 1;
+    CHECK_EQ(parse(blob), Provisioning_blob_parser::FAILED);
+
+    // lengths outside the format limits fail even with a correct CRC
+    blob = good;
+    blob[ssid_len_pos] = 0;
+    recrc(blob);
+    CHECK_EQ(parse(blob), Provisioning_blob_parser::FAILED);
+    blob = good;
+    blob[ssid_len_pos] = 33;
+    blob.insert(blob.begin() + ssid_len_pos + 1, 29, 'x');
+    recrc(blob);
+    CHECK_EQ(parse(blob), Provisioning_blob_parser::FAILED);
+    blob = good;
+    blob[pw_len_pos] = 65;
+    blob.insert(blob.begin() + pw_len_pos + 1, 44, 'p');
+    recrc(blob);
+    CHECK_EQ(parse(blob), Provisioning_blob_parser::FAILED);
+    blob = good;
+    blob[profile_pos] = Wifi_power_governor::ADAPTIVE + 1;
+    recrc(blob);
+    CHECK_EQ(parse(blob), Provisioning_blob_parser::FAILED);
+
+    // truncated anywhere, the blob is never complete
+    for (size_t len = 0; len < good.size(); len++) {
+        Provisioning_blob_parser parser;
+        CHECK_EQ(parser.feed(good.data(), len), Provisioning_blob_parser::IN_PROGRESS);
+    }
+    // bytes after the CRC
+    blob = good;
+    blob.push_back(0);
+    CHECK_EQ(parse(blob), Provisioning_blob_parser::FAILED);
+    Provisioning_blob_parser parser;
+    CHECK_EQ(parser.feed(good.data(), good.size()), Provisioning_blob_parser::COMPLETE);
+    CHECK_EQ(parser.feed(good.data(), 1), Provisioning_blob_parser::FAILED);
+}
+
+// A header that claims more records than follow allocates nothing for them
+void test_oversized_count()
+{
+    const uint8_t header[] = {'P', 'W', 'K', 'N', Provisioning_blob_parser::BLOB_VERSION, 0xff, 0xff};
+    Provisioning_blob_parser parser;
+    CHECK_EQ(parser.feed(header, sizeof(header)), Provisioning_blob_parser::IN_PROGRESS);
+    CHECK_EQ(parser.get_records().capacity(), 0u);
+
+    // the blob ends after one record: the next length byte is read as
+    // part of a second record, and the CRC never comes
+    std::vector<uint8_t> blob;
+    Provisioning_blob_parser::encode(make_records(), blob);
+    blob[5] = 0xff;
+    blob[6] = 0xff;
+    recrc(blob);
+    parser.reset();
+    CHECK(parser.feed(blob.data(), blob.size()) != Provisioning_blob_parser::COMPLETE);
+    CHECK(parser.get_records().size() <= 3);
+    CHECK(parser.get_records().capacity() <= 4);
+}
+
+const Ssid_info* find(const std::vector<Ssid_info>& entries, const std::string& ssid)
+{
+    for (auto& info: entries) {
+        if (info.ssid == ssid) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+// The last record for an SSID wins, and each invalid record is counted
+// once, wherever it is in the batch
+void test_import()
+{
+    Fake_wifi_driver driver;
+    Pico_w_connection_manager wifi(nullptr, &driver);
+    wifi.set_log_drain_per_task(0);
+    size_t known_before = wifi.get_known_ssids().size();
+    std::vector<Ssid_info> batch = {
+        make_info("home", "first passphrase", Pico_w_connection_manager::WPA2),
+        make_info("", "", Pico_w_connection_manager::OPEN),
+        make_info(std::string(33, 'x'), "", Pico_w_connection_manager::OPEN),
+        make_info("cafe", "", Pico_w_connection_manager::OPEN, Wifi_power_governor::LOWEST_LATENCY),
+        make_info("wep", "0123456789", Pico_w_connection_manager::WEP),
+        make_info("short", "1234567", Pico_w_connection_manager::WPA2),
+        make_info("long", std::string(65, 'p'), Pico_w_connection_manager::MIXED),
+        make_info("profile", "", Pico_w_connection_manager::OPEN,
+            static_cast<Wifi_power_governor::Power_profile>(Wifi_power_governor::ADAPTIVE + 1)),
+        make_info("home", "second passphrase", Pico_w_connection_manager::MIXED, Wifi_power_governor::ADAPTIVE),
+        // an invalid record does not undo a valid one for the same SSID
+        make_info("cafe", "1234", Pico_w_connection_manager::WPA2),
+    };
+    size_t n_rejected = 0;
+    // without settings storage the import cannot be saved
+    CHECK(!wifi.import_known_ssids(batch, &n_rejected));
+    CHECK_EQ(n_rejected, 7u);
+    auto& known = wifi.get_known_ssids();
+    CHECK_EQ(known.size(), known_before + 2);
+    auto home = find(known, "home");
+    CHECK(home != nullptr);
+    if (home != nullptr) {
+        CHECK(home->passphrase == "second passphrase");
+        CHECK_EQ(home->security, Pico_w_connection_manager::MIXED);
+        CHECK_EQ(home->power_profile, Wifi_power_governor::ADAPTIVE);
+    }
+    auto cafe = find(known, "cafe");
+    CHECK(cafe != nullptr);
+    if (cafe != nullptr) {
+        CHECK_EQ(cafe->power_profile, Wifi_power_governor::LOWEST_LATENCY);
+    }
+
+    // through a parsed blob; the encoder skips the records it cannot
+    // encode, and the import rejects the rest
+    std::vector<uint8_t> blob;
+    CHECK_EQ(Provisioning_blob_parser::encode(batch, blob), 7u);
+    Provisioning_blob_parser parser;
+    parser.feed(blob.data(), blob.size() - 1);
+    // an incomplete blob is not imported
+    CHECK(!wifi.import_known_ssids(parser, &n_rejected));
+    parser.feed(&blob.back(), 1);
+    // the profile byte out of range fails the whole blob
+    CHECK_EQ(parser.get_parse_state(), Provisioning_blob_parser::FAILED);
+    batch.erase(batch.begin() + 7);
+    Provisioning_blob_parser::encode(batch, blob);
+    parser.reset();
+    CHECK_EQ(parser.feed(blob.data(), blob.size()), Provisioning_blob_parser::COMPLETE);
+    wifi.import_known_ssids(parser, &n_rejected);
+    CHECK_EQ(n_rejected, 3u);
+    CHECK_EQ(known.size(), known_before + 2);
+}
+}
+
+int main()
+{
+    test_whole_and_byte_at_a_time();
+    test_random_chunks();
+    test_empty_blob();
+    test_malformed();
+    test_oversized_count();
+    test_import();
+    return test::result();
+}
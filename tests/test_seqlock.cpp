@@ -0,0 +1,146 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "test_support.h"
+#include "seqlock.h"
+
+using rppicomidi::Seqlock;
+
+namespace
+{
+// Large enough that a copy takes many stores, so a torn read is likely
+// if the sequence checks are wrong
+struct Sample
+{
+    uint32_t serial;
+    uint32_t words[62];
+    uint32_t check;
+};
+
+void make_sample(uint32_t serial, Sample& sample)
+{
+    sample.serial = serial;
+    sample.check = serial;
+    for (size_t idx = 0; idx < sizeof(sample.words) / sizeof(sample.words[0]); idx++) {
+        sample.words[idx] = serial * 2654435761u + idx;
+        sample.check ^= sample.words[idx];
+    }
+}
+
+bool is_consistent(const Sample& sample)
+{
+    uint32_t check = sample.serial;
+    for (size_t idx = 0; idx < sizeof(sample.words) / sizeof(sample.words[0]); idx++) {
+        if (sample.words[idx] != sample.serial * 2654435761u + idx) {
+            return false;
+        }
+        check ^= sample.words[idx];
+    }
+    return check == sample.check;
+}
+
+void test_single_thread()
+{
+    Seqlock<Sample> lock;
+    Sample sample;
+    CHECK(lock.try_read(sample));
+    CHECK_EQ(sample.serial, 0u);
+    for (uint32_t serial = 1; serial < 5; serial++) {
+        Sample published;
+        make_sample(serial, published);
+        lock.write(published);
+        lock.read(sample);
+        CHECK_EQ(sample.serial, serial);
+        CHECK(is_consistent(sample));
+    }
+}
+
+// One thread publishes as fast as it can while another reads; every
+// value read must be whole and no older than the one read before it
+void test_two_threads()
+{
+    const auto run_time = std::chrono::milliseconds(500);
+    Seqlock<Sample> lock;
+    Sample first;
+    make_sample(1, first);
+    lock.write(first);
+    std::atomic<bool> done{false};
+    uint32_t reads = 0;
+    uint32_t retries = 0;
+    uint32_t torn = 0;
+    uint32_t went_back = 0;
+    uint32_t distinct = 0;
+    std::thread reader([&]() {
+        uint32_t last_serial = 0;
+        while (!done.load(std::memory_order_acquire)) {
+            Sample sample;
+            if (!lock.try_read(sample)) {
+                ++retries;
+                continue;
+            }
+            ++reads;
+            if (!is_consistent(sample)) {
+                ++torn;
+            }
+            if (sample.serial < last_serial) {
+                ++went_back;
+            }
+            if (sample.serial != last_serial) {
+                ++distinct;
+            }
+            last_serial = sample.serial;
+        }
+    });
+    Sample sample;
+    uint32_t serial = 1;
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < run_time) {
+        for (int burst = 0; burst < 64; burst++) {
+            make_sample(++serial, sample);
+            lock.write(sample);
+        }
+        // on a single core, let the reader run between timer preemptions too
+        std::this_thread::yield();
+    }
+    done.store(true, std::memory_order_release);
+    reader.join();
+    std::printf("%u writes, %u reads of %u distinct values, %u retries\n", serial, reads, distinct, retries);
+    CHECK(reads > 0);
+    CHECK_EQ(torn, 0u);
+    CHECK_EQ(went_back, 0u);
+    lock.read(sample);
+    CHECK_EQ(sample.serial, serial);
+    CHECK(is_consistent(sample));
+}
+}
+
+int main()
+{
+    test_single_thread();
+    test_two_threads();
+    return test::result();
+}
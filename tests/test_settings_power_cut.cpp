@@ -0,0 +1,260 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <string>
+#include "test_support.h"
+#include "fake_wifi_driver.h"
+#include "pico_w_connection_manager.h"
+#include "ram_settings_storage.h"
+#include "settings_record.h"
+
+using rppicomidi::Pico_w_connection_manager;
+using rppicomidi::Ram_settings_storage;
+using rppicomidi::Settings_record;
+using test::Fake_wifi_driver;
+
+namespace
+{
+// Boot, which loads the settings, and save settings whose current SSID
+// is ssid; return whether the write succeeded
+bool save(Ram_settings_storage& storage, const char* ssid)
+{
+    Fake_wifi_driver driver;
+    Pico_w_connection_manager wifi(&storage, &driver);
+    wifi.set_log_drain_per_task(0);
+    wifi.set_current_ssid(ssid);
+    return wifi.save_settings();
+}
+
+// Boot; return the current SSID of the settings it loaded or "(none)"
+std::string load(Ram_settings_storage& storage)
+{
+    Fake_wifi_driver driver;
+    Pico_w_connection_manager wifi(&storage, &driver);
+    wifi.set_log_drain_per_task(0);
+    if (wifi.get_settings_saved_state() != Pico_w_connection_manager::SAVED) {
+        return "(none)";
+    }
+    std::string ssid;
+    wifi.get_current_ssid(ssid);
+    return ssid;
+}
+
+std::string slot_contents(Ram_settings_storage& storage, unsigned slot)
+{
+    std::string data;
+    storage.read(slot, data);
+    return data;
+}
+
+// The JSON the manager saves for ssid
+std::string settings_json(const char* ssid)
+{
+    Ram_settings_storage scratch;
+    // the first boot saves the defaults to slot 0
+    CHECK(save(scratch, ssid));
+    return slot_contents(scratch, 1).substr(Settings_record::HEADER_LEN);
+}
+
+std::string make_record(uint32_t generation, const std::string& payload)
+{
+    std::string record(Settings_record::HEADER_LEN, '\0');
+    Settings_record::encode_header(&record[0], generation, payload.data(), payload.size());
+    return record + payload;
+}
+
+void put(Ram_settings_storage& storage, unsigned slot, const std::string& data)
+{
+    CHECK(storage.write(slot, data.data(), data.size()));
+}
+
+uint32_t generation_of(Ram_settings_storage& storage, unsigned slot)
+{
+    uint32_t generation = 0;
+    size_t offset;
+    CHECK(Settings_record::decode(slot_contents(storage, slot), generation, offset));
+    return generation;
+}
+
+// Cut the power after every possible number of bytes of a save that
+// starts from the state make_state() builds. Whatever survives must load
+// as the settings before the save, or the new ones if every byte got
+// stored, and the save after the reboot must work. The SSIDs saved here
+// have the same length, so their records do too
+template<typename Make_state> void cut_every_byte(const char* what, Make_state make_state, const std::string& before)
+{
+    Ram_settings_storage probe;
+    make_state(probe);
+    CHECK(save(probe, "after"));
+    size_t record_len = 0;
+    for (unsigned slot = 0; slot < probe.get_num_slots(); slot++) {
+        std::string data = slot_contents(probe, slot);
+        uint32_t generation;
+        size_t offset;
+        if (Settings_record::decode(data, generation, offset) && data.find("\"after\"") != std::string::npos) {
+            record_len = data.size();
+        }
+    }
+    CHECK(record_len > Settings_record::HEADER_LEN);
+    int failures = 0;
+    for (size_t cut = 0; cut <= record_len; cut++) {
+        Ram_settings_storage storage;
+        make_state(storage);
+        storage.set_write_fault(cut);
+        CHECK(!save(storage, "after"));
+        std::string loaded = load(storage);
+        std::string expected = cut == record_len ? "after" : before;
+        if (loaded != expected) {
+            if (++failures <= 5) {
+                printf("%s: cut after %zu of %zu bytes loaded %s, not %s\n", what, cut, record_len, loaded.c_str(),
+                    expected.c_str());
+            }
+            continue;
+        }
+        // the reboot continues where the stored settings left off
+        CHECK(save(storage, "again"));
+        CHECK(load(storage) == "again");
+        // and a second cut still leaves the settings that were loaded
+        storage.set_write_fault(cut);
+        CHECK(!save(storage, "later"));
+        CHECK(load(storage) == (cut == record_len ? "later" : "again"));
+    }
+    CHECK_EQ(failures, 0);
+}
+
+void test_cut_with_two_framed_records()
+{
+    cut_every_byte("framed", [](Ram_settings_storage& storage) {
+        CHECK(save(storage, "first"));
+        CHECK(save(storage, "second"));
+        CHECK_EQ(generation_of(storage, 0), 3u);
+        CHECK_EQ(generation_of(storage, 1), 2u);
+    }, "second");
+}
+
+// The other slot was never written
+void test_cut_with_one_framed_record()
+{
+    cut_every_byte("one record", [](Ram_settings_storage& storage) {
+        put(storage, 0, make_record(1, settings_json("first")));
+    }, "first");
+}
+
+// Plain JSON in the first slot, as saved before records were framed
+void test_cut_after_legacy_settings()
+{
+    auto make_legacy = [](Ram_settings_storage& storage) {
+        put(storage, 0, settings_json("legacy"));
+    };
+    Ram_settings_storage storage;
+    make_legacy(storage);
+    CHECK_EQ(slot_contents(storage, 0)[0], '{');
+    CHECK(load(storage) == "legacy");
+    CHECK(save(storage, "framed"));
+    // the legacy JSON stays until the framed record is safely stored
+    CHECK_EQ(slot_contents(storage, 0)[0], '{');
+    CHECK_EQ(generation_of(storage, 1), 1u);
+    CHECK(load(storage) == "framed");
+
+    cut_every_byte("legacy", make_legacy, "legacy");
+}
+
+// Nothing loads: the next save must not overwrite a record that may
+// still be recovered, and it must not lose the generation
+void test_load_failures_choose_the_slot_to_overwrite()
+{
+    // the only record is a legacy one that was cut short
+    std::string legacy = settings_json("legacy");
+    Ram_settings_storage storage;
+    put(storage, 0, legacy.substr(0, legacy.size() / 2));
+    CHECK(load(storage) == "(none)");
+    CHECK(save(storage, "framed"));
+    CHECK(slot_contents(storage, 0) == legacy.substr(0, legacy.size() / 2));
+    CHECK_EQ(generation_of(storage, 1), 1u);
+
+    // an intact newest record that does not apply and a damaged older one
+    Ram_settings_storage damaged;
+    std::string older = make_record(6, settings_json("older"));
+    older[older.size() - 2] ^= 1;
+    put(damaged, 0, older);
+    put(damaged, 1, make_record(7, "{}"));
+    CHECK(load(damaged) == "(none)");
+    CHECK(save(damaged, "fresh"));
+    CHECK(slot_contents(damaged, 1) == make_record(7, "{}"));
+    CHECK_EQ(generation_of(damaged, 0), 8u);
+    CHECK(load(damaged) == "fresh");
+
+    // nothing intact: the first save goes to slot 0
+    Ram_settings_storage garbage;
+    put(garbage, 0, "PWS1 garbage");
+    put(garbage, 1, older);
+    CHECK(load(garbage) == "(none)");
+    CHECK(save(garbage, "fresh"));
+    CHECK_EQ(generation_of(garbage, 0), 1u);
+    CHECK(slot_contents(garbage, 1) == older);
+
+    // an intact newest record that does not apply falls back to the older one
+    Ram_settings_storage fallback;
+    put(fallback, 0, make_record(3, settings_json("older")));
+    put(fallback, 1, make_record(4, "{}"));
+    CHECK(load(fallback) == "older");
+    CHECK(save(fallback, "fresh"));
+    CHECK_EQ(generation_of(fallback, 1), 4u);
+    CHECK(load(fallback) == "fresh");
+}
+
+// The generation counter wraps from 0xffffffff to 0
+void test_cut_across_generation_wrap()
+{
+    auto make_wrapped = [](Ram_settings_storage& storage) {
+        put(storage, 0, make_record(0xffffffffu, settings_json("newest")));
+        put(storage, 1, make_record(0xfffffffeu, settings_json("older")));
+    };
+    Ram_settings_storage storage;
+    make_wrapped(storage);
+    CHECK(load(storage) == "newest");
+    CHECK(save(storage, "wrapped"));
+    CHECK_EQ(generation_of(storage, 1), 0u);
+    CHECK(load(storage) == "wrapped");
+    CHECK(save(storage, "after wrap"));
+    CHECK_EQ(generation_of(storage, 0), 1u);
+    CHECK(load(storage) == "after wrap");
+
+    cut_every_byte("wrap", make_wrapped, "newest");
+    cut_every_byte("wrapped", [&make_wrapped](Ram_settings_storage& storage) {
+        make_wrapped(storage);
+        CHECK(save(storage, "wrapped"));
+    }, "wrapped");
+}
+}
+
+int main()
+{
+    test_cut_with_two_framed_records();
+    test_cut_with_one_framed_record();
+    test_cut_after_legacy_settings();
+    test_load_failures_choose_the_slot_to_overwrite();
+    test_cut_across_generation_wrap();
+    return test::result();
+}
@@ -0,0 +1,67 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstdio>
+
+/**
+ * @brief Minimal checks for the host tests
+ *
+ * Each test is a program that runs its checks from main() and returns
+ * test::result(), so ctest reports it as failed if any check failed.
+ */
+namespace test
+{
+inline int& failures()
+{
+    static int count = 0;
+    return count;
+}
+
+inline int result()
+{
+    if (failures() != 0) {
+        std::printf("%d check(s) failed\n", failures());
+        return 1;
+    }
+    return 0;
+}
+}
+
+#define CHECK(cond_) do { \
+    if (!(cond_)) { \
+        std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond_); \
+        ++test::failures(); \
+    } \
+} while (0)
+
+#define CHECK_EQ(actual_, expected_) do { \
+    auto actual_value_ = (actual_); \
+    auto expected_value_ = (expected_); \
+    if (!(actual_value_ == expected_value_)) { \
+        std::printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #actual_, #expected_, \
+            static_cast<long long>(actual_value_), static_cast<long long>(expected_value_)); \
+        ++test::failures(); \
+    } \
+} while (0)
@@ -0,0 +1,335 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <climits>
+#include <cstring>
+#include <string>
+#include "test_support.h"
+#include "fake_wifi_driver.h"
+#include "host_lwip.h"
+#include "pico_w_connection_manager.h"
+#include "wifi_metrics_server.h"
+
+using rppicomidi::Pico_w_connection_manager;
+using rppicomidi::Wifi_metrics_server;
+using test::Fake_wifi_driver;
+
+namespace
+{
+const uint16_t port = Wifi_metrics_server::DEFAULT_PORT;
+const char request[] = "GET /metrics HTTP/1.1\r\nHost: pico\r\n\r\n";
+const char http_header[] = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n\r\n";
+
+Pico_w_connection_manager::Status_snapshot make_snapshot()
+{
+    Pico_w_connection_manager::Status_snapshot status = {};
+    status.state = Pico_w_connection_manager::CONNECTED;
+    strcpy(status.ssid, "my \"lab\"\\\n");
+    status.rssi = -61;
+    status.timestamp_ms = 12345;
+    status.state_changes = 7;
+    status.state_entries[Pico_w_connection_manager::SCANNING] = 1;
+    status.state_entries[Pico_w_connection_manager::CONNECTED] = 2;
+    status.link_ups = 2;
+    status.link_downs = 1;
+    status.errors_by_type[Pico_w_connection_manager::LINK_ERROR_BADAUTH] = 1;
+    status.errors_by_type[Pico_w_connection_manager::LINK_ERROR_GATEWAY] = 3;
+    status.reconnects = 4;
+    status.scans = 1;
+    status.link_uptime_ms = 61000;
+    status.total_link_uptime_ms = 3600001;
+    status.settings_saves = 5;
+    status.settings_save_failures = 1;
+    status.settings_save_us = 1500;
+    status.max_settings_save_us = 700;
+    return status;
+}
+
+const char expected_text[] =
+    "# TYPE pico_w_uptime_seconds gauge\n"
+    "pico_w_uptime_seconds 12.345\n"
+    "# TYPE pico_w_info gauge\n"
+    "pico_w_info{ssid=\"my \\\"lab\\\"\\\\\\n\"} 1\n"
+    "# TYPE pico_w_state gauge\n"
+    "pico_w_state{state=\"connected\"} 1\n"
+    "# TYPE pico_w_state_transitions_total counter\n"
+    "pico_w_state_transitions_total 7\n"
+    "# TYPE pico_w_state_entries_total counter\n"
+    "pico_w_state_entries_total{state=\"deinitialized\"} 0\n"
+    "pico_w_state_entries_total{state=\"initialized\"} 0\n"
+    "pico_w_state_entries_total{state=\"scan_requested\"} 0\n"
+    "pico_w_state_entries_total{state=\"scanning\"} 1\n"
+    "pico_w_state_entries_total{state=\"scan_complete\"} 0\n"
+    "pico_w_state_entries_total{state=\"connection_requested\"} 0\n"
+    "pico_w_state_entries_total{state=\"connected\"} 2\n"
+    "# TYPE pico_w_link_ups_total counter\n"
+    "pico_w_link_ups_total 2\n"
+    "# TYPE pico_w_link_downs_total counter\n"
+    "pico_w_link_downs_total 1\n"
+    "# TYPE pico_w_link_errors_total counter\n"
+    "pico_w_link_errors_total{error=\"badauth\"} 1\n"
+    "pico_w_link_errors_total{error=\"nonet\"} 0\n"
+    "pico_w_link_errors_total{error=\"fail\"} 0\n"
+    "pico_w_link_errors_total{error=\"unknown\"} 0\n"
+    "pico_w_link_errors_total{error=\"gateway\"} 3\n"
+    "# TYPE pico_w_reconnects_total counter\n"
+    "pico_w_reconnects_total 4\n"
+    "# TYPE pico_w_scans_total counter\n"
+    "pico_w_scans_total 1\n"
+    "# TYPE pico_w_rssi_dbm gauge\n"
+    "pico_w_rssi_dbm -61\n"
+    "# TYPE pico_w_link_uptime_seconds gauge\n"
+    "pico_w_link_uptime_seconds 61.000\n"
+    "# TYPE pico_w_link_uptime_seconds_total counter\n"
+    "pico_w_link_uptime_seconds_total 3600.001\n"
+    "# TYPE pico_w_settings_saves_total counter\n"
+    "pico_w_settings_saves_total 5\n"
+    "# TYPE pico_w_settings_save_failures_total counter\n"
+    "pico_w_settings_save_failures_total 1\n"
+    "# TYPE pico_w_settings_save_seconds_total counter\n"
+    "pico_w_settings_save_seconds_total 0.001500\n"
+    "# TYPE pico_w_settings_save_seconds_max gauge\n"
+    "pico_w_settings_save_seconds_max 0.000700\n";
+
+void test_render()
+{
+    auto status = make_snapshot();
+    char text[PICO_W_CM_METRICS_BUFFER_SIZE];
+    size_t len = Wifi_metrics_server::render(status, text, sizeof(text));
+    CHECK_EQ(len, sizeof(expected_text) - 1);
+    CHECK(strcmp(text, expected_text) == 0);
+
+    // no RSSI without a link
+    status.rssi = INT_MIN;
+    len = Wifi_metrics_server::render(status, text, sizeof(text));
+    CHECK(len != 0);
+    CHECK(strstr(text, "rssi") == nullptr);
+
+    // the text and its NUL must fit
+    status.rssi = -61;
+    size_t needed = sizeof(expected_text);
+    CHECK_EQ(Wifi_metrics_server::render(status, text, needed), needed - 1);
+    CHECK_EQ(Wifi_metrics_server::render(status, text, needed - 1), 0u);
+    CHECK_EQ(text[0], '\0');
+    CHECK_EQ(Wifi_metrics_server::render(status, text, 0), 0u);
+}
+
+// A manager with a link up and a few counters to report
+struct Connected_manager {
+    Fake_wifi_driver driver;
+    Pico_w_connection_manager wifi;
+
+    Connected_manager() : wifi{nullptr, &driver}
+    {
+        wifi.set_log_drain_per_task(0);
+        wifi.set_current_ssid("home");
+        CHECK(wifi.initialize());
+        CHECK(wifi.connect());
+        for (int idx = 0; idx < 100 && wifi.get_state() != Pico_w_connection_manager::CONNECTED; idx++) {
+            driver.time_ms += 10;
+            wifi.task();
+        }
+        CHECK(wifi.is_link_up());
+    }
+
+    std::string expected_response() const
+    {
+        Pico_w_connection_manager::Status_snapshot status;
+        wifi.get_status_snapshot(status);
+        char text[PICO_W_CM_METRICS_BUFFER_SIZE];
+        CHECK(Wifi_metrics_server::render(status, text, sizeof(text)) != 0);
+        return std::string(http_header) + text;
+    }
+};
+
+std::string received(int client)
+{
+    static char buffer[2 * PICO_W_CM_METRICS_BUFFER_SIZE];
+    host_lwip_client_received(client, buffer, sizeof(buffer));
+    return buffer;
+}
+
+int poll_until_closed(int client, int limit)
+{
+    int polls = 0;
+    while (!host_lwip_client_is_closed(client) && polls < limit) {
+        host_lwip_poll();
+        ++polls;
+    }
+    return polls;
+}
+
+void test_scrape()
+{
+    host_lwip_reset();
+    host_lwip_peer.tcp_ack_bytes = 1460;
+    Connected_manager manager;
+    Wifi_metrics_server server(manager.wifi);
+    CHECK(server.start(port));
+    CHECK(server.is_running());
+    CHECK_EQ(host_lwip_stats.tcp_pcbs, 1);
+
+    int client = host_lwip_client_connect(port);
+    host_lwip_poll();
+    CHECK(!host_lwip_client_is_closed(client));
+    CHECK_EQ(host_lwip_stats.tcp_pcbs, 2);
+    host_lwip_client_send(client, request);
+    host_lwip_poll();
+    CHECK(host_lwip_client_is_closed(client));
+    CHECK(!host_lwip_client_was_aborted(client));
+    std::string response = received(client);
+    CHECK(response == manager.expected_response());
+    CHECK(response.find("pico_w_state{state=\"connected\"} 1\n") != std::string::npos);
+    CHECK(response.find("pico_w_info{ssid=\"home\"} 1\n") != std::string::npos);
+    CHECK(response.find("pico_w_link_ups_total 1\n") != std::string::npos);
+    CHECK_EQ(server.get_scrapes(), 1u);
+    CHECK_EQ(server.get_rejected(), 0u);
+    CHECK_EQ(host_lwip_stats.tcp_pcbs, 1);
+
+    // the next client is served the same way
+    client = host_lwip_client_connect(port);
+    host_lwip_client_send(client, request);
+    poll_until_closed(client, 10);
+    CHECK(received(client) == manager.expected_response());
+    CHECK_EQ(server.get_scrapes(), 2u);
+
+    // nothing listens on other ports
+    client = host_lwip_client_connect(port + 1);
+    host_lwip_poll();
+    CHECK(host_lwip_client_was_aborted(client));
+
+    server.stop();
+    CHECK(!server.is_running());
+    CHECK_EQ(host_lwip_stats.tcp_pcbs, 0);
+    client = host_lwip_client_connect(port);
+    host_lwip_poll();
+    CHECK(host_lwip_client_was_aborted(client));
+}
+
+// A send buffer smaller than the response: the server writes more as the
+// client acknowledges what it has
+void test_scrape_in_pieces()
+{
+    host_lwip_reset();
+    host_lwip_peer.tcp_snd_buf = 256;
+    host_lwip_peer.tcp_ack_bytes = 256;
+    Connected_manager manager;
+    Wifi_metrics_server server(manager.wifi);
+    CHECK(server.start(port));
+    int client = host_lwip_client_connect(port);
+    host_lwip_client_send(client, request);
+    host_lwip_poll();
+    int polls = poll_until_closed(client, 100);
+    std::string response = received(client);
+    CHECK(!host_lwip_client_was_aborted(client));
+    CHECK(response == manager.expected_response());
+    CHECK_EQ(static_cast<size_t>(polls), (response.size() - 1) / 256);
+    CHECK_EQ(server.get_scrapes(), 1u);
+
+    // a client that shuts down its sending side right after the request
+    // still receives the whole response
+    int half_closed = host_lwip_client_connect(port);
+    host_lwip_client_send(half_closed, request);
+    host_lwip_client_close(half_closed);
+    host_lwip_poll();
+    poll_until_closed(half_closed, 100);
+    CHECK(!host_lwip_client_was_aborted(half_closed));
+    CHECK(received(half_closed) == manager.expected_response());
+    CHECK_EQ(server.get_scrapes(), 2u);
+    server.stop();
+    CHECK_EQ(host_lwip_stats.tcp_pcbs, 0);
+}
+
+// One client at a time; a client that sends nothing is dropped after two
+// 2 s polls, and one that closes first is closed without a response
+void test_busy_idle_and_closed_clients()
+{
+    host_lwip_reset();
+    host_lwip_peer.tcp_ack_bytes = 1460;
+    Connected_manager manager;
+    Wifi_metrics_server server(manager.wifi);
+    CHECK(server.start(port));
+    int idle = host_lwip_client_connect(port);
+    int refused = host_lwip_client_connect(port);
+    host_lwip_poll();
+    CHECK(!host_lwip_client_is_closed(idle));
+    CHECK(host_lwip_client_was_aborted(refused));
+    CHECK_EQ(server.get_rejected(), 1u);
+    for (int tick = 0; tick < 7; tick++) {
+        host_lwip_poll();
+    }
+    CHECK(!host_lwip_client_is_closed(idle));
+    host_lwip_poll();
+    CHECK(host_lwip_client_was_aborted(idle));
+    CHECK_EQ(server.get_rejected(), 2u);
+    CHECK(received(idle).empty());
+
+    int quitter = host_lwip_client_connect(port);
+    host_lwip_poll();
+    host_lwip_client_close(quitter);
+    host_lwip_poll();
+    CHECK(host_lwip_client_is_closed(quitter));
+    CHECK(!host_lwip_client_was_aborted(quitter));
+    CHECK(received(quitter).empty());
+
+    // a reset frees the client, and the server takes the next one
+    int reset = host_lwip_client_connect(port);
+    host_lwip_poll();
+    host_lwip_peer.tcp_reset = true;
+    host_lwip_poll();
+    CHECK(host_lwip_client_was_aborted(reset));
+    CHECK(server.is_running());
+    int client = host_lwip_client_connect(port);
+    host_lwip_client_send(client, request);
+    poll_until_closed(client, 10);
+    CHECK(received(client) == manager.expected_response());
+    CHECK_EQ(server.get_scrapes(), 1u);
+    CHECK_EQ(server.get_rejected(), 2u);
+    CHECK_EQ(host_lwip_stats.tcp_pcbs, 1);
+}
+
+// Another listener already has the port
+void test_port_in_use()
+{
+    host_lwip_reset();
+    Connected_manager manager;
+    Wifi_metrics_server first(manager.wifi);
+    Wifi_metrics_server second(manager.wifi);
+    CHECK(first.start(port));
+    CHECK(!second.start(port));
+    CHECK(second.start(port + 1));
+    CHECK_EQ(host_lwip_stats.tcp_pcbs, 2);
+}
+}
+
+int main()
+{
+    test_render();
+    test_scrape();
+    test_scrape_in_pieces();
+    test_busy_idle_and_closed_clients();
+    test_port_in_use();
+    CHECK_EQ(host_lwip_stats.tcp_pcbs, 0);
+    return test::result();
+}
@@ -0,0 +1,158 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "test_support.h"
+#include "wifi_power_governor.h"
+
+using rppicomidi::Wifi_power_governor;
+
+namespace
+{
+/**
+ * @brief Feed the governor one sample period of traffic at a given rate
+ * and apply the profile it asks for, like the connection manager does
+ */
+struct Link
+{
+    Wifi_power_governor governor;
+    uint32_t bytes;
+    uint32_t now_ms;
+
+    explicit Link(uint32_t initial_bytes = 0) : bytes{initial_bytes}, now_ms{0}
+    {
+        governor.set_active(Wifi_power_governor::BALANCED, now_ms);
+        governor.restart_sampling(bytes, now_ms);
+    }
+
+    Wifi_power_governor::Power_profile run(uint32_t rate_bps, uint32_t seconds = 1)
+    {
+        const uint32_t period = governor.get_config().sample_period_ms;
+        for (uint32_t ms = 0; ms < seconds * 1000; ms += period) {
+            bytes += rate_bps / 8 * period / 1000;
+            now_ms += period;
+            auto wanted = governor.update(bytes, now_ms);
+            if (wanted != governor.get_active()) {
+                governor.set_active(wanted, now_ms);
+            }
+        }
+        return governor.get_active();
+    }
+};
+
+void test_thresholds_and_dwell()
+{
+    Link link;
+    // fast traffic, but BALANCED has not been active for min_dwell_ms yet
+    CHECK_EQ(link.run(100000, 4), Wifi_power_governor::BALANCED);
+    CHECK_EQ(link.governor.get_last_rate_bps(), 100000u);
+    CHECK_EQ(link.run(100000, 1), Wifi_power_governor::LOWEST_LATENCY);
+    // an immediate drop does not switch again before min_dwell_ms
+    CHECK_EQ(link.run(1000, 4), Wifi_power_governor::LOWEST_LATENCY);
+    CHECK_EQ(link.run(1000, 1), Wifi_power_governor::LOWEST_POWER);
+}
+
+void test_hysteresis()
+{
+    Link link;
+    auto config = link.governor.get_config();
+    CHECK_EQ(link.run(config.latency_threshold_bps, 5), Wifi_power_governor::LOWEST_LATENCY);
+    // just under the threshold, but not by the hysteresis margin
+    uint32_t inside = config.latency_threshold_bps * (100 - config.hysteresis_pct) / 100 + 800;
+    CHECK_EQ(link.run(inside, 30), Wifi_power_governor::LOWEST_LATENCY);
+    uint32_t outside = config.latency_threshold_bps * (100 - config.hysteresis_pct) / 100 - 800;
+    CHECK_EQ(link.run(outside, 5), Wifi_power_governor::BALANCED);
+
+    CHECK_EQ(link.run(config.power_threshold_bps, 5), Wifi_power_governor::LOWEST_POWER);
+    inside = config.power_threshold_bps * (100 + config.hysteresis_pct) / 100 - 800;
+    CHECK_EQ(link.run(inside, 30), Wifi_power_governor::LOWEST_POWER);
+    outside = config.power_threshold_bps * (100 + config.hysteresis_pct) / 100 + 800;
+    CHECK_EQ(link.run(outside, 5), Wifi_power_governor::BALANCED);
+    // without hysteresis the same rate would have left LOWEST_POWER
+    CHECK(inside > config.power_threshold_bps);
+}
+
+void test_rate_oscillating_around_threshold()
+{
+    // traffic alternating just above and below the threshold must not
+    // make the radio flap between profiles
+    Link link;
+    auto config = link.governor.get_config();
+    link.run(config.latency_threshold_bps + 8000, 5);
+    unsigned switches = 0;
+    auto previous = link.governor.get_active();
+    for (int idx = 0; idx < 100; idx++) {
+        auto now = link.run(idx & 1 ? config.latency_threshold_bps + 8000 : config.latency_threshold_bps - 8000);
+        if (now != previous) {
+            ++switches;
+            previous = now;
+        }
+    }
+    CHECK_EQ(switches, 0u);
+}
+
+void test_sample_period()
+{
+    Link link;
+    link.bytes += 100000;
+    link.now_ms += link.governor.get_config().sample_period_ms - 1;
+    // too early to compute a rate
+    CHECK_EQ(link.governor.update(link.bytes, link.now_ms), Wifi_power_governor::BALANCED);
+    CHECK_EQ(link.governor.get_last_rate_bps(), 0u);
+    link.now_ms += 1;
+    link.governor.update(link.bytes, link.now_ms);
+    CHECK_EQ(link.governor.get_last_rate_bps(), 800000u);
+}
+
+void test_byte_counter_wrap()
+{
+    Link link(0xFFFFF000u);
+    link.run(64000, 1);
+    CHECK_EQ(link.governor.get_last_rate_bps(), 64000u);
+    CHECK(link.bytes < 0xFFFFF000u);
+}
+
+void test_time_in_profile()
+{
+    Link link;
+    link.run(100000, 5);                // 5 s BALANCED, then LOWEST_LATENCY
+    link.run(100000, 3);
+    link.governor.stop_accounting(link.now_ms);
+    link.now_ms += 10000;               // the radio is off
+    CHECK_EQ(link.governor.get_time_in_profile_ms(Wifi_power_governor::BALANCED, link.now_ms), 5000u);
+    CHECK_EQ(link.governor.get_time_in_profile_ms(Wifi_power_governor::LOWEST_LATENCY, link.now_ms), 3000u);
+    CHECK_EQ(link.governor.get_time_in_profile_ms(Wifi_power_governor::LOWEST_POWER, link.now_ms), 0u);
+    CHECK_EQ(link.governor.get_time_in_profile_ms(Wifi_power_governor::ADAPTIVE, link.now_ms), 0u);
+}
+}
+
+int main()
+{
+    test_thresholds_and_dwell();
+    test_hysteresis();
+    test_rate_oscillating_around_threshold();
+    test_sample_period();
+    test_byte_counter_wrap();
+    test_time_in_profile();
+    return test::result();
+}
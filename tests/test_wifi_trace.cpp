@@ -0,0 +1,209 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <vector>
+#include "test_support.h"
+#include "fake_wifi_driver.h"
+#include "pico_w_connection_manager.h"
+#include "wifi_trace.h"
+
+using rppicomidi::Pico_w_connection_manager;
+using rppicomidi::Wifi_driver;
+using rppicomidi::Wifi_trace_recorder;
+using rppicomidi::Wifi_trace_replay_driver;
+using test::Fake_wifi_driver;
+
+namespace
+{
+/**
+ * @brief What the application could see after each task() call
+ */
+struct Observation
+{
+    Pico_w_connection_manager::Status_snapshot status;
+    uint32_t gateway_detections;
+    uint32_t dns_refreshes;
+    uint32_t dns_address;
+    uint8_t self_test_rtt_result;
+
+    bool operator==(const Observation& other) const
+    {
+        return status.state == other.status.state && status.ip_address == other.status.ip_address &&
+            status.rssi == other.status.rssi && status.last_error == other.status.last_error &&
+            status.timestamp_ms == other.status.timestamp_ms && status.link_ups == other.status.link_ups &&
+            status.link_downs == other.status.link_downs && status.link_errors == other.status.link_errors &&
+            status.scans == other.status.scans && status.state_changes == other.status.state_changes &&
+            status.reconnects == other.status.reconnects &&
+            status.total_link_uptime_ms == other.status.total_link_uptime_ms &&
+            gateway_detections == other.gateway_detections && dns_refreshes == other.dns_refreshes &&
+            dns_address == other.dns_address && self_test_rtt_result == other.self_test_rtt_result;
+    }
+};
+
+void append(void* context, const uint8_t* data, size_t len)
+{
+    auto trace = reinterpret_cast<std::vector<uint8_t>*>(context);
+    trace->insert(trace->end(), data, data + len);
+}
+
+/**
+ * @brief Run the same application session against any driver
+ *
+ * @param driver the driver the manager uses
+ * @param fake the driver underneath while recording, to advance time and
+ * change what the network does; nullptr while replaying
+ * @param steps the number of task() calls
+ */
+std::vector<Observation> run_session(Wifi_driver& driver, Fake_wifi_driver* fake, int steps = 400)
+{
+    if (fake != nullptr) {
+        fake->access_points.push_back(Fake_wifi_driver::make_ap("home", 1, 1, -70));
+        fake->access_points.push_back(Fake_wifi_driver::make_ap("home", 2, 6, -48));
+        fake->access_points.push_back(Fake_wifi_driver::make_ap("neighbor", 3, 6, -60));
+        fake->dns_server["example.com"] = 0x04030201;
+    }
+    std::vector<Observation> observations;
+    Pico_w_connection_manager wifi(nullptr, &driver);
+    wifi.set_link_health_config({true, 1000, 300, 3});
+    wifi.set_dns_cache_config({true, 2000, 1000, 500});
+    wifi.add_dns_cache_host("example.com");
+    wifi.set_current_ssid("home");
+    wifi.initialize();
+    wifi.start_scan();
+    rppicomidi::Link_self_test::Config self_test = {};
+    ip4_addr_set_u32(ip_2_ip4(&self_test.peer), 0x0200a8c0);
+    self_test.udp_port = 7;
+    self_test.tests = rppicomidi::Link_self_test::TEST_RTT;
+    self_test.rtt_count = 3;
+    self_test.timeout_ms = 100;
+    for (int step = 0; step < steps; step++) {
+        if (fake != nullptr) {
+            fake->time_ms += 50;
+            if (step == 150) {
+                fake->dns_server["example.com"] = 0x08070605;
+            }
+            else if (step == 200) {
+                fake->gateway_answers = false;
+            }
+            else if (step == 280) {
+                fake->gateway_answers = true;
+            }
+        }
+        if (step == 20) {
+            wifi.connect();
+        }
+        else if (step == 100) {
+            wifi.get_rssi();
+            wifi.start_self_test(self_test);
+        }
+        else if (step == steps - 20) {
+            wifi.disconnect();
+        }
+        wifi.task();
+        Observation observation;
+        wifi.get_status_snapshot(observation.status);
+        observation.gateway_detections = wifi.get_link_health_checker().get_detection_count();
+        observation.dns_refreshes = wifi.get_dns_cache().get_refreshes();
+        observation.dns_address = wifi.get_dns_cache().get_address("home", "example.com");
+        observation.self_test_rtt_result = static_cast<uint8_t>(wifi.get_self_test_results().rtt_result);
+        observations.push_back(observation);
+    }
+    return observations;
+}
+
+void test_replay_matches_recording()
+{
+    Fake_wifi_driver fake;
+    std::vector<uint8_t> trace;
+    Wifi_trace_recorder recorder(fake, append, &trace);
+    auto recorded = run_session(recorder, &fake);
+    CHECK_EQ(recorder.get_bytes_written(), trace.size());
+
+    // the session exercised what the replay has to reproduce
+    const auto& last = recorded.back();
+    CHECK(fake.joined_bssid);
+    CHECK_EQ(fake.bssid[5], 2);             // the stronger AP on the emptier channel
+    CHECK(last.gateway_detections >= 1);
+    CHECK(last.status.reconnects >= 1);
+    CHECK_EQ(last.status.errors_by_type[Pico_w_connection_manager::LINK_ERROR_GATEWAY], last.gateway_detections);
+    CHECK(last.dns_refreshes >= 2);
+    CHECK_EQ(last.dns_address, 0x08070605u);
+    CHECK(last.self_test_rtt_result != rppicomidi::Link_self_test::RESULT_NOT_RUN);
+    CHECK_EQ(last.status.state, Pico_w_connection_manager::INITIALIZED);
+
+    Wifi_trace_replay_driver replay(trace.data(), trace.size());
+    auto replayed = run_session(replay, nullptr);
+    CHECK(!replay.is_diverged());
+    CHECK(replay.is_finished());
+    CHECK_EQ(replayed.size(), recorded.size());
+    size_t first_difference = 0;
+    while (first_difference < recorded.size() && first_difference < replayed.size() &&
+            recorded[first_difference] == replayed[first_difference]) {
+        ++first_difference;
+    }
+    CHECK_EQ(first_difference, recorded.size());
+}
+
+void test_replay_detects_divergence()
+{
+    Fake_wifi_driver fake;
+    std::vector<uint8_t> trace;
+    Wifi_trace_recorder recorder(fake, append, &trace);
+    run_session(recorder, &fake);
+
+    // the application disconnects at step 180 instead of step 380
+    Wifi_trace_replay_driver replay(trace.data(), trace.size());
+    auto replayed = run_session(replay, nullptr, 200);
+    CHECK(replay.is_diverged());
+    CHECK(!replay.is_finished());
+    CHECK_EQ(replayed.size(), 200u);
+
+    // a different version of the trace format is refused
+    trace[4] = static_cast<uint8_t>(rppicomidi::Wifi_trace::VERSION + 1);
+    Wifi_trace_replay_driver other_version(trace.data(), trace.size());
+    CHECK(other_version.is_diverged());
+    CHECK_EQ(other_version.now_ms(), 0u);
+}
+
+void test_default_driver_on_host()
+{
+    // the CYW43 driver builds against the host stand-ins, which never link up
+    Pico_w_connection_manager wifi;
+    CHECK(wifi.initialize());
+    CHECK(wifi.start_scan());
+    for (int step = 0; step < 3; step++) {
+        wifi.task();
+    }
+    CHECK_EQ(wifi.get_state(), Pico_w_connection_manager::SCAN_COMPLETE);
+    CHECK(!wifi.is_link_up());
+}
+}
+
+int main()
+{
+    test_replay_matches_recording();
+    test_replay_detects_divergence();
+    test_default_driver_on_host();
+    return test::result();
+}
@@ -0,0 +1,280 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstdint>
+
+namespace rppicomidi
+{
+/**
+ * @brief Every Wi-Fi driver and clock interaction of the connection manager
+ *
+ * Pico_w_connection_manager and its helpers (Link_health_checker,
+ * Link_self_test, Dns_cache and Wifi_event_log) make all of their CYW43
+ * driver and lwIP calls that decide what the manager does, and read the
+ * time, only through this interface. Cyw43_wifi_driver implements it
+ * with the real driver. Wifi_trace_recorder wraps another driver and
+ * records every call, and Wifi_trace_replay_driver plays a recording back
+ * so a field failure can be reproduced off the hardware.
+ *
+ * The interface does not include any Pico SDK header, so the manager and
+ * the replay driver also build on a host computer. Return values follow
+ * the CYW43 driver functions each method replaces, and the constants
+ * below have the values of the CYW43 constants of the same name.
+ */
+class Wifi_driver
+{
+public:
+    /**
+     * @brief One access point found by a scan; the fields have the names
+     * and meanings of the cyw43_ev_scan_result_t fields
+     */
+    struct Scan_result {
+        uint8_t bssid[6];
+        uint16_t channel;
+        uint8_t auth_mode;
+        int16_t rssi;
+        uint8_t ssid_len;
+        uint8_t ssid[32];
+    };
+    typedef int (*Scan_result_cb)(void* env, const Scan_result* result);
+
+    // link_status() values; the CYW43_LINK_xxx values
+    static constexpr int LINK_DOWN = 0;
+    static constexpr int LINK_JOIN = 1;
+    static constexpr int LINK_NOIP = 2;
+    static constexpr int LINK_UP = 3;
+    static constexpr int LINK_FAIL = -1;
+    static constexpr int LINK_NONET = -2;
+    static constexpr int LINK_BADAUTH = -3;
+
+    // connect() auth values; the CYW43_AUTH_xxx values
+    static constexpr uint32_t AUTH_OPEN = 0;
+    static constexpr uint32_t AUTH_WPA_TKIP_PSK = 0x00200002;
+    static constexpr uint32_t AUTH_WPA2_AES_PSK = 0x00400004;
+    static constexpr uint32_t AUTH_WPA2_MIXED_PSK = 0x00400006;
+
+    // set_power_management() values
+    static constexpr uint32_t PM_NONE = 0x10;       //!< cyw43_pm_value(CYW43_NO_POWERSAVE_MODE, 10, 0, 0, 0)
+    static constexpr uint32_t PM_PM1 = 0x11;        //!< cyw43_pm_value(CYW43_PM1_POWERSAVE_MODE, 10, 0, 0, 0)
+    static constexpr uint32_t PM_DEFAULT = 0xa11142;//!< CYW43_DEFAULT_PM
+
+    virtual ~Wifi_driver() = default;
+
+    /**
+     * @brief Get the time since boot in milliseconds
+     */
+    virtual uint32_t now_ms() = 0;
+
+    /**
+     * @brief Get a time stamp in microseconds, modulo 2^32
+     *
+     * Traces do not record time stamps, so this may be called from lwIP
+     * callbacks and as often as needed. Use it only to measure; pass any
+     * result that changes what the caller does through observe().
+     */
+    virtual uint32_t timestamp_us() = 0;
+
+    /**
+     * @brief Hand a value that came from outside the driver, such as a
+     * flag set by an lwIP callback, to the caller through the driver
+     *
+     * Wifi_trace_recorder records the value and Wifi_trace_replay_driver
+     * returns the recorded value, so decisions made on it replay the same.
+     * @param value the value
+     * @return value
+     */
+    virtual uint32_t observe(uint32_t value) { return value; }
+
+    /**
+     * @brief Initialize the driver; replaces cyw43_arch_init_with_country()
+     */
+    virtual int init(uint32_t country_code) = 0;
+
+    /**
+     * @brief Shut down the driver; replaces cyw43_arch_deinit()
+     */
+    virtual void deinit() = 0;
+
+    /**
+     * @brief Enable station mode; replaces cyw43_arch_enable_sta_mode()
+     */
+    virtual void enable_sta_mode() = 0;
+
+    /**
+     * @brief Get the country the driver was initialized with; replaces
+     * cyw43_arch_get_country_code()
+     */
+    virtual uint32_t get_country_code() = 0;
+
+    /**
+     * @brief Get the station link status; replaces cyw43_tcpip_link_status()
+     */
+    virtual int link_status() = 0;
+
+    /**
+     * @brief Start a scan; replaces cyw43_wifi_scan()
+     *
+     * @param cb called once per result, possibly from the driver's context
+     * @param env passed to cb
+     */
+    virtual int scan(Scan_result_cb cb, void* env) = 0;
+
+    /**
+     * @brief replaces cyw43_wifi_scan_active()
+     */
+    virtual bool is_scan_active() = 0;
+
+    /**
+     * @brief Request a connection; replaces cyw43_arch_wifi_connect_async()
+     * or, if bssid is not nullptr, cyw43_wifi_join()
+     *
+     * @param ssid the network name
+     * @param pw the passphrase or nullptr for an open network
+     * @param auth the AUTH_xxx value
+     * @param bssid the access point to join or nullptr to let the driver choose
+     * @param channel the access point's channel; ignored if bssid is nullptr
+     */
+    virtual int connect(const char* ssid, const char* pw, uint32_t auth, const uint8_t* bssid, uint32_t channel) = 0;
+
+    /**
+     * @brief Disconnect; replaces cyw43_wifi_leave()
+     */
+    virtual int leave() = 0;
+
+    /**
+     * @brief Set the radio power management mode; replaces cyw43_wifi_pm()
+     *
+     * @param pm PM_NONE, PM_PM1, PM_DEFAULT or another cyw43_pm_value()
+     */
+    virtual int set_power_management(uint32_t pm) = 0;
+
+    /**
+     * @brief Read the RSSI of the link
+     *
+     * @param rssi receives the RSSI in dBm
+     * @return 0 if successful
+     */
+    virtual int get_rssi(int32_t& rssi) = 0;
+
+    /**
+     * @brief Get the station interface IPv4 address in network byte order
+     */
+    virtual uint32_t get_ip_address() = 0;
+
+    /**
+     * @brief Get the station interface gateway IPv4 address in network byte order
+     */
+    virtual uint32_t get_gateway() = 0;
+
+    /**
+     * @brief Get the total bytes received and sent on the station interface
+     *
+     * @param bytes receives the byte count, which may wrap
+     * @return 0 if successful, or -1 if the interface does not count bytes
+     */
+    virtual int get_byte_count(uint32_t& bytes) = 0;
+
+    /**
+     * @brief Start accepting ICMP echo replies from a host; replaces
+     * raw_new(), raw_recv() and raw_bind()
+     *
+     * @param addr the IPv4 address of the host in network byte order
+     * @return 0 if successful, or -1 if lwIP is built without LWIP_RAW or
+     * out of memory
+     */
+    virtual int open_ping(uint32_t addr) = 0;
+
+    /**
+     * @brief Stop accepting ICMP echo replies; replaces raw_remove()
+     */
+    virtual void close_ping() = 0;
+
+    /**
+     * @brief Send an ICMP echo request to the host open_ping() named
+     *
+     * @param seq the sequence number of the request; not 0
+     * @return 0 if sent
+     */
+    virtual int send_ping(uint16_t seq) = 0;
+
+    /**
+     * @brief Get the sequence number of the most recent echo reply, or 0
+     * if none arrived since open_ping()
+     */
+    virtual uint16_t get_ping_reply() = 0;
+
+    /**
+     * @brief Add a host to lwIP's local host list, replacing any address
+     * it had there; replaces dns_local_addhost()
+     *
+     * @param name the host name
+     * @param addr the IPv4 address in network byte order
+     * @return 0 if added, or -1 if lwIP is built without a dynamic local
+     * host list
+     */
+    virtual int add_local_host(const char* name, uint32_t addr) = 0;
+
+    /**
+     * @brief Remove a host from lwIP's local host list; replaces
+     * dns_local_removehost()
+     */
+    virtual void remove_local_host(const char* name) = 0;
+
+    /**
+     * @brief Start resolving a host name; replaces dns_gethostbyname()
+     *
+     * The query skips the local host list, so it asks the DNS server even
+     * for a name add_local_host() added. Only one query may be in
+     * progress; starting another or calling cancel_dns_query() abandons
+     * the previous one.
+     * @param name the host name
+     * @return 0 if the query started, or -1 if it could not
+     */
+    virtual int start_dns_query(const char* name) = 0;
+
+    /**
+     * @brief Check on the query start_dns_query() started
+     *
+     * @param addr receives the IPv4 address in network byte order when
+     * the query is done
+     * @return 1 while the query is in progress, 0 when addr is valid, or
+     * -1 if the query failed or none was started
+     */
+    virtual int poll_dns_query(uint32_t& addr) = 0;
+
+    /**
+     * @brief Abandon the query start_dns_query() started
+     */
+    virtual void cancel_dns_query() = 0;
+
+    /**
+     * @brief Keep scan and lwIP callbacks from running until unlock()
+     *
+     * Calls may nest.
+     */
+    virtual void lock() {}
+    virtual void unlock() {}
+};
+}
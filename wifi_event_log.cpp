@@ -0,0 +1,161 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstdio>
+#include <cstring>
+#include "wifi_event_log.h"
+#include "wifi_driver.h"
+
+static const char* const event_formats[] = {
+#define PICO_W_CM_LOG_EVENT_FORMAT(name_, fmt_) fmt_,
+    PICO_W_CM_LOG_EVENTS(PICO_W_CM_LOG_EVENT_FORMAT)
+#undef PICO_W_CM_LOG_EVENT_FORMAT
+};
+
+rppicomidi::Wifi_event_log& rppicomidi::Wifi_event_log::instance()
+{
+    static Wifi_event_log log;
+    return log;
+}
+
+const char* rppicomidi::Wifi_event_log::get_format(Event event)
+{
+    return event < NUM_EVENTS ? event_formats[event] : "unknown event";
+}
+
+void rppicomidi::Wifi_event_log::push(Level level, Event event, const uintptr_t* args, size_t num_args, size_t copied_arg)
+{
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= RING_SIZE) {
+        dropped_total.store(dropped_total.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    Entry& entry = ring[h & (RING_SIZE - 1)];
+    Wifi_driver* driver = clock.load(std::memory_order_acquire);
+    entry.timestamp_us = driver != nullptr ? driver->timestamp_us() : 0;
+    entry.event = event;
+    entry.level = level;
+    entry.num_args = static_cast<uint8_t>(num_args);
+    memcpy(entry.args, args, sizeof(entry.args));
+    entry.copied_arg = static_cast<uint8_t>(copied_arg);
+    if (copied_arg != 0) {
+        auto str = reinterpret_cast<const char*>(args[copied_arg - 1]);
+        size_t len = 0;
+        if (str != nullptr) {
+            len = strnlen(str, MAX_COPY);
+            memcpy(entry.copy, str, len);
+        }
+        entry.copy[len] = '\0';
+    }
+    head.store(h + 1, std::memory_order_release);
+}
+
+bool rppicomidi::Wifi_event_log::pop(Entry& entry)
+{
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) {
+        return false;
+    }
+    entry = ring[t & (RING_SIZE - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+size_t rppicomidi::Wifi_event_log::format(const Entry& entry, char* buf, size_t buflen)
+{
+    if (buf == nullptr || buflen == 0) {
+        return 0;
+    }
+    static const char level_chars[] = "-EWID";
+    char level_char = entry.level <= LEVEL_DEBUG ? level_chars[entry.level] : '?';
+    int n = snprintf(buf, buflen, "[%lu.%06lu] %c ", static_cast<unsigned long>(entry.timestamp_us / 1000000),
+        static_cast<unsigned long>(entry.timestamp_us % 1000000), level_char);
+    size_t len = n < 0 ? 0 : static_cast<size_t>(n);
+    size_t arg = 0;
+    for (const char* fmt = get_format(entry.event); *fmt != '\0' && len + 1 < buflen; ++fmt) {
+        if (*fmt != '%' || fmt[1] == '\0') {
+            buf[len++] = *fmt;
+            continue;
+        }
+        ++fmt;
+        if (*fmt == '%') {
+            buf[len++] = '%';
+            continue;
+        }
+        uintptr_t value = arg < entry.num_args ? entry.args[arg] : 0;
+        ++arg;
+        switch (*fmt) {
+            case 'd':
+                n = snprintf(buf + len, buflen - len, "%ld", static_cast<long>(static_cast<intptr_t>(value)));
+                break;
+            case 'u':
+                n = snprintf(buf + len, buflen - len, "%lu", static_cast<unsigned long>(value));
+                break;
+            case 'x':
+                n = snprintf(buf + len, buflen - len, "%lx", static_cast<unsigned long>(value));
+                break;
+            case 'c':
+                n = snprintf(buf + len, buflen - len, "%c", static_cast<char>(value));
+                break;
+            case 's':
+                if (arg == entry.copied_arg) {
+                    n = snprintf(buf + len, buflen - len, "%s", entry.copy);
+                }
+                else {
+                    n = snprintf(buf + len, buflen - len, "%s", value != 0 ? reinterpret_cast<const char*>(value) : "(null)");
+                }
+                break;
+            default:
+                n = snprintf(buf + len, buflen - len, "%%%c", *fmt);
+                break;
+        }
+        if (n > 0) {
+            len += static_cast<size_t>(n);
+        }
+    }
+    if (len >= buflen) {
+        len = buflen - 1;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+size_t rppicomidi::Wifi_event_log::drain(size_t max_entries)
+{
+    size_t count = 0;
+    Entry entry;
+    char line[128];
+    while (count < max_entries && pop(entry)) {
+        format(entry, line, sizeof(line));
+        printf("%s\r\n", line);
+        ++count;
+    }
+    uint32_t total = dropped_total.load(std::memory_order_relaxed);
+    uint32_t lost = total - dropped_reported.load(std::memory_order_relaxed);
+    if (lost != 0) {
+        dropped_reported.store(total, std::memory_order_relaxed);
+        printf("[log] %lu entries dropped\r\n", static_cast<unsigned long>(lost));
+    }
+    return count;
+}
@@ -0,0 +1,263 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "pico_w_connection_manager_config.h"
+
+namespace rppicomidi
+{
+class Wifi_driver;
+
+/**
+ * @brief The events the connection manager logs and their format strings
+ *
+ * Each format string may use up to Wifi_event_log::MAX_ARGS conversions.
+ * Only %d, %u, %x, %c and %s are supported. Because entries are formatted
+ * after the logging call returns, a %s argument must either point to a
+ * string that lives for the life of the program (e.g., a literal) or be
+ * wrapped with Wifi_event_log::copy(), which stores up to MAX_COPY
+ * characters of it in the entry. Each entry can hold one copied string.
+ */
+#define PICO_W_CM_LOG_EVENTS(X) \
+    X(COUNTRY_CODE_SET,     "new country code %c%c=%s") \
+    X(COUNTRY_CODE_INVALID, "invalid country code %c%c; using previous code %c%c") \
+    X(SCAN_STARTED,         "Performing wifi scan") \
+    X(SCAN_START_FAILED,    "Failed to start scan: %d") \
+    X(LINK_ERROR,           "Connection error %s") \
+    X(LINK_DEGRADED,        "Link degraded: %s") \
+    X(RECONNECTING,         "Attempting to reconnect") \
+    X(NO_SSID,              "No SSID specified") \
+    X(NO_PASSPHRASE,        "No password specified") \
+    X(CONNECT_REQUESTED,    "Requesting connection to %s") \
+    X(ADAPTIVE_UNAVAILABLE, "ADAPTIVE power profile needs the MIB2_STATS byte counters") \
+    X(BSSID_SELECTED,       "Joining the access point on channel %u (%d dBm)") \
+    X(CONNECT_FAILED,       "failed to connect to %s") \
+    X(SELF_TEST_DONE,       "Self-test: TCP %u bps, UDP echo %u bps, RTT %u us, RSSI %d dBm") \
+    X(DNS_ADDRESS_CHANGED,  "DNS cache address changed (%u refreshes, %u failures)") \
+    X(LOAD_SETTINGS_FAILED, "load settings failed") \
+    X(INITIALIZE_FAILED,    "initialize failed")
+
+/**
+ * @brief Record log events as compact binary entries and format them later
+ *
+ * Logging an event stores an event id, a microsecond time stamp and a
+ * few integer arguments in a lock-free ring buffer; nothing is formatted
+ * and stdio is not touched. Call drain() from a low-priority path (for
+ * example, the main loop after task()) to format and print the entries;
+ * Pico_w_connection_manager::task() drains entries itself only if
+ * set_log_drain_per_task() asks it to. If the ring is full, new entries
+ * are dropped and counted.
+ *
+ * One thread of execution may record entries and one (possibly on the
+ * other core) may drain them.
+ */
+class Wifi_event_log
+{
+public:
+    enum Event : uint16_t {
+#define PICO_W_CM_LOG_EVENT_ENUM(name_, fmt_) name_,
+        PICO_W_CM_LOG_EVENTS(PICO_W_CM_LOG_EVENT_ENUM)
+#undef PICO_W_CM_LOG_EVENT_ENUM
+        NUM_EVENTS
+    };
+
+    enum Level : uint8_t {
+        LEVEL_NONE = PICO_W_CM_LOG_LEVEL_NONE,
+        LEVEL_ERROR = PICO_W_CM_LOG_LEVEL_ERROR,
+        LEVEL_WARN = PICO_W_CM_LOG_LEVEL_WARN,
+        LEVEL_INFO = PICO_W_CM_LOG_LEVEL_INFO,
+        LEVEL_DEBUG = PICO_W_CM_LOG_LEVEL_DEBUG
+    };
+
+    static constexpr size_t MAX_ARGS = 4;
+    static constexpr size_t MAX_COPY = 32;     //!< long enough for an SSID
+
+    /**
+     * @brief A %s argument the log copies when it records the entry
+     */
+    struct Copied_string {
+        const char* str;
+    };
+
+    struct Entry {
+        uint32_t timestamp_us;
+        Event event;
+        Level level;
+        uint8_t num_args;
+        uint8_t copied_arg;             //!< 1 + the index of the argument copied to copy, or 0
+        uintptr_t args[MAX_ARGS];
+        char copy[MAX_COPY + 1];
+    };
+
+    /**
+     * @brief Wrap a %s argument that may change or be freed after the
+     * logging call returns
+     *
+     * @param str the string; only the first MAX_COPY characters are logged
+     */
+    static Copied_string copy(const char* str) { return Copied_string{str}; }
+
+    /**
+     * @brief Get the log all connection manager objects share
+     */
+    static Wifi_event_log& instance();
+
+    /**
+     * @brief Take entry time stamps from a Wi-Fi driver's timestamp_us()
+     *
+     * Entries are stamped 0 until a clock is set. Each connection manager
+     * sets its driver as the clock when it is constructed.
+     * @param driver the driver, or nullptr to stop stamping entries
+     */
+    void set_clock(Wifi_driver* driver) { clock.store(driver, std::memory_order_release); }
+
+    /**
+     * @brief Stop taking time stamps from driver if it is the clock
+     *
+     * Only the thread that calls set_clock() may call this, so it needs
+     * no read-modify-write.
+     */
+    void clear_clock(Wifi_driver* driver)
+    {
+        if (clock.load(std::memory_order_relaxed) == driver) {
+            clock.store(nullptr, std::memory_order_release);
+        }
+    }
+
+    /**
+     * @brief Record an event
+     *
+     * Use the PICO_W_CM_LOG_xxx() macros instead so calls below
+     * PICO_W_CM_LOG_LEVEL compile out.
+     * @param level the severity of the event
+     * @param event the event id
+     * @param args up to MAX_ARGS integer, character or static string arguments
+     */
+    template <typename... Args>
+    void record(Level level, Event event, Args... args)
+    {
+        static_assert(sizeof...(Args) <= MAX_ARGS, "too many log arguments");
+        static_assert((0 + ... + std::is_same<Args, Copied_string>::value) <= 1, "only one copied string per entry");
+        uintptr_t packed[MAX_ARGS] = {to_arg(args)...};
+        size_t copied_arg = 0;
+        size_t idx = 0;
+        ((++idx, copied_arg = std::is_same<Args, Copied_string>::value ? idx : copied_arg), ...);
+        push(level, event, packed, sizeof...(Args), copied_arg);
+    }
+
+    /**
+     * @brief Remove the oldest entry from the ring
+     *
+     * @param entry receives the entry
+     * @return true if an entry was removed, false if the ring is empty
+     */
+    bool pop(Entry& entry);
+
+    /**
+     * @brief Format an entry as one line of text
+     *
+     * The line has the form "[<seconds>.<microseconds>] <L> <message>"
+     * where L is E, W, I or D, and is always null terminated.
+     * @param entry the entry to format
+     * @param buf the output buffer
+     * @param buflen the number of bytes in buf
+     * @return the number of characters written, not counting the terminator
+     */
+    static size_t format(const Entry& entry, char* buf, size_t buflen);
+
+    /**
+     * @brief Format and print up to max_entries of the oldest entries
+     *
+     * @param max_entries the maximum number of entries to print; use a
+     * small number to bound the time this takes
+     * @return the number of entries printed
+     */
+    size_t drain(size_t max_entries = SIZE_MAX);
+
+    /**
+     * @brief Get the number of entries dropped because the ring was full
+     * that drain() has not reported yet
+     */
+    uint32_t get_dropped() const
+    {
+        return dropped_total.load(std::memory_order_relaxed) - dropped_reported.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the format string of an event
+     */
+    static const char* get_format(Event event);
+private:
+    Wifi_event_log() : clock{nullptr}, head{0}, tail{0}, dropped_total{0}, dropped_reported{0} {}
+    Wifi_event_log(Wifi_event_log const&) = delete;
+    void operator=(Wifi_event_log const&) = delete;
+
+    static uintptr_t to_arg(int value) { return static_cast<uintptr_t>(static_cast<intptr_t>(value)); }
+    static uintptr_t to_arg(unsigned value) { return value; }
+    static uintptr_t to_arg(long value) { return static_cast<uintptr_t>(static_cast<intptr_t>(value)); }
+    static uintptr_t to_arg(unsigned long value) { return static_cast<uintptr_t>(value); }
+    static uintptr_t to_arg(char value) { return static_cast<unsigned char>(value); }
+    static uintptr_t to_arg(const char* value) { return reinterpret_cast<uintptr_t>(value); }
+    static uintptr_t to_arg(Copied_string value) { return reinterpret_cast<uintptr_t>(value.str); }
+    void push(Level level, Event event, const uintptr_t* args, size_t num_args, size_t copied_arg);
+
+    static constexpr uint32_t RING_SIZE = PICO_W_CM_LOG_ENTRIES;
+    static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "PICO_W_CM_LOG_ENTRIES must be a power of 2");
+    Entry ring[RING_SIZE];
+    // Only loads and stores, like Seqlock, so the RP2040 needs no
+    // library lock helpers
+    std::atomic<Wifi_driver*> clock;
+    std::atomic<uint32_t> head;     // next entry to write; only the producer stores
+    std::atomic<uint32_t> tail;     // next entry to read; only the consumer stores
+    std::atomic<uint32_t> dropped_total;    // only the producer stores
+    std::atomic<uint32_t> dropped_reported; // only the consumer stores
+};
+}
+
+// Calls below PICO_W_CM_LOG_LEVEL compile out; the if (0) keeps the
+// arguments "used" so compiling them out does not cause warnings
+#if PICO_W_CM_LOG_LEVEL >= PICO_W_CM_LOG_LEVEL_ERROR
+#define PICO_W_CM_LOG_ERROR(event_, ...) rppicomidi::Wifi_event_log::instance().record(rppicomidi::Wifi_event_log::LEVEL_ERROR, rppicomidi::Wifi_event_log::event_, ##__VA_ARGS__)
+#else
+#define PICO_W_CM_LOG_ERROR(event_, ...) do { if (0) rppicomidi::Wifi_event_log::instance().record(rppicomidi::Wifi_event_log::LEVEL_ERROR, rppicomidi::Wifi_event_log::event_, ##__VA_ARGS__); } while (0)
+#endif
+#if PICO_W_CM_LOG_LEVEL >= PICO_W_CM_LOG_LEVEL_WARN
+#define PICO_W_CM_LOG_WARN(event_, ...) rppicomidi::Wifi_event_log::instance().record(rppicomidi::Wifi_event_log::LEVEL_WARN, rppicomidi::Wifi_event_log::event_, ##__VA_ARGS__)
+#else
+#define PICO_W_CM_LOG_WARN(event_, ...) do { if (0) rppicomidi::Wifi_event_log::instance().record(rppicomidi::Wifi_event_log::LEVEL_WARN, rppicomidi::Wifi_event_log::event_, ##__VA_ARGS__); } while (0)
+#endif
+#if PICO_W_CM_LOG_LEVEL >= PICO_W_CM_LOG_LEVEL_INFO
+#define PICO_W_CM_LOG_INFO(event_, ...) rppicomidi::Wifi_event_log::instance().record(rppicomidi::Wifi_event_log::LEVEL_INFO, rppicomidi::Wifi_event_log::event_, ##__VA_ARGS__)
+#else
+#define PICO_W_CM_LOG_INFO(event_, ...) do { if (0) rppicomidi::Wifi_event_log::instance().record(rppicomidi::Wifi_event_log::LEVEL_INFO, rppicomidi::Wifi_event_log::event_, ##__VA_ARGS__); } while (0)
+#endif
+#if PICO_W_CM_LOG_LEVEL >= PICO_W_CM_LOG_LEVEL_DEBUG
+#define PICO_W_CM_LOG_DEBUG(event_, ...) rppicomidi::Wifi_event_log::instance().record(rppicomidi::Wifi_event_log::LEVEL_DEBUG, rppicomidi::Wifi_event_log::event_, ##__VA_ARGS__)
+#else
+#define PICO_W_CM_LOG_DEBUG(event_, ...) do { if (0) rppicomidi::Wifi_event_log::instance().record(rppicomidi::Wifi_event_log::LEVEL_DEBUG, rppicomidi::Wifi_event_log::event_, ##__VA_ARGS__); } while (0)
+#endif
@@ -0,0 +1,370 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cinttypes>
+#include <climits>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include "wifi_metrics_server.h"
+#include "pico/cyw43_arch.h"
+#if LWIP_TCP
+#include "lwip/tcp.h"
+#endif
+
+namespace
+{
+const char* const state_names[rppicomidi::Pico_w_connection_manager::NUM_WIFI_STATES] = {
+    "deinitialized", "initialized", "scan_requested", "scanning", "scan_complete", "connection_requested", "connected"
+};
+const char* const error_names[rppicomidi::Pico_w_connection_manager::NUM_LINK_ERRORS] = {
+    "none", "badauth", "nonet", "fail", "unknown", "gateway"
+};
+const char http_header[] = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n\r\n";
+const uint8_t poll_interval = 4;    // in units of 500 ms
+const uint8_t max_idle_polls = 2;
+
+struct Writer {
+    char* buffer;
+    size_t size;
+    size_t len;
+    bool overflow;
+
+    void append(const char* fmt, ...)
+    {
+        if (overflow) {
+            return;
+        }
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(buffer + len, size - len, fmt, args);
+        va_end(args);
+        if (n < 0 || static_cast<size_t>(n) >= size - len) {
+            overflow = true;
+        }
+        else {
+            len += static_cast<size_t>(n);
+        }
+    }
+
+    void type(const char* name, const char* kind) { append("# TYPE pico_w_%s %s\n", name, kind); }
+
+    void metric(const char* name, const char* kind, uint64_t value)
+    {
+        type(name, kind);
+        append("pico_w_%s %" PRIu64 "\n", name, value);
+    }
+
+    // microseconds or milliseconds as seconds with a fraction
+    void seconds(const char* name, const char* kind, uint64_t value, uint32_t per_second)
+    {
+        type(name, kind);
+        append(per_second == 1000 ? "pico_w_%s %" PRIu64 ".%03" PRIu64 "\n" : "pico_w_%s %" PRIu64 ".%06" PRIu64 "\n",
+            name, value / per_second, value % per_second);
+    }
+};
+}
+
+rppicomidi::Wifi_metrics_server::Wifi_metrics_server(const Pico_w_connection_manager& manager_) :
+    manager{manager_}, listener{nullptr}, client{nullptr}, response_len{0}, response_sent{0}, idle_polls{0},
+    scrapes{0}, rejected{0}
+{
+    response[0] = '\0';
+}
+
+rppicomidi::Wifi_metrics_server::~Wifi_metrics_server()
+{
+    stop();
+}
+
+size_t rppicomidi::Wifi_metrics_server::render(const Pico_w_connection_manager::Status_snapshot& status, char* buffer, size_t size)
+{
+    if (size == 0) {
+        return 0;
+    }
+    Writer out{buffer, size, 0, false};
+    out.seconds("uptime_seconds", "gauge", status.timestamp_ms, 1000);
+    out.type("info", "gauge");
+    out.append("pico_w_info{ssid=\"");
+    for (const char* ch = status.ssid; *ch != '\0'; ch++) {
+        if (*ch == '\\' || *ch == '"') {
+            out.append("\\%c", *ch);
+        }
+        else if (*ch == '\n') {
+            out.append("\\n");
+        }
+        else {
+            out.append("%c", *ch);
+        }
+    }
+    out.append("\"} 1\n");
+    out.type("state", "gauge");
+    out.append("pico_w_state{state=\"%s\"} 1\n", state_names[status.state]);
+    out.metric("state_transitions_total", "counter", status.state_changes);
+    out.type("state_entries_total", "counter");
+    for (int state = 0; state < Pico_w_connection_manager::NUM_WIFI_STATES; state++) {
+        out.append("pico_w_state_entries_total{state=\"%s\"} %" PRIu32 "\n", state_names[state], status.state_entries[state]);
+    }
+    out.metric("link_ups_total", "counter", status.link_ups);
+    out.metric("link_downs_total", "counter", status.link_downs);
+    out.type("link_errors_total", "counter");
+    for (int error = Pico_w_connection_manager::LINK_ERROR_BADAUTH; error < Pico_w_connection_manager::NUM_LINK_ERRORS; error++) {
+        out.append("pico_w_link_errors_total{error=\"%s\"} %" PRIu32 "\n", error_names[error], status.errors_by_type[error]);
+    }
+    out.metric("reconnects_total", "counter", status.reconnects);
+    out.metric("scans_total", "counter", status.scans);
+    if (status.rssi != INT_MIN) {
+        out.type("rssi_dbm", "gauge");
+        out.append("pico_w_rssi_dbm %d\n", status.rssi);
+    }
+    out.seconds("link_uptime_seconds", "gauge", status.link_uptime_ms, 1000);
+    out.seconds("link_uptime_seconds_total", "counter", status.total_link_uptime_ms, 1000);
+    out.metric("settings_saves_total", "counter", status.settings_saves);
+    out.metric("settings_save_failures_total", "counter", status.settings_save_failures);
+    out.seconds("settings_save_seconds_total", "counter", status.settings_save_us, 1000000);
+    out.seconds("settings_save_seconds_max", "gauge", status.max_settings_save_us, 1000000);
+    if (out.overflow) {
+        buffer[0] = '\0';
+        return 0;
+    }
+    return out.len;
+}
+
+bool rppicomidi::Wifi_metrics_server::start(uint16_t port)
+{
+    stop();
+#if LWIP_TCP
+    cyw43_arch_lwip_begin();
+    struct tcp_pcb* pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+    if (pcb != nullptr) {
+        if (tcp_bind(pcb, IP_ANY_TYPE, port) == ERR_OK) {
+            // tcp_listen frees pcb whether or not it succeeds
+            listener = tcp_listen_with_backlog(pcb, 1);
+        }
+        else {
+            tcp_close(pcb);
+        }
+    }
+    if (listener != nullptr) {
+        tcp_arg(listener, this);
+        tcp_accept(listener, static_accept);
+    }
+    cyw43_arch_lwip_end();
+    return listener != nullptr;
+#else
+    (void)port;
+    return false;
+#endif
+}
+
+void rppicomidi::Wifi_metrics_server::stop()
+{
+#if LWIP_TCP
+    cyw43_arch_lwip_begin();
+    close_client(true);
+    if (listener != nullptr) {
+        tcp_arg(listener, nullptr);
+        tcp_accept(listener, nullptr);
+        tcp_close(listener);
+        listener = nullptr;
+    }
+    cyw43_arch_lwip_end();
+#endif
+}
+
+bool rppicomidi::Wifi_metrics_server::respond(struct tcp_pcb* pcb)
+{
+    Pico_w_connection_manager::Status_snapshot status;
+    manager.get_status_snapshot(status);
+    size_t header_len = sizeof(http_header) - 1;
+    memcpy(response, http_header, header_len);
+    size_t body_len = render(status, response + header_len, sizeof(response) - header_len);
+    if (body_len == 0) {
+        ++rejected;
+        return close_client(true);
+    }
+    response_len = header_len + body_len;
+    response_sent = 0;
+    ++scrapes;
+    return send_more(pcb);
+}
+
+bool rppicomidi::Wifi_metrics_server::send_more(struct tcp_pcb* pcb)
+{
+#if LWIP_TCP
+    while (response_sent < response_len) {
+        size_t len = response_len - response_sent;
+        uint16_t space = tcp_sndbuf(pcb);
+        if (space == 0) {
+            break;
+        }
+        if (len > space) {
+            len = space;
+        }
+        uint8_t flags = TCP_WRITE_FLAG_COPY | (response_sent + len < response_len ? TCP_WRITE_FLAG_MORE : 0);
+        err_t err = tcp_write(pcb, response + response_sent, static_cast<uint16_t>(len), flags);
+        if (err == ERR_MEM) {
+            break; // try again when some data is acknowledged
+        }
+        if (err != ERR_OK) {
+            return close_client(true);
+        }
+        response_sent += len;
+    }
+    tcp_output(pcb);
+    if (response_sent == response_len) {
+        // tcp_close() sends the queued data before the FIN
+        return close_client(false);
+    }
+#else
+    (void)pcb;
+#endif
+    return false;
+}
+
+bool rppicomidi::Wifi_metrics_server::close_client(bool abort)
+{
+    bool aborted = false;
+#if LWIP_TCP
+    if (client != nullptr) {
+        tcp_arg(client, nullptr);
+        tcp_recv(client, nullptr);
+        tcp_sent(client, nullptr);
+        tcp_poll(client, nullptr, 0);
+        tcp_err(client, nullptr);
+        if (abort || tcp_close(client) != ERR_OK) {
+            tcp_abort(client);
+            aborted = true;
+        }
+        client = nullptr;
+    }
+#else
+    (void)abort;
+#endif
+    response_len = 0;
+    response_sent = 0;
+    return aborted;
+}
+
+int8_t rppicomidi::Wifi_metrics_server::static_accept(void* arg, struct tcp_pcb* pcb, int8_t err)
+{
+#if LWIP_TCP
+    auto me = reinterpret_cast<Wifi_metrics_server*>(arg);
+    if (me == nullptr || err != ERR_OK || pcb == nullptr) {
+        return ERR_VAL;
+    }
+    if (me->client != nullptr) {
+        ++me->rejected;
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    me->client = pcb;
+    me->response_len = 0;
+    me->response_sent = 0;
+    me->idle_polls = 0;
+    tcp_arg(pcb, me);
+    tcp_recv(pcb, static_recv);
+    tcp_sent(pcb, static_sent);
+    tcp_poll(pcb, static_poll, poll_interval);
+    tcp_err(pcb, static_err);
+    return ERR_OK;
+#else
+    (void)arg;
+    (void)pcb;
+    (void)err;
+    return -1;
+#endif
+}
+
+int8_t rppicomidi::Wifi_metrics_server::static_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, int8_t err)
+{
+#if LWIP_TCP
+    auto me = reinterpret_cast<Wifi_metrics_server*>(arg);
+    if (p == nullptr) {
+        // The client closed its end. If it did so right after sending
+        // the request, it can still receive the rest of the response;
+        // send_more() closes the connection when all of it is queued.
+        if (me->response_len != 0) {
+            return ERR_OK;
+        }
+        return me->close_client(false) ? ERR_ABRT : ERR_OK;
+    }
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+    if (err != ERR_OK) {
+        return me->close_client(true) ? ERR_ABRT : ERR_OK;
+    }
+    me->idle_polls = 0;
+    if (me->response_len == 0 && me->respond(pcb)) {
+        return ERR_ABRT;
+    }
+    return ERR_OK;
+#else
+    (void)arg;
+    (void)pcb;
+    (void)p;
+    (void)err;
+    return -1;
+#endif
+}
+
+int8_t rppicomidi::Wifi_metrics_server::static_sent(void* arg, struct tcp_pcb* pcb, uint16_t)
+{
+#if LWIP_TCP
+    auto me = reinterpret_cast<Wifi_metrics_server*>(arg);
+    me->idle_polls = 0;
+    return me->send_more(pcb) ? ERR_ABRT : ERR_OK;
+#else
+    (void)arg;
+    (void)pcb;
+    return -1;
+#endif
+}
+
+int8_t rppicomidi::Wifi_metrics_server::static_poll(void* arg, struct tcp_pcb*)
+{
+#if LWIP_TCP
+    auto me = reinterpret_cast<Wifi_metrics_server*>(arg);
+    if (++me->idle_polls >= max_idle_polls) {
+        ++me->rejected;
+        me->close_client(true);
+        return ERR_ABRT;
+    }
+    return ERR_OK;
+#else
+    (void)arg;
+    return -1;
+#endif
+}
+
+void rppicomidi::Wifi_metrics_server::static_err(void* arg, int8_t)
+{
+    auto me = reinterpret_cast<Wifi_metrics_server*>(arg);
+    if (me != nullptr) {
+        // lwIP already freed the pcb
+        me->client = nullptr;
+        me->response_len = 0;
+        me->response_sent = 0;
+    }
+}
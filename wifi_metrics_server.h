@@ -0,0 +1,124 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "pico_w_connection_manager.h"
+
+struct tcp_pcb;
+struct pbuf;
+namespace rppicomidi
+{
+/**
+ * @brief Serve the connection manager's counters and gauges to a
+ * monitoring system
+ *
+ * The server listens on a TCP port. When a client such as Prometheus or
+ * curl sends a request, the server renders the most recent status
+ * snapshot in the Prometheus text exposition format into a fixed buffer
+ * of PICO_W_CM_METRICS_BUFFER_SIZE bytes, sends it as an HTTP/1.0
+ * response and closes the connection. It serves one client at a time
+ * and refuses others while it is busy. The request itself is not parsed.
+ *
+ * render() does not need lwIP, so it can run on any host.
+ *
+ * @note requires LWIP_TCP in the application's lwipopts.h. If LWIP_TCP
+ * is 0, start() always fails.
+ */
+class Wifi_metrics_server
+{
+public:
+    static constexpr uint16_t DEFAULT_PORT = 9100;
+
+    /**
+     * @brief Construct a server for a connection manager
+     *
+     * @param manager_ the connection manager; must outlive this object
+     */
+    Wifi_metrics_server(const Pico_w_connection_manager& manager_);
+    ~Wifi_metrics_server();
+    Wifi_metrics_server(Wifi_metrics_server const&) = delete;
+    void operator=(Wifi_metrics_server const&) = delete;
+
+    /**
+     * @brief Start listening for clients
+     *
+     * The listener does not depend on the link being up, so call this once.
+     * @param port the TCP port to listen on
+     * @return true if listening, false if the lwIP resources could not be allocated
+     */
+    bool start(uint16_t port = DEFAULT_PORT);
+
+    /**
+     * @brief Stop listening and drop the client, if any
+     */
+    void stop();
+
+    /**
+     * @brief return true if the server is listening
+     */
+    bool is_running() const { return listener != nullptr; }
+
+    /**
+     * @brief Get the number of responses served
+     */
+    uint32_t get_scrapes() const { return scrapes; }
+
+    /**
+     * @brief Get the number of clients refused or dropped because the
+     * server was busy, the client was idle too long or the response did
+     * not fit in the buffer
+     */
+    uint32_t get_rejected() const { return rejected; }
+
+    /**
+     * @brief Render a status snapshot in the Prometheus text exposition format
+     *
+     * @param status the snapshot
+     * @param buffer the buffer to receive the text; it is NUL terminated
+     * @param size the size of the buffer in bytes
+     * @return size_t the length of the text or 0 if it does not fit
+     */
+    static size_t render(const Pico_w_connection_manager::Status_snapshot& status, char* buffer, size_t size);
+private:
+    bool respond(struct tcp_pcb* pcb);
+    bool send_more(struct tcp_pcb* pcb);
+    bool close_client(bool abort);
+    static int8_t static_accept(void* arg, struct tcp_pcb* pcb, int8_t err);
+    static int8_t static_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, int8_t err);
+    static int8_t static_sent(void* arg, struct tcp_pcb* pcb, uint16_t len);
+    static int8_t static_poll(void* arg, struct tcp_pcb* pcb);
+    static void static_err(void* arg, int8_t err);
+    const Pico_w_connection_manager& manager;
+    struct tcp_pcb* listener;
+    struct tcp_pcb* client;
+    size_t response_len;                // 0 until the client sends its request
+    size_t response_sent;
+    uint8_t idle_polls;
+    uint32_t scrapes;
+    uint32_t rejected;
+    char response[PICO_W_CM_METRICS_BUFFER_SIZE];
+};
+}
@@ -0,0 +1,114 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include "wifi_power_governor.h"
+
+rppicomidi::Wifi_power_governor::Wifi_power_governor() :
+    config{64000, 8000, 25, 5000, 1000}, active{BALANCED}, accounting{false},
+    active_since_ms{0}, last_switch_ms{0}, sample_start_ms{0}, sample_start_bytes{0},
+    last_rate_bps{0}, time_in_profile_ms{0, 0, 0}
+{
+}
+
+void rppicomidi::Wifi_power_governor::restart_sampling(uint32_t total_bytes, uint32_t now_ms)
+{
+    sample_start_bytes = total_bytes;
+    sample_start_ms = now_ms;
+    last_rate_bps = 0;
+}
+
+rppicomidi::Wifi_power_governor::Power_profile rppicomidi::Wifi_power_governor::classify(uint32_t rate_bps) const
+{
+    uint64_t rate_pct = static_cast<uint64_t>(rate_bps) * 100;
+    uint32_t down_pct = config.hysteresis_pct < 100 ? 100 - config.hysteresis_pct : 0;
+    uint32_t up_pct = 100 + config.hysteresis_pct;
+    // Leaving either extreme profile requires the rate to move past the
+    // threshold by the hysteresis margin
+    if (active == LOWEST_LATENCY && rate_pct >= static_cast<uint64_t>(config.latency_threshold_bps) * down_pct) {
+        return LOWEST_LATENCY;
+    }
+    if (active == LOWEST_POWER && rate_pct <= static_cast<uint64_t>(config.power_threshold_bps) * up_pct) {
+        return LOWEST_POWER;
+    }
+    if (rate_bps >= config.latency_threshold_bps) {
+        return LOWEST_LATENCY;
+    }
+    if (rate_bps <= config.power_threshold_bps) {
+        return LOWEST_POWER;
+    }
+    return BALANCED;
+}
+
+rppicomidi::Wifi_power_governor::Power_profile rppicomidi::Wifi_power_governor::update(uint32_t total_bytes, uint32_t now_ms)
+{
+    uint32_t elapsed = now_ms - sample_start_ms;
+    if (elapsed < config.sample_period_ms || elapsed == 0) {
+        return active;
+    }
+    uint64_t bits = static_cast<uint64_t>(total_bytes - sample_start_bytes) * 8;
+    last_rate_bps = static_cast<uint32_t>(bits * 1000 / elapsed);
+    sample_start_bytes = total_bytes;
+    sample_start_ms = now_ms;
+    Power_profile wanted = classify(last_rate_bps);
+    if (wanted != active && (now_ms - last_switch_ms) >= config.min_dwell_ms) {
+        return wanted;
+    }
+    return active;
+}
+
+void rppicomidi::Wifi_power_governor::set_active(Power_profile profile, uint32_t now_ms)
+{
+    if (profile >= NUM_PROFILES) {
+        return;
+    }
+    if (accounting) {
+        time_in_profile_ms[active] += now_ms - active_since_ms;
+    }
+    if (profile != active) {
+        last_switch_ms = now_ms;
+    }
+    active = profile;
+    active_since_ms = now_ms;
+    accounting = true;
+}
+
+void rppicomidi::Wifi_power_governor::stop_accounting(uint32_t now_ms)
+{
+    if (accounting) {
+        time_in_profile_ms[active] += now_ms - active_since_ms;
+        accounting = false;
+    }
+}
+
+uint32_t rppicomidi::Wifi_power_governor::get_time_in_profile_ms(Power_profile profile, uint32_t now_ms) const
+{
+    if (profile >= NUM_PROFILES) {
+        return 0;
+    }
+    uint32_t result = time_in_profile_ms[profile];
+    if (accounting && profile == active) {
+        result += now_ms - active_since_ms;
+    }
+    return result;
+}
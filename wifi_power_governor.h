@@ -0,0 +1,142 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstdint>
+
+namespace rppicomidi
+{
+/**
+ * @brief Chooses a Wi-Fi radio power management profile
+ *
+ * This class only makes decisions and keeps statistics. It does not
+ * talk to the Wi-Fi driver, so it can run on any host. The caller
+ * feeds it the total byte count of the network interface and the
+ * current time, and applies whatever profile it returns.
+ */
+class Wifi_power_governor
+{
+public:
+    /**
+     * @brief The power management profiles
+     */
+    enum Power_profile {
+        LOWEST_LATENCY, //!< power save off; radio always listening
+        BALANCED,       //!< the CYW43 driver default power save mode
+        LOWEST_POWER,   //!< aggressive power save; radio sleeps between beacons
+        ADAPTIVE,       //!< not a radio mode: switch between the other 3 based on traffic
+    };
+    static const int NUM_PROFILES = ADAPTIVE; //!< number of profiles the radio can actually be in
+
+    /**
+     * @brief Thresholds for the ADAPTIVE profile
+     */
+    struct Config {
+        uint32_t latency_threshold_bps; //!< traffic rate at or above which LOWEST_LATENCY is selected
+        uint32_t power_threshold_bps;   //!< traffic rate at or below which LOWEST_POWER is selected
+        uint32_t hysteresis_pct;        //!< percent a rate must move past a threshold to leave the current profile
+        uint32_t min_dwell_ms;          //!< minimum time to stay in a profile before switching again
+        uint32_t sample_period_ms;      //!< how often to compute the traffic rate
+    };
+
+    Wifi_power_governor();
+
+    /**
+     * @brief Set the adaptive switching thresholds
+     *
+     * @param config_ the new thresholds
+     */
+    void set_config(const Config& config_) { config = config_; }
+
+    /**
+     * @brief Get the adaptive switching thresholds
+     */
+    const Config& get_config() const { return config; }
+
+    /**
+     * @brief Restart adaptive rate measurement
+     *
+     * Call this when the link comes up so the first rate sample does not
+     * include traffic from a previous connection.
+     * @param total_bytes the current interface byte counter
+     * @param now_ms the current time in milliseconds
+     */
+    void restart_sampling(uint32_t total_bytes, uint32_t now_ms);
+
+    /**
+     * @brief compute the profile the ADAPTIVE mode wants right now
+     *
+     * @param total_bytes the current interface byte counter (may wrap)
+     * @param now_ms the current time in milliseconds
+     * @return Power_profile the profile to apply; it is the active profile
+     * if no switch is necessary
+     */
+    Power_profile update(uint32_t total_bytes, uint32_t now_ms);
+
+    /**
+     * @brief Tell the governor which profile the radio is in now
+     *
+     * @param profile one of LOWEST_LATENCY, BALANCED or LOWEST_POWER
+     * @param now_ms the current time in milliseconds
+     */
+    void set_active(Power_profile profile, uint32_t now_ms);
+
+    /**
+     * @brief Stop accumulating time in the active profile because the radio is off
+     *
+     * @param now_ms the current time in milliseconds
+     */
+    void stop_accounting(uint32_t now_ms);
+
+    /**
+     * @brief Get the profile the radio is in
+     */
+    Power_profile get_active() const { return active; }
+
+    /**
+     * @brief Get the most recently measured traffic rate
+     */
+    uint32_t get_last_rate_bps() const { return last_rate_bps; }
+
+    /**
+     * @brief Get the total time the radio has spent in profile
+     *
+     * @param profile one of LOWEST_LATENCY, BALANCED or LOWEST_POWER
+     * @param now_ms the current time in milliseconds
+     * @return uint32_t the time in milliseconds
+     */
+    uint32_t get_time_in_profile_ms(Power_profile profile, uint32_t now_ms) const;
+private:
+    Power_profile classify(uint32_t rate_bps) const;
+    Config config;
+    Power_profile active;
+    bool accounting;
+    uint32_t active_since_ms;
+    uint32_t last_switch_ms;
+    uint32_t sample_start_ms;
+    uint32_t sample_start_bytes;
+    uint32_t last_rate_bps;
+    uint32_t time_in_profile_ms[NUM_PROFILES];
+};
+}
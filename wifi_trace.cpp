@@ -0,0 +1,672 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#include <cstring>
+#include "wifi_trace.h"
+
+static const uint8_t trace_magic[4] = {'P', 'W', 'T', 'R'};
+
+class rppicomidi::Wifi_trace_recorder::Record
+{
+public:
+    explicit Record(Wifi_trace::Op op) : len{0} { put_byte(op); }
+    void put_byte(uint8_t value)
+    {
+        if (len < sizeof(data)) {
+            data[len++] = value;
+        }
+    }
+    void put_bytes(const uint8_t* value, size_t nbytes)
+    {
+        for (size_t idx = 0; idx < nbytes; idx++) {
+            put_byte(value[idx]);
+        }
+    }
+    void put_varint(uint32_t value)
+    {
+        while (value >= 0x80) {
+            put_byte(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        put_byte(static_cast<uint8_t>(value));
+    }
+    void put_signed(int32_t value)
+    {
+        put_varint((static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31));
+    }
+    uint8_t data[Wifi_trace::MAX_RECORD_LEN];
+    size_t len;
+};
+
+rppicomidi::Wifi_trace_recorder::Wifi_trace_recorder(Wifi_driver& inner_, Sink sink_, void* context_) :
+    inner{inner_}, sink{sink_}, context{context_}, header_written{false}, last_now{0}, bytes_written{0},
+    scan_cb{nullptr}, scan_env{nullptr}
+{
+}
+
+void rppicomidi::Wifi_trace_recorder::emit(const Record& record)
+{
+    // the scan callback may record from the driver's context
+    inner.lock();
+    if (!header_written) {
+        uint8_t header[Wifi_trace::HEADER_LEN];
+        memcpy(header, trace_magic, sizeof(trace_magic));
+        header[4] = Wifi_trace::VERSION;
+        sink(context, header, sizeof(header));
+        bytes_written += sizeof(header);
+        header_written = true;
+    }
+    sink(context, record.data, record.len);
+    bytes_written += record.len;
+    inner.unlock();
+}
+
+uint32_t rppicomidi::Wifi_trace_recorder::now_ms()
+{
+    uint32_t now = inner.now_ms();
+    Record record(Wifi_trace::OP_NOW);
+    record.put_varint(now - last_now);
+    last_now = now;
+    emit(record);
+    return now;
+}
+
+int rppicomidi::Wifi_trace_recorder::init(uint32_t country_code)
+{
+    int result = inner.init(country_code);
+    Record record(Wifi_trace::OP_INIT);
+    record.put_varint(country_code);
+    record.put_signed(result);
+    emit(record);
+    return result;
+}
+
+void rppicomidi::Wifi_trace_recorder::deinit()
+{
+    inner.deinit();
+    emit(Record(Wifi_trace::OP_DEINIT));
+}
+
+void rppicomidi::Wifi_trace_recorder::enable_sta_mode()
+{
+    inner.enable_sta_mode();
+    emit(Record(Wifi_trace::OP_ENABLE_STA));
+}
+
+uint32_t rppicomidi::Wifi_trace_recorder::get_country_code()
+{
+    uint32_t result = inner.get_country_code();
+    Record record(Wifi_trace::OP_GET_COUNTRY);
+    record.put_varint(result);
+    emit(record);
+    return result;
+}
+
+int rppicomidi::Wifi_trace_recorder::link_status()
+{
+    int result = inner.link_status();
+    Record record(Wifi_trace::OP_LINK_STATUS);
+    record.put_signed(result);
+    emit(record);
+    return result;
+}
+
+int rppicomidi::Wifi_trace_recorder::scan(Scan_result_cb cb, void* env)
+{
+    // hold off results until the scan call itself is recorded
+    inner.lock();
+    scan_cb = cb;
+    scan_env = env;
+    int result = inner.scan(static_scan_result, this);
+    Record record(Wifi_trace::OP_SCAN);
+    record.put_signed(result);
+    emit(record);
+    inner.unlock();
+    return result;
+}
+
+int rppicomidi::Wifi_trace_recorder::static_scan_result(void* env, const Scan_result* result)
+{
+    auto me = reinterpret_cast<Wifi_trace_recorder*>(env);
+    if (result != nullptr) {
+        uint8_t ssid_len = result->ssid_len <= sizeof(result->ssid) ? result->ssid_len : sizeof(result->ssid);
+        Record record(Wifi_trace::OP_SCAN_RESULT);
+        record.put_bytes(result->bssid, sizeof(result->bssid));
+        record.put_byte(ssid_len);
+        record.put_bytes(result->ssid, ssid_len);
+        record.put_varint(result->channel);
+        record.put_byte(result->auth_mode);
+        record.put_signed(result->rssi);
+        me->emit(record);
+    }
+    return me->scan_cb != nullptr ? me->scan_cb(me->scan_env, result) : 0;
+}
+
+bool rppicomidi::Wifi_trace_recorder::is_scan_active()
+{
+    bool result = inner.is_scan_active();
+    Record record(Wifi_trace::OP_SCAN_ACTIVE);
+    record.put_byte(result ? 1 : 0);
+    emit(record);
+    return result;
+}
+
+int rppicomidi::Wifi_trace_recorder::connect(const char* ssid, const char* pw, uint32_t auth, const uint8_t* bssid, uint32_t channel)
+{
+    int result = inner.connect(ssid, pw, auth, bssid, channel);
+    Record record(Wifi_trace::OP_CONNECT);
+    if (bssid != nullptr) {
+        record.put_byte(1);
+        record.put_bytes(bssid, 6);
+    }
+    else {
+        record.put_byte(0);
+    }
+    record.put_signed(result);
+    emit(record);
+    return result;
+}
+
+int rppicomidi::Wifi_trace_recorder::leave()
+{
+    int result = inner.leave();
+    Record record(Wifi_trace::OP_LEAVE);
+    record.put_signed(result);
+    emit(record);
+    return result;
+}
+
+int rppicomidi::Wifi_trace_recorder::set_power_management(uint32_t pm)
+{
+    int result = inner.set_power_management(pm);
+    Record record(Wifi_trace::OP_SET_PM);
+    record.put_varint(pm);
+    record.put_signed(result);
+    emit(record);
+    return result;
+}
+
+int rppicomidi::Wifi_trace_recorder::get_rssi(int32_t& rssi)
+{
+    int result = inner.get_rssi(rssi);
+    Record record(Wifi_trace::OP_GET_RSSI);
+    record.put_signed(result);
+    record.put_signed(rssi);
+    emit(record);
+    return result;
+}
+
+uint32_t rppicomidi::Wifi_trace_recorder::get_ip_address()
+{
+    uint32_t result = inner.get_ip_address();
+    Record record(Wifi_trace::OP_GET_IP);
+    record.put_varint(result);
+    emit(record);
+    return result;
+}
+
+uint32_t rppicomidi::Wifi_trace_recorder::get_gateway()
+{
+    uint32_t result = inner.get_gateway();
+    Record record(Wifi_trace::OP_GET_GATEWAY);
+    record.put_varint(result);
+    emit(record);
+    return result;
+}
+
+int rppicomidi::Wifi_trace_recorder::get_byte_count(uint32_t& bytes)
+{
+    int result = inner.get_byte_count(bytes);
+    Record record(Wifi_trace::OP_GET_BYTES);
+    record.put_signed(result);
+    record.put_varint(bytes);
+    emit(record);
+    return result;
+}
+
+uint32_t rppicomidi::Wifi_trace_recorder::timestamp_us()
+{
+    return inner.timestamp_us();
+}
+
+uint32_t rppicomidi::Wifi_trace_recorder::observe(uint32_t value)
+{
+    value = inner.observe(value);
+    Record record(Wifi_trace::OP_OBSERVE);
+    record.put_varint(value);
+    emit(record);
+    return value;
+}
+
+int rppicomidi::Wifi_trace_recorder::open_ping(uint32_t addr)
+{
+    int result = inner.open_ping(addr);
+    Record record(Wifi_trace::OP_OPEN_PING);
+    record.put_varint(addr);
+    record.put_signed(result);
+    emit(record);
+    return result;
+}
+
+void rppicomidi::Wifi_trace_recorder::close_ping()
+{
+    inner.close_ping();
+    emit(Record(Wifi_trace::OP_CLOSE_PING));
+}
+
+int rppicomidi::Wifi_trace_recorder::send_ping(uint16_t seq)
+{
+    int result = inner.send_ping(seq);
+    Record record(Wifi_trace::OP_SEND_PING);
+    record.put_varint(seq);
+    record.put_signed(result);
+    emit(record);
+    return result;
+}
+
+uint16_t rppicomidi::Wifi_trace_recorder::get_ping_reply()
+{
+    uint16_t result = inner.get_ping_reply();
+    Record record(Wifi_trace::OP_PING_REPLY);
+    record.put_varint(result);
+    emit(record);
+    return result;
+}
+
+int rppicomidi::Wifi_trace_recorder::add_local_host(const char* name, uint32_t addr)
+{
+    int result = inner.add_local_host(name, addr);
+    Record record(Wifi_trace::OP_ADD_HOST);
+    record.put_varint(addr);
+    record.put_signed(result);
+    emit(record);
+    return result;
+}
+
+void rppicomidi::Wifi_trace_recorder::remove_local_host(const char* name)
+{
+    inner.remove_local_host(name);
+    emit(Record(Wifi_trace::OP_REMOVE_HOST));
+}
+
+int rppicomidi::Wifi_trace_recorder::start_dns_query(const char* name)
+{
+    int result = inner.start_dns_query(name);
+    Record record(Wifi_trace::OP_START_DNS);
+    record.put_signed(result);
+    emit(record);
+    return result;
+}
+
+int rppicomidi::Wifi_trace_recorder::poll_dns_query(uint32_t& addr)
+{
+    int result = inner.poll_dns_query(addr);
+    Record record(Wifi_trace::OP_POLL_DNS);
+    record.put_signed(result);
+    record.put_varint(addr);
+    emit(record);
+    return result;
+}
+
+void rppicomidi::Wifi_trace_recorder::cancel_dns_query()
+{
+    inner.cancel_dns_query();
+    emit(Record(Wifi_trace::OP_CANCEL_DNS));
+}
+
+rppicomidi::Wifi_trace_replay_driver::Wifi_trace_replay_driver(const uint8_t* trace_, size_t len_) :
+    trace{trace_}, len{len_}, offset{0}, diverged{false}, now{0}, records_played{0},
+    scan_cb{nullptr}, scan_env{nullptr}
+{
+    if (trace == nullptr || len < Wifi_trace::HEADER_LEN || memcmp(trace, trace_magic, sizeof(trace_magic)) != 0 ||
+            trace[4] != Wifi_trace::VERSION) {
+        diverged = true;
+    }
+    else {
+        offset = Wifi_trace::HEADER_LEN;
+    }
+}
+
+bool rppicomidi::Wifi_trace_replay_driver::read_byte(uint8_t& value)
+{
+    if (offset >= len) {
+        diverged = true;
+        return false;
+    }
+    value = trace[offset++];
+    return true;
+}
+
+bool rppicomidi::Wifi_trace_replay_driver::read_bytes(uint8_t* value, size_t nbytes)
+{
+    if (len - offset < nbytes) {
+        diverged = true;
+        return false;
+    }
+    memcpy(value, trace + offset, nbytes);
+    offset += nbytes;
+    return true;
+}
+
+bool rppicomidi::Wifi_trace_replay_driver::read_varint(uint32_t& value)
+{
+    value = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7) {
+        uint8_t byte;
+        if (!read_byte(byte)) {
+            return false;
+        }
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    diverged = true;
+    return false;
+}
+
+bool rppicomidi::Wifi_trace_replay_driver::read_signed(int32_t& value)
+{
+    uint32_t zigzag;
+    if (!read_varint(zigzag)) {
+        return false;
+    }
+    value = static_cast<int32_t>((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+    return true;
+}
+
+uint32_t rppicomidi::Wifi_trace_replay_driver::read_unsigned_result()
+{
+    uint32_t value;
+    return read_varint(value) ? value : 0;
+}
+
+int rppicomidi::Wifi_trace_replay_driver::read_result(int failure)
+{
+    int32_t value;
+    return read_signed(value) ? value : failure;
+}
+
+void rppicomidi::Wifi_trace_replay_driver::deliver_scan_results()
+{
+    while (!diverged && offset < len && trace[offset] == Wifi_trace::OP_SCAN_RESULT) {
+        ++offset;
+        Scan_result result;
+        memset(&result, 0, sizeof(result));
+        uint8_t ssid_len;
+        uint32_t channel;
+        int32_t rssi;
+        if (!read_bytes(result.bssid, sizeof(result.bssid)) || !read_byte(ssid_len) || ssid_len > sizeof(result.ssid) ||
+                !read_bytes(result.ssid, ssid_len) || !read_varint(channel) || !read_byte(result.auth_mode) ||
+                !read_signed(rssi)) {
+            diverged = true;
+            return;
+        }
+        result.ssid_len = ssid_len;
+        result.channel = static_cast<uint16_t>(channel);
+        result.rssi = static_cast<int16_t>(rssi);
+        ++records_played;
+        if (scan_cb != nullptr) {
+            scan_cb(scan_env, &result);
+        }
+    }
+}
+
+bool rppicomidi::Wifi_trace_replay_driver::expect(Wifi_trace::Op op)
+{
+    deliver_scan_results();
+    if (diverged || offset >= len) {
+        return false;
+    }
+    if (trace[offset] != op) {
+        diverged = true;
+        return false;
+    }
+    ++offset;
+    ++records_played;
+    return true;
+}
+
+uint32_t rppicomidi::Wifi_trace_replay_driver::now_ms()
+{
+    if (expect(Wifi_trace::OP_NOW)) {
+        now += read_unsigned_result();
+    }
+    return now;
+}
+
+int rppicomidi::Wifi_trace_replay_driver::init(uint32_t country_code)
+{
+    if (!expect(Wifi_trace::OP_INIT)) {
+        return -1;
+    }
+    uint32_t recorded_country = read_unsigned_result();
+    int result = read_result();
+    if (recorded_country != country_code) {
+        diverged = true;
+        return -1;
+    }
+    return result;
+}
+
+void rppicomidi::Wifi_trace_replay_driver::deinit()
+{
+    expect(Wifi_trace::OP_DEINIT);
+}
+
+void rppicomidi::Wifi_trace_replay_driver::enable_sta_mode()
+{
+    expect(Wifi_trace::OP_ENABLE_STA);
+}
+
+uint32_t rppicomidi::Wifi_trace_replay_driver::get_country_code()
+{
+    return expect(Wifi_trace::OP_GET_COUNTRY) ? read_unsigned_result() : 0;
+}
+
+int rppicomidi::Wifi_trace_replay_driver::link_status()
+{
+    return expect(Wifi_trace::OP_LINK_STATUS) ? read_result(LINK_FAIL) : LINK_FAIL;
+}
+
+int rppicomidi::Wifi_trace_replay_driver::scan(Scan_result_cb cb, void* env)
+{
+    if (!expect(Wifi_trace::OP_SCAN)) {
+        return -1;
+    }
+    int result = read_result();
+    if (result == 0) {
+        scan_cb = cb;
+        scan_env = env;
+    }
+    return result;
+}
+
+bool rppicomidi::Wifi_trace_replay_driver::is_scan_active()
+{
+    uint8_t active = 0;
+    if (expect(Wifi_trace::OP_SCAN_ACTIVE)) {
+        read_byte(active);
+    }
+    return active != 0;
+}
+
+int rppicomidi::Wifi_trace_replay_driver::connect(const char*, const char*, uint32_t, const uint8_t* bssid, uint32_t)
+{
+    if (!expect(Wifi_trace::OP_CONNECT)) {
+        return -1;
+    }
+    uint8_t has_bssid;
+    uint8_t recorded_bssid[6];
+    if (!read_byte(has_bssid) || (has_bssid != 0 && !read_bytes(recorded_bssid, sizeof(recorded_bssid)))) {
+        return -1;
+    }
+    int result = read_result();
+    if ((has_bssid != 0) != (bssid != nullptr) ||
+            (bssid != nullptr && memcmp(bssid, recorded_bssid, sizeof(recorded_bssid)) != 0)) {
+        diverged = true;
+        return -1;
+    }
+    return result;
+}
+
+int rppicomidi::Wifi_trace_replay_driver::leave()
+{
+    return expect(Wifi_trace::OP_LEAVE) ? read_result() : -1;
+}
+
+int rppicomidi::Wifi_trace_replay_driver::set_power_management(uint32_t pm)
+{
+    if (!expect(Wifi_trace::OP_SET_PM)) {
+        return -1;
+    }
+    uint32_t recorded_pm = read_unsigned_result();
+    int result = read_result();
+    if (recorded_pm != pm) {
+        diverged = true;
+        return -1;
+    }
+    return result;
+}
+
+int rppicomidi::Wifi_trace_replay_driver::get_rssi(int32_t& rssi)
+{
+    if (!expect(Wifi_trace::OP_GET_RSSI)) {
+        return -1;
+    }
+    int result = read_result();
+    if (!read_signed(rssi)) {
+        return -1;
+    }
+    return result;
+}
+
+uint32_t rppicomidi::Wifi_trace_replay_driver::get_ip_address()
+{
+    return expect(Wifi_trace::OP_GET_IP) ? read_unsigned_result() : 0;
+}
+
+uint32_t rppicomidi::Wifi_trace_replay_driver::get_gateway()
+{
+    return expect(Wifi_trace::OP_GET_GATEWAY) ? read_unsigned_result() : 0;
+}
+
+int rppicomidi::Wifi_trace_replay_driver::get_byte_count(uint32_t& bytes)
+{
+    bytes = 0;
+    if (!expect(Wifi_trace::OP_GET_BYTES)) {
+        return -1;
+    }
+    int result = read_result();
+    bytes = read_unsigned_result();
+    return result;
+}
+
+uint32_t rppicomidi::Wifi_trace_replay_driver::timestamp_us()
+{
+    return now * 1000;
+}
+
+uint32_t rppicomidi::Wifi_trace_replay_driver::observe(uint32_t value)
+{
+    return expect(Wifi_trace::OP_OBSERVE) ? read_unsigned_result() : value;
+}
+
+int rppicomidi::Wifi_trace_replay_driver::open_ping(uint32_t addr)
+{
+    if (!expect(Wifi_trace::OP_OPEN_PING)) {
+        return -1;
+    }
+    uint32_t recorded_addr = read_unsigned_result();
+    int result = read_result();
+    if (recorded_addr != addr) {
+        diverged = true;
+        return -1;
+    }
+    return result;
+}
+
+void rppicomidi::Wifi_trace_replay_driver::close_ping()
+{
+    expect(Wifi_trace::OP_CLOSE_PING);
+}
+
+int rppicomidi::Wifi_trace_replay_driver::send_ping(uint16_t seq)
+{
+    if (!expect(Wifi_trace::OP_SEND_PING)) {
+        return -1;
+    }
+    uint32_t recorded_seq = read_unsigned_result();
+    int result = read_result();
+    if (recorded_seq != seq) {
+        diverged = true;
+        return -1;
+    }
+    return result;
+}
+
+uint16_t rppicomidi::Wifi_trace_replay_driver::get_ping_reply()
+{
+    return expect(Wifi_trace::OP_PING_REPLY) ? static_cast<uint16_t>(read_unsigned_result()) : 0;
+}
+
+int rppicomidi::Wifi_trace_replay_driver::add_local_host(const char*, uint32_t addr)
+{
+    if (!expect(Wifi_trace::OP_ADD_HOST)) {
+        return -1;
+    }
+    uint32_t recorded_addr = read_unsigned_result();
+    int result = read_result();
+    if (recorded_addr != addr) {
+        diverged = true;
+        return -1;
+    }
+    return result;
+}
+
+void rppicomidi::Wifi_trace_replay_driver::remove_local_host(const char*)
+{
+    expect(Wifi_trace::OP_REMOVE_HOST);
+}
+
+int rppicomidi::Wifi_trace_replay_driver::start_dns_query(const char*)
+{
+    return expect(Wifi_trace::OP_START_DNS) ? read_result() : -1;
+}
+
+int rppicomidi::Wifi_trace_replay_driver::poll_dns_query(uint32_t& addr)
+{
+    addr = 0;
+    if (!expect(Wifi_trace::OP_POLL_DNS)) {
+        return -1;
+    }
+    int result = read_result();
+    addr = read_unsigned_result();
+    return result;
+}
+
+void rppicomidi::Wifi_trace_replay_driver::cancel_dns_query()
+{
+    expect(Wifi_trace::OP_CANCEL_DNS);
+}
@@ -0,0 +1,244 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2022 rppicomidi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "wifi_driver.h"
+
+namespace rppicomidi
+{
+/**
+ * @brief The binary format Wifi_trace_recorder writes and
+ * Wifi_trace_replay_driver reads
+ *
+ * A trace starts with the 4 characters "PWTR" and a version byte. Each
+ * record is an Op byte followed by the call's arguments and results.
+ * Unsigned integers are LEB128 varints and signed integers are zigzag
+ * encoded first, so most records are 2 or 3 bytes. Times are stored as
+ * the difference from the previous time. Passphrases and host names are
+ * never recorded, and neither are Wifi_driver::timestamp_us() values.
+ */
+namespace Wifi_trace
+{
+    enum Op : uint8_t {
+        OP_NOW = 1,         //!< varint ms since the previous OP_NOW
+        OP_INIT,            //!< varint country code, signed result
+        OP_DEINIT,
+        OP_ENABLE_STA,
+        OP_GET_COUNTRY,     //!< varint country code
+        OP_LINK_STATUS,     //!< signed result
+        OP_SCAN,            //!< signed result
+        OP_SCAN_RESULT,     //!< 6 byte BSSID, ssid_len, SSID, varint channel, auth_mode, signed RSSI
+        OP_SCAN_ACTIVE,     //!< 0 or 1
+        OP_CONNECT,         //!< 6 byte BSSID or 0 if none, signed result
+        OP_LEAVE,           //!< signed result
+        OP_SET_PM,          //!< varint pm, signed result
+        OP_GET_RSSI,        //!< signed result, signed RSSI
+        OP_GET_IP,          //!< varint address
+        OP_GET_GATEWAY,     //!< varint address
+        OP_GET_BYTES,       //!< signed result, varint byte count
+        OP_OBSERVE,         //!< varint value
+        OP_OPEN_PING,       //!< varint address, signed result
+        OP_CLOSE_PING,
+        OP_SEND_PING,       //!< varint sequence number, signed result
+        OP_PING_REPLY,      //!< varint sequence number
+        OP_ADD_HOST,        //!< varint address, signed result
+        OP_REMOVE_HOST,
+        OP_START_DNS,       //!< signed result
+        OP_POLL_DNS,        //!< signed result, varint address
+        OP_CANCEL_DNS,
+    };
+    static constexpr uint8_t VERSION = 5;
+    static constexpr size_t HEADER_LEN = 5;
+    static constexpr size_t MAX_RECORD_LEN = 64;
+}
+
+/**
+ * @brief Record every call the connection manager makes to a Wi-Fi driver
+ *
+ * Pass the recorder to the Pico_w_connection_manager constructor in place
+ * of the driver it wraps. Each record is handed to the sink as soon as it
+ * is complete, so the sink can copy it to RAM, flash or a serial port.
+ */
+class Wifi_trace_recorder : public Wifi_driver
+{
+public:
+    /**
+     * @brief Receives trace bytes
+     *
+     * May be called from the driver's scan callback context.
+     */
+    typedef void (*Sink)(void* context, const uint8_t* data, size_t len);
+
+    /**
+     * @brief Construct a new recorder
+     *
+     * @param inner_ the driver that does the work
+     * @param sink_ receives the trace
+     * @param context_ passed to sink_
+     */
+    Wifi_trace_recorder(Wifi_driver& inner_, Sink sink_, void* context_);
+
+    /**
+     * @brief Get the number of bytes handed to the sink so far
+     */
+    uint32_t get_bytes_written() const { return bytes_written; }
+
+    uint32_t now_ms() final;
+    int init(uint32_t country_code) final;
+    void deinit() final;
+    void enable_sta_mode() final;
+    uint32_t get_country_code() final;
+    int link_status() final;
+    int scan(Scan_result_cb cb, void* env) final;
+    bool is_scan_active() final;
+    int connect(const char* ssid, const char* pw, uint32_t auth, const uint8_t* bssid, uint32_t channel) final;
+    int leave() final;
+    int set_power_management(uint32_t pm) final;
+    int get_rssi(int32_t& rssi) final;
+    uint32_t get_ip_address() final;
+    uint32_t get_gateway() final;
+    int get_byte_count(uint32_t& bytes) final;
+    uint32_t timestamp_us() final;
+    uint32_t observe(uint32_t value) final;
+    int open_ping(uint32_t addr) final;
+    void close_ping() final;
+    int send_ping(uint16_t seq) final;
+    uint16_t get_ping_reply() final;
+    int add_local_host(const char* name, uint32_t addr) final;
+    void remove_local_host(const char* name) final;
+    int start_dns_query(const char* name) final;
+    int poll_dns_query(uint32_t& addr) final;
+    void cancel_dns_query() final;
+    void lock() final { inner.lock(); }
+    void unlock() final { inner.unlock(); }
+private:
+    class Record;
+    void emit(const Record& record);
+    static int static_scan_result(void* env, const Scan_result* result);
+    Wifi_driver& inner;
+    Sink sink;
+    void* context;
+    bool header_written;
+    uint32_t last_now;
+    uint32_t bytes_written;
+    Scan_result_cb scan_cb;
+    void* scan_env;
+};
+
+/**
+ * @brief Play back a trace made by Wifi_trace_recorder
+ *
+ * Pass the replay driver to the Pico_w_connection_manager constructor and
+ * call the same public functions the application called while recording.
+ * Each driver call returns what the recorded call returned, now_ms()
+ * returns the recorded times, and observe() returns the
+ * recorded values, so the manager makes the same decisions without
+ * waiting. timestamp_us() returns the most recent now_ms() time in
+ * microseconds. Recorded scan results are delivered to the scan
+ * callback at the point in the call sequence where they arrived.
+ *
+ * If the manager makes a call the trace does not have next, the replay
+ * has diverged: is_diverged() returns true and every call from then on
+ * returns a failure.
+ */
+class Wifi_trace_replay_driver : public Wifi_driver
+{
+public:
+    /**
+     * @brief Construct a new replay driver
+     *
+     * @param trace_ the trace; it must stay valid for the life of the driver
+     * @param len_ the number of bytes in trace_
+     */
+    Wifi_trace_replay_driver(const uint8_t* trace_, size_t len_);
+
+    /**
+     * @brief return true if every record has been played back
+     */
+    bool is_finished() const { return offset >= len; }
+
+    /**
+     * @brief return true if the trace is malformed or the manager made a
+     * call different from the recorded one
+     */
+    bool is_diverged() const { return diverged; }
+
+    /**
+     * @brief Get the offset of the next record, or of the record that
+     * diverged
+     */
+    size_t get_offset() const { return offset; }
+
+    /**
+     * @brief Get the number of records played back
+     */
+    uint32_t get_records_played() const { return records_played; }
+
+    uint32_t now_ms() final;
+    int init(uint32_t country_code) final;
+    void deinit() final;
+    void enable_sta_mode() final;
+    uint32_t get_country_code() final;
+    int link_status() final;
+    int scan(Scan_result_cb cb, void* env) final;
+    bool is_scan_active() final;
+    int connect(const char* ssid, const char* pw, uint32_t auth, const uint8_t* bssid, uint32_t channel) final;
+    int leave() final;
+    int set_power_management(uint32_t pm) final;
+    int get_rssi(int32_t& rssi) final;
+    uint32_t get_ip_address() final;
+    uint32_t get_gateway() final;
+    int get_byte_count(uint32_t& bytes) final;
+    uint32_t timestamp_us() final;
+    uint32_t observe(uint32_t value) final;
+    int open_ping(uint32_t addr) final;
+    void close_ping() final;
+    int send_ping(uint16_t seq) final;
+    uint16_t get_ping_reply() final;
+    int add_local_host(const char* name, uint32_t addr) final;
+    void remove_local_host(const char* name) final;
+    int start_dns_query(const char* name) final;
+    int poll_dns_query(uint32_t& addr) final;
+    void cancel_dns_query() final;
+private:
+    bool expect(Wifi_trace::Op op);
+    void deliver_scan_results();
+    bool read_byte(uint8_t& value);
+    bool read_bytes(uint8_t* value, size_t nbytes);
+    bool read_varint(uint32_t& value);
+    bool read_signed(int32_t& value);
+    uint32_t read_unsigned_result();
+    int read_result(int failure = -1);
+    const uint8_t* trace;
+    size_t len;
+    size_t offset;
+    bool diverged;
+    uint32_t now;
+    uint32_t records_played;
+    Scan_result_cb scan_cb;
+    void* scan_env;
+};
+}